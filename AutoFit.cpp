@@ -0,0 +1,393 @@
+/**
+ *
+ *  Name: AutoFit.cpp
+ *
+ *  Description:
+ *
+ *      Input sampling for txt2pdf's automatic layout (-a).
+ *
+ *      The input is mapped and only a few windows of it are read: the
+ *      first AUTOFIT_HEAD bytes and AUTOFIT_WINDOWS slices spread evenly
+ *      over the rest, so the cost is the same for a 100 KB listing and a
+ *      multi-GB spool file.  Small files are read whole.  Only complete
+ *      lines are examined; a window that starts or ends mid-line drops
+ *      the partial line.
+ *
+ *      Each line is scored twice, as ASA (column 1 through the caller's
+ *      carriage control table) and as plain text (form feeds), counting
+ *      the width and the number of lines between page ejects.  Page
+ *      lengths are only counted between two ejects in the same window.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "AutoFit.h"
+
+#define AUTOFIT_HEAD        (32 * 1024)
+#define AUTOFIT_WINDOWS     16
+#define AUTOFIT_WINDOW      (8 * 1024)
+#define AUTOFIT_WHOLE       (AUTOFIT_HEAD + AUTOFIT_WINDOWS * AUTOFIT_WINDOW)
+#define AUTOFIT_MIN_PAGE    10          /* shorter or longer "pages" are not counted */
+#define AUTOFIT_MAX_PAGE    512
+
+struct _AutoFitCount
+    {
+    long  lines;                        /* non-empty lines */
+    long  controls;                     /* ... with a known control in column 1 */
+    long  signals;                      /* ... with one other than single space */
+    long  ejects;                       /* ... starting a new page */
+    int   asa_width;
+    int   plain_width;
+    int   asa_rows;                     /* rows since the last eject, -1 before one */
+    int   plain_rows;
+    long  asa_pages[AUTOFIT_MAX_PAGE + 1];
+    long  plain_pages[AUTOFIT_MAX_PAGE + 1];
+    };
+
+typedef _AutoFitCount AutoFitCount;
+
+
+static int autofit_width(const unsigned char *text, const unsigned char *end, int tab_width)
+    {
+    int column = 0;
+
+    for (; text < end; text++)
+        {
+        if (*text == '\t')
+            {
+            column += tab_width - column % tab_width;
+            }
+        else if (*text == '\f' || *text == '\r')
+            {
+            continue;
+            }
+        else if ((*text & 0xC0) != 0x80)    //  UTF-8 continuation bytes take no column
+            {
+            column++;
+            }
+        }
+    return column;
+    }
+
+
+static void autofit_page(long *pages, int *rows, int start)
+    {
+    if (*rows >= AUTOFIT_MIN_PAGE && *rows <= AUTOFIT_MAX_PAGE)
+        {
+        pages[*rows]++;
+        }
+    *rows = start;
+    }
+
+
+static void autofit_line(AutoFitCount *count, const unsigned char *text, const unsigned char *end,
+                         const signed char *advance, int tab_width)
+    {
+    const unsigned char *form;
+    int                  step;
+    int                  width;
+
+    if (end > text && end[-1] == '\r')
+        {
+        end--;
+        }
+
+    /*
+    **  As plain text: a form feed anywhere starts a new page with what
+    **  follows it
+    */
+    form = (const unsigned char *)memchr(text, '\f', end - text);
+    if (form != NULL)
+        {
+        autofit_page(count->plain_pages, &count->plain_rows, 1);
+        }
+    else if (count->plain_rows >= 0)
+        {
+        count->plain_rows++;
+        }
+    width = autofit_width(text, end, tab_width);
+    if (width > count->plain_width)
+        {
+        count->plain_width = width;
+        }
+
+    /*
+    **  As ASA
+    */
+    if (text == end)
+        {
+        if (count->asa_rows >= 0)
+            {
+            count->asa_rows++;
+            }
+        return;
+        }
+    count->lines++;
+    step = advance[*text];
+    if (step == AUTOFIT_NOT_CONTROL)
+        {
+        return;
+        }
+    count->controls++;
+    if (step == AUTOFIT_EJECT)
+        {
+        count->signals++;
+        count->ejects++;
+        autofit_page(count->asa_pages, &count->asa_rows, 1);
+        }
+    else
+        {
+        if (step != 1)
+            {
+            count->signals++;
+            }
+        if (count->asa_rows >= 0)
+            {
+            count->asa_rows += step;
+            }
+        }
+    width = autofit_width(text + 1, end, tab_width);
+    if (width > count->asa_width)
+        {
+        count->asa_width = width;
+        }
+    }
+
+
+static void autofit_window(AutoFitCount *count, const unsigned char *base, long long size, long long offset,
+                           long long length, const signed char *advance, int tab_width, AutoFit *fit)
+    {
+    const unsigned char *text = base + offset;
+    const unsigned char *end = text + length;
+    const unsigned char *newline;
+
+    if (offset > 0)
+        {
+        newline = (const unsigned char *)memchr(text, '\n', end - text);
+        if (newline == NULL)
+            {
+            return;
+            }
+        text = newline + 1;
+        }
+    if (offset + length < size)
+        {
+        while (end > text && end[-1] != '\n')
+            {
+            end--;
+            }
+        }
+
+    count->asa_rows = (offset == 0) ? 0 : -1;      //  the file starts a page
+    count->plain_rows = count->asa_rows;
+    fit->bytes += end - text;
+    while (text < end)
+        {
+        newline = (const unsigned char *)memchr(text, '\n', end - text);
+        if (newline == NULL)
+            {
+            newline = end;
+            }
+        autofit_line(count, text, newline, advance, tab_width);
+        fit->lines++;
+        text = newline + 1;
+        }
+    }
+
+
+/*
+**  Start reading every window at once, so a cold file costs about one
+**  disk seek rather than one per window (the mapping is MADV_RANDOM, so
+**  nothing else is read ahead)
+*/
+static void autofit_prefetch(const unsigned char *base, long long offset, long long length)
+    {
+#ifndef _WIN32
+    long long page = (long long)sysconf(_SC_PAGESIZE);
+    long long first = offset - offset % page;
+
+    madvise((void *)(base + first), (size_t)(offset + length - first), MADV_WILLNEED);
+#endif
+    }
+
+
+/*
+**  The usual page length: the longest one no more than a quarter over
+**  the most frequent, so short last pages and the odd runaway page do
+**  not decide it.  A length seen only once is not a pattern unless it
+**  is the only page.
+*/
+static int autofit_page_lines(const long *pages)
+    {
+    long seen = 0;
+    int  mode = 0;
+    int  best = 0;
+    int  i;
+
+    for (i = AUTOFIT_MIN_PAGE; i <= AUTOFIT_MAX_PAGE; i++)
+        {
+        seen += pages[i];
+        if (pages[i] > pages[mode])
+            {
+            mode = i;
+            }
+        }
+    if (mode == 0 || (pages[mode] < 2 && seen > 1))
+        {
+        return 0;
+        }
+    for (i = mode; i <= mode + mode / 4 && i <= AUTOFIT_MAX_PAGE; i++)
+        {
+        if (pages[i] > 0)
+            {
+            best = i;
+            }
+        }
+    return best;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Sample an input file and describe its layout.
+**
+**  Parameters:     Name        Description.
+**                  path        Input file (must be seekable and mappable).
+**                  advance     Lines advanced per column 1 character,
+**                              AUTOFIT_EJECT for a new page or
+**                              AUTOFIT_NOT_CONTROL.
+**                  tab_width   Tab interval for measuring widths.
+**                  fit         Result.
+**
+**  Returns:        FALSE if the file could not be sampled (empty, not a
+**                  regular file, gzip or zstd).
+**
+**------------------------------------------------------------------------*/
+
+bool autofit_sample(const char *path, const signed char *advance, int tab_width, AutoFit *fit)
+    {
+    AutoFitCount         count;
+    auto                 start = std::chrono::steady_clock::now();
+    const unsigned char *base;
+    long long            size;
+    long long            stride;
+    int                  i;
+
+    memset(fit, 0, sizeof(*fit));
+    memset(&count, 0, sizeof(count));
+    if (tab_width < 1)
+        {
+        tab_width = 8;
+        }
+
+#ifdef _WIN32
+    HANDLE        file;
+    HANDLE        mapping;
+    LARGE_INTEGER length;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        {
+        return FALSE;
+        }
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &length) || length.QuadPart == 0)
+        {
+        CloseHandle(file);
+        return FALSE;
+        }
+    size = length.QuadPart;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    base = (mapping == NULL) ? NULL : (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == NULL)
+        {
+        if (mapping != NULL)
+            {
+            CloseHandle(mapping);
+            }
+        CloseHandle(file);
+        return FALSE;
+        }
+#else
+    struct stat st;
+    int         file;
+    void       *view;
+
+    file = open(path, O_RDONLY);
+    if (file < 0)
+        {
+        return FALSE;
+        }
+    if (fstat(file, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        {
+        close(file);
+        return FALSE;
+        }
+    size = (long long)st.st_size;
+    view = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED)
+        {
+        close(file);
+        return FALSE;
+        }
+    madvise(view, (size_t)size, MADV_RANDOM);
+    base = (const unsigned char *)view;
+#endif
+
+    if ((size < 2 || base[0] != 0x1F || base[1] != 0x8B) &&
+        (size < 4 || base[0] != 0x28 || base[1] != 0xB5 || base[2] != 0x2F || base[3] != 0xFD))
+        {
+        if (size <= AUTOFIT_WHOLE)
+            {
+            autofit_window(&count, base, size, 0, size, advance, tab_width, fit);
+            }
+        else
+            {
+            stride = (size - AUTOFIT_HEAD - AUTOFIT_WINDOW) / (AUTOFIT_WINDOWS - 1);
+            autofit_prefetch(base, 0, AUTOFIT_HEAD);
+            for (i = 0; i < AUTOFIT_WINDOWS; i++)
+                {
+                autofit_prefetch(base, AUTOFIT_HEAD + i * stride, AUTOFIT_WINDOW);
+                }
+            autofit_window(&count, base, size, 0, AUTOFIT_HEAD, advance, tab_width, fit);
+            for (i = 0; i < AUTOFIT_WINDOWS; i++)
+                {
+                autofit_window(&count, base, size, AUTOFIT_HEAD + i * stride, AUTOFIT_WINDOW, advance, tab_width, fit);
+                }
+            }
+        }
+
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(view, (size_t)size);
+    close(file);
+#endif
+
+    if (fit->lines == 0)
+        {
+        return FALSE;
+        }
+
+    /*
+    **  ASA if nearly every line starts with a control and something other
+    **  than single spacing turns up; text that is merely indented by one
+    **  blank stays plain so nothing is dropped, and so do numbered lines
+    **  (more than one "eject" in eight lines is not a listing)
+    */
+    fit->is_asa = count.lines > 0 && count.controls * 50 >= count.lines * 49 && count.signals > 0 &&
+                  count.ejects * 8 <= count.lines;
+    fit->columns = fit->is_asa ? count.asa_width : count.plain_width;
+    fit->page_lines = autofit_page_lines(fit->is_asa ? count.asa_pages : count.plain_pages);
+    fit->elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return TRUE;
+    }
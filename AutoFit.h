@@ -0,0 +1,34 @@
+/**
+ *
+ *  Name: AutoFit.h
+ *
+ *  Description:
+ *
+ *      Input sampling for txt2pdf's automatic layout (-a): a few windows
+ *      of the input are read to tell ASA from plain text and to measure
+ *      the widest line and the usual page length, so the page size,
+ *      lines per page and font can be chosen before rendering.
+ *
+ */
+
+#ifndef AUTOFIT_H
+#define AUTOFIT_H
+
+#define AUTOFIT_NOT_CONTROL (-1)        /* advance[] entries */
+#define AUTOFIT_EJECT       (-2)
+
+struct _AutoFit
+    {
+    bool      is_asa;                   /* column 1 holds carriage control */
+    int       columns;                  /* widest line (after the control) */
+    int       page_lines;               /* lines per page seen, 0 if none */
+    long      lines;                    /* lines examined */
+    long long bytes;                    /* bytes examined */
+    double    elapsed_ms;
+    };
+
+typedef _AutoFit AutoFit;
+
+bool autofit_sample(const char *path, const signed char *advance, int tab_width, AutoFit *fit);
+
+#endif //AUTOFIT_H
@@ -0,0 +1,314 @@
+/**
+ *
+ *  Name: CarriageControl.cpp
+ *
+ *  Description:
+ *
+ *      Carriage-control table and forms control buffer for txt2pdf.
+ *
+ *      The built-in table is ASA plus the txt2pdf extensions:
+ *
+ *          ' '  single space           '+'  overstrike (-o colour)
+ *          '0'  double space           'R' 'G' 'B'  overstrike in colour
+ *          '-'  triple space           'r' 'g' 'b'  single space in colour
+ *          '1'  skip to channel 1      '^'  overstrike, extended ASCII
+ *          '2'-'9' 'A' 'C'  channels 2-9, 10, 12
+ *          'H'  half line              '>'  single space
+ *          FF   new page
+ *
+ *      'B' stays the blue overstrike; a control file can map it to
+ *      channel 11 instead.  The built-in FCB has only channel 1, at
+ *      line 1.
+ *
+ *      A control file has one definition per line ('#' starts a
+ *      comment):
+ *
+ *          <byte> space <n> [color <RRGGBB>|color overstrike] [extended]
+ *          <byte> channel <n>
+ *          <byte> half
+ *          <byte> formfeed
+ *          <byte> unknown
+ *          fcb <channel> <line>[,<line>...]
+ *
+ *      where <byte> is a single character or xHH (x23 for '#', which
+ *      otherwise starts a comment).  Definitions replace
+ *      the built-in ones for their byte; the first fcb line for a
+ *      channel replaces its built-in stops.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <vector>
+#include "CarriageControl.h"
+
+CarriageControl cc_table[256];
+
+static std::vector<int> cc_stops[CC_CHANNELS + 1];
+
+
+static void cc_set(int byte, int action, int count, long color, bool is_extended)
+    {
+    cc_table[byte].action = action;
+    cc_table[byte].count = count;
+    cc_table[byte].color = color;
+    cc_table[byte].is_extended = is_extended;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load the built-in table and FCB.
+**
+**------------------------------------------------------------------------*/
+
+void cc_defaults()
+    {
+    int i;
+
+    for (i = 0; i < 256; i++)
+        {
+        cc_set(i, CC_UNKNOWN, 1, CC_COLOR_NONE, FALSE);
+        }
+
+    cc_set(' ', CC_SPACE, 1, CC_COLOR_NONE, FALSE);
+    cc_set('0', CC_SPACE, 2, CC_COLOR_NONE, FALSE);
+    cc_set('-', CC_SPACE, 3, CC_COLOR_NONE, FALSE);
+    cc_set('+', CC_SPACE, 0, CC_COLOR_OVERSTRIKE, FALSE);
+    cc_set('R', CC_SPACE, 0, 0xFF0000L, FALSE);
+    cc_set('G', CC_SPACE, 0, 0x00FF00L, FALSE);
+    cc_set('B', CC_SPACE, 0, 0x0000FFL, FALSE);
+    cc_set('r', CC_SPACE, 1, 0xFF0000L, FALSE);
+    cc_set('g', CC_SPACE, 1, 0x00FF00L, FALSE);
+    cc_set('b', CC_SPACE, 1, 0x0000FFL, FALSE);
+    cc_set('^', CC_SPACE, 0, CC_COLOR_NONE, TRUE);
+    cc_set('>', CC_SPACE, 1, CC_COLOR_NONE, FALSE);
+    cc_set('H', CC_HALF_LINE, 1, CC_COLOR_NONE, FALSE);
+    cc_set('\f', CC_FORM_FEED, 1, CC_COLOR_NONE, FALSE);
+
+    for (i = 1; i <= 9; i++)
+        {
+        cc_set('0' + i, CC_CHANNEL, i, CC_COLOR_NONE, FALSE);
+        }
+    cc_set('A', CC_CHANNEL, 10, CC_COLOR_NONE, FALSE);
+    cc_set('C', CC_CHANNEL, 12, CC_COLOR_NONE, FALSE);
+
+    for (i = 0; i <= CC_CHANNELS; i++)
+        {
+        cc_stops[i].clear();
+        }
+    cc_stops[1].push_back(1);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a control file over the built-in table.
+**
+**  Parameters:     Name        Description.
+**                  path        Control file.
+**                  form_length Lines per page (channel stops beyond it
+**                              are rejected).
+**
+**  Returns:        FALSE (after a message) if the file is unreadable or
+**                  has an invalid line.
+**
+**------------------------------------------------------------------------*/
+
+bool cc_load(const char *path, int form_length)
+    {
+    FILE *file = fopen(path, "r");
+    bool  is_replaced[CC_CHANNELS + 1] = { FALSE };
+    char  line[256];
+    char *word[6];
+    char *p;
+    int   words;
+    int   number = 0;
+    int   byte;
+    int   channel;
+    int   stop;
+    int   i;
+
+    if (file == NULL)
+        {
+        fprintf(stderr, "(error) Unable to open carriage control file %s.\n", path);
+        return FALSE;
+        }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+        {
+        number++;
+        for (p = strchr(line, '#'); p != NULL; p = strchr(p + 1, '#'))
+            {
+            if (p == line || isspace((unsigned char)p[-1]))
+                {
+                *p = '\0';
+                break;
+                }
+            }
+        words = 0;
+        for (p = strtok(line, " \t\r\n"); p != NULL && words < 6; p = strtok(NULL, " \t\r\n"))
+            {
+            word[words++] = p;
+            }
+        if (words == 0)
+            {
+            continue;
+            }
+
+        if (strcmp(word[0], "fcb") == 0)
+            {
+            channel = (words == 3) ? atoi(word[1]) : 0;
+            if (channel < 1 || channel > CC_CHANNELS)
+                {
+                break;
+                }
+            if (!is_replaced[channel])
+                {
+                cc_stops[channel].clear();
+                is_replaced[channel] = TRUE;
+                }
+            for (p = strtok(word[2], ","); p != NULL; p = strtok(NULL, ","))
+                {
+                stop = atoi(p);
+                if (stop < 1 || stop > form_length)
+                    {
+                    fprintf(stderr, "(error) %s line %d: channel %d stop %d is outside the %d-line form.\n",
+                            path, number, channel, stop, form_length);
+                    fclose(file);
+                    return FALSE;
+                    }
+                cc_stops[channel].push_back(stop);
+                }
+            std::sort(cc_stops[channel].begin(), cc_stops[channel].end());
+            continue;
+            }
+
+        if (strlen(word[0]) == 1)
+            {
+            byte = (unsigned char)word[0][0];
+            }
+        else if ((word[0][0] == 'x' || word[0][0] == 'X') && strlen(word[0]) == 3 && isxdigit((unsigned char)word[0][1]) && isxdigit((unsigned char)word[0][2]))
+            {
+            byte = (int)strtol(word[0] + 1, NULL, 16);
+            }
+        else
+            {
+            break;
+            }
+        if (words < 2)
+            {
+            break;
+            }
+
+        if (strcmp(word[1], "space") == 0 && words >= 3 && atoi(word[2]) >= 0)
+            {
+            cc_set(byte, CC_SPACE, atoi(word[2]), CC_COLOR_NONE, FALSE);
+            for (i = 3; i < words; i++)
+                {
+                if (strcmp(word[i], "extended") == 0)
+                    {
+                    cc_table[byte].is_extended = TRUE;
+                    }
+                else if (strcmp(word[i], "color") == 0 && i + 1 < words)
+                    {
+                    i++;
+                    cc_table[byte].color = (strcmp(word[i], "overstrike") == 0) ? CC_COLOR_OVERSTRIKE : strtol(word[i], NULL, 16);
+                    }
+                else
+                    {
+                    break;
+                    }
+                }
+            if (i < words)
+                {
+                break;
+                }
+            }
+        else if (strcmp(word[1], "channel") == 0 && words == 3 && atoi(word[2]) >= 1 && atoi(word[2]) <= CC_CHANNELS)
+            {
+            cc_set(byte, CC_CHANNEL, atoi(word[2]), CC_COLOR_NONE, FALSE);
+            }
+        else if (strcmp(word[1], "half") == 0 && words == 2)
+            {
+            cc_set(byte, CC_HALF_LINE, 1, CC_COLOR_NONE, FALSE);
+            }
+        else if (strcmp(word[1], "formfeed") == 0 && words == 2)
+            {
+            cc_set(byte, CC_FORM_FEED, 1, CC_COLOR_NONE, FALSE);
+            }
+        else if (strcmp(word[1], "unknown") == 0 && words == 2)
+            {
+            cc_set(byte, CC_UNKNOWN, 1, CC_COLOR_NONE, FALSE);
+            }
+        else
+            {
+            break;
+            }
+        }
+
+    if (!feof(file))
+        {
+        fprintf(stderr, "(error) %s line %d: invalid carriage control definition.\n", path, number);
+        fclose(file);
+        return FALSE;
+        }
+    fclose(file);
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Find where a skip to channel lands.
+**
+**  Parameters:     Name        Description.
+**                  channel     1 .. CC_CHANNELS.
+**                  line        Last line printed on the page (0 at the
+**                              top).
+**
+**  Returns:        The first stop below line; minus the first stop
+**                  if there is none below it (it is on the next page);
+**                  0 if the channel has no stops.
+**
+**------------------------------------------------------------------------*/
+
+int cc_next_stop(int channel, int line)
+    {
+    std::vector<int> &stops = cc_stops[channel];
+    auto next = std::upper_bound(stops.begin(), stops.end(), line);
+
+    if (stops.empty())
+        {
+        return 0;
+        }
+    return (next != stops.end()) ? *next : -stops.front();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Add the table and FCB to a settings digest.
+**
+**------------------------------------------------------------------------*/
+
+void cc_digest(Digest *digest)
+    {
+    int i;
+
+    for (i = 0; i < 256; i++)
+        {
+        digest_update(digest, &cc_table[i].action, sizeof(cc_table[i].action));
+        digest_update(digest, &cc_table[i].count, sizeof(cc_table[i].count));
+        digest_update(digest, &cc_table[i].color, sizeof(cc_table[i].color));
+        digest_update(digest, &cc_table[i].is_extended, sizeof(cc_table[i].is_extended));
+        }
+    for (i = 1; i <= CC_CHANNELS; i++)
+        {
+        digest_update(digest, &i, sizeof(i));
+        if (!cc_stops[i].empty())
+            {
+            digest_update(digest, cc_stops[i].data(), cc_stops[i].size() * sizeof(int));
+            }
+        }
+    }
@@ -0,0 +1,49 @@
+/**
+ *
+ *  Name: CarriageControl.h
+ *
+ *  Description:
+ *
+ *      Carriage-control table and forms control buffer (FCB) for
+ *      txt2pdf's ASA processor.  Every control byte maps to one entry
+ *      of a 256-entry table; a control file (-J) can redefine entries
+ *      and channel stops for other spool dialects.
+ *
+ */
+
+#ifndef CARRIAGECONTROL_H
+#define CARRIAGECONTROL_H
+
+#include "Digest.h"
+
+#define CC_CHANNELS         12
+#define CC_COLOR_NONE       (-1L)
+#define CC_COLOR_OVERSTRIKE (-2L)          /* the -o colour */
+
+enum
+    {
+    CC_SPACE,                   /* advance `count` lines (0 overstrikes) */
+    CC_CHANNEL,                 /* skip to channel `count` */
+    CC_HALF_LINE,               /* advance half a line */
+    CC_FORM_FEED,               /* end the page, print on a new one */
+    CC_UNKNOWN                  /* warn, then space one line */
+    };
+
+struct _CarriageControl
+    {
+    int   action;
+    int   count;
+    long  color;                /* RRGGBB, or CC_COLOR_NONE/OVERSTRIKE */
+    bool  is_extended;          /* shift the text up by 127 ('^') */
+    };
+
+typedef _CarriageControl CarriageControl;
+
+extern CarriageControl cc_table[256];
+
+void cc_defaults();
+bool cc_load(const char *path, int form_length);
+int  cc_next_stop(int channel, int line);
+void cc_digest(Digest *digest);
+
+#endif //CARRIAGECONTROL_H
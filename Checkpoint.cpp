@@ -0,0 +1,266 @@
+/**
+ *
+ *  Name: Checkpoint.cpp
+ *
+ *  Description:
+ *
+ *      Restart journal for long txt2pdf conversions.
+ *
+ *      The journal is append-only, so each checkpoint costs only the
+ *      pages and objects added since the one before.  Every record ends
+ *      with a digest of itself; a record torn by a kill fails the check
+ *      and the journal is cut back to the last complete one.
+ *
+ *      Layout (native byte order):
+ *
+ *          "TXT2CKP1", digest of the command line
+ *          records: CheckpointRecord, page ids (new_pages ints),
+ *                   xrefs [first_object, object_id) as 64-bit values,
+ *                   digest of the record
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <io.h>
+#include "Checkpoint.h"
+
+#define CHECKPOINT_MAGIC    "TXT2CKP1"
+
+struct CheckpointRecord
+    {
+    long long input_offset;
+    long long output_length;
+    int       object_id;
+    int       first_object;     /* xrefs below this are in earlier records */
+    int       line_count;
+    int       page_count;
+    int       new_pages;
+    double    color[3];
+    };
+
+static FILE *checkpoint_file = NULL;
+static char  checkpoint_path[1024];
+static int   checkpoint_objects = 1;        /* xrefs journaled so far */
+
+
+static bool checkpoint_write(Digest *digest, const void *data, size_t length)
+    {
+    digest_update(digest, data, length);
+    return (fwrite(data, 1, length, checkpoint_file) == length);
+    }
+
+
+static bool checkpoint_read(FILE *file, Digest *digest, void *data, size_t length)
+    {
+    if (fread(data, 1, length, file) != length)
+        {
+        return FALSE;
+        }
+    digest_update(digest, data, length);
+    return TRUE;
+    }
+
+
+static void *checkpoint_grow(void *block, size_t size)
+    {
+    void *grown = realloc(block, size);
+
+    if (grown == NULL)
+        {
+        fprintf(stderr, "(error) Unable to allocate memory for the checkpoint.\n");
+        exit(1);
+        }
+    return grown;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Replay the records of an existing journal.
+**
+**  Returns:        Length of the journal up to its last good record.
+**
+**------------------------------------------------------------------------*/
+
+static long checkpoint_replay(FILE *file, Checkpoint *resume)
+    {
+    CheckpointRecord record;
+    Digest           digest;
+    Digest           stored;
+    long             good = ftell(file);
+    bool             ok;
+
+    for (;;)
+        {
+        digest_init(&digest);
+        if (!checkpoint_read(file, &digest, &record, sizeof(record)) ||
+            record.first_object != checkpoint_objects || record.object_id < record.first_object ||
+            record.new_pages < 0)
+            {
+            break;
+            }
+
+        resume->page_ids = (int *)checkpoint_grow(resume->page_ids, (resume->page_total + record.new_pages + 1) * sizeof(int));
+        resume->xrefs = (long long *)checkpoint_grow(resume->xrefs, (record.object_id + 1) * sizeof(long long));
+        ok = checkpoint_read(file, &digest, resume->page_ids + resume->page_total, record.new_pages * sizeof(int));
+        ok = ok && checkpoint_read(file, &digest, resume->xrefs + record.first_object,
+                                   (record.object_id - record.first_object) * sizeof(long long));
+        digest_final(&digest);
+        if (!ok || fread(&stored, sizeof(stored), 1, file) != 1 || !digest_equal(&stored, &digest))
+            {
+            break;
+            }
+
+        resume->input_offset = record.input_offset;
+        resume->output_length = record.output_length;
+        resume->object_id = record.object_id;
+        resume->line_count = record.line_count;
+        resume->page_count = record.page_count;
+        resume->page_total += record.new_pages;
+        memcpy(resume->color, record.color, sizeof(resume->color));
+        checkpoint_objects = record.object_id;
+        good = ftell(file);
+        }
+
+    return good;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open (or create) the journal for a conversion.
+**
+**  Parameters:     Name        Description.
+**                  path        Journal file.
+**                  options     Digest of the output settings and input file.
+**                  resume      Receives the saved state on CHECKPOINT_RESUME
+**                              (the caller frees page_ids and xrefs).
+**
+**  Returns:        CHECKPOINT_NEW, _RESUME, _MISMATCH or _ERROR.
+**
+**------------------------------------------------------------------------*/
+
+int checkpoint_open(const char *path, const Digest *options, Checkpoint *resume)
+    {
+    char   magic[8];
+    Digest saved;
+    long   good;
+
+    strncpy(checkpoint_path, path, sizeof(checkpoint_path) - 1);
+    checkpoint_objects = 1;
+    memset(resume, 0, sizeof(*resume));
+
+    checkpoint_file = fopen(path, "r+b");
+    if (checkpoint_file != NULL)
+        {
+        if (fread(magic, 1, sizeof(magic), checkpoint_file) == sizeof(magic) &&
+            memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0 &&
+            fread(&saved, sizeof(saved), 1, checkpoint_file) == 1)
+            {
+            if (!digest_equal(&saved, options))
+                {
+                fclose(checkpoint_file);
+                checkpoint_file = NULL;
+                return CHECKPOINT_MISMATCH;
+                }
+
+            good = checkpoint_replay(checkpoint_file, resume);
+            if (resume->page_total > 0)
+                {
+                /*
+                **  Drop a torn record and carry on appending after it
+                */
+                fflush(checkpoint_file);
+                _chsize(_fileno(checkpoint_file), good);
+                fseek(checkpoint_file, good, SEEK_SET);
+                return CHECKPOINT_RESUME;
+                }
+            }
+        fclose(checkpoint_file);
+        free(resume->page_ids);
+        free(resume->xrefs);
+        memset(resume, 0, sizeof(*resume));
+        checkpoint_objects = 1;
+        }
+
+    checkpoint_file = fopen(path, "wb");
+    if (checkpoint_file == NULL)
+        {
+        return CHECKPOINT_ERROR;
+        }
+    fwrite(CHECKPOINT_MAGIC, 1, 8, checkpoint_file);
+    fwrite(options, sizeof(*options), 1, checkpoint_file);
+    fflush(checkpoint_file);
+    return CHECKPOINT_NEW;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Append a checkpoint.  The PDF must already hold
+**                  output_length bytes.
+**
+**  Parameters:     Name        Description.
+**                  state       Current state; page_ids holds the pages
+**                              finished since the previous checkpoint,
+**                              xrefs the whole table.
+**
+**  Returns:        FALSE if the journal could not be written.
+**
+**------------------------------------------------------------------------*/
+
+bool checkpoint_append(const Checkpoint *state)
+    {
+    CheckpointRecord record;
+    Digest           digest;
+    bool             ok;
+
+    if (checkpoint_file == NULL)
+        {
+        return FALSE;
+        }
+
+    memset(&record, 0, sizeof(record));
+    record.input_offset = state->input_offset;
+    record.output_length = state->output_length;
+    record.object_id = state->object_id;
+    record.first_object = checkpoint_objects;
+    record.line_count = state->line_count;
+    record.page_count = state->page_count;
+    record.new_pages = state->page_total;
+    memcpy(record.color, state->color, sizeof(record.color));
+
+    digest_init(&digest);
+    ok = checkpoint_write(&digest, &record, sizeof(record));
+    ok = ok && checkpoint_write(&digest, state->page_ids, state->page_total * sizeof(int));
+    ok = ok && checkpoint_write(&digest, state->xrefs + checkpoint_objects,
+                                (state->object_id - checkpoint_objects) * sizeof(long long));
+    digest_final(&digest);
+    ok = ok && fwrite(&digest, sizeof(digest), 1, checkpoint_file) == 1;
+    ok = (fflush(checkpoint_file) == 0) && ok;
+
+    if (ok)
+        {
+        checkpoint_objects = state->object_id;
+        }
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close the journal; a finished conversion removes it.
+**
+**------------------------------------------------------------------------*/
+
+void checkpoint_close(bool is_complete)
+    {
+    if (checkpoint_file != NULL)
+        {
+        fclose(checkpoint_file);
+        checkpoint_file = NULL;
+        }
+    if (is_complete)
+        {
+        remove(checkpoint_path);
+        }
+    }
@@ -0,0 +1,44 @@
+/**
+ *
+ *  Name: Checkpoint.h
+ *
+ *  Description:
+ *
+ *      Restart journal for long txt2pdf conversions.  At page boundaries
+ *      the input offset, output length and the document state needed to
+ *      continue (object numbering, page list, cross-reference offsets)
+ *      are appended; a later run with the same output settings on the
+ *      same input file resumes from the last complete record.
+ *
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Digest.h"
+
+#define CHECKPOINT_NEW      0       /* no usable journal: start from the top */
+#define CHECKPOINT_RESUME   1       /* state loaded from the journal */
+#define CHECKPOINT_MISMATCH 2       /* journal was made with other options */
+#define CHECKPOINT_ERROR    3       /* journal cannot be created */
+
+struct _Checkpoint
+    {
+    long long input_offset;     /* input_line_offset() of the next line */
+    long long output_length;    /* bytes of PDF already written */
+    int       object_id;        /* next free object number */
+    int       line_count;
+    int       page_count;
+    double    color[3];         /* current text colour */
+    int       page_total;       /* entries in page_ids */
+    int      *page_ids;         /* append: pages since the last record */
+    long long *xrefs;           /* object_id entries */
+    };
+
+typedef _Checkpoint Checkpoint;
+
+int  checkpoint_open(const char *path, const Digest *options, Checkpoint *resume);
+bool checkpoint_append(const Checkpoint *state);
+void checkpoint_close(bool is_complete);
+
+#endif //CHECKPOINT_H
@@ -0,0 +1,508 @@
+/**
+ *
+ *  Name: CidFont.cpp
+ *
+ *  Description:
+ *
+ *      The UTF-8 fallback font of txt2pdf (/F3, -3).
+ *
+ *      Characters with no WinAnsi code are shown in /F3 as 2-byte codes
+ *      equal to their Unicode code point (Identity-H, so CID = code
+ *      point).  The font is written as
+ *
+ *          0   Type0 font, /ToUnicode 3
+ *          1   CIDFontType2, /FontDescriptor 2 [, /CIDToGIDMap 4]
+ *          2   FontDescriptor [, /FontFile2 5]
+ *          3   ToUnicode CMap: every code is its own code point
+ *          4   CIDToGIDMap (embedded only)
+ *          5   the TrueType file (embedded only)
+ *
+ *      When -3 names a TrueType file it is embedded whole and the
+ *      CIDToGIDMap is built from its Unicode cmap, so each code point
+ *      shows its own glyph.  Otherwise -3 is a font name the viewer must
+ *      supply; a CIDToGIDMap only applies to embedded fonts, so viewers
+ *      choose the glyphs through the ToUnicode CMap, and the descriptor
+ *      carries Arial-like metrics for a substitute.
+ *
+ *      Only TrueType outlines ('glyf') can be a FontFile2; CFF based
+ *      OpenType and font collections are refused.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "PdfWriter.h"
+#include "CidFont.h"
+
+#define CIDFONT_CODES       0x10000
+#define CIDFONT_NAME_MAX    64
+
+static char   cidfont_name[CIDFONT_NAME_MAX];
+static std::vector<unsigned char> cidfont_file;         /* TrueType file; empty when not embedded */
+static std::vector<unsigned char> cidfont_gids;         /* CIDToGIDMap, 2 bytes big-endian per CID */
+static std::string cidfont_to_unicode;
+static int    cidfont_bbox[4] = { -665, -325, 2000, 1040 };    /* glyph space, 1/1000 em */
+static int    cidfont_ascent = 905;
+static int    cidfont_descent = -212;
+static int    cidfont_cap_height = 716;
+
+
+static unsigned tt_u16(const unsigned char *p)
+    {
+    return ((unsigned)p[0] << 8) | p[1];
+    }
+
+
+static int tt_s16(const unsigned char *p)
+    {
+    return (int)(short)tt_u16(p);
+    }
+
+
+static unsigned long tt_u32(const unsigned char *p)
+    {
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+    }
+
+
+/*
+**  Table `tag` of the loaded file and its length, NULL if absent or
+**  outside the file
+*/
+static const unsigned char *tt_table(const char *tag, size_t *length)
+    {
+    const unsigned char *file = cidfont_file.data();
+    size_t   size = cidfont_file.size();
+    unsigned count = tt_u16(file + 4);
+    unsigned i;
+    unsigned long offset;
+
+    for (i = 0; i < count && 12 + 16 * (size_t)(i + 1) <= size; i++)
+        {
+        const unsigned char *record = file + 12 + 16 * i;
+
+        if (memcmp(record, tag, 4) == 0)
+            {
+            offset = tt_u32(record + 8);
+            *length = tt_u32(record + 12);
+            if (offset > size || *length > size - offset)
+                {
+                return NULL;
+                }
+            return file + offset;
+            }
+        }
+    return NULL;
+    }
+
+
+static void tt_map(std::vector<unsigned short> &gids, unsigned long code, unsigned long gid)
+    {
+    if (code < CIDFONT_CODES && gids[code] == 0)
+        {
+        gids[code] = (unsigned short)gid;
+        }
+    }
+
+
+/*
+**  Unicode cmap subtables: format 4 (BMP) and 12 (segmented coverage,
+**  of which only the BMP is used)
+*/
+static bool tt_read_subtable(const unsigned char *table, size_t length, std::vector<unsigned short> &gids)
+    {
+    const unsigned char *end = table + length;
+    unsigned long code;
+    unsigned long last;
+    unsigned long i;
+
+    if (length >= 14 && tt_u16(table) == 4)
+        {
+        unsigned seg_x2 = tt_u16(table + 6);
+        const unsigned char *ends = table + 14;
+        const unsigned char *starts = ends + seg_x2 + 2;
+        const unsigned char *deltas = starts + seg_x2;
+        const unsigned char *ranges = deltas + seg_x2;
+
+        if (ranges + seg_x2 > end)
+            {
+            return FALSE;
+            }
+        for (i = 0; i < seg_x2 / 2; i++)
+            {
+            unsigned start = tt_u16(starts + 2 * i);
+            unsigned delta = tt_u16(deltas + 2 * i);
+            unsigned range = tt_u16(ranges + 2 * i);
+
+            last = tt_u16(ends + 2 * i);
+            for (code = start; code <= last && code < 0xFFFF; code++)
+                {
+                const unsigned char *glyph = ranges + 2 * i + range + 2 * (code - start);
+                unsigned gid;
+
+                if (range == 0)
+                    {
+                    gid = (code + delta) & 0xFFFF;
+                    }
+                else
+                    {
+                    gid = (glyph + 2 <= end) ? tt_u16(glyph) : 0;
+                    gid = (gid != 0) ? (gid + delta) & 0xFFFF : 0;
+                    }
+                tt_map(gids, code, gid);
+                }
+            }
+        return TRUE;
+        }
+
+    if (length >= 16 && tt_u16(table) == 12)
+        {
+        unsigned long groups = tt_u32(table + 12);
+
+        if (groups > (length - 16) / 12)
+            {
+            return FALSE;
+            }
+        for (i = 0; i < groups; i++)
+            {
+            const unsigned char *group = table + 16 + 12 * i;
+            unsigned long start = tt_u32(group);
+
+            last = tt_u32(group + 4);
+            for (code = start; code <= last && code < CIDFONT_CODES; code++)
+                {
+                tt_map(gids, code, tt_u32(group + 8) + (code - start));
+                }
+            }
+        return TRUE;
+        }
+    return FALSE;
+    }
+
+
+static bool tt_read_cmap()
+    {
+    std::vector<unsigned short> gids(CIDFONT_CODES, 0);
+    const unsigned char *cmap;
+    size_t   length;
+    unsigned count;
+    unsigned i;
+    unsigned long offset;
+    long     highest;
+    int      pass;
+    bool     is_read = FALSE;
+
+    cmap = tt_table("cmap", &length);
+    if (cmap == NULL || length < 4)
+        {
+        return FALSE;
+        }
+    count = tt_u16(cmap + 2);
+
+    /*
+    **  Windows full-repertoire and BMP subtables first, then Unicode
+    **  platform ones; earlier mappings are kept
+    */
+    for (pass = 0; pass < 3; pass++)
+        {
+        for (i = 0; i < count && 4 + 8 * (size_t)(i + 1) <= length; i++)
+            {
+            const unsigned char *record = cmap + 4 + 8 * i;
+            unsigned platform = tt_u16(record);
+            unsigned encoding = tt_u16(record + 2);
+
+            if ((pass == 0 && platform == 3 && encoding == 10) ||
+                (pass == 1 && platform == 3 && encoding == 1) ||
+                (pass == 2 && platform == 0))
+                {
+                offset = tt_u32(record + 4);
+                if (offset < length && tt_read_subtable(cmap + offset, length - offset, gids))
+                    {
+                    is_read = TRUE;
+                    }
+                }
+            }
+        }
+    if (!is_read)
+        {
+        return FALSE;
+        }
+
+    for (highest = CIDFONT_CODES - 1; highest > 0 && gids[highest] == 0; highest--)
+        {
+        }
+    cidfont_gids.resize(2 * (size_t)(highest + 1));
+    for (i = 0; i <= (unsigned)highest; i++)
+        {
+        cidfont_gids[2 * i] = (unsigned char)(gids[i] >> 8);
+        cidfont_gids[2 * i + 1] = (unsigned char)gids[i];
+        }
+    return TRUE;
+    }
+
+
+static void tt_read_metrics()
+    {
+    const unsigned char *table;
+    size_t length;
+    int    units = 1000;
+    int    i;
+
+    table = tt_table("head", &length);
+    if (table != NULL && length >= 54 && tt_u16(table + 18) != 0)
+        {
+        units = (int)tt_u16(table + 18);
+        for (i = 0; i < 4; i++)
+            {
+            cidfont_bbox[i] = tt_s16(table + 36 + 2 * i) * 1000 / units;
+            }
+        }
+    table = tt_table("hhea", &length);
+    if (table != NULL && length >= 8)
+        {
+        cidfont_ascent = tt_s16(table + 4) * 1000 / units;
+        cidfont_descent = tt_s16(table + 6) * 1000 / units;
+        }
+    cidfont_cap_height = cidfont_ascent * 7 / 10;
+    table = tt_table("OS/2", &length);
+    if (table != NULL && length >= 90 && tt_u16(table) >= 2)
+        {
+        cidfont_cap_height = tt_s16(table + 88) * 1000 / units;
+        }
+    }
+
+
+/*
+**  PostScript name (name ID 6), ASCII, from a Windows or Macintosh record
+*/
+static bool tt_read_name()
+    {
+    const unsigned char *table;
+    size_t   length;
+    unsigned count;
+    unsigned strings;
+    unsigned i;
+    unsigned j;
+    size_t   out;
+
+    table = tt_table("name", &length);
+    if (table == NULL || length < 6)
+        {
+        return FALSE;
+        }
+    count = tt_u16(table + 2);
+    strings = tt_u16(table + 4);
+    for (i = 0; i < count && 6 + 12 * (size_t)(i + 1) <= length; i++)
+        {
+        const unsigned char *record = table + 6 + 12 * i;
+        unsigned platform = tt_u16(record);
+        unsigned size = tt_u16(record + 8);
+        unsigned step = (platform == 3 || platform == 0) ? 2 : 1;
+        const unsigned char *text = table + strings + tt_u16(record + 10);
+
+        if (tt_u16(record + 6) != 6 || text + size > table + length)
+            {
+            continue;
+            }
+        out = 0;
+        for (j = step - 1; j < size && out < sizeof(cidfont_name) - 1; j += step)
+            {
+            if (text[j] > ' ' && text[j] < 0x7F && strchr("()<>[]{}/%#", text[j]) == NULL)
+                {
+                cidfont_name[out++] = (char)text[j];
+                }
+            }
+        cidfont_name[out] = '\0';
+        if (out > 0)
+            {
+            return TRUE;
+            }
+        }
+    return FALSE;
+    }
+
+
+static void cidfont_build_to_unicode()
+    {
+    char line[32];
+    int  high;
+    int  ranges = 0;
+    int  block;
+
+    cidfont_to_unicode = "/CIDInit /ProcSet findresource begin\n12 dict begin\nbegincmap\n"
+                         "/CIDSystemInfo<</Registry(Adobe)/Ordering(UCS)/Supplement 0>>def\n"
+                         "/CMapName/Adobe-Identity-UCS def\n/CMapType 2 def\n"
+                         "1 begincodespacerange\n<0000><FFFF>\nendcodespacerange\n";
+
+    /*
+    **  One range per high byte (a range may only vary the last byte),
+    **  skipping the surrogates, at most 100 to a block
+    */
+    for (high = 0; high < 0x100; high++)
+        {
+        if (high >= 0xD8 && high <= 0xDF)
+            {
+            continue;
+            }
+        if (ranges % 100 == 0)
+            {
+            block = (ranges == 200) ? 48 : 100;
+            snprintf(line, sizeof(line), "%s%d beginbfrange\n", (ranges > 0) ? "endbfrange\n" : "", block);
+            cidfont_to_unicode += line;
+            }
+        snprintf(line, sizeof(line), "<%02X00><%02XFF><%02X00>\n", high, high, high);
+        cidfont_to_unicode += line;
+        ranges++;
+        }
+    cidfont_to_unicode += "endbfrange\nendcmap\nCMapName currentdict /CMap defineresource pop\nend\nend\n";
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set up the fallback font.
+**
+**  Parameters:     Name        Description.
+**                  name        -3: a TrueType file to embed, or the
+**                              name of a font the viewer supplies.
+**
+**  Returns:        FALSE (after a message) for a file that is not a
+**                  usable TrueType font.
+**
+**------------------------------------------------------------------------*/
+
+bool cidfont_load(const char *name)
+    {
+    FILE  *file;
+    long   size;
+    const char *base;
+    char  *dot;
+
+    cidfont_build_to_unicode();
+    cidfont_file.clear();
+    cidfont_gids.clear();
+
+    file = fopen(name, "rb");
+    if (file == NULL)
+        {
+        strncpy(cidfont_name, name, sizeof(cidfont_name) - 1);
+        cidfont_name[sizeof(cidfont_name) - 1] = '\0';
+        return TRUE;
+        }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 12)
+        {
+        cidfont_file.resize((size_t)size);
+        if (fread(cidfont_file.data(), 1, (size_t)size, file) != (size_t)size)
+            {
+            cidfont_file.clear();
+            }
+        }
+    fclose(file);
+
+    if (cidfont_file.size() < 12 || (tt_u32(cidfont_file.data()) != 0x00010000ul && memcmp(cidfont_file.data(), "true", 4) != 0))
+        {
+        fprintf(stderr, "(error) -3 %s: not a TrueType font (CFF OpenType and collections cannot be embedded)\n", name);
+        cidfont_file.clear();
+        return FALSE;
+        }
+    if (!tt_read_cmap())
+        {
+        fprintf(stderr, "(error) -3 %s: no Unicode cmap\n", name);
+        cidfont_file.clear();
+        return FALSE;
+        }
+    tt_read_metrics();
+    if (!tt_read_name())
+        {
+        base = strrchr(name, '/');
+        base = (base == NULL) ? strrchr(name, '\\') : base;
+        strncpy(cidfont_name, (base == NULL) ? name : base + 1, sizeof(cidfont_name) - 1);
+        cidfont_name[sizeof(cidfont_name) - 1] = '\0';
+        dot = strrchr(cidfont_name, '.');
+        if (dot != NULL)
+            {
+            *dot = '\0';
+            }
+        }
+    return TRUE;
+    }
+
+
+int cidfont_object_count()
+    {
+    return cidfont_file.empty() ? 4 : 6;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the body of font object `index` (after the
+**                  caller's "N 0 obj"), the objects being numbered from
+**                  first_id, and "endobj".
+**
+**------------------------------------------------------------------------*/
+
+void cidfont_write_object(int index, int first_id)
+    {
+    bool is_embedded = !cidfont_file.empty();
+
+    switch (index)
+        {
+        case 0:
+            writer_printf("<</Type/Font/Subtype/Type0/BaseFont/%s/Encoding/Identity-H/DescendantFonts[%d 0 R]/ToUnicode %d 0 R>>",
+                          cidfont_name, first_id + 1, first_id + 3);
+            break;
+
+        case 1:
+            writer_printf("<</Type/Font/Subtype/CIDFontType2/BaseFont/%s", cidfont_name);
+            writer_printf("/CIDSystemInfo<</Registry(Adobe)/Ordering(Identity)/Supplement 0>>/FontDescriptor %d 0 R/DW 600", first_id + 2);
+            if (is_embedded)
+                {
+                writer_printf("/CIDToGIDMap %d 0 R", first_id + 4);
+                }
+            writer_printf(">>");
+            break;
+
+        case 2:
+            writer_printf("<</Type/FontDescriptor/FontName/%s/Flags 32/FontBBox[%d %d %d %d]/ItalicAngle 0",
+                          cidfont_name, cidfont_bbox[0], cidfont_bbox[1], cidfont_bbox[2], cidfont_bbox[3]);
+            writer_printf("/Ascent %d/Descent %d/CapHeight %d/StemV 80", cidfont_ascent, cidfont_descent, cidfont_cap_height);
+            if (is_embedded)
+                {
+                writer_printf("/FontFile2 %d 0 R", first_id + 5);
+                }
+            writer_printf(">>");
+            break;
+
+        case 3:
+            writer_printf("<</Length %d>>stream\n", (int)cidfont_to_unicode.size());
+            writer_write(cidfont_to_unicode.data(), cidfont_to_unicode.size());
+            writer_printf("endstream");
+            break;
+
+        case 4:
+            writer_printf("<</Length %d>>stream\n", (int)cidfont_gids.size());
+            writer_write(cidfont_gids.data(), cidfont_gids.size());
+            writer_printf("\nendstream");
+            break;
+
+        case 5:
+            writer_printf("<</Length %d/Length1 %d>>stream\n", (int)cidfont_file.size(), (int)cidfont_file.size());
+            writer_write(cidfont_file.data(), cidfont_file.size());
+            writer_printf("\nendstream");
+            break;
+        }
+    writer_printf("\nendobj\n");
+    }
+
+
+void cidfont_digest(Digest *digest)
+    {
+    digest_update(digest, cidfont_name, strlen(cidfont_name) + 1);
+    digest_update(digest, cidfont_file.data(), cidfont_file.size());
+    }
@@ -0,0 +1,24 @@
+/**
+ *
+ *  Name: CidFont.h
+ *
+ *  Description:
+ *
+ *      The UTF-8 fallback font of txt2pdf (/F3, -3): a Type0 font whose
+ *      2-byte codes are Unicode code points, with its descriptor, a
+ *      ToUnicode CMap and, when -3 names a TrueType file, the embedded
+ *      font and the CIDToGIDMap built from its cmap.
+ *
+ */
+
+#ifndef CIDFONT_H
+#define CIDFONT_H
+
+#include "Digest.h"
+
+bool cidfont_load(const char *name);
+int  cidfont_object_count();
+void cidfont_write_object(int index, int first_id);
+void cidfont_digest(Digest *digest);
+
+#endif //CIDFONT_H
@@ -0,0 +1,267 @@
+/**
+ *
+ *  Name: CodePage.cpp
+ *
+ *  Description:
+ *
+ *      Single-byte code pages for txt2pdf.
+ *
+ *      Each code page lists, for bytes 0x80 - 0xFF, either the glyph
+ *      name the byte shows (from the standard Latin set every base-14
+ *      font carries) or "=c", the ASCII character printed in its place.
+ *      The first kind stays as it is in the content stream and the
+ *      fonts' /Differences name the glyph; only the second kind is
+ *      translated, by codec_translate().  Bytes below 0x80 are ASCII in
+ *      every supported code page and are never changed.
+ *
+ *      Built-in: cp437 (PC, box drawing), cp850 (PC Latin-1) and latin1
+ *      (ISO-8859-1, whose 0x80 - 0x9F controls print as blanks).  Any
+ *      other name is read as a file of "HH glyphname" or "HH =c" lines
+ *      over WinAnsi ('#' starts a comment).
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "CodePage.h"
+
+#define CODEPAGE_NAME_MAX   32
+
+/**
+ *  WinAnsiEncoding glyphs for 0x80 - 0xFF; NULL marks undefined codes.
+ */
+
+static const char *CWinAnsiGlyphs[128] =
+    {
+    "Euro",           NULL,             "quotesinglbase", "florin",         "quotedblbase",   "ellipsis",       "dagger",         "daggerdbl",
+    "circumflex",     "perthousand",    "Scaron",         "guilsinglleft",  "OE",             NULL,             "Zcaron",         NULL,
+    NULL,             "quoteleft",      "quoteright",     "quotedblleft",   "quotedblright",  "bullet",         "endash",         "emdash",
+    "tilde",          "trademark",      "scaron",         "guilsinglright", "oe",             NULL,             "zcaron",         "Ydieresis",
+    "space",          "exclamdown",     "cent",           "sterling",       "currency",       "yen",            "brokenbar",      "section",
+    "dieresis",       "copyright",      "ordfeminine",    "guillemotleft",  "logicalnot",     "hyphen",         "registered",     "macron",
+    "degree",         "plusminus",      "twosuperior",    "threesuperior",  "acute",          "mu",             "paragraph",      "periodcentered",
+    "cedilla",        "onesuperior",    "ordmasculine",   "guillemotright", "onequarter",     "onehalf",        "threequarters",  "questiondown",
+    "Agrave",         "Aacute",         "Acircumflex",    "Atilde",         "Adieresis",      "Aring",          "AE",             "Ccedilla",
+    "Egrave",         "Eacute",         "Ecircumflex",    "Edieresis",      "Igrave",         "Iacute",         "Icircumflex",    "Idieresis",
+    "Eth",            "Ntilde",         "Ograve",         "Oacute",         "Ocircumflex",    "Otilde",         "Odieresis",      "multiply",
+    "Oslash",         "Ugrave",         "Uacute",         "Ucircumflex",    "Udieresis",      "Yacute",         "Thorn",          "germandbls",
+    "agrave",         "aacute",         "acircumflex",    "atilde",         "adieresis",      "aring",          "ae",             "ccedilla",
+    "egrave",         "eacute",         "ecircumflex",    "edieresis",      "igrave",         "iacute",         "icircumflex",    "idieresis",
+    "eth",            "ntilde",         "ograve",         "oacute",         "ocircumflex",    "otilde",         "odieresis",      "divide",
+    "oslash",         "ugrave",         "uacute",         "ucircumflex",    "udieresis",      "yacute",         "thorn",          "ydieresis",
+    };
+
+static const char *CCodePage437[128] =
+    {
+    "Ccedilla",       "udieresis",      "eacute",         "acircumflex",    "adieresis",      "agrave",         "aring",          "ccedilla",
+    "ecircumflex",    "edieresis",      "egrave",         "idieresis",      "icircumflex",    "igrave",         "Adieresis",      "Aring",
+    "Eacute",         "ae",             "AE",             "ocircumflex",    "odieresis",      "ograve",         "ucircumflex",    "ugrave",
+    "ydieresis",      "Odieresis",      "Udieresis",      "cent",           "sterling",       "yen",            "=P",             "florin",
+    "aacute",         "iacute",         "oacute",         "uacute",         "ntilde",         "Ntilde",         "ordfeminine",    "ordmasculine",
+    "questiondown",   "=-",             "logicalnot",     "onehalf",        "onequarter",     "exclamdown",     "guillemotleft",  "guillemotright",
+    "=#",             "=#",             "=#",             "=|",             "=+",             "=+",             "=+",             "=+",
+    "=+",             "=+",             "=|",             "=+",             "=+",             "=+",             "=+",             "=+",
+    "=+",             "=-",             "=-",             "=+",             "=-",             "=-",             "=+",             "=+",
+    "=+",             "=+",             "==",             "==",             "=+",             "==",             "==",             "=+",
+    "=+",             "=+",             "=+",             "=+",             "=+",             "=+",             "=+",             "=+",
+    "=+",             "=+",             "=+",             "=#",             "=#",             "=#",             "=#",             "=#",
+    "=a",             "germandbls",     "=G",             "=n",             "=E",             "=o",             "mu",             "=t",
+    "=O",             "=O",             "=O",             "=d",             "=o",             "=o",             "=e",             "=n",
+    "==",             "plusminus",      "greaterequal",   "lessequal",      "=|",             "=|",             "divide",         "=~",
+    "degree",         "periodcentered", "periodcentered", "radical",        "=n",             "twosuperior",    "=#",             "space",
+    };
+
+static const char *CCodePage850[128] =
+    {
+    "Ccedilla",       "udieresis",      "eacute",         "acircumflex",    "adieresis",      "agrave",         "aring",          "ccedilla",
+    "ecircumflex",    "edieresis",      "egrave",         "idieresis",      "icircumflex",    "igrave",         "Adieresis",      "Aring",
+    "Eacute",         "ae",             "AE",             "ocircumflex",    "odieresis",      "ograve",         "ucircumflex",    "ugrave",
+    "ydieresis",      "Odieresis",      "Udieresis",      "oslash",         "sterling",       "Oslash",         "multiply",       "florin",
+    "aacute",         "iacute",         "oacute",         "uacute",         "ntilde",         "Ntilde",         "ordfeminine",    "ordmasculine",
+    "questiondown",   "registered",     "logicalnot",     "onehalf",        "onequarter",     "exclamdown",     "guillemotleft",  "guillemotright",
+    "=#",             "=#",             "=#",             "=|",             "=+",             "Aacute",         "Acircumflex",    "Agrave",
+    "copyright",      "=+",             "=|",             "=+",             "=+",             "cent",           "yen",            "=+",
+    "=+",             "=-",             "=-",             "=+",             "=-",             "=-",             "atilde",         "Atilde",
+    "=+",             "=+",             "==",             "==",             "=+",             "==",             "==",             "currency",
+    "eth",            "Eth",            "Ecircumflex",    "Edieresis",      "Egrave",         "dotlessi",       "Iacute",         "Icircumflex",
+    "Idieresis",      "=+",             "=+",             "=#",             "=#",             "brokenbar",      "Igrave",         "=#",
+    "Oacute",         "germandbls",     "Ocircumflex",    "Ograve",         "otilde",         "Otilde",         "mu",             "thorn",
+    "Thorn",          "Uacute",         "Ucircumflex",    "Ugrave",         "yacute",         "Yacute",         "macron",         "acute",
+    "hyphen",         "plusminus",      "=_",             "threequarters",  "paragraph",      "section",        "divide",         "cedilla",
+    "degree",         "dieresis",       "periodcentered", "onesuperior",    "threesuperior",  "twosuperior",    "=#",             "space",
+    };
+
+static const char *CCodePageLatin1[128] =
+    {
+    "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",
+    "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",
+    "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",
+    "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",             "= ",
+    "space",          "exclamdown",     "cent",           "sterling",       "currency",       "yen",            "brokenbar",      "section",
+    "dieresis",       "copyright",      "ordfeminine",    "guillemotleft",  "logicalnot",     "hyphen",         "registered",     "macron",
+    "degree",         "plusminus",      "twosuperior",    "threesuperior",  "acute",          "mu",             "paragraph",      "periodcentered",
+    "cedilla",        "onesuperior",    "ordmasculine",   "guillemotright", "onequarter",     "onehalf",        "threequarters",  "questiondown",
+    "Agrave",         "Aacute",         "Acircumflex",    "Atilde",         "Adieresis",      "Aring",          "AE",             "Ccedilla",
+    "Egrave",         "Eacute",         "Ecircumflex",    "Edieresis",      "Igrave",         "Iacute",         "Icircumflex",    "Idieresis",
+    "Eth",            "Ntilde",         "Ograve",         "Oacute",         "Ocircumflex",    "Otilde",         "Odieresis",      "multiply",
+    "Oslash",         "Ugrave",         "Uacute",         "Ucircumflex",    "Udieresis",      "Yacute",         "Thorn",          "germandbls",
+    "agrave",         "aacute",         "acircumflex",    "atilde",         "adieresis",      "aring",          "ae",             "ccedilla",
+    "egrave",         "eacute",         "ecircumflex",    "edieresis",      "igrave",         "iacute",         "icircumflex",    "idieresis",
+    "eth",            "ntilde",         "ograve",         "oacute",         "ocircumflex",    "otilde",         "odieresis",      "divide",
+    "oslash",         "ugrave",         "uacute",         "ucircumflex",    "udieresis",      "yacute",         "thorn",          "ydieresis",
+    };
+
+struct CodePageName
+    {
+    const char  *name;
+    const char **glyphs;
+    };
+
+static const CodePageName CCodePages[] =
+    {
+        { "cp437",  CCodePage437 },
+        { "cp850",  CCodePage850 },
+        { "latin1", CCodePageLatin1 },
+    };
+
+static unsigned char codepage_translate[256];
+static char          codepage_glyphs[128][CODEPAGE_NAME_MAX];
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set one code of the selected page from a table entry.
+**
+**  Returns:        FALSE if the entry is malformed.
+**
+**------------------------------------------------------------------------*/
+
+static bool codepage_set(int code, const char *entry)
+    {
+    if (entry[0] == '=' && entry[1] != '\0' && entry[2] == '\0' && (unsigned char)entry[1] < 0x80)
+        {
+        codepage_translate[code] = (unsigned char)entry[1];
+        codepage_glyphs[code - 0x80][0] = '\0';
+        return TRUE;
+        }
+    if (!isalpha((unsigned char)entry[0]) || strlen(entry) >= CODEPAGE_NAME_MAX)
+        {
+        return FALSE;
+        }
+    codepage_translate[code] = (unsigned char)code;
+    if (CWinAnsiGlyphs[code - 0x80] != NULL && strcmp(CWinAnsiGlyphs[code - 0x80], entry) == 0)
+        {
+        codepage_glyphs[code - 0x80][0] = '\0';        //  WinAnsi already shows it
+        }
+    else
+        {
+        strcpy(codepage_glyphs[code - 0x80], entry);
+        }
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Select a built-in code page or read one from a file.
+**
+**  Parameters:     Name        Description.
+**                  name        cp437, cp850, latin1 or a file name.
+**
+**  Returns:        FALSE (after a message) if the file is unreadable or
+**                  has an invalid line.
+**
+**------------------------------------------------------------------------*/
+
+bool codepage_select(const char *name)
+    {
+    FILE *file;
+    char  line[256];
+    char  glyph[64];
+    int   number = 0;
+    int   code;
+    int   i;
+
+    for (i = 0; i < 256; i++)
+        {
+        codepage_translate[i] = (unsigned char)i;
+        }
+    memset(codepage_glyphs, 0, sizeof(codepage_glyphs));
+
+    for (i = 0; i < (int)(sizeof(CCodePages) / sizeof(CCodePages[0])); i++)
+        {
+        if (_stricmp(name, CCodePages[i].name) == 0)
+            {
+            for (code = 0x80; code < 0x100; code++)
+                {
+                codepage_set(code, CCodePages[i].glyphs[code - 0x80]);
+                }
+            return TRUE;
+            }
+        }
+
+    file = fopen(name, "r");
+    if (file == NULL)
+        {
+        fprintf(stderr, "(error) %s is neither cp437, cp850, latin1 nor a readable code page file.\n", name);
+        return FALSE;
+        }
+    while (fgets(line, sizeof(line), file) != NULL)
+        {
+        number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line))
+            {
+            continue;
+            }
+        if (sscanf(line, "%x %63s", &code, glyph) != 2 || code < 0x80 || code > 0xFF || !codepage_set(code, glyph))
+            {
+            fprintf(stderr, "(error) %s line %d: expected \"HH glyphname\" or \"HH =c\" for a byte 80 - FF.\n", name, number);
+            fclose(file);
+            return FALSE;
+            }
+        }
+    fclose(file);
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Translation table for codec_translate().
+**
+**------------------------------------------------------------------------*/
+
+const unsigned char *codepage_table()
+    {
+    return codepage_translate;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Glyph for a code in the /Differences array.
+**
+**  Returns:        The glyph name, or NULL where WinAnsi applies.
+**
+**------------------------------------------------------------------------*/
+
+const char *codepage_glyph(int code)
+    {
+    if (code < 0x80 || code > 0xFF || codepage_glyphs[code - 0x80][0] == '\0')
+        {
+        return NULL;
+        }
+    return codepage_glyphs[code - 0x80];
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Add the selected page to a settings digest.
+**
+**------------------------------------------------------------------------*/
+
+void codepage_digest(Digest *digest)
+    {
+    digest_update(digest, codepage_translate, sizeof(codepage_translate));
+    digest_update(digest, codepage_glyphs, sizeof(codepage_glyphs));
+    }
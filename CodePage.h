@@ -0,0 +1,24 @@
+/**
+ *
+ *  Name: CodePage.h
+ *
+ *  Description:
+ *
+ *      Single-byte code pages for txt2pdf (-m).  Bytes 0x80 - 0xFF keep
+ *      their value and are given the code page's glyphs through a
+ *      /Differences encoding; bytes with no glyph in the standard
+ *      fonts (box drawing, Greek) are translated to ASCII stand-ins.
+ *
+ */
+
+#ifndef CODEPAGE_H
+#define CODEPAGE_H
+
+#include "Digest.h"
+
+bool        codepage_select(const char *name);
+const unsigned char *codepage_table();
+const char *codepage_glyph(int code);
+void        codepage_digest(Digest *digest);
+
+#endif //CODEPAGE_H
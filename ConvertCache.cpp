@@ -0,0 +1,415 @@
+/**
+ *
+ *  Name: ConvertCache.cpp
+ *
+ *  Description:
+ *
+ *      Content-addressed cache of finished PDFs for txt2pdf (-c).
+ *
+ *      An entry is DIR/<key>.pdf, where the key is the SHA-256 of the
+ *      input bytes and every setting that changes the output, so another
+ *      user of the directory cannot make their input share someone
+ *      else's entry (the digest used elsewhere is not collision
+ *      resistant).  A conversion is written to DIR/<key>.<pid>.tmp and
+ *      renamed into place only when complete, so readers never see a
+ *      partial entry and two processes converting the same input simply
+ *      race to an identical result.  A hit refreshes the entry's
+ *      modification time; when the directory grows past its limit the
+ *      least recently used entries are removed.  An entry another
+ *      process still has open on Windows cannot be removed and is
+ *      skipped until the next pass.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <io.h>
+#include <fcntl.h>
+#include <process.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+#include "ConvertCache.h"
+
+#ifdef _WIN32
+#define CACHE_SEPARATOR     "\\"
+#define cache_utime         _utime
+#else
+#define CACHE_SEPARATOR     "/"
+#define cache_utime         utime
+#endif
+
+#define CACHE_PATH_MAX      1024
+#define CACHE_BLOCK         (1024 * 1024)
+#define CACHE_STALE_SECONDS 3600            /* .tmp left by a process that died */
+
+struct CacheFile
+    {
+    char      name[96];
+    long long size;
+    long long mtime;
+    };
+
+static char      cache_directory[CACHE_PATH_MAX];
+static long long cache_limit = 0;
+static char      cache_entry[CACHE_PATH_MAX];
+static char      cache_temp[CACHE_PATH_MAX];
+static FILE     *cache_temp_file = NULL;
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Set the cache directory and its size limit in bytes.
+**
+**------------------------------------------------------------------------*/
+
+void cache_configure(const char *directory, long long limit)
+    {
+    strncpy(cache_directory, directory, sizeof(cache_directory) - 1);
+    cache_limit = limit;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Path of the entry for a key.
+**
+**  Returns:        FALSE if it does not fit in CACHE_PATH_MAX.
+**
+**------------------------------------------------------------------------*/
+
+static bool cache_name(const unsigned char *key, char *path, const char *suffix)
+    {
+    char text[2 * SHA256_BYTES + 1];
+    int  i;
+
+    for (i = 0; i < SHA256_BYTES; i++)
+        {
+        sprintf(text + 2 * i, "%02x", key[i]);
+        }
+    return snprintf(path, CACHE_PATH_MAX, "%s" CACHE_SEPARATOR "%s%s", cache_directory, text, suffix) < CACHE_PATH_MAX;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy a whole stream to another.
+**
+**------------------------------------------------------------------------*/
+
+static bool cache_copy(FILE *from, FILE *to)
+    {
+    char  *block = (char *)malloc(CACHE_BLOCK);
+    size_t length;
+    bool   ok = (block != NULL);
+
+    while (ok && (length = fread(block, 1, CACHE_BLOCK, from)) > 0)
+        {
+        ok = (fwrite(block, 1, length, to) == length);
+        }
+    ok = ok && !ferror(from) && fflush(to) == 0;
+    free(block);
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Digest the raw input bytes (compressed input is
+**                  hashed as it is stored).
+**
+**  Parameters:     Name        Description.
+**                  path        Input file, NULL for stdin.
+**                  digest      Digest to update.
+**                  spool       Receives the file stdin was copied to
+**                              (the caller converts and removes it).
+**                  size        Size of spool.
+**
+**  Returns:        FALSE if the input cannot be read.
+**
+**------------------------------------------------------------------------*/
+
+bool cache_hash_input(const char *path, Digest *digest, char *spool, size_t size)
+    {
+    char  *block = (char *)malloc(CACHE_BLOCK);
+    FILE  *in = stdin;
+    FILE  *copy = NULL;
+    size_t length;
+    bool   ok = (block != NULL);
+
+    spool[0] = '\0';
+    if (path != NULL)
+        {
+        in = fopen(path, "rb");
+        }
+    else
+        {
+        /*
+        **  stdin can only be read once: keep a copy to convert from
+        */
+        _setmode(_fileno(stdin), _O_BINARY);
+        snprintf(spool, size, "%s" CACHE_SEPARATOR "%d.in.tmp", cache_directory, (int)_getpid());
+        copy = fopen(spool, "wb");
+        ok = ok && (copy != NULL);
+        }
+    ok = ok && (in != NULL);
+
+    while (ok && (length = fread(block, 1, CACHE_BLOCK, in)) > 0)
+        {
+        digest_update(digest, block, length);
+        ok = (copy == NULL || fwrite(block, 1, length, copy) == length);
+        }
+    ok = ok && !ferror(in);
+
+    if (copy != NULL && fclose(copy) != 0)
+        {
+        ok = FALSE;
+        }
+    if (in != NULL && in != stdin)
+        {
+        fclose(in);
+        }
+    if (!ok)
+        {
+        fprintf(stderr, "(error) Unable to read the input for the cache key.\n");
+        if (spool[0] != '\0')
+            {
+            remove(spool);
+            }
+        }
+    free(block);
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Look up an entry and copy it to the output.
+**
+**  Returns:        TRUE on a hit.
+**
+**------------------------------------------------------------------------*/
+
+bool cache_fetch(const unsigned char *key, FILE *out)
+    {
+    FILE *entry;
+    bool  ok;
+
+    if (!cache_name(key, cache_entry, ".pdf"))
+        {
+        return FALSE;
+        }
+    entry = fopen(cache_entry, "rb");
+    if (entry == NULL)
+        {
+        return FALSE;
+        }
+
+    _setmode(_fileno(out), _O_BINARY);
+    ok = cache_copy(entry, out);
+    fclose(entry);
+    if (!ok)
+        {
+        fprintf(stderr, "(error) Unable to copy cached %s.\n", cache_entry);
+        exit(1);
+        }
+
+    /*
+    **  Recently used: eviction goes by modification time
+    */
+    cache_utime(cache_entry, NULL);
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the private file a conversion is written to.
+**
+**  Returns:        The open file, or NULL (convert without caching).
+**
+**------------------------------------------------------------------------*/
+
+FILE *cache_create(const unsigned char *key)
+    {
+    char suffix[32];
+
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)_getpid());
+    if (!cache_name(key, cache_entry, ".pdf") || !cache_name(key, cache_temp, suffix))
+        {
+        fprintf(stderr, "(warning) Cache directory path %s is too long; output is not cached.\n", cache_directory);
+        return NULL;
+        }
+    cache_temp_file = fopen(cache_temp, "w+b");
+    if (cache_temp_file == NULL)
+        {
+        fprintf(stderr, "(warning) Unable to create %s; output is not cached.\n", cache_temp);
+        }
+    return cache_temp_file;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Remove the oldest entries until the directory is back
+**                  under its limit (and stale temporary files).
+**
+**------------------------------------------------------------------------*/
+
+static void cache_evict()
+    {
+    std::vector<CacheFile> files;
+    CacheFile  file;
+    long long  total = 0;
+    long long  now = (long long)time(NULL);
+    char       path[CACHE_PATH_MAX];
+    size_t     i;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE           find;
+
+    if (snprintf(path, sizeof(path), "%s\\*", cache_directory) >= (int)sizeof(path))
+        {
+        return;
+        }
+    find = FindFirstFileA(path, &data);
+    if (find == INVALID_HANDLE_VALUE)
+        {
+        return;
+        }
+    do
+        {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 || strlen(data.cFileName) >= sizeof(file.name))
+            {
+            continue;
+            }
+        strcpy(file.name, data.cFileName);
+        file.size = ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        file.mtime = (long long)((((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+                                  data.ftLastWriteTime.dwLowDateTime) / 10000000ull - 11644473600ull);
+        files.push_back(file);
+        } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    struct dirent *ent;
+    struct stat    st;
+    DIR           *dir = opendir(cache_directory);
+
+    if (dir == NULL)
+        {
+        return;
+        }
+    while ((ent = readdir(dir)) != NULL)
+        {
+        if (strlen(ent->d_name) >= sizeof(file.name) ||
+            snprintf(path, sizeof(path), "%s/%s", cache_directory, ent->d_name) >= (int)sizeof(path) ||
+            stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            {
+            continue;
+            }
+        strcpy(file.name, ent->d_name);
+        file.size = (long long)st.st_size;
+        file.mtime = (long long)st.st_mtime;
+        files.push_back(file);
+        }
+    closedir(dir);
+#endif
+
+    /*
+    **  Entries are "<64 hex digits>.pdf" (32 from releases that keyed
+    **  them by the weaker digest, which are never hit again and age
+    **  out); anything else is left alone apart from temporary files
+    **  nobody has touched for an hour
+    */
+    for (i = 0; i < files.size(); )
+        {
+        const char *dot = strchr(files[i].name, '.');
+
+        if (dot != NULL && (dot - files[i].name == 2 * SHA256_BYTES || dot - files[i].name == 32) &&
+            strcmp(dot, ".pdf") == 0)
+            {
+            total += files[i].size;
+            i++;
+            continue;
+            }
+        if (strstr(files[i].name, ".tmp") != NULL && now - files[i].mtime > CACHE_STALE_SECONDS)
+            {
+            if (snprintf(path, sizeof(path), "%s" CACHE_SEPARATOR "%s", cache_directory, files[i].name) < (int)sizeof(path))
+                {
+                remove(path);
+                }
+            }
+        files.erase(files.begin() + i);
+        }
+
+    if (total <= cache_limit)
+        {
+        return;
+        }
+
+    std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b)
+        {
+        return a.mtime < b.mtime;
+        });
+    for (i = 0; i < files.size() && total > cache_limit; i++)
+        {
+        if (snprintf(path, sizeof(path), "%s" CACHE_SEPARATOR "%s", cache_directory, files[i].name) < (int)sizeof(path) &&
+            remove(path) == 0)
+            {
+            total -= files[i].size;
+            }
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy a finished conversion to the output and publish
+**                  it as a cache entry.
+**
+**  Returns:        FALSE if the output could not be written.
+**
+**------------------------------------------------------------------------*/
+
+bool cache_publish(FILE *out)
+    {
+    bool ok;
+
+    _setmode(_fileno(out), _O_BINARY);
+    ok = (fflush(cache_temp_file) == 0);
+    rewind(cache_temp_file);
+    ok = ok && cache_copy(cache_temp_file, out);
+    if (fclose(cache_temp_file) != 0)
+        {
+        ok = FALSE;
+        }
+    cache_temp_file = NULL;
+
+    /*
+    **  A concurrent run may have published the same (identical) entry
+    */
+    if (!ok || rename(cache_temp, cache_entry) != 0)
+        {
+        remove(cache_temp);
+        }
+    cache_evict();
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Drop the temporary file of a failed conversion.
+**
+**------------------------------------------------------------------------*/
+
+void cache_discard()
+    {
+    if (cache_temp_file != NULL)
+        {
+        fclose(cache_temp_file);
+        cache_temp_file = NULL;
+        remove(cache_temp);
+        }
+    }
@@ -0,0 +1,26 @@
+/**
+ *
+ *  Name: ConvertCache.h
+ *
+ *  Description:
+ *
+ *      Content-addressed cache of finished PDFs for txt2pdf (-c).  An
+ *      entry is named by the SHA-256 of the input bytes and the effective
+ *      conversion settings; several processes may share one directory.
+ *
+ */
+
+#ifndef CONVERTCACHE_H
+#define CONVERTCACHE_H
+
+#include <stdio.h>
+#include "Digest.h"
+
+void  cache_configure(const char *directory, long long limit);
+bool  cache_hash_input(const char *path, Digest *digest, char *spool, size_t size);
+bool  cache_fetch(const unsigned char *key, FILE *out);
+FILE *cache_create(const unsigned char *key);
+bool  cache_publish(FILE *out);
+void  cache_discard();
+
+#endif //CONVERTCACHE_H
@@ -0,0 +1,132 @@
+/**
+ *
+ *  Name: Digest.cpp
+ *
+ *  Description:
+ *
+ *      Two independent 64-bit multiply/rotate lanes over 8-byte words,
+ *      plus the total length.  Not cryptographic; it is only used to
+ *      find byte-identical content that txt2pdf produced itself.
+ *
+ */
+
+#include "stdafx.h"
+#include <string.h>
+#include "Digest.h"
+
+#define DIGEST_P1   0x9E3779B185EBCA87ull
+#define DIGEST_P2   0xC2B2AE3D27D4EB4Full
+#define DIGEST_P3   0x165667B19E3779F9ull
+
+#define ROTL64(x, r)    (((x) << (r)) | ((x) >> (64 - (r))))
+
+static Digest *digest_teed = NULL;         /* see digest_tee() */
+static Sha256 *digest_strong = NULL;
+
+static void digest_word(Digest *digest, unsigned long long word)
+    {
+    digest->h1 = ROTL64(digest->h1 ^ (word * DIGEST_P1), 31) * DIGEST_P2;
+    digest->h2 = ROTL64(digest->h2 + (word * DIGEST_P3), 27) * DIGEST_P1 + 0x52DCE729;
+    }
+
+static unsigned long long digest_mix(unsigned long long h)
+    {
+    h ^= h >> 33;
+    h *= DIGEST_P2;
+    h ^= h >> 29;
+    h *= DIGEST_P3;
+    h ^= h >> 32;
+    return h;
+    }
+
+void digest_init(Digest *digest)
+    {
+    digest->h1 = 0x243F6A8885A308D3ull;
+    digest->h2 = 0x13198A2E03707344ull;
+    digest->length = 0;
+    digest->tail = 0;
+    digest->tail_bytes = 0;
+    }
+
+/*
+**  Until digest_final(), also feed everything given to digest to a
+**  SHA-256.  Digests are written to files as they are (-K), so the
+**  link is kept here rather than in the structure.
+*/
+void digest_tee(Digest *digest, Sha256 *strong)
+    {
+    digest_teed = digest;
+    digest_strong = strong;
+    }
+
+void digest_update(Digest *digest, const void *data, size_t length)
+    {
+    const unsigned char *p = (const unsigned char *)data;
+    unsigned long long word;
+
+    digest->length += length;
+    if (digest == digest_teed)
+        {
+        sha256_update(digest_strong, data, length);
+        }
+
+    /*
+    **  Complete a partial word left over from the previous call
+    */
+    while (digest->tail_bytes != 0 && length > 0)
+        {
+        digest->tail |= (unsigned long long)*p++ << (8 * digest->tail_bytes);
+        length--;
+        if (++digest->tail_bytes == 8)
+            {
+            digest_word(digest, digest->tail);
+            digest->tail = 0;
+            digest->tail_bytes = 0;
+            }
+        }
+
+    while (length >= 8)
+        {
+        memcpy(&word, p, 8);
+        digest_word(digest, word);
+        p += 8;
+        length -= 8;
+        }
+
+    while (length > 0)
+        {
+        digest->tail |= (unsigned long long)*p++ << (8 * digest->tail_bytes);
+        digest->tail_bytes++;
+        length--;
+        }
+    }
+
+void digest_final(Digest *digest)
+    {
+    if (digest->tail_bytes != 0)
+        {
+        digest_word(digest, digest->tail);
+        digest->tail = 0;
+        digest->tail_bytes = 0;
+        }
+    if (digest == digest_teed)
+        {
+        digest_teed = NULL;
+        }
+    digest->h1 = digest_mix(digest->h1 ^ digest->length);
+    digest->h2 = digest_mix(digest->h2 + digest->h1);
+    }
+
+bool digest_equal(const Digest *a, const Digest *b)
+    {
+    return (a->h1 == b->h1 && a->h2 == b->h2 && a->length == b->length);
+    }
+
+void digest_format(const Digest *digest, char *text)
+    {
+
+    /*
+    **  32 hex digits plus the terminating NUL
+    */
+    sprintf(text, "%016llx%016llx", digest->h1, digest->h2);
+    }
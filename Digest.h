@@ -0,0 +1,38 @@
+/**
+ *
+ *  Name: Digest.h
+ *
+ *  Description:
+ *
+ *      128-bit content digest used by txt2pdf to recognise identical
+ *      settings and inputs.  It is not collision resistant: where a
+ *      match puts other bytes in the output (-D shared streams, -j
+ *      cached pages, cache keys) SHA-256 is used instead.
+ *
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include "Sha256.h"
+
+struct _Digest
+    {
+    unsigned long long h1;
+    unsigned long long h2;
+    unsigned long long length;
+    unsigned long long tail;
+    int tail_bytes;
+    };
+
+typedef _Digest Digest;
+
+void digest_init(Digest *digest);
+void digest_tee(Digest *digest, Sha256 *strong);
+void digest_update(Digest *digest, const void *data, size_t length);
+void digest_final(Digest *digest);
+bool digest_equal(const Digest *a, const Digest *b);
+void digest_format(const Digest *digest, char *text);
+
+#endif //DIGEST_H
@@ -0,0 +1,686 @@
+/**
+ *
+ *  Name: Inflate.cpp
+ *
+ *  Description:
+ *
+ *      Streaming gzip / deflate decoder.
+ *
+ *      Huffman codes are decoded canonically (count of codes per bit
+ *      length, symbols in code order) as in Mark Adler's puff.c, with a
+ *      lookup table for codes of up to FASTBITS bits in front; output
+ *      goes through a 32K history window which is handed to the caller
+ *      each time it fills.  Concatenated gzip members are decoded in
+ *      sequence and every member's CRC-32 and length are checked.
+ *
+ */
+
+#include "stdafx.h"
+#include <string.h>
+#include <setjmp.h>
+#include "Inflate.h"
+
+#define MAXBITS     15              /* maximum bits in a code */
+#define MAXLCODES   286             /* maximum number of literal/length codes */
+#define MAXDCODES   30              /* maximum number of distance codes */
+#define MAXCODES    (MAXLCODES + MAXDCODES)
+#define FIXLCODES   288             /* number of fixed literal/length codes */
+#define WINDOW      32768           /* deflate history window */
+#define FASTBITS    9               /* codes this short decode by table */
+
+struct _Huffman
+    {
+    short count[MAXBITS + 1];
+    short symbol[FIXLCODES];
+    short fast[1 << FASTBITS];      /* symbol | (length << 10), 0 = slow path */
+    };
+
+typedef _Huffman Huffman;
+
+struct _InflateState
+    {
+    InflateSource *source;
+    unsigned long  bitbuf;
+    int            bitcnt;
+    unsigned char  window[WINDOW];
+    unsigned int   wpos;
+    unsigned long  crc;
+    unsigned long  length;
+    jmp_buf        failure;
+    };
+
+typedef _InflateState InflateState;
+
+static unsigned long CRCTable[256];
+static bool          CRCTableReady = FALSE;
+
+
+static void crc_init()
+    {
+    unsigned long c;
+    int n;
+    int k;
+
+    for (n = 0; n < 256; n++)
+        {
+        c = (unsigned long)n;
+        for (k = 0; k < 8; k++)
+            {
+            c = (c & 1) ? 0xEDB88320ul ^ (c >> 1) : c >> 1;
+            }
+        CRCTable[n] = c;
+        }
+    CRCTableReady = TRUE;
+    }
+
+
+static unsigned long crc_update(unsigned long crc, const unsigned char *data, size_t length)
+    {
+    crc ^= 0xFFFFFFFFul;
+    while (length-- > 0)
+        {
+        crc = CRCTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        }
+    return crc ^ 0xFFFFFFFFul;
+    }
+
+
+static int next_byte(InflateState *s)
+    {
+    if (s->source->avail == 0 && !s->source->refill(s->source))
+        {
+        longjmp(s->failure, INFLATE_TRUNCATED);
+        }
+    s->source->avail--;
+    return *s->source->next++;
+    }
+
+
+static int bits(InflateState *s, int need)
+    {
+    unsigned long val = s->bitbuf;
+
+    while (s->bitcnt < need)
+        {
+        val |= (unsigned long)next_byte(s) << s->bitcnt;
+        s->bitcnt += 8;
+        }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return (int)(val & ((1ul << need) - 1));
+    }
+
+
+static void flush_window(InflateState *s)
+    {
+    if (s->wpos > 0)
+        {
+        s->crc = crc_update(s->crc, s->window, s->wpos);
+        s->length += s->wpos;
+        if (!s->source->write(s->source->context, s->window, s->wpos))
+            {
+            longjmp(s->failure, INFLATE_STOPPED);
+            }
+        }
+    }
+
+
+static void put_byte(InflateState *s, unsigned char c)
+    {
+    s->window[s->wpos++] = c;
+    if (s->wpos == WINDOW)
+        {
+        flush_window(s);
+        s->wpos = 0;
+        }
+    }
+
+
+static bool peek_bits(InflateState *s, int need)
+    {
+    while (s->bitcnt < need)
+        {
+        if (s->source->avail == 0 && !s->source->refill(s->source))
+            {
+            return FALSE;
+            }
+        s->source->avail--;
+        s->bitbuf |= (unsigned long)*s->source->next++ << s->bitcnt;
+        s->bitcnt += 8;
+        }
+    return TRUE;
+    }
+
+
+static int decode(InflateState *s, const Huffman *h)
+    {
+    int entry;
+    int code = 0;               /* bits being decoded */
+    int first = 0;              /* first code of length len */
+    int index = 0;              /* index of first code of length len in symbol table */
+    int count;
+    int len;
+
+    if (peek_bits(s, FASTBITS))
+        {
+        entry = h->fast[s->bitbuf & ((1 << FASTBITS) - 1)];
+        if (entry != 0)
+            {
+            s->bitbuf >>= entry >> 10;
+            s->bitcnt -= entry >> 10;
+            return entry & 0x3FF;
+            }
+        }
+
+    for (len = 1; len <= MAXBITS; len++)
+        {
+        code |= bits(s, 1);
+        count = h->count[len];
+        if (code - count < first)
+            {
+            return h->symbol[index + (code - first)];
+            }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+        }
+    longjmp(s->failure, INFLATE_BAD_DATA);
+    return -1;
+    }
+
+
+static void build_fast(Huffman *h)
+    {
+
+    /*
+    **  Deflate sends codes most significant bit first, so the table
+    **  is indexed by the bit-reversed code padded with every suffix
+    */
+
+    int code = 0;
+    int index = 0;
+    int len;
+    int i;
+    int reversed;
+    int bit;
+    int fill;
+
+    memset(h->fast, 0, sizeof(h->fast));
+
+    for (len = 1; len <= FASTBITS; len++)
+        {
+        for (i = 0; i < h->count[len]; i++)
+            {
+            reversed = 0;
+            for (bit = 0; bit < len; bit++)
+                {
+                reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+                }
+            for (fill = reversed; fill < (1 << FASTBITS); fill += 1 << len)
+                {
+                h->fast[fill] = (short)(h->symbol[index] | (len << 10));
+                }
+            code++;
+            index++;
+            }
+        code <<= 1;
+        }
+    }
+
+
+static int construct(Huffman *h, const short *length, int n)
+    {
+    short offs[MAXBITS + 1];
+    int   symbol;
+    int   len;
+    int   left;
+
+    for (len = 0; len <= MAXBITS; len++)
+        {
+        h->count[len] = 0;
+        }
+    for (symbol = 0; symbol < n; symbol++)
+        {
+        h->count[length[symbol]]++;
+        }
+    if (h->count[0] == n)
+        {
+        return 0;
+        }
+
+    left = 1;
+    for (len = 1; len <= MAXBITS; len++)
+        {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            {
+            return left;        /* over-subscribed */
+            }
+        }
+
+    offs[1] = 0;
+    for (len = 1; len < MAXBITS; len++)
+        {
+        offs[len + 1] = offs[len] + h->count[len];
+        }
+    for (symbol = 0; symbol < n; symbol++)
+        {
+        if (length[symbol] != 0)
+            {
+            h->symbol[offs[length[symbol]]++] = (short)symbol;
+            }
+        }
+
+    build_fast(h);
+
+    return left;                /* > 0 for incomplete codes */
+    }
+
+
+static void codes(InflateState *s, const Huffman *lencode, const Huffman *distcode)
+    {
+    static const short lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const short lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const short dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const short dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+        12, 12, 13, 13};
+
+    int symbol;
+    int len;
+    unsigned int dist;
+
+    for (;;)
+        {
+        symbol = decode(s, lencode);
+        if (symbol < 256)
+            {
+            put_byte(s, (unsigned char)symbol);
+            }
+        else if (symbol == 256)
+            {
+            return;
+            }
+        else
+            {
+            symbol -= 257;
+            if (symbol >= 29)
+                {
+                longjmp(s->failure, INFLATE_BAD_DATA);
+                }
+            len = lbase[symbol] + bits(s, lext[symbol]);
+
+            symbol = decode(s, distcode);
+            if (symbol >= 30)
+                {
+                longjmp(s->failure, INFLATE_BAD_DATA);
+                }
+            dist = dbase[symbol] + bits(s, dext[symbol]);
+
+            /*
+            **  The window always holds the last 32K of output
+            **  (distances beyond the start of the stream are
+            **  not checked and read zeros)
+            */
+            while (len-- > 0)
+                {
+                put_byte(s, s->window[(s->wpos - dist) & (WINDOW - 1)]);
+                }
+            }
+        }
+    }
+
+
+static void stored(InflateState *s)
+    {
+    unsigned int len;
+
+    s->bitbuf = 0;              /* discard leftover bits */
+    s->bitcnt = 0;
+
+    len = next_byte(s);
+    len |= next_byte(s) << 8;
+    if (next_byte(s) != (int)(~len & 0xFF) || next_byte(s) != (int)((~len >> 8) & 0xFF))
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+
+    while (len-- > 0)
+        {
+        put_byte(s, (unsigned char)next_byte(s));
+        }
+    }
+
+
+static void fixed(InflateState *s)
+    {
+    static bool    built = FALSE;
+    static Huffman lencode;
+    static Huffman distcode;
+    short lengths[FIXLCODES];
+    int   symbol;
+
+    if (!built)
+        {
+        for (symbol = 0; symbol < 144; symbol++) lengths[symbol] = 8;
+        for (; symbol < 256; symbol++)           lengths[symbol] = 9;
+        for (; symbol < 280; symbol++)           lengths[symbol] = 7;
+        for (; symbol < FIXLCODES; symbol++)     lengths[symbol] = 8;
+        construct(&lencode, lengths, FIXLCODES);
+
+        for (symbol = 0; symbol < MAXDCODES; symbol++)
+            {
+            lengths[symbol] = 5;
+            }
+        construct(&distcode, lengths, MAXDCODES);
+        built = TRUE;
+        }
+
+    codes(s, &lencode, &distcode);
+    }
+
+
+static void dynamic(InflateState *s)
+    {
+    static const short order[19] =
+        {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    short   lengths[MAXCODES];
+    Huffman lencode;
+    Huffman distcode;
+    int     nlen;
+    int     ndist;
+    int     ncode;
+    int     index;
+    int     symbol;
+    int     len;
+    int     err;
+
+    nlen = bits(s, 5) + 257;
+    ndist = bits(s, 5) + 1;
+    ncode = bits(s, 4) + 4;
+    if (nlen > MAXLCODES || ndist > MAXDCODES)
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+
+    for (index = 0; index < ncode; index++)
+        {
+        lengths[order[index]] = (short)bits(s, 3);
+        }
+    for (; index < 19; index++)
+        {
+        lengths[order[index]] = 0;
+        }
+    if (construct(&lencode, lengths, 19) != 0)
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+
+    index = 0;
+    while (index < nlen + ndist)
+        {
+        symbol = decode(s, &lencode);
+        if (symbol < 16)
+            {
+            lengths[index++] = (short)symbol;
+            }
+        else
+            {
+            len = 0;
+            if (symbol == 16)
+                {
+                if (index == 0)
+                    {
+                    longjmp(s->failure, INFLATE_BAD_DATA);
+                    }
+                len = lengths[index - 1];
+                symbol = 3 + bits(s, 2);
+                }
+            else if (symbol == 17)
+                {
+                symbol = 3 + bits(s, 3);
+                }
+            else
+                {
+                symbol = 11 + bits(s, 7);
+                }
+            if (index + symbol > nlen + ndist)
+                {
+                longjmp(s->failure, INFLATE_BAD_DATA);
+                }
+            while (symbol-- > 0)
+                {
+                lengths[index++] = (short)len;
+                }
+            }
+        }
+
+    if (lengths[256] == 0)
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+
+    err = construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+    err = construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+        {
+        longjmp(s->failure, INFLATE_BAD_DATA);
+        }
+
+    codes(s, &lencode, &distcode);
+    }
+
+
+static void gzip_header(InflateState *s)
+    {
+    int flags;
+    int extra;
+    int i;
+
+    if (next_byte(s) != 0x1F || next_byte(s) != 0x8B || next_byte(s) != 8)
+        {
+        longjmp(s->failure, INFLATE_BAD_HEADER);
+        }
+    flags = next_byte(s);
+    for (i = 0; i < 6; i++)             /* MTIME, XFL, OS */
+        {
+        next_byte(s);
+        }
+    if (flags & 0x04)                   /* FEXTRA */
+        {
+        extra = next_byte(s);
+        extra |= next_byte(s) << 8;
+        while (extra-- > 0)
+            {
+            next_byte(s);
+            }
+        }
+    if (flags & 0x08)                   /* FNAME */
+        {
+        while (next_byte(s) != 0)
+            ;
+        }
+    if (flags & 0x10)                   /* FCOMMENT */
+        {
+        while (next_byte(s) != 0)
+            ;
+        }
+    if (flags & 0x02)                   /* FHCRC */
+        {
+        next_byte(s);
+        next_byte(s);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode deflate blocks up to and including the last.
+**
+**------------------------------------------------------------------------*/
+
+static void deflate_blocks(InflateState *s)
+    {
+    int last;
+    int type;
+
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+    s->wpos = 0;
+    s->crc = 0;
+    s->length = 0;
+    memset(s->window, 0, sizeof(s->window));
+
+    do
+        {
+        last = bits(s, 1);
+        type = bits(s, 2);
+        switch (type)
+            {
+                case 0:  stored(s);  break;
+                case 1:  fixed(s);   break;
+                case 2:  dynamic(s); break;
+                default: longjmp(s->failure, INFLATE_BAD_DATA);
+            }
+        } while (!last);
+
+    flush_window(s);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode every gzip member of the source.
+**
+**  Parameters:     Name        Description.
+**                  source      Compressed input and decompressed sink.
+**
+**  Returns:        INFLATE_OK or a negative INFLATE_ error code.
+**
+**------------------------------------------------------------------------*/
+
+int inflate_gzip(InflateSource *source)
+    {
+    InflateState *s;
+    unsigned long crc;
+    unsigned long length;
+    int i;
+    int result;
+
+    if (!CRCTableReady)
+        {
+        crc_init();
+        }
+
+    s = new InflateState;
+    s->source = source;
+
+    result = setjmp(s->failure);
+    if (result != 0)
+        {
+        delete s;
+        return result;
+        }
+
+    do
+        {
+        gzip_header(s);
+        deflate_blocks(s);
+
+        crc = 0;
+        length = 0;
+        for (i = 0; i < 4; i++)
+            {
+            crc |= (unsigned long)next_byte(s) << (8 * i);
+            }
+        for (i = 0; i < 4; i++)
+            {
+            length |= (unsigned long)next_byte(s) << (8 * i);
+            }
+        if (crc != s->crc || length != (s->length & 0xFFFFFFFFul))
+            {
+            longjmp(s->failure, INFLATE_BAD_CRC);
+            }
+
+        /*
+        **  Another member may follow (cat a.gz b.gz)
+        */
+        } while (source->avail > 0 || source->refill(source));
+
+    delete s;
+    return INFLATE_OK;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode one zlib (RFC 1950) stream, the /FlateDecode
+**                  filter of PDF files.
+**
+**  Returns:        INFLATE_OK or a negative INFLATE_ error code.
+**
+**  Description:    The Adler-32 trailer is not checked; PDF writers
+**                  have been known to leave it out.
+**
+**------------------------------------------------------------------------*/
+
+int inflate_zlib(InflateSource *source)
+    {
+    InflateState *s;
+    int cmf;
+    int flg;
+    int result;
+
+    if (!CRCTableReady)
+        {
+        crc_init();
+        }
+
+    s = new InflateState;
+    s->source = source;
+
+    result = setjmp(s->failure);
+    if (result != 0)
+        {
+        delete s;
+        return result;
+        }
+
+    cmf = next_byte(s);
+    flg = next_byte(s);
+    if ((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20) != 0)
+        {
+        longjmp(s->failure, INFLATE_BAD_HEADER);
+        }
+    deflate_blocks(s);
+
+    delete s;
+    return INFLATE_OK;
+    }
+
+
+const char *inflate_error(int code)
+    {
+    switch (code)
+        {
+            case INFLATE_OK:         return "no error";
+            case INFLATE_TRUNCATED:  return "compressed input is truncated";
+            case INFLATE_BAD_HEADER: return "not a gzip member or zlib stream";
+            case INFLATE_BAD_DATA:   return "invalid deflate data";
+            case INFLATE_BAD_CRC:    return "CRC or length mismatch";
+            case INFLATE_STOPPED:    return "decoding was stopped";
+        }
+    return "unknown error";
+    }
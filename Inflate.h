@@ -0,0 +1,47 @@
+/**
+ *
+ *  Name: Inflate.h
+ *
+ *  Description:
+ *
+ *      Streaming gzip (RFC 1952) / deflate (RFC 1951) decoder used to
+ *      read compressed spool files without an external zcat, and zlib
+ *      (RFC 1950) for /FlateDecode streams of overlay PDFs.
+ *
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+
+/**
+ *  Compressed bytes are pulled from the source; refill() makes more
+ *  available in next/avail and returns FALSE at end of input.
+ *  Decompressed bytes are pushed to write() as they are produced;
+ *  write() returns FALSE to abandon decoding (INFLATE_STOPPED).
+ */
+
+struct _InflateSource
+    {
+    const unsigned char *next;
+    size_t avail;
+    bool (*refill)(struct _InflateSource *source);
+    bool (*write)(void *context, const unsigned char *data, size_t length);
+    void *context;
+    };
+
+typedef _InflateSource InflateSource;
+
+#define INFLATE_OK          0
+#define INFLATE_TRUNCATED   (-1)
+#define INFLATE_BAD_HEADER  (-2)
+#define INFLATE_BAD_DATA    (-3)
+#define INFLATE_BAD_CRC     (-4)
+#define INFLATE_STOPPED     (-6)        /* write() asked to stop */
+
+int         inflate_gzip(InflateSource *source);
+int         inflate_zlib(InflateSource *source);
+const char *inflate_error(int code);
+
+#endif //INFLATE_H
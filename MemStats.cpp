@@ -0,0 +1,236 @@
+/**
+ *
+ *  Name: MemStats.cpp
+ *
+ *  Description:
+ *
+ *      Allocation and memory-footprint accounting for txt2pdf (-I).
+ *
+ *      Each subsystem keeps a count of allocations (a reallocation
+ *      counts as one), the bytes requested, the bytes live and the peak
+ *      of the latter.  Resident memory is sampled every `interval` pages;
+ *      the timeline holds at most MEM_TIMELINE samples, and when it fills
+ *      every other sample is dropped and the interval doubled, so a
+ *      million-page job costs no more than a short one.
+ *
+ *      The output writer releases buffers on its own thread, hence the
+ *      lock; it is only taken when accounting is enabled.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <mutex>
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <string.h>
+#endif
+#include "MemStats.h"
+
+#define MEM_TIMELINE        64
+
+struct MemSubsystem
+    {
+    const char *name;
+    long        allocations;
+    long long   requested;
+    long long   live;
+    long long   peak;
+    };
+
+struct MemSample
+    {
+    int         page;
+    double      seconds;
+    long long   resident;
+    long long   live;
+    };
+
+bool mem_is_enabled = FALSE;
+
+static MemSubsystem mem_subsystems[MEM_SUBSYSTEMS] =
+    {
+        { "xref table",   0, 0, 0, 0 },
+        { "page list",    0, 0, 0, 0 },
+        { "stream table", 0, 0, 0, 0 },
+        { "page buffer",  0, 0, 0, 0 },
+        { "I/O buffers",  0, 0, 0, 0 },
+    };
+
+static std::mutex mem_lock;
+static long long  mem_live = 0;
+static long long  mem_peak = 0;
+static MemSample  mem_timeline[MEM_TIMELINE];
+static int        mem_samples = 0;
+static int        mem_interval = 1000;
+static std::chrono::steady_clock::time_point mem_start;
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Current and peak resident set size in bytes.
+**
+**------------------------------------------------------------------------*/
+
+static void mem_resident(long long *current, long long *peak)
+    {
+    *current = 0;
+    *peak = 0;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+        *current = (long long)counters.WorkingSetSize;
+        *peak = (long long)counters.PeakWorkingSetSize;
+        }
+#else
+    char  line[128];
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status != NULL)
+        {
+        while (fgets(line, sizeof(line), status) != NULL)
+            {
+            if (strncmp(line, "VmRSS:", 6) == 0)
+                {
+                *current = strtoll(line + 6, NULL, 10) * 1024;
+                }
+            else if (strncmp(line, "VmHWM:", 6) == 0)
+                {
+                *peak = strtoll(line + 6, NULL, 10) * 1024;
+                }
+            }
+        fclose(status);
+        }
+#endif
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start accounting.
+**
+**  Parameters:     Name        Description.
+**                  interval    Pages between resident memory samples.
+**
+**------------------------------------------------------------------------*/
+
+void mem_enable(int interval)
+    {
+    mem_is_enabled = TRUE;
+    mem_interval = (interval < 1) ? 1 : interval;
+    mem_start = std::chrono::steady_clock::now();
+    mem_sample(0);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Record an allocation, reallocation or free.
+**
+**  Parameters:     Name        Description.
+**                  subsystem   MEM_XREF ... MEM_IO_BUFFER.
+**                  old_size    Bytes before (0 for an allocation).
+**                  new_size    Bytes after (0 for a free).
+**
+**------------------------------------------------------------------------*/
+
+void mem_account(int subsystem, long long old_size, long long new_size)
+    {
+    std::lock_guard<std::mutex> guard(mem_lock);
+    MemSubsystem *s = &mem_subsystems[subsystem];
+
+    if (new_size > 0)
+        {
+        s->allocations++;
+        s->requested += new_size;
+        }
+    s->live += new_size - old_size;
+    mem_live += new_size - old_size;
+    if (s->live > s->peak)
+        {
+        s->peak = s->live;
+        }
+    if (mem_live > mem_peak)
+        {
+        mem_peak = mem_live;
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Add a timeline sample if the page is on the interval.
+**
+**------------------------------------------------------------------------*/
+
+void mem_sample(int page)
+    {
+    MemSample *sample;
+    long long  peak;
+    int        i;
+
+    if (page % mem_interval != 0)
+        {
+        return;
+        }
+    if (mem_samples == MEM_TIMELINE)
+        {
+        for (i = 0; i < MEM_TIMELINE / 2; i++)
+            {
+            mem_timeline[i] = mem_timeline[i * 2];
+            }
+        mem_samples = MEM_TIMELINE / 2;
+        mem_interval *= 2;
+        if (page % mem_interval != 0)
+            {
+            return;
+            }
+        }
+
+    sample = &mem_timeline[mem_samples++];
+    sample->page = page;
+    sample->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mem_start).count();
+    mem_resident(&sample->resident, &peak);
+    std::lock_guard<std::mutex> guard(mem_lock);
+    sample->live = mem_live;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print the subsystem table and the timeline to stderr.
+**
+**------------------------------------------------------------------------*/
+
+void mem_report()
+    {
+    long long resident;
+    long long peak;
+    int       i;
+
+    if (!mem_is_enabled)
+        {
+        return;
+        }
+    std::lock_guard<std::mutex> guard(mem_lock);
+
+    fprintf(stderr, "(info) memory %-14s %10s %14s %12s %12s\n", "subsystem", "allocs", "bytes", "peak live", "live");
+    for (i = 0; i < MEM_SUBSYSTEMS; i++)
+        {
+        MemSubsystem *s = &mem_subsystems[i];
+
+        fprintf(stderr, "(info) memory %-14s %10ld %14lld %12lld %12lld\n",
+                s->name, s->allocations, s->requested, s->peak, s->live);
+        }
+    fprintf(stderr, "(info) memory %-14s %10s %14s %12lld %12lld\n", "total", "", "", mem_peak, mem_live);
+
+    mem_resident(&resident, &peak);
+    fprintf(stderr, "(info) memory resident %lld KB, peak %lld KB\n", resident / 1024, peak / 1024);
+    fprintf(stderr, "(info) memory timeline %8s %10s %12s %12s\n", "page", "seconds", "resident KB", "tracked KB");
+    for (i = 0; i < mem_samples; i++)
+        {
+        fprintf(stderr, "(info) memory timeline %8d %10.3f %12lld %12lld\n", mem_timeline[i].page,
+                mem_timeline[i].seconds, mem_timeline[i].resident / 1024, mem_timeline[i].live / 1024);
+        }
+    }
@@ -0,0 +1,43 @@
+/**
+ *
+ *  Name: MemStats.h
+ *
+ *  Description:
+ *
+ *      Allocation and memory-footprint accounting for txt2pdf (-I).
+ *      Allocation sites report size changes per subsystem; the totals,
+ *      peaks and a timeline of resident memory are printed at exit.
+ *      When disabled each site costs one test of mem_is_enabled.
+ *
+ */
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+enum
+    {
+    MEM_XREF,                   /* cross-reference offsets */
+    MEM_PAGE_LIST,              /* PageList nodes */
+    MEM_STREAM_TABLE,           /* duplicate page index (-D) */
+    MEM_PAGE_BUFFER,            /* content stream being assembled */
+    MEM_IO_BUFFER,              /* output writer buffers */
+    MEM_SUBSYSTEMS
+    };
+
+extern bool mem_is_enabled;
+
+void mem_enable(int interval);
+void mem_account(int subsystem, long long old_size, long long new_size);
+void mem_sample(int page);
+void mem_report();
+
+/*
+**  old_size 0 is an allocation, new_size 0 a free, both a reallocation
+*/
+#define MEM_ACCOUNT(subsystem, old_size, new_size) \
+    do { if (mem_is_enabled) mem_account((subsystem), (long long)(old_size), (long long)(new_size)); } while (0)
+
+#define MEM_SAMPLE(page) \
+    do { if (mem_is_enabled) mem_sample(page); } while (0)
+
+#endif //MEMSTATS_H
@@ -0,0 +1,189 @@
+/**
+ *
+ *  Name: MicroBench.cpp
+ *
+ *  Description:
+ *
+ *      Timing harness for txt2pdf's inner kernels (-y).
+ *
+ *      A kernel is first calibrated: the number of calls per batch is
+ *      doubled until a batch takes at least BENCH_BATCH_NS, so the clock
+ *      resolution does not show.  Then `repetitions` batches are timed
+ *      and the fastest, median and slowest batch are reported as
+ *      nanoseconds per unit (per byte of input or per call); a wide
+ *      spread means the figure is noise, not a regression.
+ *
+ *      The slow sink is a pipe whose reader thread takes no more than a
+ *      given number of bytes per second, like a network share or a
+ *      pipeline stage that cannot keep up with the output.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <io.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "MicroBench.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define BENCH_BATCH_NS      20000000.0      /* 20 ms per timed batch */
+#define BENCH_MAX_CALLS     (1L << 30)
+#define BENCH_PIPE_SIZE     (64 * 1024)
+#define BENCH_SINK_SLACK_MS 20
+
+#ifdef _WIN32
+#define bench_pipe(fds)     _pipe(fds, BENCH_PIPE_SIZE, _O_BINARY)
+#define bench_fdopen        _fdopen
+#define bench_read          _read
+#define bench_close         _close
+#else
+#define bench_pipe(fds)     pipe(fds)
+#define bench_fdopen        fdopen
+#define bench_read          read
+#define bench_close         close
+#endif
+
+static int         bench_repetitions = 15;
+static std::thread bench_sink_thread;
+
+
+static double bench_batch(BenchKernel kernel, void *context, long calls)
+    {
+    auto start = std::chrono::steady_clock::now();
+    long i;
+
+    for (i = 0; i < calls; i++)
+        {
+        kernel(context);
+        }
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print the column headings.
+**
+**  Parameters:     Name        Description.
+**                  repetitions Timed batches per kernel.
+**
+**------------------------------------------------------------------------*/
+
+void bench_header(int repetitions)
+    {
+    bench_repetitions = (repetitions < 3) ? 3 : repetitions;
+    printf("%-34s %12s %10s %10s %10s %8s\n", "kernel", "calls/batch", "min", "median", "max", "spread");
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Time one kernel and print its line.
+**
+**  Parameters:     Name        Description.
+**                  name        Kernel and input description.
+**                  unit        "B" (per byte) or "call".
+**                  units_per_call
+**                              Bytes handled by one call (1 per call).
+**                  kernel      Function under test.
+**                  context     Its argument.
+**
+**------------------------------------------------------------------------*/
+
+void bench_run(const char *name, const char *unit, double units_per_call, BenchKernel kernel, void *context)
+    {
+    std::vector<double> samples;
+    char   scale[16];
+    double elapsed;
+    long   calls = 1;
+    int    r;
+
+    bench_batch(kernel, context, 1);                    //  warm caches and buffers
+    while ((elapsed = bench_batch(kernel, context, calls)) < BENCH_BATCH_NS && calls < BENCH_MAX_CALLS)
+        {
+        calls *= 2;
+        }
+
+    for (r = 0; r < bench_repetitions; r++)
+        {
+        samples.push_back(bench_batch(kernel, context, calls) / ((double)calls * units_per_call));
+        }
+    std::sort(samples.begin(), samples.end());
+
+    snprintf(scale, sizeof(scale), "ns/%s", unit);
+    printf("%-34s %12ld %10.3f %10.3f %10.3f %7.1f%%   %s\n", name, calls,
+           samples.front(), samples[samples.size() / 2], samples.back(),
+           100.0 * (samples.back() - samples.front()) / samples[samples.size() / 2], scale);
+    fflush(stdout);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the slow sink at no more than rate bytes per
+**                  second until the write end is closed.
+**
+**------------------------------------------------------------------------*/
+
+static void bench_sink_drain(int fd, double rate)
+    {
+    static char block[BENCH_PIPE_SIZE];
+    auto due = std::chrono::steady_clock::now();
+    int  got;
+
+    while ((got = (int)bench_read(fd, block, sizeof(block))) > 0)
+        {
+        /*
+        **  A sleep is coarser than one read, so up to BENCH_SINK_SLACK
+        **  of lateness is made up later; time spent waiting for data
+        **  beyond that is not banked
+        */
+        due = std::max(due, std::chrono::steady_clock::now() - std::chrono::milliseconds(BENCH_SINK_SLACK_MS)) +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(got / rate));
+        std::this_thread::sleep_until(due);
+        }
+    bench_close(fd);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open a stream drained at rate bytes per second.
+**
+**  Returns:        The stream to write to, or NULL if no pipe can be made.
+**
+**------------------------------------------------------------------------*/
+
+FILE *bench_slow_sink_open(double rate)
+    {
+    FILE *sink;
+    int   fds[2];
+
+    if (bench_pipe(fds) != 0)
+        {
+        return NULL;
+        }
+    sink = bench_fdopen(fds[1], "wb");
+    if (sink == NULL)
+        {
+        bench_close(fds[0]);
+        bench_close(fds[1]);
+        return NULL;
+        }
+    bench_sink_thread = std::thread(bench_sink_drain, fds[0], rate);
+    return sink;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Close the slow sink once its reader has everything.
+**
+**------------------------------------------------------------------------*/
+
+void bench_slow_sink_close(FILE *sink)
+    {
+    fclose(sink);
+    bench_sink_thread.join();
+    }
@@ -0,0 +1,26 @@
+/**
+ *
+ *  Name: MicroBench.h
+ *
+ *  Description:
+ *
+ *      Timing harness for txt2pdf's inner kernels (-y).  Each kernel is
+ *      run in timed batches and reported per byte or per call with the
+ *      spread over the repetitions.  A paced pipe stands in for a slow
+ *      consumer of the output.
+ *
+ */
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdio.h>
+
+typedef void (*BenchKernel)(void *context);
+
+void bench_header(int repetitions);
+void bench_run(const char *name, const char *unit, double units_per_call, BenchKernel kernel, void *context);
+FILE *bench_slow_sink_open(double rate);
+void bench_slow_sink_close(FILE *sink);
+
+#endif //MICROBENCH_H
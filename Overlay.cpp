@@ -0,0 +1,1712 @@
+/**
+ *
+ *  Name: Overlay.cpp
+ *
+ *  Description:
+ *
+ *      Background form overlay for txt2pdf (-G).
+ *
+ *      The overlay is compiled into a list of PDF objects whose
+ *      references are numbered from 0, object 0 being the form XObject;
+ *      txt2pdf writes them at the start of every document with the
+ *      numbers moved up to free object ids, and each page shows the form
+ *      with one "Do".  The source may be
+ *
+ *        - a PDF: the page's content streams become the form and every
+ *          object its /Resources reach is copied (fonts, images, ...).
+ *          Classic and stream cross-reference tables, object streams
+ *          and /FlateDecode are read; a damaged table is rebuilt by
+ *          scanning for "N G obj"; encrypted files are refused.
+ *        - a JPEG, drawn over the whole page.
+ *        - anything else, taken as PDF drawing operators in page
+ *          coordinates ("0.8 g 36 36 720 24 re f ...").
+ *
+ *      The compiled objects are kept in memory for every burst (-b)
+ *      document and saved as KEY.t2o, KEY being the SHA-256 of the
+ *      source bytes and the page, so the workers of a watch (-w) and
+ *      later runs do not parse the source again.  The file goes to the
+ *      -c cache directory, or else to a directory of the user's own
+ *      (%TEMP%, or $TMPDIR/txt2pdf-UID created 0700), never beside a
+ *      source that other users may be able to write next to.  A .t2o
+ *      that cannot be written is not an error.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <process.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Inflate.h"
+#include "PdfWriter.h"
+#include "Sha256.h"
+#include "Overlay.h"
+
+#ifdef _WIN32
+#define OVERLAY_SEPARATOR   "\\"
+#else
+#define OVERLAY_SEPARATOR   "/"
+#endif
+
+#define OVERLAY_MAGIC       "TXT2OVL2"      /* 1 was keyed by size and mtime */
+#define OVERLAY_MAX_DEPTH   64          /* nesting of values, page tree, object chains */
+
+#define PV_KEYWORD          0           /* true, false, null */
+#define PV_NUMBER           1
+#define PV_NAME             2
+#define PV_STRING           3
+#define PV_ARRAY            4
+#define PV_DICT             5
+#define PV_REF              6
+
+struct PdfValue
+    {
+    int                   kind;
+    std::string           text;         /* the token as written */
+    int                   ref;          /* PV_REF object number */
+    std::vector<PdfValue> items;        /* arrays; dictionaries as key, value, ... */
+    };
+
+struct PdfObject
+    {
+    PdfValue    value;
+    const char *stream;                 /* NULL unless the object is a stream */
+    size_t      stream_length;
+    };
+
+struct PdfLexer
+    {
+    const char *data;
+    size_t      size;
+    size_t      pos;
+    };
+
+struct XrefEntry
+    {
+    int       type;                     /* 1: at offset, 2: in object stream `offset` */
+    long long offset;
+    int       index;
+    };
+
+struct OverlayObject
+    {
+    std::string body;                   /* between "N 0 obj" and "endobj" */
+    std::vector<std::pair<unsigned, int> > refs;    /* body offset of "N 0 R", object */
+    };
+
+struct OverlayBuilder
+    {
+    OverlayObject *object;
+    bool           is_word;             /* body ends inside a token */
+    };
+
+static std::vector<OverlayObject> overlay_objects;
+
+/**
+ *  Parse state, released once the overlay is compiled
+ */
+
+static std::string overlay_source;
+static std::unordered_map<int, XrefEntry> overlay_xref;
+static std::unordered_map<int, std::string> overlay_streams;
+static std::unordered_map<int, int> overlay_locals;
+static std::deque<int> overlay_pending;
+static int overlay_depth = 0;
+
+
+static bool is_space(int c)
+    {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\0';
+    }
+
+
+static bool is_delimiter(int c)
+    {
+    return c != '\0' && strchr("()<>[]{}/%", c) != NULL;
+    }
+
+
+static bool is_integer(const std::string &text)
+    {
+    return !text.empty() && strspn(text.c_str(), "0123456789") == text.size();
+    }
+
+
+static void lex_skip(PdfLexer *lx)
+    {
+    while (lx->pos < lx->size)
+        {
+        if (lx->data[lx->pos] == '%')
+            {
+            while (lx->pos < lx->size && lx->data[lx->pos] != '\r' && lx->data[lx->pos] != '\n')
+                {
+                lx->pos++;
+                }
+            }
+        else if (is_space((unsigned char)lx->data[lx->pos]))
+            {
+            lx->pos++;
+            }
+        else
+            {
+            break;
+            }
+        }
+    }
+
+
+static std::string lex_word(PdfLexer *lx)
+    {
+    size_t start;
+
+    lex_skip(lx);
+    start = lx->pos;
+    while (lx->pos < lx->size && !is_space((unsigned char)lx->data[lx->pos]) && !is_delimiter((unsigned char)lx->data[lx->pos]))
+        {
+        lx->pos++;
+        }
+    return std::string(lx->data + start, lx->pos - start);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Parse one PDF value; "N G R" becomes a reference.
+**
+**  Returns:        FALSE on a syntax error or the end of the data.
+**
+**------------------------------------------------------------------------*/
+
+static bool parse_value(PdfLexer *lx, PdfValue *value, int depth)
+    {
+    PdfValue item;
+    size_t   start;
+    size_t   save;
+    int      nest = 0;
+    int      c;
+
+    lex_skip(lx);
+    if (lx->pos >= lx->size || depth > OVERLAY_MAX_DEPTH)
+        {
+        return FALSE;
+        }
+    value->items.clear();
+    value->ref = 0;
+    start = lx->pos;
+    c = (unsigned char)lx->data[lx->pos];
+
+    if (c == '/')
+        {
+        lx->pos++;
+        lex_word(lx);
+        value->kind = PV_NAME;
+        }
+    else if (c == '(')
+        {
+        do
+            {
+            c = lx->data[lx->pos++];
+            if (c == '\\')
+                {
+                lx->pos++;
+                }
+            else if (c == '(')
+                {
+                nest++;
+                }
+            else if (c == ')')
+                {
+                nest--;
+                }
+            } while (nest > 0 && lx->pos < lx->size);
+        if (nest > 0)
+            {
+            return FALSE;
+            }
+        value->kind = PV_STRING;
+        }
+    else if (c == '<' && lx->pos + 1 < lx->size && lx->data[lx->pos + 1] == '<')
+        {
+        value->kind = PV_DICT;
+        lx->pos += 2;
+        for (;;)
+            {
+            lex_skip(lx);
+            if (lx->pos + 1 < lx->size && lx->data[lx->pos] == '>' && lx->data[lx->pos + 1] == '>')
+                {
+                lx->pos += 2;
+                break;
+                }
+            if (!parse_value(lx, &item, depth + 1) || item.kind != PV_NAME)
+                {
+                return FALSE;
+                }
+            value->items.push_back(item);
+            if (!parse_value(lx, &item, depth + 1))
+                {
+                return FALSE;
+                }
+            value->items.push_back(item);
+            }
+        }
+    else if (c == '<')
+        {
+        while (lx->pos < lx->size && lx->data[lx->pos] != '>')
+            {
+            lx->pos++;
+            }
+        if (lx->pos++ >= lx->size)
+            {
+            return FALSE;
+            }
+        value->kind = PV_STRING;
+        }
+    else if (c == '[')
+        {
+        value->kind = PV_ARRAY;
+        lx->pos++;
+        for (;;)
+            {
+            lex_skip(lx);
+            if (lx->pos < lx->size && lx->data[lx->pos] == ']')
+                {
+                lx->pos++;
+                break;
+                }
+            if (!parse_value(lx, &item, depth + 1))
+                {
+                return FALSE;
+                }
+            value->items.push_back(item);
+            }
+        }
+    else if (isdigit(c) || c == '+' || c == '-' || c == '.')
+        {
+        value->kind = PV_NUMBER;
+        value->text = lex_word(lx);
+        if (is_integer(value->text))
+            {
+            save = lx->pos;
+            if (is_integer(lex_word(lx)) && lex_word(lx) == "R")
+                {
+                value->kind = PV_REF;
+                value->ref = atoi(value->text.c_str());
+                return TRUE;
+                }
+            lx->pos = save;
+            }
+        return TRUE;
+        }
+    else
+        {
+        value->kind = PV_KEYWORD;
+        if (lex_word(lx).empty())
+            {
+            return FALSE;
+            }
+        }
+
+    if (value->kind == PV_ARRAY || value->kind == PV_DICT)
+        {
+        value->text.clear();
+        }
+    else
+        {
+        value->text.assign(lx->data + start, lx->pos - start);
+        }
+    return TRUE;
+    }
+
+
+static const PdfValue *dict_get(const PdfValue &dict, const char *key)
+    {
+    size_t i;
+
+    if (dict.kind != PV_DICT)
+        {
+        return NULL;
+        }
+    for (i = 0; i + 1 < dict.items.size(); i += 2)
+        {
+        if (dict.items[i].text == key)
+            {
+            return &dict.items[i + 1];
+            }
+        }
+    return NULL;
+    }
+
+
+static bool is_name(const PdfValue *value, const char *name)
+    {
+    return value != NULL && value->kind == PV_NAME && value->text == name;
+    }
+
+
+static long long to_integer(const PdfValue *value, long long fallback)
+    {
+    return (value != NULL && value->kind == PV_NUMBER) ? (long long)strtod(value->text.c_str(), NULL) : fallback;
+    }
+
+
+static bool inflate_append(void *context, const unsigned char *data, size_t length)
+    {
+    ((std::string *)context)->append((const char *)data, length);
+    return TRUE;
+    }
+
+
+static bool inflate_no_refill(InflateSource *source)
+    {
+    return FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Undo a PNG predictor (/Predictor 10 - 15).
+**
+**------------------------------------------------------------------------*/
+
+static bool png_unpredict(std::string *data, int colors, int bits, int columns)
+    {
+    int    bpp = (colors * bits + 7) / 8;
+    size_t row = (size_t)(colors * bits * columns + 7) / 8;
+    std::string out;
+    std::vector<unsigned char> prior(row, 0);
+    size_t at;
+    size_t i;
+
+    if (row == 0)
+        {
+        return FALSE;
+        }
+    for (at = 0; at + row + 1 <= data->size(); at += row + 1)
+        {
+        int filter = (unsigned char)(*data)[at];
+        unsigned char *cur = (unsigned char *)&(*data)[at + 1];
+
+        for (i = 0; i < row; i++)
+            {
+            int left = (i >= (size_t)bpp) ? cur[i - bpp] : 0;
+            int up = prior[i];
+            int corner = (i >= (size_t)bpp) ? prior[i - bpp] : 0;
+            int p, pa, pb, pc;
+
+            switch (filter)
+                {
+                    case 0:  break;
+                    case 1:  cur[i] = (unsigned char)(cur[i] + left);           break;
+                    case 2:  cur[i] = (unsigned char)(cur[i] + up);             break;
+                    case 3:  cur[i] = (unsigned char)(cur[i] + (left + up) / 2); break;
+                    case 4:
+                        p = left + up - corner;
+                        pa = abs(p - left);
+                        pb = abs(p - up);
+                        pc = abs(p - corner);
+                        cur[i] = (unsigned char)(cur[i] + ((pa <= pb && pa <= pc) ? left : (pb <= pc) ? up : corner));
+                        break;
+                    default: return FALSE;
+                }
+            }
+        out.append((const char *)cur, row);
+        memcpy(prior.data(), cur, row);
+        }
+    data->swap(out);
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decoded data of a stream (no filter or /FlateDecode).
+**
+**------------------------------------------------------------------------*/
+
+static bool decode_stream(const PdfObject &object, std::string *out)
+    {
+    const PdfValue *filter = dict_get(object.value, "/Filter");
+    const PdfValue *parms = dict_get(object.value, "/DecodeParms");
+    InflateSource   source;
+    long long       predictor;
+
+    if (filter != NULL && filter->kind == PV_ARRAY)
+        {
+        if (filter->items.size() > 1)
+            {
+            return FALSE;
+            }
+        filter = filter->items.empty() ? NULL : &filter->items[0];
+        parms = (parms != NULL && parms->kind == PV_ARRAY) ? (parms->items.empty() ? NULL : &parms->items[0]) : parms;
+        }
+
+    out->clear();
+    if (filter == NULL)
+        {
+        out->assign(object.stream, object.stream_length);
+        return TRUE;
+        }
+    if (!is_name(filter, "/FlateDecode") && !is_name(filter, "/Fl"))
+        {
+        return FALSE;
+        }
+
+    source.next = (const unsigned char *)object.stream;
+    source.avail = object.stream_length;
+    source.refill = inflate_no_refill;
+    source.write = inflate_append;
+    source.context = out;
+    if (inflate_zlib(&source) != INFLATE_OK)
+        {
+        return FALSE;
+        }
+
+    predictor = (parms != NULL) ? to_integer(dict_get(*parms, "/Predictor"), 1) : 1;
+    if (predictor >= 10)
+        {
+        return png_unpredict(out, (int)to_integer(dict_get(*parms, "/Colors"), 1),
+                             (int)to_integer(dict_get(*parms, "/BitsPerComponent"), 8),
+                             (int)to_integer(dict_get(*parms, "/Columns"), 1));
+        }
+    return predictor == 1;
+    }
+
+
+static bool read_object(int number, PdfObject *object);
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Parse the indirect object ("N G obj ...") at an
+**                  offset of the source, with its stream data.
+**
+**------------------------------------------------------------------------*/
+
+static bool parse_object_at(long long offset, int *number, PdfObject *object)
+    {
+    PdfLexer  lx = { overlay_source.data(), overlay_source.size(), (size_t)offset };
+    PdfObject length;
+    std::string word;
+    long long count;
+    size_t    end;
+
+    if (offset < 0 || (size_t)offset >= overlay_source.size())
+        {
+        return FALSE;
+        }
+    word = lex_word(&lx);
+    if (!is_integer(word) || !is_integer(lex_word(&lx)) || lex_word(&lx) != "obj" || !parse_value(&lx, &object->value, 0))
+        {
+        return FALSE;
+        }
+    *number = atoi(word.c_str());
+    object->stream = NULL;
+    object->stream_length = 0;
+
+    lex_skip(&lx);
+    if (object->value.kind != PV_DICT || overlay_source.compare(lx.pos, 6, "stream") != 0)
+        {
+        return TRUE;
+        }
+    lx.pos += 6;
+    if (lx.pos < lx.size && lx.data[lx.pos] == '\r')
+        {
+        lx.pos++;
+        }
+    if (lx.pos < lx.size && lx.data[lx.pos] == '\n')
+        {
+        lx.pos++;
+        }
+
+    const PdfValue *value = dict_get(object->value, "/Length");
+    count = -1;
+    if (value != NULL && value->kind == PV_REF && read_object(value->ref, &length))
+        {
+        value = &length.value;
+        }
+    count = to_integer(value, -1);
+
+    /*
+    **  A wrong /Length is common enough: fall back to "endstream"
+    */
+    if (count >= 0 && lx.pos + (size_t)count <= lx.size)
+        {
+        PdfLexer check = lx;
+
+        check.pos += (size_t)count;
+        lex_skip(&check);
+        if (overlay_source.compare(check.pos, 9, "endstream") != 0)
+            {
+            count = -1;
+            }
+        }
+    else
+        {
+        count = -1;
+        }
+    if (count < 0)
+        {
+        end = overlay_source.find("endstream", lx.pos);
+        if (end == std::string::npos)
+            {
+            return FALSE;
+            }
+        if (end > lx.pos && lx.data[end - 1] == '\n')
+            {
+            end--;
+            }
+        if (end > lx.pos && lx.data[end - 1] == '\r')
+            {
+            end--;
+            }
+        count = (long long)(end - lx.pos);
+        }
+    object->stream = lx.data + lx.pos;
+    object->stream_length = (size_t)count;
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decoded object stream number `number`.
+**
+**------------------------------------------------------------------------*/
+
+static const std::string *object_stream(int number)
+    {
+    auto found = overlay_streams.find(number);
+    PdfObject stream;
+    std::string data;
+
+    if (found != overlay_streams.end())
+        {
+        return &found->second;
+        }
+    if (!read_object(number, &stream) || stream.stream == NULL || !decode_stream(stream, &data))
+        {
+        return NULL;
+        }
+    std::string &kept = overlay_streams[number];
+    kept.swap(data);
+    return &kept;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read object `number` through the cross-reference
+**                  table.
+**
+**  Returns:        FALSE if it is missing or damaged (a null object).
+**
+**------------------------------------------------------------------------*/
+
+static bool read_object(int number, PdfObject *object)
+    {
+    auto       entry = overlay_xref.find(number);
+    PdfObject  stream;
+    PdfLexer   lx;
+    const std::string *data;
+    long long  first;
+    long long  offset = -1;
+    int        found = -1;
+    int        i;
+    bool       ok = FALSE;
+
+    if (entry == overlay_xref.end() || overlay_depth >= OVERLAY_MAX_DEPTH)
+        {
+        return FALSE;
+        }
+    overlay_depth++;
+
+    if (entry->second.type == 1)
+        {
+        ok = parse_object_at(entry->second.offset, &found, object) && found == number;
+        }
+    else if ((data = object_stream((int)entry->second.offset)) != NULL &&
+             read_object((int)entry->second.offset, &stream))
+        {
+        /*
+        **  The object stream starts with N pairs "number offset"
+        */
+        lx.data = data->data();
+        lx.size = data->size();
+        lx.pos = 0;
+        first = to_integer(dict_get(stream.value, "/First"), 0);
+        for (i = 0; i <= entry->second.index; i++)
+            {
+            found = atoi(lex_word(&lx).c_str());
+            offset = atoll(lex_word(&lx).c_str());
+            }
+        if (found == number && first + offset >= 0 && (size_t)(first + offset) < lx.size)
+            {
+            lx.pos = (size_t)(first + offset);
+            object->stream = NULL;
+            object->stream_length = 0;
+            ok = parse_value(&lx, &object->value, 0);
+            }
+        }
+
+    overlay_depth--;
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read one cross-reference section (table or stream).
+**
+**  Parameters:     Name        Description.
+**                  offset      Where it starts.
+**                  trailer     Receives its trailer dictionary.
+**
+**------------------------------------------------------------------------*/
+
+static bool read_xref_section(long long offset, PdfValue *trailer)
+    {
+    PdfLexer    lx = { overlay_source.data(), overlay_source.size(), (size_t)offset };
+    PdfObject   stream;
+    std::string data;
+    std::string word;
+    XrefEntry   entry;
+    long long   start;
+    long long   count;
+    long long   field[3];
+    int         width[3];
+    int         number;
+    size_t      at = 0;
+    size_t      i;
+    int         f;
+    int         k;
+
+    if (offset <= 0 || (size_t)offset >= overlay_source.size())
+        {
+        return FALSE;
+        }
+
+    if (lex_word(&lx) == "xref")
+        {
+        for (;;)
+            {
+            word = lex_word(&lx);
+            if (word == "trailer")
+                {
+                return parse_value(&lx, trailer, 0) && trailer->kind == PV_DICT;
+                }
+            if (!is_integer(word))
+                {
+                return FALSE;
+                }
+            start = atoll(word.c_str());
+            count = atoll(lex_word(&lx).c_str());
+            for (k = 0; k < count; k++)
+                {
+                entry.offset = atoll(lex_word(&lx).c_str());
+                lex_word(&lx);
+                word = lex_word(&lx);
+                if (word != "n" && word != "f")
+                    {
+                    return FALSE;
+                    }
+                entry.type = 1;
+                entry.index = 0;
+                if (word == "n" && overlay_xref.count((int)(start + k)) == 0)
+                    {
+                    overlay_xref[(int)(start + k)] = entry;
+                    }
+                }
+            }
+        }
+
+    /*
+    **  PDF 1.5 cross-reference stream
+    */
+    if (!parse_object_at(offset, &number, &stream) || stream.stream == NULL ||
+        !is_name(dict_get(stream.value, "/Type"), "/XRef") || !decode_stream(stream, &data))
+        {
+        return FALSE;
+        }
+    const PdfValue *w = dict_get(stream.value, "/W");
+    const PdfValue *index = dict_get(stream.value, "/Index");
+    PdfValue        whole;
+
+    if (w == NULL || w->kind != PV_ARRAY || w->items.size() != 3)
+        {
+        return FALSE;
+        }
+    for (f = 0; f < 3; f++)
+        {
+        width[f] = (int)to_integer(&w->items[f], 0);
+        if (width[f] < 0 || width[f] > 8)
+            {
+            return FALSE;
+            }
+        }
+    if ((index == NULL || index->kind != PV_ARRAY) && dict_get(stream.value, "/Size") == NULL)
+        {
+        return FALSE;
+        }
+    if (index == NULL || index->kind != PV_ARRAY)
+        {
+        whole.kind = PV_ARRAY;
+        whole.items.resize(2);
+        whole.items[0].kind = PV_NUMBER;
+        whole.items[0].text = "0";
+        whole.items[1] = *dict_get(stream.value, "/Size");
+        index = &whole;
+        }
+
+    for (i = 0; i + 1 < index->items.size(); i += 2)
+        {
+        start = to_integer(&index->items[i], 0);
+        count = to_integer(&index->items[i + 1], 0);
+        for (k = 0; k < count && at + width[0] + width[1] + width[2] <= data.size(); k++)
+            {
+            for (f = 0; f < 3; f++)
+                {
+                field[f] = 0;
+                while (width[f]-- > 0)
+                    {
+                    field[f] = (field[f] << 8) | (unsigned char)data[at++];
+                    }
+                width[f] = (int)to_integer(&w->items[f], 0);
+                }
+            entry.type = (width[0] == 0) ? 1 : (int)field[0];
+            entry.offset = field[1];
+            entry.index = (int)field[2];
+            if ((entry.type == 1 || entry.type == 2) && overlay_xref.count((int)(start + k)) == 0)
+                {
+                overlay_xref[(int)(start + k)] = entry;
+                }
+            }
+        }
+    *trailer = stream.value;
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the cross-reference sections from startxref
+**                  back through /Prev (newest entries win).
+**
+**------------------------------------------------------------------------*/
+
+static bool read_xref(PdfValue *trailer)
+    {
+    std::unordered_set<long long> seen;
+    PdfValue  section;
+    PdfValue  hybrid;
+    PdfLexer  lx;
+    size_t    at = overlay_source.rfind("startxref");
+    long long offset;
+    bool      is_first = TRUE;
+
+    if (at == std::string::npos)
+        {
+        return FALSE;
+        }
+    lx.data = overlay_source.data();
+    lx.size = overlay_source.size();
+    lx.pos = at + 9;
+    offset = atoll(lex_word(&lx).c_str());
+
+    while (offset > 0 && seen.insert(offset).second)
+        {
+        if (!read_xref_section(offset, &section))
+            {
+            return FALSE;
+            }
+        if (is_first)
+            {
+            *trailer = section;
+            is_first = FALSE;
+            }
+        if (dict_get(section, "/XRefStm") != NULL &&
+            !read_xref_section(to_integer(dict_get(section, "/XRefStm"), 0), &hybrid))
+            {
+            return FALSE;
+            }
+        offset = to_integer(dict_get(section, "/Prev"), 0);
+        }
+    return !is_first;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Rebuild the cross-reference table of a damaged file
+**                  by finding every "N G obj" (the last one wins) and
+**                  the objects in its object streams.
+**
+**------------------------------------------------------------------------*/
+
+static bool rebuild_xref(PdfValue *trailer)
+    {
+    std::vector<int> numbers;
+    PdfObject   object;
+    PdfValue    found;
+    PdfLexer    lx;
+    XrefEntry   entry;
+    const std::string *data;
+    size_t      at = 0;
+    size_t      start;
+    int         number;
+    long long   n;
+    int         i;
+
+    overlay_xref.clear();
+    trailer->kind = PV_DICT;
+    trailer->items.clear();
+
+    while ((at = overlay_source.find("obj", at)) != std::string::npos)
+        {
+        start = at;
+        while (start > 0 && is_space((unsigned char)overlay_source[start - 1])) start--;
+        while (start > 0 && isdigit((unsigned char)overlay_source[start - 1])) start--;
+        while (start > 0 && is_space((unsigned char)overlay_source[start - 1])) start--;
+        while (start > 0 && isdigit((unsigned char)overlay_source[start - 1])) start--;
+        at += 3;
+        if (start < at - 3 && parse_object_at((long long)start, &number, &object))
+            {
+            entry.type = 1;
+            entry.offset = (long long)start;
+            entry.index = 0;
+            overlay_xref[number] = entry;
+            }
+        }
+
+    for (auto &it : overlay_xref)
+        {
+        numbers.push_back(it.first);
+        }
+    for (int stream : numbers)
+        {
+        if (!read_object(stream, &object))
+            {
+            continue;
+            }
+        if (is_name(dict_get(object.value, "/Type"), "/Catalog"))
+            {
+            found.kind = PV_REF;
+            found.ref = stream;
+            trailer->items.resize(2);
+            trailer->items[0].kind = PV_NAME;
+            trailer->items[0].text = "/Root";
+            trailer->items[1] = found;
+            }
+        if (object.stream == NULL || !is_name(dict_get(object.value, "/Type"), "/ObjStm") ||
+            (data = object_stream(stream)) == NULL)
+            {
+            continue;
+            }
+        lx.data = data->data();
+        lx.size = data->size();
+        lx.pos = 0;
+        n = to_integer(dict_get(object.value, "/N"), 0);
+        for (i = 0; i < n; i++)
+            {
+            number = atoi(lex_word(&lx).c_str());
+            lex_word(&lx);
+            entry.type = 2;
+            entry.offset = stream;
+            entry.index = i;
+            if (overlay_xref.count(number) == 0)
+                {
+                overlay_xref[number] = entry;
+                }
+            }
+        }
+
+    /*
+    **  Objects inside object streams may hold the catalog too
+    */
+    if (dict_get(*trailer, "/Root") == NULL)
+        {
+        for (auto &it : overlay_xref)
+            {
+            if (it.second.type == 2 && read_object(it.first, &object) &&
+                is_name(dict_get(object.value, "/Type"), "/Catalog"))
+                {
+                found.kind = PV_REF;
+                found.ref = it.first;
+                trailer->items.resize(2);
+                trailer->items[0].kind = PV_NAME;
+                trailer->items[0].text = "/Root";
+                trailer->items[1] = found;
+                break;
+                }
+            }
+        }
+    return dict_get(*trailer, "/Root") != NULL;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Find page `wanted` (from 1) in the page tree, with
+**                  the /Resources and /MediaBox it inherits.
+**
+**------------------------------------------------------------------------*/
+
+static bool find_page(const PdfValue &node, int wanted, int *passed, int depth,
+                      PdfValue resources, PdfValue box, PdfObject *page, PdfValue *page_resources, PdfValue *page_box)
+    {
+    PdfObject object;
+    PdfObject array;
+    const PdfValue *kids;
+    const PdfValue *value;
+    long long count;
+    size_t    i;
+
+    if (node.kind != PV_REF || depth > OVERLAY_MAX_DEPTH || !read_object(node.ref, &object))
+        {
+        return FALSE;
+        }
+    if ((value = dict_get(object.value, "/Resources")) != NULL)
+        {
+        resources = *value;
+        }
+    if ((value = dict_get(object.value, "/MediaBox")) != NULL)
+        {
+        box = *value;
+        }
+
+    kids = dict_get(object.value, "/Kids");
+    if (kids != NULL && kids->kind == PV_REF && read_object(kids->ref, &array))
+        {
+        kids = &array.value;
+        }
+    if (kids != NULL && kids->kind == PV_ARRAY)
+        {
+        count = to_integer(dict_get(object.value, "/Count"), -1);
+        if (count >= 0 && *passed + count < wanted)
+            {
+            *passed += (int)count;
+            return FALSE;
+            }
+        for (i = 0; i < kids->items.size(); i++)
+            {
+            if (find_page(kids->items[i], wanted, passed, depth + 1, resources, box, page, page_resources, page_box))
+                {
+                return TRUE;
+                }
+            }
+        return FALSE;
+        }
+
+    if (++*passed != wanted)
+        {
+        return FALSE;
+        }
+    *page = object;
+    *page_resources = resources;
+    *page_box = box;
+    return TRUE;
+    }
+
+
+static void put_text(OverlayBuilder *b, const char *text, size_t length)
+    {
+    if (length == 0)
+        {
+        return;
+        }
+    if (b->is_word && !is_delimiter((unsigned char)text[0]))
+        {
+        b->object->body += ' ';
+        }
+    b->object->body.append(text, length);
+    b->is_word = !is_delimiter((unsigned char)text[length - 1]) && !is_space((unsigned char)text[length - 1]);
+    }
+
+
+static void put_text(OverlayBuilder *b, const std::string &text)
+    {
+    put_text(b, text.data(), text.size());
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Overlay object for source object `number`; the
+**                  object is copied later.
+**
+**------------------------------------------------------------------------*/
+
+static int overlay_local(int number)
+    {
+    auto found = overlay_locals.find(number);
+    int  local;
+
+    if (found != overlay_locals.end())
+        {
+        return found->second;
+        }
+    local = (int)overlay_locals.size() + 1;         /* 0 is the form */
+    overlay_locals[number] = local;
+    overlay_pending.push_back(number);
+    return local;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write a value with its references renumbered.
+**
+**  Parameters:     Name        Description.
+**                  b           Object being built.
+**                  value       Value to write.
+**                  length      For a stream dictionary: the /Length to
+**                              write instead of the source's (else -1).
+**
+**------------------------------------------------------------------------*/
+
+static void put_value(OverlayBuilder *b, const PdfValue &value, long long length)
+    {
+    char   text[32];
+    size_t i;
+
+    switch (value.kind)
+        {
+            case PV_REF:
+                if (b->is_word)
+                    {
+                    b->object->body += ' ';
+                    }
+                b->object->refs.push_back(std::make_pair((unsigned)b->object->body.size(), overlay_local(value.ref)));
+                b->is_word = TRUE;
+                break;
+
+            case PV_ARRAY:
+                put_text(b, "[", 1);
+                for (i = 0; i < value.items.size(); i++)
+                    {
+                    put_value(b, value.items[i], -1);
+                    }
+                put_text(b, "]", 1);
+                break;
+
+            case PV_DICT:
+                put_text(b, "<<", 2);
+                for (i = 0; i + 1 < value.items.size(); i += 2)
+                    {
+                    if (length >= 0 && value.items[i].text == "/Length")
+                        {
+                        continue;
+                        }
+                    put_text(b, value.items[i].text);
+                    put_value(b, value.items[i + 1], -1);
+                    }
+                if (length >= 0)
+                    {
+                    snprintf(text, sizeof(text), "/Length %lld", length);
+                    put_text(b, text, strlen(text));
+                    }
+                put_text(b, ">>", 2);
+                break;
+
+            default:
+                put_text(b, value.text);
+                break;
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy source object `number` as overlay object `local`.
+**                  Pages and the document catalog are not followed (an
+**                  annotation's /P would pull in the whole document).
+**
+**------------------------------------------------------------------------*/
+
+static void copy_object(int number, int local)
+    {
+    OverlayObject  object;
+    OverlayBuilder b = { &object, FALSE };
+    PdfObject      source;
+    const PdfValue *type;
+
+    if (!read_object(number, &source))
+        {
+        object.body = "null";
+        }
+    else if ((type = dict_get(source.value, "/Type")) != NULL &&
+             (is_name(type, "/Page") || is_name(type, "/Pages") || is_name(type, "/Catalog")))
+        {
+        object.body = "null";
+        }
+    else if (source.stream == NULL)
+        {
+        put_value(&b, source.value, -1);
+        }
+    else
+        {
+        put_value(&b, source.value, (long long)source.stream_length);
+        object.body += "stream\n";
+        object.body.append(source.stream, source.stream_length);
+        object.body += "\nendstream";
+        }
+
+    if ((int)overlay_objects.size() <= local)
+        {
+        overlay_objects.resize(local + 1);
+        }
+    overlay_objects[local].body.swap(object.body);
+    overlay_objects[local].refs.swap(object.refs);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Object 0: a form XObject of the given content.
+**
+**------------------------------------------------------------------------*/
+
+static void put_form(OverlayBuilder *b, const char *box, const PdfValue *resources, const PdfObject *filtered,
+                     const std::string &content)
+    {
+    char text[64];
+
+    put_text(b, "<</Type/XObject/Subtype/Form/BBox");
+    put_text(b, box, strlen(box));
+    put_text(b, "/Resources", 10);
+    if (resources != NULL)
+        {
+        put_value(b, *resources, -1);
+        }
+    else
+        {
+        put_text(b, "<<>>", 4);
+        }
+    if (filtered != NULL)
+        {
+        if (dict_get(filtered->value, "/Filter") != NULL)
+            {
+            put_text(b, "/Filter", 7);
+            put_value(b, *dict_get(filtered->value, "/Filter"), -1);
+            }
+        if (dict_get(filtered->value, "/DecodeParms") != NULL)
+            {
+            put_text(b, "/DecodeParms", 12);
+            put_value(b, *dict_get(filtered->value, "/DecodeParms"), -1);
+            }
+        }
+    snprintf(text, sizeof(text), "/Length %lu>>", (unsigned long)content.size());
+    put_text(b, text, strlen(text));
+    b->object->body += "stream\n";
+    b->object->body += content;
+    b->object->body += "\nendstream";
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Compile page `page` of the PDF in overlay_source.
+**
+**------------------------------------------------------------------------*/
+
+static const char *compile_pdf(int page)
+    {
+    PdfValue   trailer;
+    PdfValue   resources;
+    PdfValue   box;
+    PdfValue   page_resources;
+    PdfValue   page_box;
+    PdfObject  catalog;
+    PdfObject  object;
+    PdfObject  part;
+    PdfObject *single = NULL;
+    std::vector<int> parts;
+    std::string content;
+    std::string data;
+    std::string box_text;
+    OverlayBuilder b;
+    int        passed = 0;
+    size_t     i;
+
+    overlay_source.erase(0, overlay_source.find("%PDF-"));
+    if (!read_xref(&trailer) || dict_get(trailer, "/Root") == NULL)
+        {
+        overlay_xref.clear();
+        if (!rebuild_xref(&trailer))
+            {
+            return "no document catalog";
+            }
+        }
+    if (dict_get(trailer, "/Encrypt") != NULL)
+        {
+        return "encrypted PDFs are not supported";
+        }
+    if (!read_object(dict_get(trailer, "/Root")->ref, &catalog) || dict_get(catalog.value, "/Pages") == NULL)
+        {
+        return "no page tree";
+        }
+    resources.kind = PV_KEYWORD;
+    box.kind = PV_KEYWORD;
+    if (!find_page(*dict_get(catalog.value, "/Pages"), page, &passed, 0, resources, box, &object, &page_resources, &page_box))
+        {
+        return "no such page";
+        }
+
+    /*
+    **  One content stream is copied as it is, several are joined
+    */
+    const PdfValue *contents = dict_get(object.value, "/Contents");
+    PdfObject       array;
+
+    if (contents != NULL && contents->kind == PV_REF && read_object(contents->ref, &array) && array.stream == NULL)
+        {
+        contents = &array.value;
+        }
+    if (contents != NULL && contents->kind == PV_REF)
+        {
+        parts.push_back(contents->ref);
+        }
+    else if (contents != NULL && contents->kind == PV_ARRAY)
+        {
+        for (i = 0; i < contents->items.size(); i++)
+            {
+            if (contents->items[i].kind == PV_REF)
+                {
+                parts.push_back(contents->items[i].ref);
+                }
+            }
+        }
+    if (parts.size() == 1 && read_object(parts[0], &part) && part.stream != NULL)
+        {
+        content.assign(part.stream, part.stream_length);
+        single = &part;
+        }
+    else
+        {
+        for (i = 0; i < parts.size(); i++)
+            {
+            if (!read_object(parts[i], &part) || part.stream == NULL || !decode_stream(part, &data))
+                {
+                return "page content uses an unsupported filter";
+                }
+            content += data;
+            content += '\n';
+            }
+        }
+
+    box_text = "[";
+    for (i = 0; page_box.kind == PV_ARRAY && page_box.items.size() == 4 && i < 4 && page_box.items[i].kind == PV_NUMBER; i++)
+        {
+        box_text += page_box.items[i].text + ((i < 3) ? " " : "]");
+        }
+    if (i < 4)
+        {
+        box_text = "[0 0 612 792]";                 /* US Letter, the PDF default */
+        }
+
+    overlay_objects.resize(1);
+    b.object = &overlay_objects[0];
+    b.is_word = FALSE;
+    put_form(&b, box_text.c_str(), (page_resources.kind == PV_KEYWORD) ? NULL : &page_resources, single, content);
+
+    /*
+    **  Copy everything the resources reach
+    */
+    while (!overlay_pending.empty())
+        {
+        int number = overlay_pending.front();
+
+        overlay_pending.pop_front();
+        copy_object(number, overlay_locals[number]);
+        }
+    return NULL;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Compile the JPEG in overlay_source, scaled to the page.
+**
+**------------------------------------------------------------------------*/
+
+static const char *compile_jpeg(float width, float depth)
+    {
+    const unsigned char *d = (const unsigned char *)overlay_source.data();
+    size_t n = overlay_source.size();
+    size_t at = 2;
+    bool   is_adobe = FALSE;
+    int    components = 0;
+    int    pixels_wide = 0;
+    int    pixels_deep = 0;
+    int    marker;
+    char   text[256];
+    OverlayBuilder b;
+
+    while (at + 4 <= n && d[at] == 0xFF)
+        {
+        marker = d[at + 1];
+        if (marker == 0xFF)
+            {
+            at++;
+            continue;
+            }
+        if (marker == 0xDA)                         /* start of scan */
+            {
+            break;
+            }
+        if (marker == 0xEE && at + 9 <= n && memcmp(d + at + 4, "Adobe", 5) == 0)
+            {
+            is_adobe = TRUE;
+            }
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC && at + 10 <= n)
+            {
+            pixels_deep = (d[at + 5] << 8) | d[at + 6];
+            pixels_wide = (d[at + 7] << 8) | d[at + 8];
+            components = d[at + 9];
+            }
+        at += 2 + ((d[at + 2] << 8) | d[at + 3]);
+        }
+    if (components != 1 && components != 3 && components != 4)
+        {
+        return "no JPEG frame header";
+        }
+
+    overlay_objects.resize(2);
+    b.object = &overlay_objects[0];
+    b.is_word = FALSE;
+    snprintf(text, sizeof(text), "[0 0 %g %g]", width, depth);
+    put_text(&b, "<</Type/XObject/Subtype/Form/BBox");
+    put_text(&b, text, strlen(text));
+    put_text(&b, "/Resources<</XObject<</Im0");
+    b.object->body += ' ';
+    b.object->refs.push_back(std::make_pair((unsigned)b.object->body.size(), 1));
+    b.is_word = TRUE;
+    snprintf(text, sizeof(text), "q %g 0 0 %g 0 0 cm /Im0 Do Q\n", width, depth);
+    put_text(&b, ">> >>/Length", 12);
+    b.object->body += " " + std::to_string(strlen(text)) + ">>stream\n" + text + "\nendstream";
+
+    /*
+    **  Adobe CMYK JPEGs are stored inverted
+    */
+    snprintf(text, sizeof(text), "<</Type/XObject/Subtype/Image/Width %d/Height %d/ColorSpace/%s/BitsPerComponent 8%s/Filter/DCTDecode/Length %lu>>stream\n",
+             pixels_wide, pixels_deep, (components == 1) ? "DeviceGray" : (components == 3) ? "DeviceRGB" : "DeviceCMYK",
+             (components == 4 && is_adobe) ? "/Decode[1 0 1 0 1 0 1 0]" : "", (unsigned long)n);
+    overlay_objects[1].body = text;
+    overlay_objects[1].body += overlay_source;
+    overlay_objects[1].body += "\nendstream";
+    return NULL;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a compiled overlay saved by an earlier run.
+**
+**------------------------------------------------------------------------*/
+
+static bool read_compiled(const char *path, const unsigned char *key)
+    {
+    FILE      *file = fopen(path, "rb");
+    unsigned char saved[SHA256_BYTES];
+    char       magic[8];
+    unsigned   length;
+    int        count = 0;
+    int        refs;
+    int        i;
+    int        r;
+    bool       ok;
+
+    if (file == NULL)
+        {
+        return FALSE;
+        }
+    ok = fread(magic, 1, 8, file) == 8 && memcmp(magic, OVERLAY_MAGIC, 8) == 0 &&
+         fread(saved, sizeof(saved), 1, file) == 1 && memcmp(saved, key, sizeof(saved)) == 0 &&
+         fread(&count, sizeof(count), 1, file) == 1 && count > 0 && count < (1 << 24);
+    if (ok)
+        {
+        overlay_objects.resize(count);
+        }
+    for (i = 0; ok && i < count; i++)
+        {
+        OverlayObject &object = overlay_objects[i];
+
+        ok = fread(&length, sizeof(length), 1, file) == 1;
+        if (ok)
+            {
+            object.body.resize(length);
+            ok = (length == 0 || fread(&object.body[0], 1, length, file) == length) &&
+                 fread(&refs, sizeof(refs), 1, file) == 1 && refs >= 0 && refs < (1 << 24);
+            }
+        for (r = 0; ok && r < refs; r++)
+            {
+            std::pair<unsigned, int> ref;
+
+            ok = fread(&ref.first, sizeof(ref.first), 1, file) == 1 && fread(&ref.second, sizeof(ref.second), 1, file) == 1 &&
+                 ref.first <= length && ref.second >= 0 && ref.second < count;
+            object.refs.push_back(ref);
+            }
+        }
+    fclose(file);
+    if (!ok)
+        {
+        overlay_objects.clear();
+        }
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Save the compiled overlay for the next run; written
+**                  to a private file and renamed, as the workers of a
+**                  watch may all try at once.
+**
+**------------------------------------------------------------------------*/
+
+static void write_compiled(const char *path, const unsigned char *key)
+    {
+    char   temp[1100];
+    FILE  *file;
+    int    count = (int)overlay_objects.size();
+    int    refs;
+    bool   ok;
+    size_t i;
+    size_t r;
+
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)_getpid());
+    file = fopen(temp, "wb");
+    if (file == NULL)
+        {
+        return;
+        }
+    ok = fwrite(OVERLAY_MAGIC, 1, 8, file) == 8 && fwrite(key, SHA256_BYTES, 1, file) == 1 &&
+         fwrite(&count, sizeof(count), 1, file) == 1;
+    for (i = 0; ok && i < overlay_objects.size(); i++)
+        {
+        const OverlayObject &object = overlay_objects[i];
+        unsigned length = (unsigned)object.body.size();
+
+        refs = (int)object.refs.size();
+        ok = fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(object.body.data(), 1, length, file) == length &&
+             fwrite(&refs, sizeof(refs), 1, file) == 1;
+        for (r = 0; ok && r < object.refs.size(); r++)
+            {
+            ok = fwrite(&object.refs[r].first, sizeof(object.refs[r].first), 1, file) == 1 &&
+                 fwrite(&object.refs[r].second, sizeof(object.refs[r].second), 1, file) == 1;
+            }
+        }
+    if (fclose(file) != 0 || !ok)
+        {
+        remove(temp);
+        return;
+        }
+    remove(path);
+    if (rename(temp, path) != 0)
+        {
+        remove(temp);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Directory for compiled overlays: the -c cache
+**                  directory, else one only this user can write to.
+**
+**  Returns:        FALSE if there is none (the overlay is then compiled
+**                  on every run).
+**
+**------------------------------------------------------------------------*/
+
+static bool overlay_directory(const char *cache, char *directory, size_t size)
+    {
+#ifdef _WIN32
+    DWORD       length;
+#else
+    const char *temp = getenv("TMPDIR");
+    struct stat st;
+#endif
+
+    if (cache != NULL && cache[0] != '\0')
+        {
+        return snprintf(directory, size, "%s", cache) < (int)size;
+        }
+
+#ifdef _WIN32
+    /*
+    **  %TEMP% is under the user's profile
+    */
+    length = GetTempPathA((DWORD)size, directory);
+    if (length == 0 || length >= size)
+        {
+        return FALSE;
+        }
+    if (directory[length - 1] == '\\')
+        {
+        directory[length - 1] = '\0';
+        }
+    return TRUE;
+#else
+    /*
+    **  /tmp is shared: use a directory of our own, and not one someone
+    **  else made first
+    */
+    if (temp == NULL || temp[0] == '\0')
+        {
+        temp = "/tmp";
+        }
+    if (snprintf(directory, size, "%s/txt2pdf-%ld", temp, (long)getuid()) >= (int)size)
+        {
+        return FALSE;
+        }
+    mkdir(directory, 0700);
+    return lstat(directory, &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 077) == 0;
+#endif
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load the overlay, from its compiled copy if that is
+**                  current.
+**
+**  Parameters:     Name        Description.
+**                  path        PDF, JPEG or drawing operators.
+**                  page        Page of a PDF (from 1).
+**                  width       Page size, for JPEG and operator files.
+**                  depth
+**                  cache       -c directory for the compiled copy, NULL
+**                              or "" for the user's temporary directory.
+**
+**  Returns:        FALSE (after a message) if it cannot be used.
+**
+**------------------------------------------------------------------------*/
+
+bool overlay_load(const char *path, int page, float width, float depth, const char *cache)
+    {
+    Sha256        sha;
+    unsigned char key[SHA256_BYTES];
+    char          directory[1024];
+    char          compiled[1100];
+    const char   *problem;
+    FILE         *file;
+    size_t        length;
+    char          block[65536];
+    int           i;
+
+    if ((file = fopen(path, "rb")) == NULL)
+        {
+        fprintf(stderr, "(error) Unable to open overlay %s.\n", path);
+        return FALSE;
+        }
+
+    overlay_source.clear();
+    while ((length = fread(block, 1, sizeof(block), file)) > 0)
+        {
+        overlay_source.append(block, length);
+        }
+    fclose(file);
+
+    /*
+    **  Hashing the bytes is cheap next to parsing them, and unlike a
+    **  size and time it cannot be fooled by a copy or a restore
+    */
+    sha256_init(&sha);
+    sha256_update(&sha, overlay_source.data(), overlay_source.size());
+    sha256_update(&sha, &page, sizeof(page));
+    sha256_update(&sha, &width, sizeof(width));
+    sha256_update(&sha, &depth, sizeof(depth));
+    sha256_final(&sha, key);
+
+    compiled[0] = '\0';
+    if (overlay_directory(cache, directory, sizeof(directory)))
+        {
+        length = snprintf(compiled, sizeof(compiled), "%s" OVERLAY_SEPARATOR, directory);
+        for (i = 0; i < SHA256_BYTES; i++)
+            {
+            length += snprintf(compiled + length, sizeof(compiled) - length, "%02x", key[i]);
+            }
+        snprintf(compiled + length, sizeof(compiled) - length, ".t2o");
+        }
+    if (compiled[0] != '\0' && read_compiled(compiled, key))
+        {
+        overlay_source.clear();
+        overlay_source.shrink_to_fit();
+        return TRUE;
+        }
+
+    if (overlay_source.find("%PDF-") < 1024)
+        {
+        problem = compile_pdf(page);
+        }
+    else if (overlay_source.size() > 3 && (unsigned char)overlay_source[0] == 0xFF && (unsigned char)overlay_source[1] == 0xD8)
+        {
+        problem = compile_jpeg(width, depth);
+        }
+    else
+        {
+        /*
+        **  Drawing operators, in page coordinates
+        */
+        OverlayBuilder b;
+        char box[64];
+
+        overlay_objects.resize(1);
+        b.object = &overlay_objects[0];
+        b.is_word = FALSE;
+        snprintf(box, sizeof(box), "[0 0 %g %g]", width, depth);
+        put_form(&b, box, NULL, NULL, overlay_source);
+        problem = NULL;
+        }
+
+    overlay_source.clear();
+    overlay_source.shrink_to_fit();
+    overlay_xref.clear();
+    overlay_streams.clear();
+    overlay_locals.clear();
+    overlay_pending.clear();
+
+    if (problem != NULL)
+        {
+        fprintf(stderr, "(error) Overlay %s: %s.\n", path, problem);
+        overlay_objects.clear();
+        return FALSE;
+        }
+    if (compiled[0] != '\0')
+        {
+        write_compiled(compiled, key);
+        }
+    return TRUE;
+    }
+
+
+int overlay_object_count()
+    {
+    return (int)overlay_objects.size();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the body of overlay object `index` (after the
+**                  caller's "N 0 obj") with its references moved up to
+**                  first_id, and "endobj".
+**
+**------------------------------------------------------------------------*/
+
+void overlay_write_object(int index, int first_id)
+    {
+    const OverlayObject &object = overlay_objects[index];
+    size_t at = 0;
+    size_t r;
+
+    for (r = 0; r < object.refs.size(); r++)
+        {
+        writer_write(object.body.data() + at, object.refs[r].first - at);
+        writer_printf("%d 0 R", first_id + object.refs[r].second);
+        at = object.refs[r].first;
+        }
+    writer_write(object.body.data() + at, object.body.size() - at);
+    writer_printf("\nendobj\n");
+    }
+
+
+void overlay_digest(Digest *digest)
+    {
+    size_t i;
+
+    for (i = 0; i < overlay_objects.size(); i++)
+        {
+        digest_update(digest, overlay_objects[i].body.data(), overlay_objects[i].body.size());
+        digest_update(digest, overlay_objects[i].refs.data(), overlay_objects[i].refs.size() * sizeof(overlay_objects[i].refs[0]));
+        }
+    }
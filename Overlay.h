@@ -0,0 +1,24 @@
+/**
+ *
+ *  Name: Overlay.h
+ *
+ *  Description:
+ *
+ *      Background form overlay for txt2pdf (-G): a page of an existing
+ *      PDF, a JPEG or a file of PDF drawing operators, imported once as
+ *      a form XObject that every page shows behind its text, the way a
+ *      listing was printed on pre-printed stationery.
+ *
+ */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "Digest.h"
+
+bool overlay_load(const char *path, int page, float width, float depth, const char *cache);
+int  overlay_object_count();
+void overlay_write_object(int index, int first_id);
+void overlay_digest(Digest *digest);
+
+#endif //OVERLAY_H
@@ -0,0 +1,346 @@
+/**
+ *
+ *  Name: PageCache.cpp
+ *
+ *  Description:
+ *
+ *      Per-page render cache for txt2pdf (-j).
+ *
+ *      The cache file holds the pages of the last conversion that wrote
+ *      it: "TXT2PGC2" followed by a PageCacheEntry and the content
+ *      stream bytes for each page.  Every run writes a fresh file (the
+ *      pages it reused plus the ones it rendered) next to the old one
+ *      and renames it into place when the PDF is complete, so the cache
+ *      never grows beyond one conversion.
+ *
+ *      A cached page is only valid if the same lines follow its first
+ *      line, so the reader keeps a queue of lines read ahead of the
+ *      renderer; txt2pdf reads through page_cache_gets() in this mode.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SpoolInput.h"
+#include "PageCache.h"
+
+#define PAGE_CACHE_MAGIC    "TXT2PGC2"      /* 1 was keyed by the weaker digest */
+
+static FILE *cache_old = NULL;
+static FILE *cache_new = NULL;
+static char  cache_path[1024];
+static char  cache_temp[1040];
+
+/**
+ *  Pages are found by first line (prefix) and then by all their lines;
+ *  report headers repeat, so one prefix can start many different pages
+ */
+
+static std::vector<PageCacheEntry> cache_entries;
+static std::unordered_multimap<unsigned long long, size_t> cache_index;
+static std::unordered_map<unsigned long long, std::vector<int> > cache_lengths;
+static std::deque<std::string> cache_ahead;
+
+static char *cache_stream = NULL;
+static long long cache_stream_size = 0;
+
+static long cache_reused = 0;
+static long cache_rendered = 0;
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Index key of a SHA-256 (its first bytes).
+**
+**------------------------------------------------------------------------*/
+
+static unsigned long long cache_key(const unsigned char *hash)
+    {
+    unsigned long long key;
+
+    memcpy(&key, hash, sizeof(key));
+    return key;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Load the index of the previous cache file and create
+**                  the next one.
+**
+**  Returns:        FALSE if the new cache file cannot be created.
+**
+**------------------------------------------------------------------------*/
+
+bool page_cache_open(const char *path)
+    {
+    PageCacheEntry entry;
+    char           magic[8];
+    long long      end;
+
+    strncpy(cache_path, path, sizeof(cache_path) - 1);
+    snprintf(cache_temp, sizeof(cache_temp), "%s.tmp", cache_path);
+
+    cache_old = fopen(cache_path, "rb");
+    if (cache_old != NULL)
+        {
+        _fseeki64(cache_old, 0, SEEK_END);
+        end = _ftelli64(cache_old);
+        _fseeki64(cache_old, 0, SEEK_SET);
+
+        if (fread(magic, 1, sizeof(magic), cache_old) == sizeof(magic) && memcmp(magic, PAGE_CACHE_MAGIC, sizeof(magic)) == 0)
+            {
+            /*
+            **  A file cut short by a crash keeps the pages before the cut
+            */
+            while (fread(&entry, sizeof(entry), 1, cache_old) == 1)
+                {
+                entry.offset = _ftelli64(cache_old);
+                if (entry.length < 0 || entry.offset + entry.length > end)
+                    {
+                    break;
+                    }
+                std::vector<int> &totals = cache_lengths[cache_key(entry.prefix)];
+                auto at = std::lower_bound(totals.begin(), totals.end(), entry.line_total);
+
+                if (at == totals.end() || *at != entry.line_total)
+                    {
+                    totals.insert(at, entry.line_total);
+                    }
+                cache_index.insert(std::make_pair(cache_key(entry.prefix) ^ cache_key(entry.lines), cache_entries.size()));
+                cache_entries.push_back(entry);
+                _fseeki64(cache_old, entry.length, SEEK_CUR);
+                }
+            }
+        }
+
+    cache_new = fopen(cache_temp, "wb");
+    if (cache_new == NULL)
+        {
+        fprintf(stderr, "(error) Unable to create page cache %s.\n", cache_temp);
+        return FALSE;
+        }
+    fwrite(PAGE_CACHE_MAGIC, 1, 8, cache_new);
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Lengths (in input lines) of the cached pages that
+**                  start with this state and line.
+**
+**  Parameters:     Name        Description.
+**                  prefix      Key of the first line.
+**                  totals      Receives the lengths, shortest first.
+**
+**  Returns:        Number of lengths.
+**
+**------------------------------------------------------------------------*/
+
+int page_cache_lengths(const unsigned char *prefix, const int **totals)
+    {
+    auto found = cache_lengths.find(cache_key(prefix));
+
+    if (found == cache_lengths.end())
+        {
+        return 0;
+        }
+    *totals = found->second.data();
+    return (int)found->second.size();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        The cached page with this start and these lines.
+**
+**  Returns:        The entry, NULL if there is none.
+**
+**------------------------------------------------------------------------*/
+
+const PageCacheEntry *page_cache_find(const unsigned char *prefix, const unsigned char *lines)
+    {
+    auto range = cache_index.equal_range(cache_key(prefix) ^ cache_key(lines));
+
+    for (auto it = range.first; it != range.second; ++it)
+        {
+        if (memcmp(cache_entries[it->second].prefix, prefix, SHA256_BYTES) == 0 &&
+            memcmp(cache_entries[it->second].lines, lines, SHA256_BYTES) == 0)
+            {
+            return &cache_entries[it->second];
+            }
+        }
+    return NULL;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a cached content stream (valid until the next
+**                  call).
+**
+**  Returns:        The stream bytes, NULL if they cannot be read.
+**
+**------------------------------------------------------------------------*/
+
+const char *page_cache_stream(const PageCacheEntry *entry)
+    {
+    if (entry->length > cache_stream_size)
+        {
+        free(cache_stream);
+        cache_stream_size = entry->length;
+        cache_stream = (char *)malloc((size_t)cache_stream_size);
+        if (cache_stream == NULL)
+            {
+            cache_stream_size = 0;
+            return NULL;
+            }
+        }
+    if (_fseeki64(cache_old, entry->offset, SEEK_SET) != 0 ||
+        fread(cache_stream, 1, (size_t)entry->length, cache_old) != (size_t)entry->length)
+        {
+        return NULL;
+        }
+    return cache_stream;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Keep a page of this conversion for the next one.
+**
+**  Parameters:     Name        Description.
+**                  entry       Page key and the state after it.
+**                  stream      Content stream bytes.
+**                  is_reused   Copied from the cache rather than rendered.
+**
+**------------------------------------------------------------------------*/
+
+void page_cache_add(const PageCacheEntry *entry, const char *stream, bool is_reused)
+    {
+    if (is_reused)
+        {
+        cache_reused++;
+        }
+    else
+        {
+        cache_rendered++;
+        }
+    if (cache_new != NULL &&
+        (fwrite(entry, sizeof(*entry), 1, cache_new) != 1 ||
+         fwrite(stream, 1, (size_t)entry->length, cache_new) != (size_t)entry->length))
+        {
+        fprintf(stderr, "(warning) Unable to write page cache %s.\n", cache_temp);
+        fclose(cache_new);
+        cache_new = NULL;
+        remove(cache_temp);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        input_gets() behind the read-ahead queue.
+**
+**------------------------------------------------------------------------*/
+
+char *page_cache_gets(char *buffer, size_t size)
+    {
+    if (cache_ahead.empty())
+        {
+        return input_gets(buffer, size);
+        }
+    strncpy(buffer, cache_ahead.front().c_str(), size - 1);
+    buffer[size - 1] = '\0';
+    cache_ahead.pop_front();
+    return buffer;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Line `ahead` positions after the current one (0 is
+**                  the next line), reading ahead as needed.
+**
+**  Returns:        The line, NULL past the end of the input.
+**
+**------------------------------------------------------------------------*/
+
+const char *page_cache_peek(int ahead)
+    {
+    char line[4096];
+
+    while ((int)cache_ahead.size() <= ahead)
+        {
+        if (input_gets(line, sizeof(line)) == NULL)
+            {
+            return NULL;
+            }
+        cache_ahead.push_back(line);
+        }
+    return cache_ahead[ahead].c_str();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Discard lines covered by a reused page.
+**
+**------------------------------------------------------------------------*/
+
+void page_cache_drop(int count)
+    {
+    while (count-- > 0 && !cache_ahead.empty())
+        {
+        cache_ahead.pop_front();
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Report the hit rate and replace the old cache file.
+**
+**  Parameters:     Name        Description.
+**                  is_complete The PDF was written; otherwise the old
+**                              cache is kept.
+**                  pages       Pages in the document.
+**
+**  Returns:        FALSE if the new cache file could not be written.
+**
+**------------------------------------------------------------------------*/
+
+bool page_cache_close(bool is_complete, int pages)
+    {
+    bool ok = (cache_new != NULL);
+
+    fprintf(stderr, "(info) page cache: %ld of %d pages reused (%.1f%%), %ld rendered and stored\n",
+            cache_reused, pages, (pages > 0) ? 100.0 * cache_reused / pages : 0.0, cache_rendered);
+
+    if (cache_old != NULL)
+        {
+        fclose(cache_old);
+        cache_old = NULL;
+        }
+    if (cache_new != NULL && fclose(cache_new) != 0)
+        {
+        ok = FALSE;
+        }
+    cache_new = NULL;
+
+    if (ok && is_complete)
+        {
+        remove(cache_path);
+        ok = (rename(cache_temp, cache_path) == 0);
+        }
+    else
+        {
+        remove(cache_temp);
+        }
+
+    free(cache_stream);
+    cache_stream = NULL;
+    cache_stream_size = 0;
+    cache_entries.clear();
+    cache_index.clear();
+    cache_lengths.clear();
+    return ok;
+    }
@@ -0,0 +1,46 @@
+/**
+ *
+ *  Name: PageCache.h
+ *
+ *  Description:
+ *
+ *      Per-page render cache for txt2pdf (-j).  Content streams of the
+ *      previous conversion are kept with a SHA-256 of the input lines and
+ *      starting state that produced them, so an unchanged page of the
+ *      next conversion is copied instead of rendered.  The hash has to
+ *      be collision resistant: the lines are whoever wrote the input's,
+ *      and a collision would print another page in their place.
+ *
+ */
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stddef.h>
+#include "Sha256.h"
+
+struct _PageCacheEntry
+    {
+    unsigned char prefix[SHA256_BYTES];     /* settings, starting state and first line */
+    unsigned char lines[SHA256_BYTES];      /* every input line of the page */
+    int       line_total;       /* input lines on the page */
+    int       line_end;         /* line count after the page (see txt2pdf.c) */
+    float     y_end;            /* y position after the last line */
+    double    color_end[3];
+    long long length;           /* content stream bytes */
+    long long offset;           /* of the stream in the previous cache file */
+    };
+
+typedef _PageCacheEntry PageCacheEntry;
+
+bool  page_cache_open(const char *path);
+int   page_cache_lengths(const unsigned char *prefix, const int **totals);
+const PageCacheEntry *page_cache_find(const unsigned char *prefix, const unsigned char *lines);
+const char *page_cache_stream(const PageCacheEntry *entry);
+void  page_cache_add(const PageCacheEntry *entry, const char *stream, bool is_reused);
+char *page_cache_gets(char *buffer, size_t size);
+const char *page_cache_peek(int ahead);
+void  page_cache_drop(int count);
+bool  page_cache_close(bool is_complete, int pages);
+
+#endif //PAGECACHE_H
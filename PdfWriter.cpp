@@ -0,0 +1,795 @@
+/**
+ *
+ *  Name: PdfWriter.cpp
+ *
+ *  Description:
+ *
+ *      Buffered output stage for txt2pdf.
+ *
+ *      Output is collected in fixed size buffers.  With a queue depth of
+ *      zero a full buffer is written by the caller.  Otherwise a writer
+ *      thread drains full buffers while formatting continues into the
+ *      next free one; at most queue_depth buffers wait to be written, so
+ *      a slow pipe or network target holds back formatting instead of
+ *      growing memory.
+ *
+ *      A finished document can be retired instead of closed: its thread
+ *      drains the remaining buffers and closes the file on its own while
+ *      the caller opens the next document (report bursting).
+ *
+ *      To a regular file the buffers can also be written by several
+ *      threads at once.  Every byte's offset is settled when it is
+ *      formatted (the xref table is built from the same count), so a
+ *      full buffer already knows where it belongs in the file and is
+ *      written there with a positioned write, in whatever order the
+ *      threads finish.  The file is reserved ahead in large extents so
+ *      the writes do not grow it one buffer at a time.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <io.h>
+#include <fcntl.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "PdfWriter.h"
+#include "MemStats.h"
+#include "TraceEvents.h"
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAX(x, y)       ((x) > (y) ? (x) : (y))
+#define MIN(x, y)       ((x) < (y) ? (x) : (y))
+
+#define WRITER_MAX_DEPTH    64
+#define WRITER_MAX_RETIRED  8
+#define WRITER_MAX_THREADS  16
+#define WRITER_EXTENT       (64LL * 1024 * 1024)    /* file reserved ahead (positioned) */
+
+#ifdef _WIN32
+typedef HANDLE WriterFile;
+
+/*
+**  ReOpenFile() and SetFileInformationByHandle() are Vista and later
+**  while StdAfx.h targets XP, so they are looked up at run time; without
+**  them the threads share one handle and nothing is reserved
+*/
+typedef HANDLE (WINAPI *WriterReOpenFile)(HANDLE, DWORD, DWORD, DWORD);
+typedef BOOL   (WINAPI *WriterSetFileInformation)(HANDLE, int, LPVOID, DWORD);
+
+#define WRITER_FILE_ALLOCATION_INFO 5       /* FileAllocationInfo */
+
+struct WriterAllocation                     /* FILE_ALLOCATION_INFO */
+    {
+    LARGE_INTEGER size;
+    };
+
+static FARPROC writer_kernel32(const char *name)
+    {
+    HMODULE kernel = GetModuleHandleA("kernel32.dll");
+
+    return (kernel != NULL) ? GetProcAddress(kernel, name) : NULL;
+    }
+#else
+typedef int    WriterFile;
+#endif
+
+struct WriterState
+    {
+    FILE   *stream;
+    bool    is_closing_stream;      /* fclose() once drained (retired) */
+    char   *buffers[WRITER_MAX_DEPTH + 1];
+    size_t  size;
+    int     depth;
+    int     current;
+    size_t  fill;
+    long long offset;
+    std::atomic<bool> failed;
+    bool    closing;
+    long    written;                /* buffers written (trace sampling) */
+
+    /*
+    **  Positioned writes: file position of offset 0's buffer, of the
+    **  current buffer and the end of the reserved extent
+    */
+    bool      is_positioned;
+    long long start;
+    long long reserved;
+
+    /*
+    **  Queue of full buffers (ring of buffer indexes) and the free list
+    */
+    int     queue[WRITER_MAX_DEPTH + 1];
+    size_t  queue_fill[WRITER_MAX_DEPTH + 1];
+    long long queue_at[WRITER_MAX_DEPTH + 1];
+    int     queue_head;
+    int     queue_count;
+    int     busy;                   /* buffers being written */
+    int     free_list[WRITER_MAX_DEPTH + 1];
+    int     free_count;
+
+    std::thread             threads[WRITER_MAX_THREADS];
+    int                     thread_count;
+    int                     running;
+    std::mutex              lock;
+    std::condition_variable queued;
+    std::condition_variable released;
+    };
+
+static WriterState *writer = NULL;                          /* document being written */
+static WriterState *writer_retired[WRITER_MAX_RETIRED];     /* documents still draining */
+static int          writer_retired_count = 0;
+static bool         writer_retired_failed = FALSE;
+static long long    writer_last_offset = 0;
+static long         writer_stall_count = 0;
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Leave a positioned file as sequential writes would:
+**                  the reserve beyond the end released and the file
+**                  position after the last byte.
+**
+**------------------------------------------------------------------------*/
+
+static void writer_settle(WriterState *w)
+    {
+    int fd = _fileno(w->stream);
+
+#ifdef _WIN32
+    if (_lseeki64(fd, w->start, SEEK_SET) != w->start)
+        {
+        w->failed = TRUE;
+        }
+#else
+    struct stat status;
+
+    if (fstat(fd, &status) == 0 && status.st_size == w->start)
+        {
+        ftruncate(fd, w->start);                        //  frees the blocks kept beyond the end
+        }
+    if (lseek(fd, w->start, SEEK_SET) != w->start)
+        {
+        w->failed = TRUE;
+        }
+#endif
+    }
+
+
+static void writer_free_state(WriterState *w)
+    {
+    int i;
+
+    if (fflush(w->stream) != 0)
+        {
+        w->failed = TRUE;
+        }
+    if (w->is_positioned)
+        {
+        writer_settle(w);
+        }
+    if (w->is_closing_stream && fclose(w->stream) != 0)
+        {
+        w->failed = TRUE;
+        }
+
+    for (i = 0; i <= w->depth; i++)
+        {
+        free(w->buffers[i]);
+        w->buffers[i] = NULL;
+        MEM_ACCOUNT(MEM_IO_BUFFER, w->size, 0);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        The file a writer thread writes positioned buffers to.
+**
+**  Description:    On Windows every thread gets a handle of its own;
+**                  I/O on one synchronous handle is serialized.
+**
+**------------------------------------------------------------------------*/
+
+static WriterFile writer_file_open(WriterState *w)
+    {
+#ifdef _WIN32
+    static WriterReOpenFile reopen = (WriterReOpenFile)writer_kernel32("ReOpenFile");
+    HANDLE shared = (HANDLE)_get_osfhandle(_fileno(w->stream));
+    HANDLE own = (reopen != NULL) ? reopen(shared, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0) : INVALID_HANDLE_VALUE;
+
+    return (own != INVALID_HANDLE_VALUE) ? own : shared;
+#else
+    return _fileno(w->stream);
+#endif
+    }
+
+
+static void writer_file_close(WriterState *w, WriterFile file)
+    {
+#ifdef _WIN32
+    if (file != (HANDLE)_get_osfhandle(_fileno(w->stream)))
+        {
+        CloseHandle(file);
+        }
+#else
+    /*
+    **  The descriptor is the stream's own
+    */
+    (void)w;
+    (void)file;
+#endif
+    }
+
+
+static bool writer_put_at(WriterFile file, const char *buffer, size_t fill, long long at)
+    {
+#ifdef _WIN32
+    OVERLAPPED position = {0};
+    DWORD      done = 0;
+
+    position.Offset = (DWORD)at;
+    position.OffsetHigh = (DWORD)(at >> 32);
+    return WriteFile(file, buffer, (DWORD)fill, &done, &position) && done == fill;
+#else
+    ssize_t done;
+
+    while (fill > 0)
+        {
+        done = pwrite(file, buffer, fill, (off_t)at);
+        if (done <= 0)
+            {
+            return FALSE;
+            }
+        buffer += done;
+        fill -= (size_t)done;
+        at += done;
+        }
+    return TRUE;
+#endif
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write one buffer (at its offset if positioned),
+**                  traced if it is a sampled one.
+**
+**  Parameters:     Name        Description.
+**                  file        Positioned target (writer_file_open()).
+**                  at          File position of the buffer's first byte.
+**                  sequence    Buffer number, for trace sampling.
+**
+**------------------------------------------------------------------------*/
+
+static void writer_put(WriterState *w, WriterFile file, const char *buffer, size_t fill, long long at, long sequence)
+    {
+    char      args[32];
+    long long start = 0;
+    bool      is_traced = trace_is_sampled(sequence);
+
+    if (is_traced)
+        {
+        start = trace_now();
+        }
+    if (!w->failed && !(w->is_positioned ? writer_put_at(file, buffer, fill, at) : fwrite(buffer, 1, fill, w->stream) == fill))
+        {
+        w->failed = TRUE;
+        }
+    if (is_traced)
+        {
+        snprintf(args, sizeof(args), "\"bytes\":%ld", (long)fill);
+        trace_span("write", "output", start, args);
+        }
+    }
+
+
+static void writer_drain(WriterState *w)
+    {
+    WriterFile file = 0;
+    int        index;
+    size_t     fill;
+    long long  at;
+    long       sequence;
+    bool       is_last;
+
+    if (trace_is_enabled)
+        {
+        trace_thread_name("writer");
+        }
+    if (w->is_positioned)
+        {
+        file = writer_file_open(w);
+        }
+
+    for (;;)
+        {
+            {
+            std::unique_lock<std::mutex> guard(w->lock);
+            while (w->queue_count == 0 && !w->closing)
+                {
+                w->queued.wait(guard);
+                }
+            if (w->queue_count == 0)
+                {
+                break;
+                }
+            index = w->queue[w->queue_head];
+            fill = w->queue_fill[w->queue_head];
+            at = w->queue_at[w->queue_head];
+            sequence = w->written++;
+            w->queue_head = (w->queue_head + 1) % (w->depth + 1);
+            w->queue_count--;
+            w->busy++;
+            }
+
+        writer_put(w, file, w->buffers[index], fill, at, sequence);
+
+            {
+            std::lock_guard<std::mutex> guard(w->lock);
+            w->busy--;
+            w->free_list[w->free_count++] = index;
+            }
+        w->released.notify_one();
+        }
+
+    if (w->is_positioned)
+        {
+        writer_file_close(w, file);
+        }
+
+        {
+        std::lock_guard<std::mutex> guard(w->lock);
+        is_last = (--w->running == 0);
+        }
+    if (is_last && w->is_closing_stream)
+        {
+        writer_free_state(w);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Reserve the file ahead of a positioned write ending
+**                  at `end`.
+**
+**  Description:    The reserve does not change the file size; where the
+**                  file system cannot reserve, the writes just extend
+**                  the file.
+**
+**------------------------------------------------------------------------*/
+
+static void writer_reserve(WriterState *w, long long end)
+    {
+    bool ok;
+
+    if (end <= w->reserved)
+        {
+        return;
+        }
+    w->reserved = end + WRITER_EXTENT;
+
+#ifdef _WIN32
+    static WriterSetFileInformation set_information = (WriterSetFileInformation)writer_kernel32("SetFileInformationByHandle");
+    WriterAllocation allocation;
+
+    allocation.size.QuadPart = w->reserved;
+    ok = set_information != NULL &&
+         set_information((HANDLE)_get_osfhandle(_fileno(w->stream)), WRITER_FILE_ALLOCATION_INFO, &allocation, sizeof(allocation)) != 0;
+#elif defined(FALLOC_FL_KEEP_SIZE)
+    ok = fallocate(_fileno(w->stream), FALLOC_FL_KEEP_SIZE, 0, w->reserved) == 0;
+#else
+    ok = FALSE;
+#endif
+    if (!ok)
+        {
+        w->reserved = LLONG_MAX;
+        }
+    }
+
+
+static void writer_flush_current()
+    {
+    long long stall_start = -1;
+
+    if (writer->fill == 0)
+        {
+        return;
+        }
+
+    if (writer->depth == 0)
+        {
+        writer_put(writer, 0, writer->buffers[0], writer->fill, 0, writer->written++);
+        writer->fill = 0;
+        return;
+        }
+    if (writer->is_positioned)
+        {
+        writer_reserve(writer, writer->start + (long long)writer->fill);
+        }
+
+        {
+        std::unique_lock<std::mutex> guard(writer->lock);
+        if (writer->free_count == 0)
+            {
+            writer_stall_count++;
+            if (trace_is_enabled)
+                {
+                stall_start = trace_now();
+                }
+            }
+        while (writer->free_count == 0)
+            {
+            writer->released.wait(guard);
+            }
+        writer->queue[(writer->queue_head + writer->queue_count) % (writer->depth + 1)] = writer->current;
+        writer->queue_fill[(writer->queue_head + writer->queue_count) % (writer->depth + 1)] = writer->fill;
+        writer->queue_at[(writer->queue_head + writer->queue_count) % (writer->depth + 1)] = writer->start;
+        writer->queue_count++;
+        writer->current = writer->free_list[--writer->free_count];
+        }
+    writer->queued.notify_one();
+    writer->start += (long long)writer->fill;
+    writer->fill = 0;
+
+    if (stall_start >= 0)
+        {
+        trace_span("stall", "output", stall_start, NULL);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        TRUE if buffers can be written to the stream at their
+**                  offsets: a regular file, not opened for appending.
+**
+**  Parameters:     Name        Description.
+**                  position    Receives the current file position.
+**
+**------------------------------------------------------------------------*/
+
+static bool writer_is_positionable(FILE *stream, long long *position)
+    {
+    int fd = _fileno(stream);
+
+#ifdef _WIN32
+    if (GetFileType((HANDLE)_get_osfhandle(fd)) != FILE_TYPE_DISK)
+        {
+        return FALSE;
+        }
+    *position = _telli64(fd);
+#else
+    struct stat status;
+
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || (fcntl(fd, F_GETFL) & O_APPEND) != 0)
+        {
+        return FALSE;
+        }
+    *position = lseek(fd, 0, SEEK_CUR);
+#endif
+    return *position >= 0;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start the output stage.
+**
+**  Parameters:     Name        Description.
+**                  stream      Destination (switched to binary mode).
+**                  buffer_size Bytes per buffer.
+**                  queue_depth Buffers that may wait for the writer
+**                              thread; zero writes synchronously.
+**                  threads     Threads writing buffers at their offsets
+**                              if the stream is a regular file; zero
+**                              (or another kind of stream) writes them
+**                              in order on one thread.
+**
+**------------------------------------------------------------------------*/
+
+void writer_open(FILE *stream, long buffer_size, int queue_depth, int threads)
+    {
+    int i;
+
+    /*
+    **  Offsets in the xref table count bytes, so no CR/LF translation
+    */
+    fflush(stream);
+    _setmode(_fileno(stream), _O_BINARY);
+
+    writer = new WriterState;
+    writer->stream = stream;
+    writer->is_closing_stream = FALSE;
+    writer->size = (size_t)MAX(buffer_size, 4096l);
+    writer->depth = MIN(MAX(queue_depth, 0), WRITER_MAX_DEPTH);
+    writer->thread_count = (writer->depth > 0) ? 1 : 0;
+    writer->is_positioned = FALSE;
+    writer->start = 0;
+    writer->reserved = 0;
+    writer->busy = 0;
+    writer->fill = 0;
+    writer->offset = 0;
+    writer->failed = FALSE;
+    writer->closing = FALSE;
+    writer->written = 0;
+    writer->queue_head = 0;
+    writer->queue_count = 0;
+    writer->free_count = 0;
+    writer->current = 0;
+
+    if (threads > 0 && writer_is_positionable(stream, &writer->start))
+        {
+        /*
+        **  At least one buffer in flight per thread
+        */
+        writer->is_positioned = TRUE;
+        writer->thread_count = MIN(threads, WRITER_MAX_THREADS);
+        writer->depth = MAX(writer->depth, writer->thread_count);
+        }
+
+    for (i = 0; i <= writer->depth; i++)
+        {
+        writer->buffers[i] = (char *)malloc(writer->size);
+        if (writer->buffers[i] == NULL)
+            {
+            fprintf(stderr, "(error) Unable to allocate output buffer of %ld bytes.", (long)writer->size);
+            exit(1);
+            }
+        MEM_ACCOUNT(MEM_IO_BUFFER, 0, writer->size);
+        if (i != writer->current)
+            {
+            writer->free_list[writer->free_count++] = i;
+            }
+        }
+
+    if (writer->depth > 0)
+        {
+        /*
+        **  The writer threads do their own buffering
+        */
+        setvbuf(stream, NULL, _IONBF, 0);
+        writer->running = writer->thread_count;
+        for (i = 0; i < writer->thread_count; i++)
+            {
+            writer->threads[i] = std::thread(writer_drain, writer);
+            }
+        }
+    }
+
+
+void writer_write(const void *data, size_t length)
+    {
+    const char *p = (const char *)data;
+    size_t chunk;
+
+    writer->offset += (long long)length;
+
+    while (length > 0)
+        {
+        chunk = MIN(length, writer->size - writer->fill);
+        memcpy(writer->buffers[writer->current] + writer->fill, p, chunk);
+        writer->fill += chunk;
+        p += chunk;
+        length -= chunk;
+        if (writer->fill == writer->size)
+            {
+            writer_flush_current();
+            }
+        }
+    }
+
+
+int writer_printf(const char *format, ...)
+    {
+    char    text[1024];
+    char   *big;
+    va_list args;
+    int     length;
+
+    va_start(args, format);
+    length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < (int)sizeof(text))
+        {
+        writer_write(text, length);
+        return length;
+        }
+
+    big = (char *)malloc(length + 1);
+    if (big == NULL)
+        {
+        fprintf(stderr, "(error) Unable to allocate %d bytes of output.", length + 1);
+        exit(1);
+        }
+    MEM_ACCOUNT(MEM_IO_BUFFER, 0, length + 1);
+    va_start(args, format);
+    vsnprintf(big, length + 1, format, args);
+    va_end(args);
+    writer_write(big, length);
+    free(big);
+    MEM_ACCOUNT(MEM_IO_BUFFER, length + 1, 0);
+    return length;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Make the byte count start at offset (output appended
+**                  to a file that already holds offset bytes).
+**
+**------------------------------------------------------------------------*/
+
+void writer_resume(long long offset)
+    {
+    writer->offset = offset;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Push everything written so far out to the stream.
+**
+**  Returns:        FALSE if any write has failed.
+**
+**------------------------------------------------------------------------*/
+
+bool writer_sync()
+    {
+    writer_flush_current();
+
+    if (writer->depth > 0)
+        {
+        std::unique_lock<std::mutex> guard(writer->lock);
+        while (writer->queue_count > 0 || writer->busy > 0)
+            {
+            writer->released.wait(guard);
+            }
+        }
+
+    if (fflush(writer->stream) != 0)
+        {
+        writer->failed = TRUE;
+        }
+    return !writer->failed;
+    }
+
+
+long long writer_tell()
+    {
+    return (writer != NULL) ? writer->offset : writer_last_offset;
+    }
+
+
+long writer_stalls()
+    {
+    return writer_stall_count;
+    }
+
+
+static bool writer_join(WriterState *w)
+    {
+    bool ok;
+    int  i;
+
+    for (i = 0; i < w->thread_count; i++)
+        {
+        w->threads[i].join();
+        }
+    ok = !w->failed;
+    delete w;
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write out everything pending and stop the writer.
+**
+**  Returns:        FALSE if any write to the stream failed.
+**
+**------------------------------------------------------------------------*/
+
+bool writer_close()
+    {
+    bool ok;
+    int  i;
+
+    writer_flush_current();
+
+    if (writer->depth > 0)
+        {
+            {
+            std::lock_guard<std::mutex> guard(writer->lock);
+            writer->closing = TRUE;
+            }
+        writer->queued.notify_all();
+        for (i = 0; i < writer->thread_count; i++)
+            {
+            writer->threads[i].join();
+            }
+        }
+
+    writer_free_state(writer);
+    ok = !writer->failed;
+    writer_last_offset = writer->offset;
+    delete writer;
+    writer = NULL;
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Finish the current document in the background.
+**
+**  Description:    The writer threads drain what is queued and the last
+**                  one closes the stream.  Without a thread this is
+**                  writer_close() plus fclose().
+**
+**  Returns:        FALSE if a write has already failed.
+**
+**------------------------------------------------------------------------*/
+
+bool writer_retire()
+    {
+    bool ok = TRUE;
+
+    writer->is_closing_stream = TRUE;
+    writer_flush_current();
+
+    if (writer->depth == 0)
+        {
+        writer_free_state(writer);
+        ok = !writer->failed;
+        writer_last_offset = writer->offset;
+        delete writer;
+        writer = NULL;
+        return ok;
+        }
+
+    if (writer_retired_count == WRITER_MAX_RETIRED)
+        {
+        /*
+        **  Bound the documents in flight: wait for the oldest
+        */
+        ok = writer_join(writer_retired[0]);
+        writer_retired_failed = writer_retired_failed || !ok;
+        memmove(&writer_retired[0], &writer_retired[1], (WRITER_MAX_RETIRED - 1) * sizeof(WriterState *));
+        writer_retired_count--;
+        }
+
+        {
+        std::lock_guard<std::mutex> guard(writer->lock);
+        writer->closing = TRUE;
+        }
+    writer->queued.notify_all();
+
+    writer_last_offset = writer->offset;
+    writer_retired[writer_retired_count++] = writer;
+    writer = NULL;
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Wait for every retired document to be written.
+**
+**  Returns:        FALSE if any of them failed.
+**
+**------------------------------------------------------------------------*/
+
+bool writer_finish()
+    {
+    bool ok = !writer_retired_failed;
+    int  i;
+
+    for (i = 0; i < writer_retired_count; i++)
+        {
+        ok = writer_join(writer_retired[i]) && ok;
+        }
+    writer_retired_count = 0;
+    writer_retired_failed = FALSE;
+    return ok;
+    }
@@ -0,0 +1,30 @@
+/**
+ *
+ *  Name: PdfWriter.h
+ *
+ *  Description:
+ *
+ *      Buffered output stage for txt2pdf.  All file-level PDF output goes
+ *      through here so the byte offsets needed for the cross-reference
+ *      table are tracked without ftell() (which fails on pipes).
+ *
+ */
+
+#ifndef PDFWRITER_H
+#define PDFWRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+void writer_open(FILE *stream, long buffer_size, int queue_depth, int threads);
+void writer_write(const void *data, size_t length);
+int  writer_printf(const char *format, ...);
+long long writer_tell();
+void writer_resume(long long offset);
+bool writer_sync();
+bool writer_close();
+bool writer_retire();
+bool writer_finish();
+long writer_stalls();
+
+#endif //PDFWRITER_H
@@ -0,0 +1,682 @@
+/**
+ *
+ *  Name: SearchIndex.cpp
+ *
+ *  Description:
+ *
+ *      Full-text index sidecar for txt2pdf.
+ *
+ *      Words are collected while the listing is converted: a term is a
+ *      run of letters, digits, '_', '$', '#', '@' or non-ASCII bytes,
+ *      folded to upper case, at least two bytes long.  Each term keeps
+ *      the (page, line) pairs it appeared on, as shown by -p and -N.
+ *
+ *      File layout (native 32-bit little-endian words, offsets from the
+ *      start of the file) so the query side needs no parsing pass:
+ *
+ *          IndexHeader
+ *          IndexEntry[term_count]      sorted by term bytes
+ *          term bytes                  (names_length bytes)
+ *          IndexPosting[posting_count] grouped per term, (page, line) order
+ *
+ *      A query maps the file and reads only the pages of the term table
+ *      its binary searches touch and the posting lists of its terms.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "SearchIndex.h"
+
+#define INDEX_MAGIC         "TXT2IDX1"
+#define INDEX_TERM_MAX      64
+#define INDEX_TERM_MIN      2
+
+struct IndexHeader
+    {
+    char         magic[8];
+    unsigned int term_count;
+    unsigned int posting_count;
+    unsigned int terms_offset;
+    unsigned int names_offset;
+    unsigned int names_length;
+    unsigned int postings_offset;
+    };
+
+struct IndexEntry
+    {
+    unsigned int name_offset;
+    unsigned int name_length;
+    unsigned int first_posting;
+    unsigned int posting_count;
+    };
+
+struct IndexPosting
+    {
+    unsigned int page;
+    unsigned int line;
+    };
+
+/**
+ *  In-memory term table used while converting
+ */
+
+struct IndexTerm
+    {
+    unsigned int  name_offset;
+    unsigned int  name_length;
+    unsigned int  hash;
+    IndexPosting *postings;
+    unsigned int  count;
+    unsigned int  size;
+    bool          is_sorted;
+    };
+
+static FILE      *index_file = NULL;
+static IndexTerm *index_terms = NULL;       /* open addressed, index_slots entries */
+static unsigned   index_slots = 0;
+static unsigned   index_used = 0;
+static char      *index_names = NULL;
+static unsigned   index_names_length = 0;
+static unsigned   index_names_size = 0;
+static unsigned   index_posting_total = 0;
+static unsigned char index_fold[256];        /* term byte, upper-cased; 0 = separator */
+
+
+static void index_init_fold()
+    {
+    int c;
+
+    for (c = 1; c < 256; c++)
+        {
+        if (isalnum(c) || c == '_' || c == '$' || c == '#' || c == '@' || c >= 0x80)
+            {
+            index_fold[c] = (unsigned char)((c < 0x80) ? toupper(c) : c);
+            }
+        }
+    }
+
+
+static unsigned int index_hash(const char *name, unsigned int length)
+    {
+    unsigned int hash = 2166136261u;
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+        {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+        }
+    return hash;
+    }
+
+
+static void *index_grow(void *block, size_t size)
+    {
+    void *grown = realloc(block, size);
+
+    if (grown == NULL)
+        {
+        fprintf(stderr, "(error) Unable to allocate memory for the search index.\n");
+        exit(1);
+        }
+    return grown;
+    }
+
+
+static IndexTerm *index_find(const char *name, unsigned int length, unsigned int hash)
+    {
+    IndexTerm *old_terms;
+    unsigned   old_slots;
+    unsigned   slot;
+    unsigned   i;
+
+    if (index_used * 2 >= index_slots)
+        {
+        /*
+        **  Keep the table at most half full
+        */
+        old_terms = index_terms;
+        old_slots = index_slots;
+        index_slots = (old_slots == 0) ? 4096 : old_slots * 2;
+        index_terms = (IndexTerm *)calloc(index_slots, sizeof(IndexTerm));
+        if (index_terms == NULL)
+            {
+            fprintf(stderr, "(error) Unable to allocate memory for the search index.\n");
+            exit(1);
+            }
+        for (i = 0; i < old_slots; i++)
+            {
+            if (old_terms[i].size != 0)
+                {
+                slot = old_terms[i].hash & (index_slots - 1);
+                while (index_terms[slot].size != 0)
+                    {
+                    slot = (slot + 1) & (index_slots - 1);
+                    }
+                index_terms[slot] = old_terms[i];
+                }
+            }
+        free(old_terms);
+        }
+
+    slot = hash & (index_slots - 1);
+    while (index_terms[slot].size != 0)
+        {
+        if (index_terms[slot].hash == hash && index_terms[slot].name_length == length &&
+            memcmp(index_names + index_terms[slot].name_offset, name, length) == 0)
+            {
+            return &index_terms[slot];
+            }
+        slot = (slot + 1) & (index_slots - 1);
+        }
+
+    /*
+    **  New term: copy its name into the pool
+    */
+    if (index_names_length + length > index_names_size)
+        {
+        index_names_size = (index_names_size + length) * 2;
+        index_names = (char *)index_grow(index_names, index_names_size);
+        }
+    memcpy(index_names + index_names_length, name, length);
+
+    index_terms[slot].name_offset = index_names_length;
+    index_terms[slot].name_length = length;
+    index_terms[slot].hash = hash;
+    index_terms[slot].size = 4;
+    index_terms[slot].count = 0;
+    index_terms[slot].is_sorted = TRUE;
+    index_terms[slot].postings = (IndexPosting *)index_grow(NULL, 4 * sizeof(IndexPosting));
+    index_names_length += length;
+    index_used++;
+    return &index_terms[slot];
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Split text into index terms.
+**
+**  Parameters:     Name        Description.
+**                  text        Text to scan (advanced past the term).
+**                  term        Receives the upper-cased term.
+**
+**                  is_query    TRUE to report the words that are too
+**                                  short or long to be indexed.
+**
+**  Returns:        Term length, 0 at end of text.
+**
+**------------------------------------------------------------------------*/
+
+static unsigned int index_next_term(const char **text, char *term, bool is_query)
+    {
+    const unsigned char *p = (const unsigned char *)*text;
+    unsigned int length;
+
+    for (;;)
+        {
+        while (*p != '\0' && index_fold[*p] == 0)
+            {
+            p++;
+            }
+        if (*p == '\0')
+            {
+            *text = (const char *)p;
+            return 0;
+            }
+
+        length = 0;
+        while (index_fold[*p] != 0)
+            {
+            if (length < INDEX_TERM_MAX)
+                {
+                term[length] = (char)index_fold[*p];
+                }
+            length++;
+            p++;
+            }
+
+        if (length >= INDEX_TERM_MIN && length <= INDEX_TERM_MAX)
+            {
+            *text = (const char *)p;
+            return length;
+            }
+        if (is_query)
+            {
+            fprintf(stderr, "(warning) Search term %.*s%s ignored: only words of %d to %d characters are indexed.\n",
+                    (int)((length < INDEX_TERM_MAX) ? length : 16), term, (length > INDEX_TERM_MAX) ? "..." : "",
+                    INDEX_TERM_MIN, INDEX_TERM_MAX);
+            }
+        }
+    }
+
+
+static int index_compare_posting(const void *a, const void *b)
+    {
+    const IndexPosting *pa = (const IndexPosting *)a;
+    const IndexPosting *pb = (const IndexPosting *)b;
+
+    if (pa->page != pb->page)
+        {
+        return (pa->page < pb->page) ? -1 : 1;
+        }
+    if (pa->line != pb->line)
+        {
+        return (pa->line < pb->line) ? -1 : 1;
+        }
+    return 0;
+    }
+
+
+static int index_compare_names(const char *a, unsigned int a_length, const char *b, unsigned int b_length)
+    {
+    int order = memcmp(a, b, (a_length < b_length) ? a_length : b_length);
+
+    if (order != 0)
+        {
+        return order;
+        }
+    return (int)a_length - (int)b_length;
+    }
+
+
+static int index_compare_terms(const void *a, const void *b)
+    {
+    const IndexTerm *ta = *(const IndexTerm * const *)a;
+    const IndexTerm *tb = *(const IndexTerm * const *)b;
+
+    return index_compare_names(index_names + ta->name_offset, ta->name_length,
+                               index_names + tb->name_offset, tb->name_length);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start collecting an index to be written to path.
+**
+**  Returns:        FALSE (after a diagnostic) if the file cannot be created.
+**
+**------------------------------------------------------------------------*/
+
+bool index_open(const char *path)
+    {
+    index_init_fold();
+    index_file = fopen(path, "wb");
+    if (index_file == NULL)
+        {
+        fprintf(stderr, "(error) Unable to create search index %s.\n", path);
+        return FALSE;
+        }
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Record the terms of one printed line.
+**
+**  Parameters:     Name        Description.
+**                  text        Line text (without carriage control).
+**                  page        Page the line is printed on.
+**                  line        Line number as printed by -N.
+**
+**  Returns:        void.
+**
+**------------------------------------------------------------------------*/
+
+void index_add_line(const char *text, int page, int line)
+    {
+    char          term[INDEX_TERM_MAX];
+    unsigned int  length;
+    IndexTerm    *entry;
+    IndexPosting *last;
+
+    if (index_file == NULL)
+        {
+        return;
+        }
+
+    while ((length = index_next_term(&text, term, FALSE)) != 0)
+        {
+        entry = index_find(term, length, index_hash(term, length));
+
+        if (entry->count > 0)
+            {
+            last = &entry->postings[entry->count - 1];
+            if (last->page == (unsigned int)page && last->line == (unsigned int)line)
+                {
+                continue;                   /* term repeated on the line */
+                }
+            if (last->page > (unsigned int)page || (last->page == (unsigned int)page && last->line > (unsigned int)line))
+                {
+                entry->is_sorted = FALSE;   /* overstrike moved back a line */
+                }
+            }
+
+        if (entry->count == entry->size)
+            {
+            entry->size *= 2;
+            entry->postings = (IndexPosting *)index_grow(entry->postings, entry->size * sizeof(IndexPosting));
+            }
+        entry->postings[entry->count].page = (unsigned int)page;
+        entry->postings[entry->count].line = (unsigned int)line;
+        entry->count++;
+        index_posting_total++;
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the index and release it.
+**
+**  Returns:        FALSE if the file could not be written.
+**
+**------------------------------------------------------------------------*/
+
+bool index_close()
+    {
+    IndexHeader  header;
+    IndexEntry   entry;
+    IndexTerm  **order;
+    IndexTerm   *term;
+    unsigned int first = 0;
+    unsigned int kept;
+    unsigned int i;
+    unsigned int j;
+    unsigned int n = 0;
+    bool         ok;
+
+    if (index_file == NULL)
+        {
+        return TRUE;
+        }
+
+    order = (IndexTerm **)index_grow(NULL, (index_used + 1) * sizeof(IndexTerm *));
+    for (i = 0; i < index_slots; i++)
+        {
+        if (index_terms[i].size != 0)
+            {
+            term = &index_terms[i];
+            if (!term->is_sorted)
+                {
+                qsort(term->postings, term->count, sizeof(IndexPosting), index_compare_posting);
+                for (kept = 1, j = 1; j < term->count; j++)
+                    {
+                    if (index_compare_posting(&term->postings[j], &term->postings[kept - 1]) != 0)
+                        {
+                        term->postings[kept++] = term->postings[j];
+                        }
+                    }
+                index_posting_total -= term->count - kept;
+                term->count = kept;
+                }
+            order[n++] = term;
+            }
+        }
+    qsort(order, n, sizeof(IndexTerm *), index_compare_terms);
+
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.term_count = n;
+    header.posting_count = index_posting_total;
+    header.terms_offset = sizeof(IndexHeader);
+    header.names_offset = header.terms_offset + n * sizeof(IndexEntry);
+    header.names_length = index_names_length;
+    header.postings_offset = (header.names_offset + index_names_length + 3) & ~3u;
+    fwrite(&header, sizeof(header), 1, index_file);
+
+    for (i = 0; i < n; i++)
+        {
+        entry.name_offset = order[i]->name_offset;
+        entry.name_length = order[i]->name_length;
+        entry.first_posting = first;
+        entry.posting_count = order[i]->count;
+        first += order[i]->count;
+        fwrite(&entry, sizeof(entry), 1, index_file);
+        }
+
+    fwrite(index_names, 1, index_names_length, index_file);
+    fwrite("\0\0\0", 1, header.postings_offset - header.names_offset - index_names_length, index_file);
+
+    for (i = 0; i < n; i++)
+        {
+        fwrite(order[i]->postings, sizeof(IndexPosting), order[i]->count, index_file);
+        free(order[i]->postings);
+        }
+
+    ok = !ferror(index_file);
+    ok = (fclose(index_file) == 0) && ok;
+    if (!ok)
+        {
+        fprintf(stderr, "(error) Unable to write the search index.\n");
+        }
+
+    free(order);
+    free(index_terms);
+    free(index_names);
+    index_file = NULL;
+    index_terms = NULL;
+    index_names = NULL;
+    index_slots = index_used = index_names_length = index_names_size = 0;
+    index_posting_total = 0;
+    return ok;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Look a term up in a loaded index.
+**
+**  Returns:        The matching entry, or NULL.
+**
+**------------------------------------------------------------------------*/
+
+static const IndexEntry *index_lookup(const char *image, const IndexHeader *header, const char *term, unsigned int length)
+    {
+    const IndexEntry *entries = (const IndexEntry *)(image + header->terms_offset);
+    const char       *names = image + header->names_offset;
+    unsigned int      low = 0;
+    unsigned int      high = header->term_count;
+    unsigned int      mid;
+    int               order;
+
+    while (low < high)
+        {
+        mid = (low + high) / 2;
+        if ((unsigned long long)entries[mid].name_offset + entries[mid].name_length > header->names_length ||
+            (unsigned long long)entries[mid].first_posting + entries[mid].posting_count > header->posting_count)
+            {
+            return NULL;                    //  damaged: the mapping is only checked where it is read
+            }
+        order = index_compare_names(names + entries[mid].name_offset, entries[mid].name_length, term, length);
+        if (order == 0)
+            {
+            return &entries[mid];
+            }
+        if (order < 0)
+            {
+            low = mid + 1;
+            }
+        else
+            {
+            high = mid;
+            }
+        }
+    return NULL;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print the lines that contain every one of the terms.
+**
+**  Parameters:     Name        Description.
+**                  image       The mapped index (header checked).
+**                  terms       Words to find (separated by blanks).
+**
+**  Returns:        Number of matching lines, -1 if no usable term.
+**
+**------------------------------------------------------------------------*/
+
+static int index_search(const char *image, const char *terms)
+    {
+    const IndexHeader  *header = (const IndexHeader *)image;
+    const IndexPosting *postings = (const IndexPosting *)(image + header->postings_offset);
+    const IndexEntry   *entry;
+    IndexPosting       *matches = NULL;
+    unsigned int        match_count = 0;
+    unsigned int        kept;
+    unsigned int        i;
+    unsigned int        j;
+    unsigned int        length;
+    char                term[INDEX_TERM_MAX];
+    bool                first = TRUE;
+
+    index_init_fold();
+    while ((length = index_next_term(&terms, term, TRUE)) != 0)
+        {
+        entry = index_lookup(image, header, term, length);
+        if (entry == NULL)
+            {
+            match_count = 0;
+            first = FALSE;
+            break;
+            }
+
+        if (first)
+            {
+            matches = (IndexPosting *)index_grow(NULL, (entry->posting_count + 1) * sizeof(IndexPosting));
+            memcpy(matches, postings + entry->first_posting, entry->posting_count * sizeof(IndexPosting));
+            match_count = entry->posting_count;
+            first = FALSE;
+            continue;
+            }
+
+        /*
+        **  Both lists are in (page, line) order: intersect by merging
+        */
+        for (i = 0, j = 0, kept = 0; i < match_count && j < entry->posting_count; )
+            {
+            int order = index_compare_posting(&matches[i], &postings[entry->first_posting + j]);
+            if (order == 0)
+                {
+                matches[kept++] = matches[i];
+                i++;
+                j++;
+                }
+            else if (order < 0)
+                {
+                i++;
+                }
+            else
+                {
+                j++;
+                }
+            }
+        match_count = kept;
+        }
+
+    if (first)
+        {
+        fprintf(stderr, "(error) No search term of %d to %d characters was given.\n", INDEX_TERM_MIN, INDEX_TERM_MAX);
+        return -1;
+        }
+    for (i = 0; i < match_count; i++)
+        {
+        printf("page %u line %u\n", matches[i].page, matches[i].line);
+        }
+    free(matches);
+    return (int)match_count;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Search an index file in place.
+**
+**  Parameters:     Name        Description.
+**                  path        Index written by an earlier conversion.
+**                  terms       Words to find (separated by blanks).
+**
+**  Returns:        Number of matching lines, -1 if the index or the
+**                  terms are unusable.
+**
+**------------------------------------------------------------------------*/
+
+int index_query(const char *path, const char *terms)
+    {
+    const char        *image = NULL;
+    const IndexHeader *header;
+    long long          size;
+    int                result = -1;
+
+#ifdef _WIN32
+    HANDLE        file;
+    HANDLE        mapping = NULL;
+    LARGE_INTEGER file_size;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        {
+        fprintf(stderr, "(error) Unable to open search index %s.\n", path);
+        return -1;
+        }
+    size = GetFileSizeEx(file, &file_size) ? file_size.QuadPart : 0;
+    if (size >= (long long)sizeof(IndexHeader))
+        {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        image = (mapping == NULL) ? NULL : (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+    struct stat st;
+    int         file;
+    void       *view = MAP_FAILED;
+
+    file = open(path, O_RDONLY);
+    if (file < 0)
+        {
+        fprintf(stderr, "(error) Unable to open search index %s.\n", path);
+        return -1;
+        }
+    size = (fstat(file, &st) == 0 && S_ISREG(st.st_mode)) ? (long long)st.st_size : 0;
+    if (size >= (long long)sizeof(IndexHeader))
+        {
+        view = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, file, 0);
+        }
+    image = (view == MAP_FAILED) ? NULL : (const char *)view;
+#endif
+
+    header = (const IndexHeader *)image;
+    if (image == NULL || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->terms_offset + (unsigned long long)header->term_count * sizeof(IndexEntry) > (unsigned long long)size ||
+        header->names_offset + (unsigned long long)header->names_length > (unsigned long long)size ||
+        header->postings_offset + (unsigned long long)header->posting_count * sizeof(IndexPosting) > (unsigned long long)size)
+        {
+        fprintf(stderr, "(error) %s is not a txt2pdf search index.\n", path);
+        }
+    else
+        {
+        result = index_search(image, terms);
+        }
+
+#ifdef _WIN32
+    if (image != NULL)
+        {
+        UnmapViewOfFile(image);
+        }
+    if (mapping != NULL)
+        {
+        CloseHandle(mapping);
+        }
+    CloseHandle(file);
+#else
+    if (image != NULL)
+        {
+        munmap(view, (size_t)size);
+        }
+    close(file);
+#endif
+    return result;
+    }
@@ -0,0 +1,21 @@
+/**
+ *
+ *  Name: SearchIndex.h
+ *
+ *  Description:
+ *
+ *      Inverted index of the words in a listing, written by txt2pdf next
+ *      to the PDF.  Each term maps to the (page, line) positions it was
+ *      printed at; the file is laid out so it can be searched in place.
+ *
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+bool index_open(const char *path);
+void index_add_line(const char *text, int page, int line);
+bool index_close();
+int  index_query(const char *path, const char *terms);
+
+#endif //SEARCHINDEX_H
@@ -0,0 +1,132 @@
+/**
+ *
+ *  Name: Sha256.cpp
+ *
+ *  Description:
+ *
+ *      SHA-256 (FIPS 180-4).  Kept in the tree rather than taken from
+ *      BCrypt, which needs Vista or later.
+ *
+ */
+
+#include "stdafx.h"
+#include <string.h>
+#include "Sha256.h"
+
+#define ROTR32(x, r)    (((x) >> (r)) | ((x) << (32 - (r))))
+
+static const unsigned int CRound[64] =
+    {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+    };
+
+static void sha256_block(Sha256 *sha, const unsigned char *block)
+    {
+    unsigned int w[64];
+    unsigned int v[8];
+    unsigned int t1;
+    unsigned int t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        {
+        w[i] = ((unsigned int)block[4 * i] << 24) | ((unsigned int)block[4 * i + 1] << 16) |
+               ((unsigned int)block[4 * i + 2] << 8) | block[4 * i + 3];
+        }
+    for (i = 16; i < 64; i++)
+        {
+        w[i] = w[i - 16] + (ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+               w[i - 7] + (ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+        }
+
+    memcpy(v, sha->state, sizeof(v));
+    for (i = 0; i < 64; i++)
+        {
+        t1 = v[7] + (ROTR32(v[4], 6) ^ ROTR32(v[4], 11) ^ ROTR32(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+             CRound[i] + w[i];
+        t2 = (ROTR32(v[0], 2) ^ ROTR32(v[0], 13) ^ ROTR32(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+        }
+    for (i = 0; i < 8; i++)
+        {
+        sha->state[i] += v[i];
+        }
+    }
+
+void sha256_init(Sha256 *sha)
+    {
+    static const unsigned int initial[8] =
+        { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+
+    memcpy(sha->state, initial, sizeof(sha->state));
+    sha->length = 0;
+    sha->buffered = 0;
+    }
+
+void sha256_update(Sha256 *sha, const void *data, size_t length)
+    {
+    const unsigned char *p = (const unsigned char *)data;
+    size_t take;
+
+    sha->length += length;
+    if (sha->buffered > 0)
+        {
+        take = (length < 64 - sha->buffered) ? length : 64 - sha->buffered;
+        memcpy(sha->buffer + sha->buffered, p, take);
+        sha->buffered += take;
+        p += take;
+        length -= take;
+        if (sha->buffered < 64)
+            {
+            return;
+            }
+        sha256_block(sha, sha->buffer);
+        sha->buffered = 0;
+        }
+    for (; length >= 64; p += 64, length -= 64)
+        {
+        sha256_block(sha, p);
+        }
+    memcpy(sha->buffer, p, length);
+    sha->buffered = length;
+    }
+
+void sha256_final(Sha256 *sha, unsigned char *hash)
+    {
+    unsigned long long bits = sha->length * 8;
+    int i;
+
+    /*
+    **  0x80, zeros to 56 mod 64, then the bit length big-endian
+    */
+    sha->buffer[sha->buffered++] = 0x80;
+    if (sha->buffered > 56)
+        {
+        memset(sha->buffer + sha->buffered, 0, 64 - sha->buffered);
+        sha256_block(sha, sha->buffer);
+        sha->buffered = 0;
+        }
+    memset(sha->buffer + sha->buffered, 0, 56 - sha->buffered);
+    for (i = 0; i < 8; i++)
+        {
+        sha->buffer[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+        }
+    sha256_block(sha, sha->buffer);
+
+    for (i = 0; i < 8; i++)
+        {
+        hash[4 * i] = (unsigned char)(sha->state[i] >> 24);
+        hash[4 * i + 1] = (unsigned char)(sha->state[i] >> 16);
+        hash[4 * i + 2] = (unsigned char)(sha->state[i] >> 8);
+        hash[4 * i + 3] = (unsigned char)sha->state[i];
+        }
+    }
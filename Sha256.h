@@ -0,0 +1,33 @@
+/**
+ *
+ *  Name: Sha256.h
+ *
+ *  Description:
+ *
+ *      SHA-256 (FIPS 180-4), for keys that must not be forgeable by
+ *      whoever else can write the content (the -c conversion cache).
+ *
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+
+#define SHA256_BYTES    32
+
+struct _Sha256
+    {
+    unsigned int       state[8];
+    unsigned long long length;
+    unsigned char      buffer[64];
+    size_t             buffered;
+    };
+
+typedef _Sha256 Sha256;
+
+void sha256_init(Sha256 *sha);
+void sha256_update(Sha256 *sha, const void *data, size_t length);
+void sha256_final(Sha256 *sha, unsigned char *hash);
+
+#endif //SHA256_H
@@ -0,0 +1,878 @@
+/**
+ *
+ *  Name: SpoolInput.cpp
+ *
+ *  Description:
+ *
+ *      Line reader for txt2pdf input.
+ *
+ *      Plain input is read in large blocks and split into lines with
+ *      memchr().  Gzip (1F 8B) and Zstandard (28 B5 2F FD) input is
+ *      decompressed by a decoder thread into a small ring of blocks, so
+ *      decompression overlaps with the page formatting done by the
+ *      caller.
+ *
+ *      Record formats are sliced straight out of the current block: a
+ *      record that lies inside one block is trimmed of its trailing pad
+ *      and translated (if EBCDIC) as it is copied into the caller's
+ *      buffer, so there is no staging copy and no conversion pass.
+ *
+ *      A followed file (-F) has no end: at the end of the data the
+ *      reader polls for more, calling back between polls so the caller
+ *      can finish documents while the writer of the file is quiet.  A
+ *      line is only returned once its newline has arrived.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Inflate.h"
+#include "Zstd.h"
+#include "TextCodec.h"
+#include "TraceEvents.h"
+#include "SpoolInput.h"
+
+#define INPUT_BLOCK     (64 * 1024)
+#define INPUT_RING      4
+#define INPUT_POLL_MS   100         /* followed file: wait between reads at the end */
+
+#define MIN(x, y)       ((x) < (y) ? (x) : (y))
+
+#ifdef _WIN32
+#define input_fstat         _fstat64
+typedef struct _stat64      InputStat;
+#else
+#define input_fstat         fstat
+typedef struct stat         InputStat;
+#endif
+
+static FILE          *input_file = NULL;
+static bool           input_is_compressed = FALSE;
+static bool           input_is_zstd = FALSE;
+static unsigned char  input_raw[INPUT_BLOCK];
+
+static const unsigned char *input_next = NULL;
+static size_t               input_avail = 0;
+static bool                 input_eof = FALSE;
+
+static int            input_format = INPUT_LINES;
+static size_t         input_lrecl = 0;
+static bool           input_is_ebcdic = FALSE;
+static const unsigned char *input_code_page = NULL;    /* -m translation, NULL for none */
+static long           input_record_count = 0;
+static bool           input_is_blocked = FALSE;     /* variable records grouped behind BDWs */
+static bool           input_blocks_checked = FALSE;
+static size_t         input_block_left = 0;         /* bytes of the current block not yet read */
+static long long      input_consumed = 0;       /* bytes (decompressed) handed out */
+static long long      input_line_start = 0;     /* offset of the last line returned */
+static InputIdle      input_idle = NULL;        /* -F: called while waiting for data */
+
+/**
+ *  Ring of decompressed blocks filled by the decoder thread
+ */
+
+static unsigned char  input_ring[INPUT_RING][INPUT_BLOCK];
+static size_t         input_ring_fill[INPUT_RING];
+static int            input_ring_head = 0;      /* next block to read */
+static int            input_ring_count = 0;     /* blocks ready */
+static int            input_ring_tail = 0;      /* block being filled */
+static bool           input_ring_done = FALSE;
+static bool           input_ring_held = FALSE;  /* reader owns the head block */
+static bool           input_ring_stop = FALSE;  /* input_abort(): decoder to give up */
+static int            input_inflate_result = INFLATE_OK;
+static long           input_ring_blocks = 0;    /* blocks decoded (trace sampling) */
+static long long      input_block_start = 0;    /* trace: decoding of this block began */
+
+static std::thread             input_thread;
+static std::mutex              input_lock;
+static std::condition_variable input_ready;
+static std::condition_variable input_space;
+
+
+static bool input_refill_raw(InflateSource *source)
+    {
+    size_t got = fread(input_raw, 1, sizeof(input_raw), input_file);
+
+    source->next = input_raw;
+    source->avail = got;
+    return (got > 0);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Trace the decoding of the block just filled (-Y).
+**
+**  Parameters:     Name        Description.
+**                  fill        Bytes in the block.
+**
+**------------------------------------------------------------------------*/
+
+static void input_trace_block(size_t fill)
+    {
+    char args[32];
+
+    if (trace_is_sampled(input_ring_blocks++))
+        {
+        snprintf(args, sizeof(args), "\"bytes\":%ld", (long)fill);
+        trace_span(input_is_zstd ? "zstd" : "inflate", "input", input_block_start, args);
+        }
+    }
+
+
+static bool input_inflated(void *, const unsigned char *data, size_t length)
+    {
+    long long stall_start = -1;
+    size_t    chunk;
+    size_t   *fill;
+    bool      is_stopped;
+
+    while (length > 0)
+        {
+        fill = &input_ring_fill[input_ring_tail];
+        chunk = MIN(length, (size_t)INPUT_BLOCK - *fill);
+        memcpy(input_ring[input_ring_tail] + *fill, data, chunk);
+        *fill += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (*fill == INPUT_BLOCK)
+            {
+            input_trace_block(INPUT_BLOCK);
+
+                {
+                /*
+                **  Publish the block once the slot after it is free
+                */
+                std::unique_lock<std::mutex> guard(input_lock);
+                if (input_ring_count >= INPUT_RING - 1 && trace_is_enabled)
+                    {
+                    stall_start = trace_now();
+                    }
+                while (input_ring_count >= INPUT_RING - 1 && !input_ring_stop)
+                    {
+                    input_space.wait(guard);
+                    }
+                is_stopped = input_ring_stop;
+                if (!is_stopped)
+                    {
+                    input_ring_count++;
+                    input_ring_tail = (input_ring_tail + 1) % INPUT_RING;
+                    input_ring_fill[input_ring_tail] = 0;
+                    }
+                }
+            if (is_stopped)
+                {
+                return FALSE;
+                }
+            input_ready.notify_one();
+
+            if (stall_start >= 0)
+                {
+                trace_span("stall", "input", stall_start, NULL);
+                stall_start = -1;
+                }
+            if (trace_is_enabled)
+                {
+                input_block_start = trace_now();
+                }
+            }
+        }
+    return TRUE;
+    }
+
+
+static void input_decoder(const unsigned char *first, size_t first_length)
+    {
+    InflateSource source;
+    int result;
+
+    source.next = first;
+    source.avail = first_length;
+    source.refill = input_refill_raw;
+    source.write = input_inflated;
+    source.context = NULL;
+
+    if (trace_is_enabled)
+        {
+        trace_thread_name("decoder");
+        input_ring_blocks = 0;
+        input_block_start = trace_now();
+        }
+
+    result = input_is_zstd ? zstd_decompress(&source) : inflate_gzip(&source);
+    if (input_ring_fill[input_ring_tail] > 0)
+        {
+        input_trace_block(input_ring_fill[input_ring_tail]);
+        }
+
+        {
+        std::lock_guard<std::mutex> guard(input_lock);
+        if (input_ring_fill[input_ring_tail] > 0)
+            {
+            input_ring_tail = (input_ring_tail + 1) % INPUT_RING;
+            input_ring_count++;
+            }
+        input_inflate_result = result;
+        input_ring_done = TRUE;
+        }
+    input_ready.notify_one();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Make the next block of (decompressed) input current.
+**
+**  Returns:        FALSE at end of input.
+**
+**------------------------------------------------------------------------*/
+
+static bool input_fill()
+    {
+    size_t got;
+
+    if (input_eof)
+        {
+        return FALSE;
+        }
+
+    if (!input_is_compressed)
+        {
+        got = fread(input_raw, 1, sizeof(input_raw), input_file);
+        while (got == 0 && input_idle != NULL && !ferror(input_file) && input_idle())
+            {
+            clearerr(input_file);
+            std::this_thread::sleep_for(std::chrono::milliseconds(INPUT_POLL_MS));
+            got = fread(input_raw, 1, sizeof(input_raw), input_file);
+            }
+        input_next = input_raw;
+        input_avail = got;
+        input_eof = (got == 0);
+        return !input_eof;
+        }
+
+        {
+        std::unique_lock<std::mutex> guard(input_lock);
+        if (input_ring_held)
+            {
+            /*
+            **  Give the block just consumed back to the decoder
+            */
+            input_ring_held = FALSE;
+            input_ring_head = (input_ring_head + 1) % INPUT_RING;
+            input_ring_count--;
+            input_space.notify_one();
+            }
+        while (input_ring_count == 0 && !input_ring_done)
+            {
+            input_ready.wait(guard);
+            }
+        if (input_ring_count > 0)
+            {
+            input_ring_held = TRUE;
+            input_next = input_ring[input_ring_head];
+            input_avail = input_ring_fill[input_ring_head];
+            return TRUE;
+            }
+        }
+
+    input_eof = TRUE;
+    input_thread.join();
+    if (input_inflate_result != INFLATE_OK)
+        {
+        fprintf(stderr, "(error) Input: %s.\n",
+                input_is_zstd ? zstd_error(input_inflate_result) : inflate_error(input_inflate_result));
+        exit(1);
+        }
+    return FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy up to length bytes of input, crossing blocks.
+**
+**  Parameters:     Name        Description.
+**                  target      Receives the bytes (NULL to skip them).
+**                  length      Number of bytes wanted.
+**                  translate   TRUE to apply the EBCDIC translation.
+**
+**  Returns:        Number of bytes taken (short only at end of input).
+**
+**------------------------------------------------------------------------*/
+
+static size_t input_take(unsigned char *target, size_t length, bool translate)
+    {
+    size_t done = 0;
+    size_t chunk;
+
+    while (done < length)
+        {
+        if (input_avail == 0 && !input_fill())
+            {
+            break;
+            }
+        chunk = MIN(length - done, input_avail);
+        if (target != NULL)
+            {
+            if (translate && input_is_ebcdic)
+                {
+                codec_ebcdic_to_latin1(target + done, input_next, chunk);
+                }
+            else
+                {
+                memcpy(target + done, input_next, chunk);
+                }
+            }
+        input_next += chunk;
+        input_avail -= chunk;
+        input_consumed += chunk;
+        done += chunk;
+        }
+
+    return done;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Length of a block described by a BDW.
+**
+**  Parameters:     Name        Description.
+**                  bdw         The four descriptor bytes.
+**
+**  Returns:        Block length including the BDW, 0 if bdw is not one.
+**
+**  Description:    A BDW is a big-endian length and two zero bytes like
+**                  an RDW, or with the top bit set a 31 bit length (the
+**                  large block interface).
+**
+**------------------------------------------------------------------------*/
+
+static size_t input_bdw_length(const unsigned char *bdw)
+    {
+    size_t length;
+
+    if ((bdw[0] & 0x80) != 0)
+        {
+        length = ((size_t)(bdw[0] & 0x7F) << 24) | ((size_t)bdw[1] << 16) | ((size_t)bdw[2] << 8) | bdw[3];
+        }
+    else
+        {
+        length = (bdw[2] != 0 || bdw[3] != 0) ? 0 : ((size_t)bdw[0] << 8) | bdw[1];
+        }
+    return (length < 4) ? 0 : length;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decide whether variable records come in blocks.
+**
+**  Description:    A file copied with its block descriptor words starts
+**                  with a BDW directly followed by the RDW of the first
+**                  record, which must fit the block.  A file of bare
+**                  records only looks the same if the third and fourth
+**                  bytes of its first record are zero, which no text
+**                  record has.
+**
+**------------------------------------------------------------------------*/
+
+static void input_check_blocks()
+    {
+    size_t block;
+    size_t record;
+
+    input_blocks_checked = TRUE;
+    if (input_avail == 0 && !input_fill())
+        {
+        return;
+        }
+    if (input_avail < 8)
+        {
+        return;
+        }
+    block = input_bdw_length(input_next);
+    record = ((size_t)input_next[4] << 8) | input_next[5];
+    input_is_blocked = (block >= 8 && record >= 4 && record <= block - 4 && input_next[6] == 0 && input_next[7] == 0);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the BDW of the next block of variable records.
+**
+**  Returns:        FALSE at end of input.
+**
+**------------------------------------------------------------------------*/
+
+static bool input_next_block()
+    {
+    unsigned char bdw[4];
+    size_t        length = 0;
+
+    while (length == 0)
+        {
+        if (input_avail == 0 && !input_fill())
+            {
+            return FALSE;
+            }
+        if (input_take(bdw, 4, FALSE) != 4 || (length = input_bdw_length(bdw)) == 0)
+            {
+            fprintf(stderr, "(error) Input: bad block descriptor word before record %ld.\n", input_record_count);
+            exit(1);
+            }
+        length -= 4;                        /* an empty block has no records */
+        }
+    input_block_left = length;
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read one fixed or variable length record (variable
+**                  records may be grouped in blocks behind BDWs).
+**
+**  Parameters:     Name        Description.
+**                  buffer      Receives the record, trailing blanks removed.
+**                  size        Size of buffer; longer records are cut.
+**
+**  Returns:        buffer, or NULL at end of input.
+**
+**------------------------------------------------------------------------*/
+
+static char *input_get_record(char *buffer, size_t size)
+    {
+    unsigned char  rdw[4];
+    unsigned char *target = (unsigned char *)buffer;
+    size_t         length = input_lrecl;
+    size_t         kept;
+    size_t         got;
+
+    if (input_avail == 0 && !input_fill())
+        {
+        return NULL;
+        }
+    input_record_count++;
+
+    if (input_format == INPUT_VARIABLE)
+        {
+        if (!input_blocks_checked)
+            {
+            input_check_blocks();
+            }
+        if (input_is_blocked && input_block_left == 0 && !input_next_block())
+            {
+            return NULL;
+            }
+
+        /*
+        **  RDW: big-endian length including itself, then two zero bytes
+        **  (non-zero there marks a spanned VBS segment, not supported)
+        */
+        if (input_take(rdw, 4, FALSE) != 4 || (length = ((size_t)rdw[0] << 8) | rdw[1]) < 4 || rdw[2] != 0 || rdw[3] != 0)
+            {
+            fprintf(stderr, "(error) Input: bad record descriptor word at record %ld.\n", input_record_count);
+            exit(1);
+            }
+        if (input_is_blocked)
+            {
+            if (length > input_block_left)
+                {
+                fprintf(stderr, "(error) Input: record %ld runs past the end of its block.\n", input_record_count);
+                exit(1);
+                }
+            input_block_left -= length;
+            }
+        length -= 4;
+        }
+
+    kept = MIN(length, size - 1);
+
+    if (input_avail >= length)
+        {
+        /*
+        **  Whole record in this block: trim the pad before copying
+        */
+        kept = codec_trim_length(input_next, kept, input_is_ebcdic ? 0x40 : ' ');
+        if (input_is_ebcdic)
+            {
+            codec_ebcdic_to_latin1(target, input_next, kept);
+            }
+        else
+            {
+            memcpy(target, input_next, kept);
+            }
+        input_next += length;
+        input_avail -= length;
+        input_consumed += length;
+        }
+    else
+        {
+        got = input_take(target, kept, TRUE);
+        if (got == kept)
+            {
+            got += input_take(NULL, length - kept, TRUE);
+            }
+        if (got < length)
+            {
+            fprintf(stderr, "(warning) Input: record %ld is %ld bytes short.\n", input_record_count, (long)(length - got));
+            kept = MIN(got, kept);
+            }
+        kept = codec_trim_length(target, kept, ' ');
+        }
+
+    buffer[kept] = '\0';
+    return buffer;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Select the record format of the input.
+**
+**  Parameters:     Name        Description.
+**                  format      INPUT_LINES, INPUT_FIXED or INPUT_VARIABLE.
+**                  lrecl       Record length for INPUT_FIXED.
+**                  ebcdic      TRUE to translate from EBCDIC (code page 037).
+**
+**  Returns:        void.
+**
+**------------------------------------------------------------------------*/
+
+void input_set_records(int format, size_t lrecl, bool ebcdic)
+    {
+    input_format = format;
+    input_lrecl = lrecl;
+    input_is_ebcdic = ebcdic;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Translate every line returned through a code page
+**                  table (see CodePage.cpp); NULL turns it off.
+**
+**------------------------------------------------------------------------*/
+
+void input_set_code_page(const unsigned char *table)
+    {
+    input_code_page = table;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Follow the input (before input_open()): at the end of
+**                  the data wait for more instead of ending.
+**
+**  Parameters:     Name        Description.
+**                  idle        Called before each poll; returns FALSE
+**                              to end the input there.  NULL reads to
+**                              the end as usual.
+**
+**  Description:    Only plain (not compressed) input is followed.
+**
+**------------------------------------------------------------------------*/
+
+void input_set_follow(InputIdle idle)
+    {
+    input_idle = idle;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open the input and detect its compression.
+**
+**  Parameters:     Name        Description.
+**                  path        File name, NULL or "-" for standard input.
+**
+**  Returns:        FALSE (after a diagnostic) if it cannot be read.
+**
+**------------------------------------------------------------------------*/
+
+bool input_open(const char *path)
+    {
+    static bool is_abort_registered = FALSE;
+    size_t      got;
+
+    if (path == NULL || strcmp(path, "-") == 0)
+        {
+        _setmode(_fileno(stdin), _O_BINARY);
+        input_file = stdin;
+        }
+    else
+        {
+        input_file = fopen(path, "rb");
+        if (input_file == NULL)
+            {
+            fprintf(stderr, "(error) Unable to open input file %s.\n", path);
+            return FALSE;
+            }
+        }
+
+    got = fread(input_raw, 1, sizeof(input_raw), input_file);
+    input_next = input_raw;
+    input_avail = got;
+    input_eof = (got == 0 && input_idle == NULL);
+    input_is_blocked = FALSE;
+    input_blocks_checked = FALSE;
+    input_block_left = 0;
+    input_is_zstd = (got >= 4 && input_raw[0] == 0x28 && input_raw[1] == 0xB5 && input_raw[2] == 0x2F && input_raw[3] == 0xFD);
+    input_is_compressed = input_is_zstd || (got >= 2 && input_raw[0] == 0x1F && input_raw[1] == 0x8B);
+
+    if (input_is_compressed)
+        {
+        input_ring_head = 0;
+        input_ring_tail = 0;
+        input_ring_count = 0;
+        input_ring_fill[0] = 0;
+        input_ring_done = FALSE;
+        input_ring_held = FALSE;
+        input_ring_stop = FALSE;
+        input_avail = 0;
+        input_thread = std::thread(input_decoder, input_raw, got);
+        if (!is_abort_registered)
+            {
+            /*
+            **  Any exit() while the decoder runs must stop and join it
+            **  first: a joinable std::thread terminates the process when
+            **  destroyed, and a decoder waiting for ring space never ends
+            */
+            atexit(input_abort);
+            is_abort_registered = TRUE;
+            }
+        }
+
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read one line (or record), like gets_s().
+**
+**  Parameters:     Name        Description.
+**                  buffer      Receives the line without its newline
+**                              (a CR before the newline is dropped;
+**                              EBCDIC lines end in NL, 0x15).
+**                  size        Size of buffer; longer lines are cut.
+**
+**  Returns:        buffer, or NULL at end of input.
+**
+**------------------------------------------------------------------------*/
+
+char *input_gets(char *buffer, size_t size)
+    {
+    const unsigned char *newline;
+    size_t length = 0;
+    size_t chunk;
+    bool   found = FALSE;
+    bool   any = FALSE;
+    int    delimiter = input_is_ebcdic ? 0x15 : '\n';
+
+    input_line_start = input_consumed;
+
+    if (input_format != INPUT_LINES)
+        {
+        buffer = input_get_record(buffer, size);
+        if (buffer != NULL && input_code_page != NULL)
+            {
+            codec_translate((unsigned char *)buffer, strlen(buffer), input_code_page);
+            }
+        return buffer;
+        }
+
+    while (!found)
+        {
+        if (input_avail == 0 && !input_fill())
+            {
+            break;
+            }
+        any = TRUE;
+
+        newline = (const unsigned char *)memchr(input_next, delimiter, input_avail);
+        chunk = (newline != NULL) ? (size_t)(newline - input_next) : input_avail;
+
+        if (length < size - 1)
+            {
+            if (input_is_ebcdic)
+                {
+                codec_ebcdic_to_latin1((unsigned char *)buffer + length, input_next, MIN(chunk, size - 1 - length));
+                }
+            else
+                {
+                memcpy(buffer + length, input_next, MIN(chunk, size - 1 - length));
+                }
+            length += MIN(chunk, size - 1 - length);
+            }
+
+        if (newline != NULL)
+            {
+            chunk++;
+            found = TRUE;
+            }
+        input_next += chunk;
+        input_avail -= chunk;
+        input_consumed += chunk;
+        }
+
+    if (!any)
+        {
+        return NULL;
+        }
+
+    if (found && length > 0 && buffer[length - 1] == '\r')
+        {
+        length--;
+        }
+    buffer[length] = '\0';
+    if (input_code_page != NULL)
+        {
+        codec_translate((unsigned char *)buffer, length, input_code_page);
+        }
+    return buffer;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Identify the input file, so a journal made for one
+**                  listing is not continued on another.
+**
+**  Parameters:     Name        Description.
+**                  size        Receives the file size in bytes.
+**                  mtime       Receives the modification time.
+**
+**  Returns:        FALSE for standard input, which has no identity.
+**
+**------------------------------------------------------------------------*/
+
+bool input_identity(long long *size, long long *mtime)
+    {
+    InputStat status;
+
+    if (input_file == NULL || input_file == stdin || input_fstat(_fileno(input_file), &status) != 0)
+        {
+        return FALSE;
+        }
+    *size = (long long)status.st_size;
+    *mtime = (long long)status.st_mtime;
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Offset of the line (record) most recently returned by
+**                  input_gets(), counted in decompressed bytes.
+**
+**------------------------------------------------------------------------*/
+
+long long input_line_offset()
+    {
+    return input_line_start;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Skip to an offset from input_line_offset() (resume).
+**
+**  Returns:        FALSE if the input ends first.
+**
+**------------------------------------------------------------------------*/
+
+bool input_skip(long long offset)
+    {
+    size_t chunk;
+
+    if (input_format == INPUT_VARIABLE && !input_blocks_checked)
+        {
+        input_check_blocks();
+        }
+    if (input_is_blocked)
+        {
+        /*
+        **  Walk the blocks so the record reader knows where the next
+        **  BDW is
+        */
+        while (input_consumed < offset)
+            {
+            if (input_block_left == 0 && !input_next_block())
+                {
+                return FALSE;
+                }
+            chunk = (size_t)MIN(offset - input_consumed, (long long)input_block_left);
+            if (input_take(NULL, chunk, FALSE) != chunk)
+                {
+                return FALSE;
+                }
+            input_block_left -= chunk;
+            }
+        return TRUE;
+        }
+
+    if (!input_is_compressed && input_file != stdin && offset > input_consumed + (long long)input_avail &&
+        _fseeki64(input_file, offset, SEEK_SET) == 0)
+        {
+        /*
+        **  Plain file: seek instead of reading up to the offset
+        */
+        input_avail = 0;
+        input_eof = FALSE;
+        input_consumed = offset;
+        return TRUE;
+        }
+
+    while (input_consumed < offset)
+        {
+        chunk = (size_t)MIN(offset - input_consumed, (long long)INPUT_BLOCK);
+        if (input_take(NULL, chunk, FALSE) != chunk)
+            {
+            return FALSE;
+            }
+        }
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Stop the decoder thread, if one is running, and wait
+**                  for it to end (also run at exit).
+**
+**------------------------------------------------------------------------*/
+
+void input_abort()
+    {
+    if (!input_thread.joinable())
+        {
+        return;
+        }
+
+        {
+        std::lock_guard<std::mutex> guard(input_lock);
+        input_ring_stop = TRUE;
+        }
+    input_space.notify_one();
+    input_thread.join();
+    }
+
+
+void input_close()
+    {
+    if (input_is_compressed)
+        {
+        /*
+        **  Let the decoder run to the end if the reader stopped early
+        */
+        while (input_fill())
+            {
+            input_avail = 0;
+            }
+        }
+
+    if (input_file != NULL && input_file != stdin)
+        {
+        fclose(input_file);
+        }
+    input_file = NULL;
+    }
@@ -0,0 +1,38 @@
+/**
+ *
+ *  Name: SpoolInput.h
+ *
+ *  Description:
+ *
+ *      Line reader for txt2pdf input.  Reads standard input or a named
+ *      file, recognising gzip and Zstandard compressed spool files by
+ *      their magic number and decompressing them on a separate thread.  Mainframe
+ *      spools can be read as fixed (F/FB/FBA) or RDW-prefixed variable
+ *      (V/VB/VBA) records, with or without block descriptor words,
+ *      optionally translated from EBCDIC.
+ *
+ */
+
+#ifndef SPOOLINPUT_H
+#define SPOOLINPUT_H
+
+#include <stddef.h>
+
+#define INPUT_LINES     0           /* newline delimited text */
+#define INPUT_FIXED     1           /* RECFM=F/FB/FBA, no delimiters */
+#define INPUT_VARIABLE  2           /* RECFM=V/VB/VBA, 4 byte RDW per record, BDWs optional */
+
+typedef bool (*InputIdle)();
+
+void  input_set_records(int format, size_t lrecl, bool ebcdic);
+void  input_set_code_page(const unsigned char *table);
+void  input_set_follow(InputIdle idle);
+bool  input_open(const char *path);
+char *input_gets(char *buffer, size_t size);
+long long input_line_offset();
+bool  input_identity(long long *size, long long *mtime);
+bool  input_skip(long long offset);
+void  input_abort();
+void  input_close();
+
+#endif //SPOOLINPUT_H
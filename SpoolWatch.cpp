@@ -0,0 +1,638 @@
+/**
+ *
+ *  Name: SpoolWatch.cpp
+ *
+ *  Description:
+ *
+ *      Spool directory watch mode for txt2pdf (-w).
+ *
+ *      The directory is watched for files that have been completely
+ *      written (ReadDirectoryChangesW on Windows, checked by opening the
+ *      file exclusively; inotify IN_CLOSE_WRITE / IN_MOVED_TO elsewhere).
+ *      Each file is queued and converted by a txt2pdf child process run
+ *      with the watcher's own options, at most `workers` at a time.  The
+ *      conversion state of txt2pdf is process wide, so the pool is one of
+ *      processes rather than threads; the watcher itself stays resident
+ *      and starts a worker the moment a file lands.
+ *
+ *      The PDF is written to done/NAME.pdf.part and renamed into place on
+ *      success; the input is then renamed into done/ (or failed/).  Both
+ *      renames stay inside the spool volume, so neither is ever seen half
+ *      done.  A line on stderr per file reports the queue depth, workers
+ *      running and the queued-to-finished latency.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "SpoolWatch.h"
+
+#ifdef _WIN32
+#define WATCH_SEPARATOR     "\\"
+#define WATCH_MAX_WORKERS   63          /* WaitForMultipleObjects limit, less the directory */
+typedef HANDLE WatchProcess;
+#else
+#define WATCH_SEPARATOR     "/"
+#define WATCH_MAX_WORKERS   64
+typedef pid_t  WatchProcess;
+#endif
+
+#define WATCH_PATH_MAX      1024
+#define WATCH_ARGS_MAX      256
+
+struct WatchJob
+    {
+    char         name[260];
+    long long    queued_ms;
+    long long    started_ms;
+    WatchProcess process;
+    };
+
+static const char *watch_directory;
+static char        watch_self[WATCH_PATH_MAX];
+static char      **watch_argv;
+static int         watch_argc;
+static int         watch_workers;
+
+static std::deque<WatchJob> watch_queue;
+static WatchJob    watch_running[WATCH_MAX_WORKERS];
+static int         watch_running_count = 0;
+
+static long        watch_done_count = 0;
+static long        watch_failed_count = 0;
+static long long   watch_latency_total = 0;
+static long long   watch_latency_max = 0;
+
+
+static long long watch_now()
+    {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+static void watch_path(char *path, const char *subdirectory, const char *name, const char *suffix)
+    {
+    snprintf(path, WATCH_PATH_MAX, "%s%s%s%s%s%s", watch_directory, WATCH_SEPARATOR,
+             subdirectory, (subdirectory[0] != '\0') ? WATCH_SEPARATOR : "", name, suffix);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Name of the PDF for an input (extension replaced).
+**
+**------------------------------------------------------------------------*/
+
+static void watch_output_name(char *output, size_t size, const char *name)
+    {
+    const char *dot = strrchr(name, '.');
+    int length = (dot != NULL && dot != name) ? (int)(dot - name) : (int)strlen(name);
+
+    snprintf(output, size, "%.*s.pdf", length, name);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Queue a file unless it is hidden, temporary or already
+**                  queued or running.
+**
+**------------------------------------------------------------------------*/
+
+static void watch_enqueue(const char *name)
+    {
+    WatchJob job;
+    size_t   length = strlen(name);
+    size_t   i;
+    int      r;
+
+    if (name[0] == '.' || length == 0 || length >= sizeof(job.name) ||
+        (length > 5 && strcmp(name + length - 5, ".part") == 0) ||
+        (length > 4 && strcmp(name + length - 4, ".tmp") == 0))
+        {
+        return;
+        }
+
+    for (i = 0; i < watch_queue.size(); i++)
+        {
+        if (strcmp(watch_queue[i].name, name) == 0)
+            {
+            return;
+            }
+        }
+    for (r = 0; r < watch_running_count; r++)
+        {
+        if (strcmp(watch_running[r].name, name) == 0)
+            {
+            return;
+            }
+        }
+
+    strcpy(job.name, name);
+    job.queued_ms = watch_now();
+    job.started_ms = 0;
+    watch_queue.push_back(job);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Move the input (and PDF) into done/ or failed/.
+**
+**------------------------------------------------------------------------*/
+
+static void watch_finish(WatchJob *job, bool ok)
+    {
+    char      source[WATCH_PATH_MAX];
+    char      target[WATCH_PATH_MAX];
+    char      part[WATCH_PATH_MAX];
+    char      output[300];
+    long long latency = watch_now() - job->queued_ms;
+
+    watch_output_name(output, sizeof(output), job->name);
+    watch_path(part, "done", output, ".part");
+    watch_path(target, "done", output, "");
+
+#ifdef _WIN32
+    if (ok && !MoveFileExA(part, target, MOVEFILE_REPLACE_EXISTING))
+#else
+    if (ok && rename(part, target) != 0)
+#endif
+        {
+        ok = FALSE;
+        }
+    if (!ok)
+        {
+        remove(part);
+        }
+
+    watch_path(source, "", job->name, "");
+    watch_path(target, ok ? "done" : "failed", job->name, "");
+#ifdef _WIN32
+    MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING);
+#else
+    rename(source, target);
+#endif
+
+    if (ok)
+        {
+        watch_done_count++;
+        }
+    else
+        {
+        watch_failed_count++;
+        }
+    watch_latency_total += latency;
+    if (latency > watch_latency_max)
+        {
+        watch_latency_max = latency;
+        }
+
+    fprintf(stderr, "(info) watch: %s %s in %lld ms (waited %lld ms); queue %d, running %d, done %ld, failed %ld, latency avg %lld max %lld ms\n",
+            job->name, ok ? "converted" : "FAILED", latency, job->started_ms - job->queued_ms,
+            (int)watch_queue.size(), watch_running_count - 1, watch_done_count, watch_failed_count,
+            watch_latency_total / (watch_done_count + watch_failed_count), watch_latency_max);
+    }
+
+
+static void watch_remove_running(int index)
+    {
+    watch_running[index] = watch_running[--watch_running_count];
+    }
+
+
+#ifdef _WIN32
+
+/*--------------------------------------------------------------------------
+**  Purpose:        TRUE once the writer has closed the file (Windows has
+**                  no close-write notification, so try an exclusive open).
+**
+**------------------------------------------------------------------------*/
+
+static bool watch_is_complete(const char *name)
+    {
+    char   path[WATCH_PATH_MAX];
+    HANDLE file;
+    DWORD  attributes;
+
+    watch_path(path, "", name, "");
+    attributes = GetFileAttributesA(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        {
+        return FALSE;
+        }
+    file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        {
+        return FALSE;
+        }
+    CloseHandle(file);
+    return TRUE;
+    }
+
+
+static void watch_scan()
+    {
+    char             pattern[WATCH_PATH_MAX];
+    WIN32_FIND_DATAA found;
+    HANDLE           search;
+
+    watch_path(pattern, "", "*", "");
+    search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE)
+        {
+        return;
+        }
+    do
+        {
+        if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            {
+            watch_enqueue(found.cFileName);
+            }
+        }
+    while (FindNextFileA(search, &found));
+    FindClose(search);
+    }
+
+
+static bool watch_start(WatchJob *job)
+    {
+    char                command[8192];
+    char                input[WATCH_PATH_MAX];
+    char                part[WATCH_PATH_MAX];
+    char                output[300];
+    const char         *p;
+    size_t              n = 0;
+    int                 i;
+    SECURITY_ATTRIBUTES inherit = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    STARTUPINFOA        startup;
+    PROCESS_INFORMATION process;
+    HANDLE              stream;
+    BOOL                started;
+
+    watch_path(input, "", job->name, "");
+    watch_output_name(output, sizeof(output), job->name);
+    watch_path(part, "done", output, ".part");
+
+    /*
+    **  "self" "option" ... "input", each quoted
+    */
+    for (i = -1; i <= watch_argc; i++)
+        {
+        p = (i < 0) ? watch_self : (i < watch_argc) ? watch_argv[i] : input;
+        if (i == 0)
+            {
+            continue;                   /* argv[0] is replaced by watch_self */
+            }
+        n += snprintf(command + n, sizeof(command) - n, "%s\"", (n > 0) ? " " : "");
+        for (; *p != '\0' && n < sizeof(command) - 4; p++)
+            {
+            if (*p == '"')
+                {
+                command[n++] = '\\';
+                }
+            command[n++] = *p;
+            }
+        n += snprintf(command + n, sizeof(command) - n, "\"");
+        }
+
+    stream = CreateFileA(part, GENERIC_WRITE, 0, &inherit, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stream == INVALID_HANDLE_VALUE)
+        {
+        return FALSE;
+        }
+
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    startup.hStdOutput = stream;
+    startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    started = CreateProcessA(watch_self, command, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process);
+    CloseHandle(stream);
+    if (!started)
+        {
+        return FALSE;
+        }
+    CloseHandle(process.hThread);
+    job->process = process.hProcess;
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Start queued files whose writers have finished.
+**
+**  Returns:        TRUE if some file is still being written (poll again).
+**
+**------------------------------------------------------------------------*/
+
+static bool watch_dispatch()
+    {
+    size_t i = 0;
+    bool   is_busy = FALSE;
+
+    while (watch_running_count < watch_workers && i < watch_queue.size())
+        {
+        if (!watch_is_complete(watch_queue[i].name))
+            {
+            is_busy = TRUE;
+            i++;
+            continue;
+            }
+        WatchJob job = watch_queue[i];
+        watch_queue.erase(watch_queue.begin() + i);
+        job.started_ms = watch_now();
+        watch_running[watch_running_count++] = job;
+        if (!watch_start(&watch_running[watch_running_count - 1]))
+            {
+            watch_finish(&watch_running[watch_running_count - 1], FALSE);
+            watch_remove_running(watch_running_count - 1);
+            }
+        }
+    return is_busy;
+    }
+
+
+int watch_run(const char *directory, int workers, int argc, char **argv)
+    {
+    char       path[WATCH_PATH_MAX];
+    DWORD      notify[16384];
+    DWORD      got;
+    DWORD      result;
+    DWORD      exit_code;
+    HANDLE     handles[WATCH_MAX_WORKERS + 1];
+    HANDLE     folder;
+    OVERLAPPED overlapped;
+    FILE_NOTIFY_INFORMATION *event;
+    char       name[260];
+    int        length;
+    int        i;
+    bool       is_busy;
+
+    watch_directory = directory;
+    watch_argc = argc;
+    watch_argv = argv;
+    watch_workers = (workers < 1) ? 1 : (workers > WATCH_MAX_WORKERS) ? WATCH_MAX_WORKERS : workers;
+    GetModuleFileNameA(NULL, watch_self, sizeof(watch_self));
+
+    watch_path(path, "done", "", "");
+    CreateDirectoryA(path, NULL);
+    watch_path(path, "failed", "", "");
+    CreateDirectoryA(path, NULL);
+
+    folder = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (folder == INVALID_HANDLE_VALUE)
+        {
+        fprintf(stderr, "(error) Unable to watch spool directory %s.\n", directory);
+        return 1;
+        }
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    fprintf(stderr, "(info) watch: %s with %d workers\n", directory, watch_workers);
+
+    for (;;)
+        {
+        ResetEvent(overlapped.hEvent);
+        ReadDirectoryChangesW(folder, notify, sizeof(notify), FALSE,
+                              FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                              NULL, &overlapped, NULL);
+        watch_scan();                   /* files dropped before (or while) arming */
+
+        for (;;)
+            {
+            is_busy = watch_dispatch();
+
+            handles[0] = overlapped.hEvent;
+            for (i = 0; i < watch_running_count; i++)
+                {
+                handles[i + 1] = watch_running[i].process;
+                }
+            result = WaitForMultipleObjects(watch_running_count + 1, handles, FALSE, is_busy ? 250 : INFINITE);
+
+            if (result == WAIT_OBJECT_0)
+                {
+                if (!GetOverlappedResult(folder, &overlapped, &got, FALSE) || got == 0)
+                    {
+                    break;                  /* buffer overflow: rescan */
+                    }
+                event = (FILE_NOTIFY_INFORMATION *)notify;
+                for (;;)
+                    {
+                    if (event->Action == FILE_ACTION_ADDED || event->Action == FILE_ACTION_MODIFIED ||
+                        event->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                        {
+                        length = WideCharToMultiByte(CP_ACP, 0, event->FileName, event->FileNameLength / sizeof(WCHAR),
+                                                     name, sizeof(name) - 1, NULL, NULL);
+                        name[length] = '\0';
+                        watch_path(path, "", name, "");
+                        if ((GetFileAttributesA(path) & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                            {
+                            watch_enqueue(name);
+                            }
+                        }
+                    if (event->NextEntryOffset == 0)
+                        {
+                        break;
+                        }
+                    event = (FILE_NOTIFY_INFORMATION *)((char *)event + event->NextEntryOffset);
+                    }
+                ResetEvent(overlapped.hEvent);
+                ReadDirectoryChangesW(folder, notify, sizeof(notify), FALSE,
+                                      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                                      NULL, &overlapped, NULL);
+                }
+            else if (result > WAIT_OBJECT_0 && result <= WAIT_OBJECT_0 + watch_running_count)
+                {
+                i = result - WAIT_OBJECT_0 - 1;
+                exit_code = 1;
+                GetExitCodeProcess(watch_running[i].process, &exit_code);
+                CloseHandle(watch_running[i].process);
+                watch_finish(&watch_running[i], exit_code == 0);
+                watch_remove_running(i);
+                }
+            }
+        }
+    }
+
+#else
+
+static void watch_scan()
+    {
+    char           path[WATCH_PATH_MAX];
+    struct stat    info;
+    struct dirent *entry;
+    DIR           *folder = opendir(watch_directory);
+
+    if (folder == NULL)
+        {
+        return;
+        }
+    while ((entry = readdir(folder)) != NULL)
+        {
+        watch_path(path, "", entry->d_name, "");
+        if (stat(path, &info) == 0 && S_ISREG(info.st_mode))
+            {
+            watch_enqueue(entry->d_name);
+            }
+        }
+    closedir(folder);
+    }
+
+
+static bool watch_start(WatchJob *job)
+    {
+    char  input[WATCH_PATH_MAX];
+    char  part[WATCH_PATH_MAX];
+    char  output[300];
+    char *args[WATCH_ARGS_MAX + 2];
+    int   stream;
+    int   i;
+    pid_t child;
+
+    watch_path(input, "", job->name, "");
+    watch_output_name(output, sizeof(output), job->name);
+    watch_path(part, "done", output, ".part");
+
+    args[0] = watch_self;
+    for (i = 1; i < watch_argc && i < WATCH_ARGS_MAX; i++)
+        {
+        args[i] = watch_argv[i];
+        }
+    args[i++] = input;
+    args[i] = NULL;
+
+    stream = open(part, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (stream < 0)
+        {
+        return FALSE;
+        }
+
+    child = fork();
+    if (child == 0)
+        {
+        dup2(stream, 1);
+        close(stream);
+        execv(watch_self, args);
+        _exit(127);
+        }
+    close(stream);
+    if (child < 0)
+        {
+        return FALSE;
+        }
+    job->process = child;
+    return TRUE;
+    }
+
+
+int watch_run(const char *directory, int workers, int argc, char **argv)
+    {
+    char          path[WATCH_PATH_MAX];
+    char          events[16384];
+    struct pollfd ready;
+    struct inotify_event *event;
+    ssize_t       got;
+    ssize_t       offset;
+    pid_t         child;
+    int           status;
+    int           i;
+
+    watch_directory = directory;
+    watch_argc = argc;
+    watch_argv = argv;
+    watch_workers = (workers < 1) ? 1 : (workers > WATCH_MAX_WORKERS) ? WATCH_MAX_WORKERS : workers;
+    got = readlink("/proc/self/exe", watch_self, sizeof(watch_self) - 1);
+    if (got > 0)
+        {
+        watch_self[got] = '\0';
+        }
+    else
+        {
+        snprintf(watch_self, sizeof(watch_self), "%s", argv[0]);
+        }
+
+    watch_path(path, "done", "", "");
+    mkdir(path, 0777);
+    watch_path(path, "failed", "", "");
+    mkdir(path, 0777);
+
+    ready.fd = inotify_init1(IN_NONBLOCK);
+    if (ready.fd < 0 || inotify_add_watch(ready.fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_Q_OVERFLOW) < 0)
+        {
+        fprintf(stderr, "(error) Unable to watch spool directory %s.\n", directory);
+        return 1;
+        }
+    ready.events = POLLIN;
+
+    fprintf(stderr, "(info) watch: %s with %d workers\n", directory, watch_workers);
+    watch_scan();                       /* files dropped before the watch */
+
+    for (;;)
+        {
+        while (watch_running_count < watch_workers && !watch_queue.empty())
+            {
+            WatchJob job = watch_queue.front();
+            watch_queue.pop_front();
+            job.started_ms = watch_now();
+            watch_running[watch_running_count++] = job;
+            if (!watch_start(&watch_running[watch_running_count - 1]))
+                {
+                watch_finish(&watch_running[watch_running_count - 1], FALSE);
+                watch_remove_running(watch_running_count - 1);
+                }
+            }
+
+        /*
+        **  Wake for directory events; children are reaped every 50 ms
+        */
+        poll(&ready, 1, (watch_running_count > 0) ? 50 : -1);
+
+        while ((got = read(ready.fd, events, sizeof(events))) > 0)
+            {
+            for (offset = 0; offset < got; offset += sizeof(struct inotify_event) + event->len)
+                {
+                event = (struct inotify_event *)(events + offset);
+                if ((event->mask & IN_Q_OVERFLOW) != 0)
+                    {
+                    watch_scan();
+                    }
+                else if (event->len > 0 && (event->mask & IN_ISDIR) == 0)
+                    {
+                    watch_enqueue(event->name);
+                    }
+                }
+            }
+
+        while ((child = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+            for (i = 0; i < watch_running_count; i++)
+                {
+                if (watch_running[i].process == child)
+                    {
+                    watch_finish(&watch_running[i], WIFEXITED(status) && WEXITSTATUS(status) == 0);
+                    watch_remove_running(i);
+                    break;
+                    }
+                }
+            }
+        }
+    }
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ *
+ *  Name: SpoolWatch.h
+ *
+ *  Description:
+ *
+ *      Spool directory watch mode for txt2pdf.  Files dropped into the
+ *      directory are converted by a bounded pool of txt2pdf worker
+ *      processes and then moved to done/ or failed/.
+ *
+ */
+
+#ifndef SPOOLWATCH_H
+#define SPOOLWATCH_H
+
+int watch_run(const char *directory, int workers, int argc, char **argv);
+
+#endif //SPOOLWATCH_H
@@ -0,0 +1,397 @@
+/**
+ *
+ *  Name: TextCodec.cpp
+ *
+ *  Description:
+ *
+ *      Character set helpers for txt2pdf.
+ *
+ *      The ASCII scan is the fast path for UTF-8 input: a listing that is
+ *      plain 7-bit text is detected sixteen bytes at a time and printed
+ *      exactly as before, only lines carrying multi-byte sequences pay
+ *      for decoding.
+ *
+ *      EBCDIC record input is translated while it is copied out of the
+ *      input block, so a spool file needs no separate conversion pass.
+ *
+ *      The column scan behind tab expansion and line wrapping (-E, -k)
+ *      also takes sixteen bytes at a time, finding the next tab and
+ *      counting the columns before it in the same pass.
+ *
+ */
+
+#include "stdafx.h"
+#include <emmintrin.h>
+#include "TextCodec.h"
+
+/**
+ *  Unicode values of WinAnsiEncoding (CP1252) codes 0x80 - 0x9F.
+ *  Zero marks the five codes which are undefined in the encoding.
+ */
+
+static const unsigned short CWinAnsiHighBlock[32] =
+    {
+    0x20AC, 0x0000, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017D, 0x0000,
+    0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x0000, 0x017E, 0x0178
+    };
+
+
+/**
+ *  EBCDIC code page 037 to ISO-8859-1 (which WinAnsi agrees with from
+ *  0xA0 up).  Controls without a glyph become blanks, except FF (0x0C)
+ *  which the non-ASA processor treats as a page break.
+ */
+
+static const unsigned char CEbcdicToLatin1[256] =
+    {
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x0C, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0xA0, 0xE2, 0xE4, 0xE0, 0xE1, 0xE3, 0xE5, 0xE7, 0xF1, 0xA2, 0x2E, 0x3C, 0x28, 0x2B, 0x7C,
+    0x26, 0xE9, 0xEA, 0xEB, 0xE8, 0xED, 0xEE, 0xEF, 0xEC, 0xDF, 0x21, 0x24, 0x2A, 0x29, 0x3B, 0xAC,
+    0x2D, 0x2F, 0xC2, 0xC4, 0xC0, 0xC1, 0xC3, 0xC5, 0xC7, 0xD1, 0xA6, 0x2C, 0x25, 0x5F, 0x3E, 0x3F,
+    0xF8, 0xC9, 0xCA, 0xCB, 0xC8, 0xCD, 0xCE, 0xCF, 0xCC, 0x60, 0x3A, 0x23, 0x40, 0x27, 0x3D, 0x22,
+    0xD8, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0xAB, 0xBB, 0xF0, 0xFD, 0xFE, 0xB1,
+    0xB0, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0xAA, 0xBA, 0xE6, 0xB8, 0xC6, 0xA4,
+    0xB5, 0x7E, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0xA1, 0xBF, 0xD0, 0xDD, 0xDE, 0xAE,
+    0x5E, 0xA3, 0xA5, 0xB7, 0xA9, 0xA7, 0xB6, 0xBC, 0xBD, 0xBE, 0x5B, 0x5D, 0xAF, 0xA8, 0xB4, 0xD7,
+    0x7B, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0xAD, 0xF4, 0xF6, 0xF2, 0xF3, 0xF5,
+    0x7D, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0xB9, 0xFB, 0xFC, 0xF9, 0xFA, 0xFF,
+    0x5C, 0xF7, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0xB2, 0xD4, 0xD6, 0xD2, 0xD3, 0xD5,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0xB3, 0xDB, 0xDC, 0xD9, 0xDA, 0x20
+    };
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Length of the leading 7-bit ASCII run of a buffer.
+**
+**  Parameters:     Name        Description.
+**                  text        Bytes to scan.
+**                  length      Number of bytes available.
+**
+**  Returns:        Index of the first byte >= 0x80 (or length).
+**
+**------------------------------------------------------------------------*/
+
+size_t codec_ascii_prefix(const unsigned char *text, size_t length)
+    {
+    size_t i = 0;
+    int    mask;
+
+    /*
+    **  SSE2 movemask collects the high bit of sixteen bytes at once
+    */
+    while (i + 16 <= length)
+        {
+        mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(text + i)));
+        if (mask != 0)
+            {
+            while ((mask & 1) == 0)
+                {
+                mask >>= 1;
+                i++;
+                }
+            return i;
+            }
+        i += 16;
+        }
+
+    while (i < length && text[i] < 0x80)
+        {
+        i++;
+        }
+
+    return i;
+    }
+
+
+static int codec_bit_count(int mask)
+    {
+    int count = 0;
+
+    while (mask != 0)
+        {
+        mask &= mask - 1;
+        count++;
+        }
+    return count;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Find the next tab and count the columns before it.
+**
+**  Parameters:     Name        Description.
+**                  text        Bytes to scan.
+**                  length      Number of bytes available.
+**                  is_utf8     Count characters, not bytes (UTF-8
+**                              continuation bytes take no column).
+**                  columns     Receives the columns before the tab.
+**
+**  Returns:        Index of the first tab (or length).
+**
+**------------------------------------------------------------------------*/
+
+size_t codec_column_scan(const unsigned char *text, size_t length, bool is_utf8, size_t *columns)
+    {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i top = _mm_set1_epi8((char)0xC0);
+    const __m128i follow = _mm_set1_epi8((char)0x80);
+    __m128i block;
+    size_t  i = 0;
+    size_t  skipped = 0;
+    int     tabs;
+    int     trail;
+
+    while (i + 16 <= length)
+        {
+        block = _mm_loadu_si128((const __m128i *)(text + i));
+        tabs = _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab));
+        trail = is_utf8 ? _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, top), follow)) : 0;
+        if (tabs != 0)
+            {
+            tabs &= -tabs;                          //  lowest set bit: the first tab
+            skipped += codec_bit_count(trail & (tabs - 1));
+            while (tabs > 1)
+                {
+                tabs >>= 1;
+                i++;
+                }
+            *columns = i - skipped;
+            return i;
+            }
+        skipped += codec_bit_count(trail);
+        i += 16;
+        }
+
+    while (i < length && text[i] != '\t')
+        {
+        if (is_utf8 && (text[i] & 0xC0) == 0x80)
+            {
+            skipped++;
+            }
+        i++;
+        }
+
+    *columns = i - skipped;
+    return i;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode one UTF-8 sequence.
+**
+**  Parameters:     Name        Description.
+**                  text        In/out cursor, advanced past the sequence.
+**                  end         One past the last byte available.
+**
+**  Returns:        Code point, or U+FFFD for malformed/overlong input
+**                  (in which case a single byte is consumed).
+**
+**------------------------------------------------------------------------*/
+
+long codec_utf8_decode(const unsigned char **text, const unsigned char *end)
+    {
+    const unsigned char *p = *text;
+    long codepoint;
+    long minimum;
+    int  extra;
+    int  i;
+
+    if (p[0] < 0x80)
+        {
+        *text = p + 1;
+        return p[0];
+        }
+    else if ((p[0] & 0xE0) == 0xC0)
+        {
+        codepoint = p[0] & 0x1F;
+        extra = 1;
+        minimum = 0x80;
+        }
+    else if ((p[0] & 0xF0) == 0xE0)
+        {
+        codepoint = p[0] & 0x0F;
+        extra = 2;
+        minimum = 0x800;
+        }
+    else if ((p[0] & 0xF8) == 0xF0)
+        {
+        codepoint = p[0] & 0x07;
+        extra = 3;
+        minimum = 0x10000;
+        }
+    else
+        {
+        *text = p + 1;
+        return 0xFFFD;
+        }
+
+    if (end - p <= extra)
+        {
+        *text = p + 1;
+        return 0xFFFD;
+        }
+
+    for (i = 1; i <= extra; i++)
+        {
+        if ((p[i] & 0xC0) != 0x80)
+            {
+            *text = p + 1;
+            return 0xFFFD;
+            }
+        codepoint = (codepoint << 6) | (p[i] & 0x3F);
+        }
+
+    if (codepoint < minimum || codepoint > 0x10FFFF ||
+        (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        {
+        *text = p + 1;
+        return 0xFFFD;
+        }
+
+    *text = p + extra + 1;
+    return codepoint;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Map a code point onto WinAnsiEncoding.
+**
+**  Parameters:     Name        Description.
+**                  codepoint   Unicode scalar value.
+**
+**  Returns:        The WinAnsi byte, or -1 when the encoding has no glyph.
+**
+**------------------------------------------------------------------------*/
+
+int codec_unicode_to_winansi(long codepoint)
+    {
+    int i;
+
+    if (codepoint < 0x80 || (codepoint >= 0xA0 && codepoint <= 0xFF))
+        {
+        return (int)codepoint;
+        }
+
+    for (i = 0; i < 32; i++)
+        {
+        if (CWinAnsiHighBlock[i] != 0 && CWinAnsiHighBlock[i] == codepoint)
+            {
+            return 0x80 + i;
+            }
+        }
+
+    return -1;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Length of a record without its trailing pad bytes.
+**
+**  Parameters:     Name        Description.
+**                  text        Record bytes.
+**                  length      Record length.
+**                  pad         Pad byte (0x40 in EBCDIC, 0x20 in ASCII).
+**
+**  Returns:        Length up to and including the last non-pad byte.
+**
+**------------------------------------------------------------------------*/
+
+size_t codec_trim_length(const unsigned char *text, size_t length, unsigned char pad)
+    {
+    __m128i fill = _mm_set1_epi8((char)pad);
+
+    /*
+    **  Fixed records are mostly padding; skip it sixteen bytes at a time
+    */
+    while (length >= 16 &&
+           _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + length - 16)), fill)) == 0xFFFF)
+        {
+        length -= 16;
+        }
+
+    while (length > 0 && text[length - 1] == pad)
+        {
+        length--;
+        }
+
+    return length;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy EBCDIC bytes out as ISO-8859-1 / WinAnsi.
+**
+**  Parameters:     Name        Description.
+**                  target      Receives length translated bytes.
+**                  source      EBCDIC (code page 037) bytes.
+**                  length      Number of bytes.
+**
+**  Returns:        void.
+**
+**------------------------------------------------------------------------*/
+
+void codec_ebcdic_to_latin1(unsigned char *target, const unsigned char *source, size_t length)
+    {
+    size_t i = 0;
+
+    /*
+    **  A 256 entry table has no SSE2 form (a pshufb lookup needs sixteen
+    **  shuffles per block), so unroll the byte lookup instead
+    */
+    while (i + 8 <= length)
+        {
+        target[i + 0] = CEbcdicToLatin1[source[i + 0]];
+        target[i + 1] = CEbcdicToLatin1[source[i + 1]];
+        target[i + 2] = CEbcdicToLatin1[source[i + 2]];
+        target[i + 3] = CEbcdicToLatin1[source[i + 3]];
+        target[i + 4] = CEbcdicToLatin1[source[i + 4]];
+        target[i + 5] = CEbcdicToLatin1[source[i + 5]];
+        target[i + 6] = CEbcdicToLatin1[source[i + 6]];
+        target[i + 7] = CEbcdicToLatin1[source[i + 7]];
+        i += 8;
+        }
+
+    while (i < length)
+        {
+        target[i] = CEbcdicToLatin1[source[i]];
+        i++;
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Translate the bytes >= 0x80 of a line in place.
+**
+**  Parameters:     Name        Description.
+**                  text        Line to translate.
+**                  length      Number of bytes.
+**                  table       256 entry table (identity below 0x80).
+**
+**  Returns:        void.
+**
+**  Description:    Code page listings are mostly ASCII, which no table
+**                  changes: the SSE2 scan passes over it sixteen bytes
+**                  at a time and only the high bytes are looked up (see
+**                  codec_ebcdic_to_latin1 for why not by shuffles).
+**
+**------------------------------------------------------------------------*/
+
+void codec_translate(unsigned char *text, size_t length, const unsigned char *table)
+    {
+    size_t i = 0;
+
+    while (i < length)
+        {
+        i += codec_ascii_prefix(text + i, length - i);
+        while (i < length && text[i] >= 0x80)
+            {
+            text[i] = table[text[i]];
+            i++;
+            }
+        }
+    }
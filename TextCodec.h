@@ -0,0 +1,28 @@
+/**
+ *
+ *  Name: TextCodec.h
+ *
+ *  Description:
+ *
+ *      Character set helpers for txt2pdf: ASCII block scanning, the
+ *      tab and column scan used for tab stops and wrapping, UTF-8
+ *      decoding, the Unicode to WinAnsiEncoding mapping used by
+ *      print_pdf_string(), EBCDIC translation of record input and the
+ *      code page (-m) translation of lines.
+ *
+ */
+
+#ifndef TEXTCODEC_H
+#define TEXTCODEC_H
+
+#include <stddef.h>
+
+size_t codec_ascii_prefix(const unsigned char *text, size_t length);
+size_t codec_column_scan(const unsigned char *text, size_t length, bool is_utf8, size_t *columns);
+long   codec_utf8_decode(const unsigned char **text, const unsigned char *end);
+int    codec_unicode_to_winansi(long codepoint);
+size_t codec_trim_length(const unsigned char *text, size_t length, unsigned char pad);
+void   codec_ebcdic_to_latin1(unsigned char *target, const unsigned char *source, size_t length);
+void   codec_translate(unsigned char *text, size_t length, const unsigned char *table);
+
+#endif //TEXTCODEC_H
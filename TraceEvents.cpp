@@ -0,0 +1,174 @@
+/**
+ *
+ *  Name: TraceEvents.cpp
+ *
+ *  Description:
+ *
+ *      Chrome trace-event output for txt2pdf (-Y).
+ *
+ *      Every span is a complete event: name, category, start and
+ *      duration in microseconds since trace_open(), and the numeric id
+ *      of the thread that ended it.  Events are appended as they finish
+ *      under a lock, so the writer threads can report their own spans;
+ *      a run that dies leaves the closing bracket out, which both
+ *      viewers accept.
+ *
+ *      Per-page spans are sampled: only every `sample`th page (and
+ *      every `sample`th output buffer) is traced, which keeps a
+ *      million-page trace loadable.  Rare events (slow reads, writer
+ *      stalls, the trailer) are always written.
+ *
+ */
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <process.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "TraceEvents.h"
+
+bool trace_is_enabled = FALSE;
+
+static FILE             *trace_file = NULL;
+static std::mutex        trace_lock;
+static std::atomic<int>  trace_threads(0);
+static int               trace_sample = 1;
+static int               trace_pid = 0;
+static bool              trace_is_first = TRUE;
+static std::chrono::steady_clock::time_point trace_start;
+
+static thread_local int  trace_tid = 0;
+
+
+static int trace_thread_id()
+    {
+    if (trace_tid == 0)
+        {
+        trace_tid = ++trace_threads;
+        }
+    return trace_tid;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the trace file.
+**
+**  Parameters:     Name        Description.
+**                  path        JSON file to write.
+**                  sample      Trace one page (and output buffer) in
+**                              this many.
+**
+**  Returns:        FALSE if the file cannot be created.
+**
+**------------------------------------------------------------------------*/
+
+bool trace_open(const char *path, int sample)
+    {
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL)
+        {
+        fprintf(stderr, "(error) Unable to create trace file %s.\n", path);
+        return FALSE;
+        }
+    trace_sample = (sample < 1) ? 1 : sample;
+    trace_pid = (int)_getpid();
+    trace_start = std::chrono::steady_clock::now();
+    trace_is_enabled = TRUE;
+
+    fprintf(trace_file, "[\n");
+    trace_thread_name("main");
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Label the calling thread's track.
+**
+**------------------------------------------------------------------------*/
+
+void trace_thread_name(const char *name)
+    {
+    std::lock_guard<std::mutex> guard(trace_lock);
+
+    if (trace_file == NULL)
+        {
+        return;
+        }
+    fprintf(trace_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            trace_is_first ? "" : ",\n", trace_pid, trace_thread_id(), name);
+    trace_is_first = FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Microseconds since the trace was opened.
+**
+**------------------------------------------------------------------------*/
+
+long long trace_now()
+    {
+    return (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_start).count();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Whether the count'th page or buffer is traced.
+**
+**------------------------------------------------------------------------*/
+
+bool trace_is_sampled(long count)
+    {
+    return trace_is_enabled && (count % trace_sample) == 0;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write a span that ends now.
+**
+**  Parameters:     Name        Description.
+**                  name        Span name.
+**                  category    Category (filterable in the viewer).
+**                  start       trace_now() at the start.
+**                  args        Body of the args object ("\"page\":3"),
+**                              or NULL.
+**
+**------------------------------------------------------------------------*/
+
+void trace_span(const char *name, const char *category, long long start, const char *args)
+    {
+    long long end = trace_now();
+    std::lock_guard<std::mutex> guard(trace_lock);
+
+    if (trace_file == NULL)
+        {
+        return;
+        }
+    fprintf(trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,\"args\":{%s}}",
+            trace_is_first ? "" : ",\n", name, category, start, end - start, trace_pid, trace_thread_id(),
+            (args != NULL) ? args : "");
+    trace_is_first = FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Terminate the JSON array and close the file.
+**
+**------------------------------------------------------------------------*/
+
+void trace_close()
+    {
+    std::lock_guard<std::mutex> guard(trace_lock);
+
+    if (trace_file == NULL)
+        {
+        return;
+        }
+    fprintf(trace_file, "\n]\n");
+    if (fclose(trace_file) != 0)
+        {
+        fprintf(stderr, "(warning) Unable to write the trace file.\n");
+        }
+    trace_file = NULL;
+    trace_is_enabled = FALSE;
+    }
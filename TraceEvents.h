@@ -0,0 +1,25 @@
+/**
+ *
+ *  Name: TraceEvents.h
+ *
+ *  Description:
+ *
+ *      Chrome trace-event output for txt2pdf (-Y).  Spans are written
+ *      as complete ("X") events in the JSON array format that
+ *      chrome://tracing and ui.perfetto.dev load, one track per thread.
+ *
+ */
+
+#ifndef TRACEEVENTS_H
+#define TRACEEVENTS_H
+
+extern bool trace_is_enabled;
+
+bool      trace_open(const char *path, int sample);
+void      trace_thread_name(const char *name);
+long long trace_now();
+bool      trace_is_sampled(long count);
+void      trace_span(const char *name, const char *category, long long start, const char *args);
+void      trace_close();
+
+#endif //TRACEEVENTS_H
@@ -0,0 +1,1232 @@
+/**
+ *
+ *  Name: Zstd.cpp
+ *
+ *  Description:
+ *
+ *      Streaming Zstandard decoder (RFC 8878).
+ *
+ *      Frames are decoded block by block into a history buffer that
+ *      keeps the last window of output for matches to copy from; each
+ *      block is handed to the caller as soon as it is complete, and the
+ *      buffer slides back to one window once it fills.  Literals are
+ *      Huffman coded (one or four streams) and sequences FSE coded, both
+ *      read from backward bitstreams; tables carried over from the
+ *      previous block (treeless literals, repeat mode) are kept in the
+ *      state.  Concatenated and skippable frames are handled and the
+ *      optional XXH64 content checksum and the content size are checked.
+ *
+ *      Not supported: dictionaries, and windows over ZSTD_WINDOW_MAX
+ *      (zstd's own default decoder limit).
+ *
+ */
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "Zstd.h"
+
+#define ZSTD_MAGIC          0xFD2FB528ul
+#define ZSTD_SKIPPABLE      0x184D2A50ul    /* ... to 0x184D2A5F */
+#define ZSTD_BLOCK_MAX      (128 * 1024)
+#define ZSTD_WINDOW_MAX     (128ull * 1024 * 1024)
+#define ZSTD_SLACK          (1024 * 1024)   /* output kept beyond the window between slides */
+#define ZSTD_FSE_MAX_LOG    9
+#define ZSTD_HUF_MAX_BITS   11
+#define ZSTD_PAD            8               /* zero bytes after buffers read 8 at a time */
+
+#define MAX(x, y)       ((x) > (y) ? (x) : (y))
+#define MIN(x, y)       ((x) < (y) ? (x) : (y))
+
+struct _ZstdFseEntry
+    {
+    unsigned char  symbol;
+    unsigned char  bits;
+    unsigned short base;
+    };
+
+typedef _ZstdFseEntry ZstdFseEntry;
+
+struct _ZstdFse
+    {
+    int          log;
+    ZstdFseEntry table[1 << ZSTD_FSE_MAX_LOG];
+    };
+
+typedef _ZstdFse ZstdFse;
+
+struct _ZstdBits                            /* backward bitstream */
+    {
+    const unsigned char *start;
+    long long            pos;               /* bits left; < 0 once overread */
+    };
+
+typedef _ZstdBits ZstdBits;
+
+struct _ZstdXxh64
+    {
+    unsigned long long v[4];
+    unsigned long long total;
+    unsigned char      buffer[32];
+    int                buffered;
+    };
+
+typedef _ZstdXxh64 ZstdXxh64;
+
+struct _ZstdState
+    {
+    InflateSource     *source;
+    unsigned char     *history;
+    size_t             capacity;
+    size_t             fill;
+    size_t             window;
+    unsigned char      block[ZSTD_BLOCK_MAX + ZSTD_PAD];
+    unsigned char      literals[ZSTD_BLOCK_MAX + ZSTD_PAD];
+    size_t             literal_count;
+    unsigned char      huffman_symbol[1 << ZSTD_HUF_MAX_BITS];
+    unsigned char      huffman_bits[1 << ZSTD_HUF_MAX_BITS];
+    int                huffman_max_bits;    /* 0 until a block has sent a tree */
+    ZstdFse            ll;
+    ZstdFse            of;
+    ZstdFse            ml;
+    ZstdFse            weights;
+    bool               is_ll_ready;
+    bool               is_of_ready;
+    bool               is_ml_ready;
+    unsigned long long rep[3];
+    ZstdXxh64          xxh;
+    jmp_buf            failure;
+    };
+
+typedef _ZstdState ZstdState;
+
+/**
+ *  Predefined distributions and length codes (RFC 8878 3.1.1.3.2)
+ */
+
+static const short CLiteralDefaults[36] =
+    { 4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1, -1, -1, -1, -1 };
+static const short CMatchDefaults[53] =
+    { 1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1 };
+static const short COffsetDefaults[29] =
+    { 1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1 };
+
+static const unsigned long CLiteralBase[36] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512,
+      1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+static const unsigned char CLiteralBits[36] =
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+static const unsigned long CMatchBase[53] =
+    { 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+      33, 34, 35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051, 4099, 8195, 16387, 32771, 65539 };
+static const unsigned char CMatchBits[53] =
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3,
+      4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+
+static void fail(ZstdState *s, int code)
+    {
+    longjmp(s->failure, code);
+    }
+
+
+static int highbit(unsigned long long value)
+    {
+    int bit = -1;
+
+    while (value != 0)
+        {
+        value >>= 1;
+        bit++;
+        }
+    return bit;
+    }
+
+
+static unsigned long long load_le(const unsigned char *p, int bytes)
+    {
+    unsigned long long value = 0;
+    int i;
+
+    for (i = bytes - 1; i >= 0; i--)
+        {
+        value = (value << 8) | p[i];
+        }
+    return value;
+    }
+
+
+/**
+ *  XXH64 (seed 0) of the frame's content
+ */
+
+#define XXH_P1  11400714785074694791ull
+#define XXH_P2  14029467366897019727ull
+#define XXH_P3  1609587929392839161ull
+#define XXH_P4  9650029242287828579ull
+#define XXH_P5  2870177450012600261ull
+
+static unsigned long long xxh_rotl(unsigned long long x, int r)
+    {
+    return (x << r) | (x >> (64 - r));
+    }
+
+
+static unsigned long long xxh_round(unsigned long long acc, unsigned long long input)
+    {
+    return xxh_rotl(acc + input * XXH_P2, 31) * XXH_P1;
+    }
+
+
+static void xxh_init(ZstdXxh64 *x)
+    {
+    x->v[0] = XXH_P1 + XXH_P2;
+    x->v[1] = XXH_P2;
+    x->v[2] = 0;
+    x->v[3] = 0 - XXH_P1;
+    x->total = 0;
+    x->buffered = 0;
+    }
+
+
+static void xxh_update(ZstdXxh64 *x, const unsigned char *data, size_t length)
+    {
+    size_t take;
+    int    i;
+
+    x->total += length;
+    if (x->buffered > 0)
+        {
+        take = MIN(length, (size_t)(32 - x->buffered));
+        memcpy(x->buffer + x->buffered, data, take);
+        x->buffered += (int)take;
+        data += take;
+        length -= take;
+        if (x->buffered < 32)
+            {
+            return;
+            }
+        for (i = 0; i < 4; i++)
+            {
+            x->v[i] = xxh_round(x->v[i], load_le(x->buffer + 8 * i, 8));
+            }
+        x->buffered = 0;
+        }
+    for (; length >= 32; data += 32, length -= 32)
+        {
+        for (i = 0; i < 4; i++)
+            {
+            x->v[i] = xxh_round(x->v[i], load_le(data + 8 * i, 8));
+            }
+        }
+    memcpy(x->buffer, data, length);
+    x->buffered = (int)length;
+    }
+
+
+static unsigned long long xxh_digest(const ZstdXxh64 *x)
+    {
+    unsigned long long h;
+    int i;
+
+    if (x->total >= 32)
+        {
+        h = xxh_rotl(x->v[0], 1) + xxh_rotl(x->v[1], 7) + xxh_rotl(x->v[2], 12) + xxh_rotl(x->v[3], 18);
+        for (i = 0; i < 4; i++)
+            {
+            h = (h ^ xxh_round(0, x->v[i])) * XXH_P1 + XXH_P4;
+            }
+        }
+    else
+        {
+        h = XXH_P5;
+        }
+    h += x->total;
+
+    for (i = 0; i + 8 <= x->buffered; i += 8)
+        {
+        h = xxh_rotl(h ^ xxh_round(0, load_le(x->buffer + i, 8)), 27) * XXH_P1 + XXH_P4;
+        }
+    if (i + 4 <= x->buffered)
+        {
+        h = xxh_rotl(h ^ (load_le(x->buffer + i, 4) * XXH_P1), 23) * XXH_P2 + XXH_P3;
+        i += 4;
+        }
+    for (; i < x->buffered; i++)
+        {
+        h = xxh_rotl(h ^ (x->buffer[i] * XXH_P5), 11) * XXH_P1;
+        }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+    }
+
+
+/**
+ *  Compressed input
+ */
+
+static bool more_input(ZstdState *s)
+    {
+    return s->source->avail > 0 || s->source->refill(s->source);
+    }
+
+
+static void read_bytes(ZstdState *s, unsigned char *out, size_t length)
+    {
+    size_t chunk;
+
+    while (length > 0)
+        {
+        if (!more_input(s))
+            {
+            fail(s, INFLATE_TRUNCATED);
+            }
+        chunk = MIN(length, s->source->avail);
+        memcpy(out, s->source->next, chunk);
+        s->source->next += chunk;
+        s->source->avail -= chunk;
+        out += chunk;
+        length -= chunk;
+        }
+    }
+
+
+static unsigned long long read_le(ZstdState *s, int bytes)
+    {
+    unsigned char field[8];
+
+    read_bytes(s, field, (size_t)bytes);
+    return load_le(field, bytes);
+    }
+
+
+/**
+ *  Backward bitstreams: the last byte's highest set bit marks the end,
+ *  bits are read from there towards the first byte, and reading past
+ *  the first byte gives zeros (and a negative pos)
+ */
+
+static void bits_init(ZstdState *s, ZstdBits *b, const unsigned char *start, size_t length)
+    {
+    if (length == 0 || start[length - 1] == 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    b->start = start;
+    b->pos = 8 * (long long)(length - 1) + highbit(start[length - 1]);
+    }
+
+
+static unsigned long bits_peek(const ZstdBits *b, int n)
+    {
+    long long at = b->pos - n;
+    int       shift = 0;
+
+    if (n == 0)
+        {
+        return 0;
+        }
+    if (at < 0)
+        {
+        shift = (int)-at;
+        n -= shift;
+        at = 0;
+        if (n <= 0)
+            {
+            return 0;
+            }
+        }
+    return (unsigned long)(((load_le(b->start + (at >> 3), 8) >> (at & 7)) & ((1ull << n) - 1)) << shift);
+    }
+
+
+static unsigned long bits_read(ZstdBits *b, int n)
+    {
+    unsigned long value = bits_peek(b, n);
+
+    b->pos -= n;
+    return value;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read an FSE table description and build its table.
+**
+**  Parameters:     Name        Description.
+**                  p, end      Description (forward bit order).
+**                  fse         Receives the decoding table.
+**                  max_log     Largest accuracy log allowed.
+**                  max_symbol  Largest symbol allowed.
+**
+**  Returns:        Bytes the description took.
+**
+**------------------------------------------------------------------------*/
+
+static void fse_build(ZstdState *s, ZstdFse *fse, const short *probability, int symbols, int log)
+    {
+    unsigned short next[256];
+    int size = 1 << log;
+    int high = size - 1;
+    int step = (size >> 1) + (size >> 3) + 3;
+    int position = 0;
+    int symbol;
+    int i;
+
+    fse->log = log;
+    for (symbol = 0; symbol < symbols; symbol++)
+        {
+        if (probability[symbol] == -1)
+            {
+            fse->table[high--].symbol = (unsigned char)symbol;
+            next[symbol] = 1;
+            }
+        else
+            {
+            next[symbol] = (unsigned short)probability[symbol];
+            }
+        }
+    for (symbol = 0; symbol < symbols; symbol++)
+        {
+        for (i = 0; i < probability[symbol]; i++)
+            {
+            fse->table[position].symbol = (unsigned char)symbol;
+            do
+                {
+                position = (position + step) & (size - 1);
+                } while (position > high);
+            }
+        }
+    if (position != 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    for (i = 0; i < size; i++)
+        {
+        unsigned n = next[fse->table[i].symbol]++;
+        int      bits = log - highbit(n);
+
+        fse->table[i].bits = (unsigned char)bits;
+        fse->table[i].base = (unsigned short)((n << bits) - size);
+        }
+    }
+
+
+static size_t fse_read_table(ZstdState *s, const unsigned char *p, const unsigned char *end, ZstdFse *fse, int max_log, int max_symbol)
+    {
+    short     probability[256];
+    long long avail = 8 * (long long)(end - p);
+    long long at = 4;
+    int       log;
+    int       remaining;
+    int       threshold;
+    int       bits;
+    int       symbol = 0;
+    int       count;
+    int       most;
+    int       repeat;
+    int       i;
+    unsigned long value;
+
+    if (end - p < 1)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    log = (p[0] & 0x0F) + 5;
+    if (log > max_log)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    remaining = (1 << log) + 1;
+    threshold = 1 << log;
+    bits = log + 1;
+
+    while (remaining > 1 && symbol <= max_symbol)
+        {
+        if (at > avail)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        value = (unsigned long)(load_le(p + (at >> 3), 8) >> (at & 7));
+        most = (2 * threshold - 1) - remaining;
+        if ((int)(value & (threshold - 1)) < most)
+            {
+            count = (int)(value & (threshold - 1));
+            at += bits - 1;
+            }
+        else
+            {
+            count = (int)(value & (2 * threshold - 1));
+            if (count >= threshold)
+                {
+                count -= most;
+                }
+            at += bits;
+            }
+        count--;
+        probability[symbol++] = (short)count;
+        remaining -= (count < 0) ? -count : count;
+
+        if (count == 0)
+            {
+            /*
+            **  A zero is followed by 2-bit counts of further zeros, 3
+            **  meaning another count follows
+            */
+            do
+                {
+                if (at > avail)
+                    {
+                    fail(s, INFLATE_BAD_DATA);
+                    }
+                repeat = (int)((load_le(p + (at >> 3), 8) >> (at & 7)) & 3);
+                at += 2;
+                for (i = 0; i < repeat; i++)
+                    {
+                    if (symbol > max_symbol)
+                        {
+                        fail(s, INFLATE_BAD_DATA);
+                        }
+                    probability[symbol++] = 0;
+                    }
+                } while (repeat == 3);
+            }
+        while (remaining < threshold)
+            {
+            bits--;
+            threshold >>= 1;
+            }
+        }
+    if (remaining != 1 || at > avail)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    fse_build(s, fse, probability, symbol, log);
+    return (size_t)((at + 7) / 8);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read a Huffman tree description and build the table.
+**
+**  Returns:        Bytes the description took.
+**
+**------------------------------------------------------------------------*/
+
+static size_t huffman_read_table(ZstdState *s, const unsigned char *p, const unsigned char *end)
+    {
+    unsigned char weights[256];
+    int      rank_start[ZSTD_HUF_MAX_BITS + 2];
+    int      count = 0;
+    int      header;
+    int      total = 0;
+    int      rest;
+    int      max_bits;
+    int      weight;
+    int      length;
+    int      i;
+    size_t   used;
+    size_t   table_bytes;
+    ZstdBits b;
+    unsigned long state1;
+    unsigned long state2;
+
+    if (end - p < 1)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    header = p[0];
+    if (header < 128)
+        {
+        /*
+        **  FSE compressed weights, two interleaved states
+        */
+        if (end - p < 1 + header)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        table_bytes = fse_read_table(s, p + 1, p + 1 + header, &s->weights, 6, 255);
+        if (table_bytes >= (size_t)header)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        bits_init(s, &b, p + 1 + table_bytes, header - table_bytes);
+        state1 = bits_read(&b, s->weights.log);
+        state2 = bits_read(&b, s->weights.log);
+        for (;;)
+            {
+            if (count >= 254)
+                {
+                fail(s, INFLATE_BAD_DATA);
+                }
+            weights[count++] = s->weights.table[state1].symbol;
+            state1 = s->weights.table[state1].base + bits_read(&b, s->weights.table[state1].bits);
+            if (b.pos < 0)
+                {
+                weights[count++] = s->weights.table[state2].symbol;
+                break;
+                }
+            weights[count++] = s->weights.table[state2].symbol;
+            state2 = s->weights.table[state2].base + bits_read(&b, s->weights.table[state2].bits);
+            if (b.pos < 0)
+                {
+                if (count >= 255)
+                    {
+                    fail(s, INFLATE_BAD_DATA);
+                    }
+                weights[count++] = s->weights.table[state1].symbol;
+                break;
+                }
+            }
+        used = 1 + (size_t)header;
+        }
+    else
+        {
+        count = header - 127;
+        used = 1 + (size_t)(count + 1) / 2;
+        if ((size_t)(end - p) < used)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        for (i = 0; i < count; i++)
+            {
+            weights[i] = (unsigned char)((i & 1) ? (p[1 + i / 2] & 0x0F) : (p[1 + i / 2] >> 4));
+            }
+        }
+
+    /*
+    **  The last weight is implied: it completes the total to a power of 2
+    */
+    for (i = 0; i < count; i++)
+        {
+        if (weights[i] > ZSTD_HUF_MAX_BITS)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        total += weights[i] ? 1 << (weights[i] - 1) : 0;
+        }
+    if (total == 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    max_bits = highbit((unsigned long long)total) + 1;
+    rest = (1 << max_bits) - total;
+    if (max_bits > ZSTD_HUF_MAX_BITS || rest != (1 << highbit((unsigned long long)rest)))
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    weights[count++] = (unsigned char)(highbit((unsigned long long)rest) + 1);
+
+    /*
+    **  Codes of the smallest weight (longest) come first in the table
+    */
+    memset(rank_start, 0, sizeof(rank_start));
+    for (i = 0; i < count; i++)
+        {
+        rank_start[weights[i]] += (weights[i] != 0) ? 1 << (weights[i] - 1) : 0;
+        }
+    length = 0;
+    for (weight = 1; weight <= max_bits; weight++)
+        {
+        int size = rank_start[weight];
+
+        rank_start[weight] = length;
+        length += size;
+        }
+    for (i = 0; i < count; i++)
+        {
+        weight = weights[i];
+        if (weight != 0)
+            {
+            length = 1 << (weight - 1);
+            memset(s->huffman_symbol + rank_start[weight], i, (size_t)length);
+            memset(s->huffman_bits + rank_start[weight], max_bits + 1 - weight, (size_t)length);
+            rank_start[weight] += length;
+            }
+        }
+    s->huffman_max_bits = max_bits;
+    return used;
+    }
+
+
+static void huffman_stream(ZstdState *s, const unsigned char *p, size_t length, unsigned char *out, size_t count)
+    {
+    ZstdBits      b;
+    unsigned long index;
+    size_t        i;
+
+    bits_init(s, &b, p, length);
+    for (i = 0; i < count; i++)
+        {
+        index = bits_peek(&b, s->huffman_max_bits);
+        out[i] = s->huffman_symbol[index];
+        b.pos -= s->huffman_bits[index];
+        }
+    if (b.pos != 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode the literals section of a compressed block.
+**
+**  Returns:        Bytes the section took.
+**
+**------------------------------------------------------------------------*/
+
+static size_t read_literals(ZstdState *s, const unsigned char *p, const unsigned char *end)
+    {
+    static const int header_bytes[4] = { 3, 3, 4, 5 };
+    static const int size_bits[4] = { 10, 10, 14, 18 };
+    int    type = p[0] & 3;
+    int    format = (p[0] >> 2) & 3;
+    int    header;
+    size_t regenerated;
+    size_t compressed;
+    size_t segment;
+    size_t sizes[4];
+    size_t used;
+    unsigned long long field;
+    const unsigned char *streams;
+    int    i;
+
+    if (type <= 1)
+        {
+        /*
+        **  Raw or RLE
+        */
+        header = (format == 1) ? 2 : (format == 3) ? 3 : 1;
+        if (end - p < header)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        field = load_le(p, header);
+        regenerated = (size_t)((format & 1) ? field >> 4 : field >> 3);
+        used = (size_t)header + ((type == 0) ? regenerated : 1);
+        if (regenerated > ZSTD_BLOCK_MAX || (size_t)(end - p) < used)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        if (type == 0)
+            {
+            memcpy(s->literals, p + header, regenerated);
+            }
+        else
+            {
+            memset(s->literals, p[header], regenerated);
+            }
+        s->literal_count = regenerated;
+        return used;
+        }
+
+    /*
+    **  Huffman coded, with a new tree (2) or the last one (3)
+    */
+    header = header_bytes[format];
+    if (end - p < header)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    field = load_le(p, header);
+    regenerated = (size_t)((field >> 4) & ((1ull << size_bits[format]) - 1));
+    compressed = (size_t)((field >> (4 + size_bits[format])) & ((1ull << size_bits[format]) - 1));
+    if (regenerated > ZSTD_BLOCK_MAX || (size_t)(end - p - header) < compressed)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    p += header;
+    end = p + compressed;
+    streams = p;
+    if (type == 2)
+        {
+        streams += huffman_read_table(s, p, end);
+        }
+    else if (s->huffman_max_bits == 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+
+    if (format == 0)
+        {
+        huffman_stream(s, streams, (size_t)(end - streams), s->literals, regenerated);
+        }
+    else
+        {
+        if (end - streams < 6)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        sizes[0] = (size_t)load_le(streams, 2);
+        sizes[1] = (size_t)load_le(streams + 2, 2);
+        sizes[2] = (size_t)load_le(streams + 4, 2);
+        streams += 6;
+        if (sizes[0] + sizes[1] + sizes[2] > (size_t)(end - streams))
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        sizes[3] = (size_t)(end - streams) - sizes[0] - sizes[1] - sizes[2];
+        segment = (regenerated + 3) / 4;
+        if (3 * segment > regenerated)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        for (i = 0; i < 4; i++)
+            {
+            huffman_stream(s, streams, sizes[i], s->literals + i * segment, (i < 3) ? segment : regenerated - 3 * segment);
+            streams += sizes[i];
+            }
+        }
+    s->literal_count = regenerated;
+    return (size_t)header + compressed;
+    }
+
+
+static size_t read_sequence_table(ZstdState *s, int mode, const unsigned char *p, const unsigned char *end, ZstdFse *fse,
+                                  bool *is_ready, int max_log, int max_symbol, const short *defaults, int default_count, int default_log)
+    {
+    switch (mode)
+        {
+            case 0:
+                fse_build(s, fse, defaults, default_count, default_log);
+                *is_ready = TRUE;
+                return 0;
+
+            case 1:
+                if (p >= end || *p > max_symbol)
+                    {
+                    fail(s, INFLATE_BAD_DATA);
+                    }
+                fse->log = 0;
+                fse->table[0].symbol = *p;
+                fse->table[0].bits = 0;
+                fse->table[0].base = 0;
+                *is_ready = TRUE;
+                return 1;
+
+            case 2:
+                *is_ready = TRUE;
+                return fse_read_table(s, p, end, fse, max_log, max_symbol);
+        }
+    if (!*is_ready)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    return 0;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode a compressed block into the history buffer.
+**
+**  Parameters:     Name        Description.
+**                  length      Bytes of block content in s->block.
+**
+**  Returns:        Bytes produced at s->history + s->fill.
+**
+**------------------------------------------------------------------------*/
+
+static size_t decode_block(ZstdState *s, size_t length)
+    {
+    const unsigned char *p = s->block;
+    const unsigned char *end = s->block + length;
+    const unsigned char *literal;
+    const unsigned char *literal_end;
+    unsigned char *out = s->history + s->fill;
+    unsigned char *match;
+    size_t   produced = 0;
+    long     sequences;
+    long     i;
+    int      modes;
+    ZstdBits b;
+    unsigned long ll_state;
+    unsigned long of_state;
+    unsigned long ml_state;
+    unsigned long long offset;
+    unsigned long literal_length;
+    unsigned long match_length;
+    int      ll_code;
+    int      ml_code;
+    int      of_code;
+    int      index;
+
+    if (length == 0)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    p += read_literals(s, p, end);
+    literal = s->literals;
+    literal_end = s->literals + s->literal_count;
+
+    /*
+    **  Sequences section header
+    */
+    if (p >= end)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    sequences = *p++;
+    if (sequences >= 128)
+        {
+        if (sequences == 255)
+            {
+            if (end - p < 2)
+                {
+                fail(s, INFLATE_BAD_DATA);
+                }
+            sequences = (long)load_le(p, 2) + 0x7F00;
+            p += 2;
+            }
+        else
+            {
+            if (p >= end)
+                {
+                fail(s, INFLATE_BAD_DATA);
+                }
+            sequences = ((sequences - 128) << 8) + *p++;
+            }
+        }
+
+    if (sequences > 0)
+        {
+        if (p >= end)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        modes = *p++;
+        if ((modes & 3) != 0)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        p += read_sequence_table(s, modes >> 6, p, end, &s->ll, &s->is_ll_ready, 9, 35, CLiteralDefaults, 36, 6);
+        p += read_sequence_table(s, (modes >> 4) & 3, p, end, &s->of, &s->is_of_ready, 8, 31, COffsetDefaults, 29, 5);
+        p += read_sequence_table(s, (modes >> 2) & 3, p, end, &s->ml, &s->is_ml_ready, 9, 52, CMatchDefaults, 53, 6);
+        if (p >= end)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+
+        bits_init(s, &b, p, (size_t)(end - p));
+        ll_state = bits_read(&b, s->ll.log);
+        of_state = bits_read(&b, s->of.log);
+        ml_state = bits_read(&b, s->ml.log);
+
+        for (i = 0; i < sequences; i++)
+            {
+            ll_code = s->ll.table[ll_state].symbol;
+            ml_code = s->ml.table[ml_state].symbol;
+            of_code = s->of.table[of_state].symbol;
+
+            offset = (1ull << of_code) + bits_read(&b, of_code);
+            match_length = CMatchBase[ml_code] + bits_read(&b, CMatchBits[ml_code]);
+            literal_length = CLiteralBase[ll_code] + bits_read(&b, CLiteralBits[ll_code]);
+
+            /*
+            **  Offsets 1 - 3 name a recent offset (shifted by one when
+            **  there are no literals); the one used moves to the front
+            */
+            if (offset > 3)
+                {
+                offset -= 3;
+                s->rep[2] = s->rep[1];
+                s->rep[1] = s->rep[0];
+                s->rep[0] = offset;
+                }
+            else
+                {
+                index = (int)offset - 1 + (literal_length == 0 ? 1 : 0);
+                if (index > 0)
+                    {
+                    offset = (index == 3) ? s->rep[0] - 1 : s->rep[index];
+                    if (index > 1)
+                        {
+                        s->rep[2] = s->rep[1];
+                        }
+                    s->rep[1] = s->rep[0];
+                    s->rep[0] = offset;
+                    }
+                else
+                    {
+                    offset = s->rep[0];
+                    }
+                }
+
+            if (i + 1 < sequences)
+                {
+                ll_state = s->ll.table[ll_state].base + bits_read(&b, s->ll.table[ll_state].bits);
+                ml_state = s->ml.table[ml_state].base + bits_read(&b, s->ml.table[ml_state].bits);
+                of_state = s->of.table[of_state].base + bits_read(&b, s->of.table[of_state].bits);
+                }
+
+            if (literal_length > (size_t)(literal_end - literal) ||
+                produced + literal_length + match_length > ZSTD_BLOCK_MAX ||
+                offset == 0 || offset > s->fill + produced + literal_length)
+                {
+                fail(s, INFLATE_BAD_DATA);
+                }
+            memcpy(out + produced, literal, literal_length);
+            literal += literal_length;
+            produced += literal_length;
+
+            match = out + produced - offset;
+            if (offset >= match_length)
+                {
+                memcpy(out + produced, match, match_length);
+                }
+            else
+                {
+                for (; match_length > 0; match_length--)    //  overlapping: repeats the last offset bytes
+                    {
+                    out[produced++] = *match++;
+                    }
+                }
+            produced += match_length;
+            }
+        if (b.pos != 0)
+            {
+            fail(s, INFLATE_BAD_DATA);
+            }
+        }
+    else if (p != end)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+
+    if (produced + (size_t)(literal_end - literal) > ZSTD_BLOCK_MAX)
+        {
+        fail(s, INFLATE_BAD_DATA);
+        }
+    memcpy(out + produced, literal, (size_t)(literal_end - literal));
+    return produced + (size_t)(literal_end - literal);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode one frame (after its magic number).
+**
+**------------------------------------------------------------------------*/
+
+static void decode_frame(ZstdState *s)
+    {
+    static const int dictionary_bytes[4] = { 0, 1, 2, 4 };
+    unsigned long long content_size = 0;
+    unsigned long long produced = 0;
+    unsigned long long window = 0;
+    unsigned long long header;
+    size_t block_max;
+    size_t need;
+    size_t length;
+    size_t keep;
+    size_t made;
+    int    descriptor;
+    int    size_bytes;
+    int    type;
+    bool   is_last;
+
+    descriptor = (int)read_le(s, 1);
+    if ((descriptor & 0x08) != 0)
+        {
+        fail(s, INFLATE_BAD_HEADER);
+        }
+    if ((descriptor & 0x20) == 0)
+        {
+        header = read_le(s, 1);
+        window = 1ull << (10 + (header >> 3));
+        window += (window >> 3) * (header & 7);
+        }
+    if (dictionary_bytes[descriptor & 3] > 0 && read_le(s, dictionary_bytes[descriptor & 3]) != 0)
+        {
+        fail(s, ZSTD_UNSUPPORTED);
+        }
+    size_bytes = (descriptor >> 6 == 0) ? ((descriptor & 0x20) ? 1 : 0) : 1 << (descriptor >> 6);
+    if (size_bytes > 0)
+        {
+        content_size = read_le(s, size_bytes) + (size_bytes == 2 ? 256 : 0);
+        }
+    if ((descriptor & 0x20) != 0)
+        {
+        window = content_size;
+        }
+    if (window > ZSTD_WINDOW_MAX)
+        {
+        fail(s, ZSTD_UNSUPPORTED);
+        }
+    s->window = (size_t)window;
+    block_max = MIN(s->window, (size_t)ZSTD_BLOCK_MAX);
+
+    need = s->window + MAX(s->window, (size_t)ZSTD_SLACK) + ZSTD_BLOCK_MAX;
+    if (s->capacity < need)
+        {
+        free(s->history);
+        s->history = (unsigned char *)malloc(need);
+        s->capacity = (s->history != NULL) ? need : 0;
+        if (s->history == NULL)
+            {
+            fail(s, ZSTD_UNSUPPORTED);
+            }
+        }
+    s->fill = 0;
+    s->rep[0] = 1;
+    s->rep[1] = 4;
+    s->rep[2] = 8;
+    s->huffman_max_bits = 0;
+    s->is_ll_ready = FALSE;
+    s->is_of_ready = FALSE;
+    s->is_ml_ready = FALSE;
+    xxh_init(&s->xxh);
+
+    do
+        {
+        header = read_le(s, 3);
+        is_last = (header & 1) != 0;
+        type = (int)(header >> 1) & 3;
+        length = (size_t)(header >> 3);
+
+        if (s->fill + ZSTD_BLOCK_MAX > s->capacity)
+            {
+            keep = MIN(s->window, s->fill);
+            memmove(s->history, s->history + s->fill - keep, keep);
+            s->fill = keep;
+            }
+
+        switch (type)
+            {
+                case 0:
+                    if (length > block_max)
+                        {
+                        fail(s, INFLATE_BAD_DATA);
+                        }
+                    read_bytes(s, s->history + s->fill, length);
+                    made = length;
+                    break;
+
+                case 1:
+                    if (length > block_max)
+                        {
+                        fail(s, INFLATE_BAD_DATA);
+                        }
+                    memset(s->history + s->fill, (int)read_le(s, 1), length);
+                    made = length;
+                    break;
+
+                case 2:
+                    if (length > block_max)
+                        {
+                        fail(s, INFLATE_BAD_DATA);
+                        }
+                    read_bytes(s, s->block, length);
+                    memset(s->block + length, 0, ZSTD_PAD);
+                    made = decode_block(s, length);
+                    if (made > block_max)
+                        {
+                        fail(s, INFLATE_BAD_DATA);
+                        }
+                    break;
+
+                default:
+                    fail(s, INFLATE_BAD_DATA);
+                    made = 0;
+                    break;
+            }
+
+        xxh_update(&s->xxh, s->history + s->fill, made);
+        if (!s->source->write(s->source->context, s->history + s->fill, made))
+            {
+            fail(s, INFLATE_STOPPED);
+            }
+        s->fill += made;
+        produced += made;
+        } while (!is_last);
+
+    if ((descriptor & 0x04) != 0 && read_le(s, 4) != (xxh_digest(&s->xxh) & 0xFFFFFFFFull))
+        {
+        fail(s, INFLATE_BAD_CRC);
+        }
+    if (size_bytes > 0 && produced != content_size)
+        {
+        fail(s, INFLATE_BAD_CRC);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Decode every frame of the source.
+**
+**  Parameters:     Name        Description.
+**                  source      Compressed input and decompressed sink.
+**
+**  Returns:        INFLATE_OK or a negative INFLATE_ / ZSTD_ error code.
+**
+**------------------------------------------------------------------------*/
+
+int zstd_decompress(InflateSource *source)
+    {
+    ZstdState *s;
+    unsigned long magic;
+    unsigned long long skip;
+    unsigned char discard[256];
+    int result;
+
+    s = new ZstdState;
+    s->source = source;
+    s->history = NULL;
+    s->capacity = 0;
+    s->window = 0;
+
+    result = setjmp(s->failure);
+    if (result != 0)
+        {
+        free(s->history);
+        delete s;
+        return result;
+        }
+
+    do
+        {
+        magic = (unsigned long)read_le(s, 4);
+        if ((magic & 0xFFFFFFF0ul) == ZSTD_SKIPPABLE)
+            {
+            for (skip = read_le(s, 4); skip > 0; skip -= MIN(skip, sizeof(discard)))
+                {
+                read_bytes(s, discard, (size_t)MIN(skip, sizeof(discard)));
+                }
+            continue;
+            }
+        if (magic != ZSTD_MAGIC)
+            {
+            fail(s, INFLATE_BAD_HEADER);
+            }
+        decode_frame(s);
+
+        /*
+        **  Another frame may follow (cat a.zst b.zst)
+        */
+        } while (more_input(s));
+
+    free(s->history);
+    delete s;
+    return INFLATE_OK;
+    }
+
+
+const char *zstd_error(int code)
+    {
+    switch (code)
+        {
+            case INFLATE_OK:         return "no error";
+            case INFLATE_TRUNCATED:  return "compressed input is truncated";
+            case INFLATE_BAD_HEADER: return "not a Zstandard frame";
+            case INFLATE_BAD_DATA:   return "invalid Zstandard data";
+            case INFLATE_BAD_CRC:    return "checksum or content size mismatch";
+            case ZSTD_UNSUPPORTED:   return "Zstandard dictionary or window over 128 MB not supported";
+            case INFLATE_STOPPED:    return "decoding was stopped";
+        }
+    return "unknown error";
+    }
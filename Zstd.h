@@ -0,0 +1,23 @@
+/**
+ *
+ *  Name: Zstd.h
+ *
+ *  Description:
+ *
+ *      Streaming Zstandard (RFC 8878) decoder used to read compressed
+ *      spool files without an external zstd, through the same source
+ *      and sink as the gzip decoder (Inflate.h).
+ *
+ */
+
+#ifndef ZSTD_H
+#define ZSTD_H
+
+#include "Inflate.h"
+
+#define ZSTD_UNSUPPORTED    (-5)        /* dictionary, or window over ZSTD_WINDOW_MAX */
+
+int         zstd_decompress(InflateSource *source);
+const char *zstd_error(int code);
+
+#endif //ZSTD_H
@@ -57,12 +57,33 @@
 
 #include "stdafx.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <signal.h>
 #include <tchar.h>
+#include <chrono>
 #include "unistd.h"
 #include "XGetopt.h"
+#include "TextCodec.h"
+#include "Digest.h"
+#include "Sha256.h"
+#include "PdfWriter.h"
+#include "SpoolInput.h"
+#include "SearchIndex.h"
+#include "SpoolWatch.h"
+#include "Checkpoint.h"
+#include "ConvertCache.h"
+#include "PageCache.h"
+#include "MicroBench.h"
+#include "MemStats.h"
+#include "TraceEvents.h"
+#include "CarriageControl.h"
+#include "CodePage.h"
+#include "Overlay.h"
+#include "AutoFit.h"
+#include "CidFont.h"
 
 /**
  * Compiler Function Definitions 
@@ -72,6 +93,8 @@
 #define MIN(x, y)       ((x) < (y) ? (x) : (y))
 #define ABS(x)          ((x) < 0 ? -(x) : (x))
 
+#define NUP_MAX         16              /* -q pages per sheet */
+
 
 /**
  *	Output Headings and Constants
@@ -80,6 +103,7 @@
 static  TCHAR GV_DashCode[256];
 static  TCHAR GV_BodyFontName[256];
 static  TCHAR GV_HeadingFontName[256];
+static  TCHAR GV_CIDFontName[256];
 
 const   float GV_VersionNumber = 1.1f;
 const   int CGreyScaleValue = 0xC0C0C0;
@@ -109,8 +133,18 @@ bool    GV_IsPrintPageNumbers;
 bool    GV_IsPrintLineNumbers;
 bool    GV_IsPerPageLineNumbers;
 bool    GV_IsPageCountPositionTop;
+bool    GV_IsUTF8Input;
+bool    GV_IsOptimizeStream;
+bool    GV_IsStatistics;
+bool    GV_IsDedupPages;
+bool    GV_IsEBCDIC;
 
 int     GV_ShadeStep;
+int     GV_RecordFormat;
+long    GV_RecordLength;
+int     GV_WriterQueueDepth;
+int     GV_WriterThreads;
+long    GV_WriterBufferSize;
 int     GV_CurrentLineCount;
 int     GV_CurrentPageCount;
 
@@ -118,15 +152,118 @@ static  TCHAR GV_TitleLeft[256];
 static  TCHAR GV_TitleRight[256];
 static  TCHAR GV_ImpactTop[256];
 
+TCHAR  *GV_InputPath = NULL;
+TCHAR  *GV_SearchIndexPath = NULL;
+TCHAR  *GV_SearchTerms = NULL;
+TCHAR  *GV_BurstPattern = NULL;
+TCHAR  *GV_BurstTemplate = "%s.pdf";
+TCHAR   GV_BurstName[128];
+char  **GV_BurstPaths = NULL;                   /* files created by this run (-b, -F) */
+int     GV_BurstPathCount = 0;
+int     GV_BurstCount = 0;
+bool    GV_IsBursting = FALSE;                  /* documents made by burst_open_document() (-b, -F) */
+bool    GV_IsDocumentOpen = FALSE;
+
+/**
+ *  Follow mode (-F): a new document every GV_FollowPages pages or once
+ *  the oldest line waiting in it is GV_FollowSeconds old
+ */
+
+bool    GV_IsFollow = FALSE;
+int     GV_FollowPages = 0;
+int     GV_FollowSeconds = 0;
+bool    GV_IsFollowPageClosed = FALSE;          /* document finished while waiting; no page open */
+long    GV_FollowLines = 0;                     /* lines in the current document */
+long long GV_FollowOldest = 0;                  /* read time of its first line (ms) */
+long long GV_FollowWaitSum = 0;                 /* sum of read times after the first */
+long    GV_FollowLinesTotal = 0;
+long long GV_FollowLatencyWorst = 0;
+static volatile sig_atomic_t GV_FollowStop = 0;
+
+/**
+ *  Tab stops (-E) and lines wider than the page (-k); see pdf_layout_line()
+ */
+
+#define TAB_MAX_STOPS       32
+#define LAYOUT_MAX          16384           /* bytes of a line after tab expansion */
+
+#define OVERFLOW_NONE       0               /* run off the right edge */
+#define OVERFLOW_WRAP       1
+#define OVERFLOW_TRUNCATE   2
+
+int     GV_TabStops[TAB_MAX_STOPS];             /* columns (from 0) of an -E list */
+int     GV_TabStopCount = 0;
+int     GV_TabInterval = 0;                     /* stops after the list; 0 leaves tabs alone */
+int     GV_Overflow = OVERFLOW_NONE;
+TCHAR  *GV_ContinuationMarker = "+";
+int     GV_LineColumns = 0;                     /* columns between the margins */
+bool    GV_IsLayoutLines = FALSE;               /* -E or -k set */
+bool    GV_IsContinuationRow = FALSE;           /* printing a wrapped row: no line number */
+long    GV_StatRowsWrapped = 0;
+long    GV_StatLinesTruncated = 0;
+
+/**
+ *  Layout chosen from a sample of the input (-a); see pdf_auto_fit()
+ */
+
+#define AUTO_MAX_COLUMNS    256             /* wider lines are left to -k */
+
+bool    GV_IsAutoFit = FALSE;
+float   GV_BodyFontScale = 1.0f;                /* body font size over the line spacing */
+
+TCHAR   GV_WatchDirectory[260] = "";
+int     GV_WatchWorkers = 2;
+TCHAR  *GV_OutputPath = NULL;
+TCHAR   GV_CheckpointPath[1024];
+int     GV_CheckpointInterval = 100;
+TCHAR   GV_CacheDirectory[260] = "";
+long    GV_CacheLimit = 1024;
+FILE   *GV_CacheFile = NULL;
+TCHAR  *GV_PageCachePath = NULL;
+Digest  GV_SettingsDigest;
+PageCacheEntry GV_PageRecord;           /* -j: page being rendered */
+Sha256  GV_PageLines;                   /* -j: hash of its lines so far */
+int     GV_PageRecordStart;
+bool    GV_IsPageRecorded = FALSE;
+int     GV_BenchRepetitions = 0;
+int     GV_MemorySampleInterval = 0;
+char   *GV_TracePath = NULL;
+char   *GV_ControlPath = NULL;
+char   *GV_CodePageName = NULL;
+char   *GV_OverlayPath = NULL;
+int     GV_OverlayPage = 1;
+int     GV_OverlayId = 0;
+int     GV_PagesPerSheet = 1;
+int     GV_SheetCount = 0;
+int     GV_SheetStreamId = 0;
+int     GV_SheetForms[NUP_MAX];
+float   GV_SheetMatrix[NUP_MAX][6];
+int     GV_TraceSample = 1;
+bool    GV_IsPageTraced = FALSE;
+long long GV_TracePageStart = 0;
+long long GV_TraceReadTime = 0;
+int     GV_PageOverstrikes = 0;
+
 int     GV_PDFObjectId = 1;
 int     GV_PDFPageTreeId;
+int     GV_PDFResourcesId = 0;
 int     GV_PDFNumberOfPages = 0;
 int     GV_PDFXRefCount = 0;
-int     GV_PDFStreamId;
-int     GV_PDFStreamLengthId;
-
-long    GV_PDFStreamStart;
-long   *GV_XReferences = NULL;
+long long *GV_XReferences = NULL;
+
+char   *GV_PageBuffer = NULL;
+long    GV_PageBufferLength = 0;
+long    GV_PageBufferSize = 0;
+
+long    GV_StatStateEmitted = 0;
+long    GV_StatStateElided = 0;
+long    GV_StatStateBytesSaved = 0;
+long    GV_StatMoveOpsIn = 0;
+long    GV_StatMoveOpsOut = 0;
+long    GV_StatMoveBytesIn = 0;
+long    GV_StatMoveBytesOut = 0;
+long    GV_StatPagesDeduplicated = 0;
+long    GV_StatDedupBytesSaved = 0;
 
 /**
  *	Structures and Type Definitions
@@ -141,6 +278,25 @@ struct _RGB
 
 typedef _RGB RGB;
 
+/**
+ *  Graphics state of the content stream being written.
+ *  Operators are only emitted when the requested value differs.
+ */
+
+struct _GState
+    {
+    RGB   fill;
+    RGB   pending_fill;                 /* set but not yet written (is_fill_pending) */
+    bool  is_fill_pending;
+    int   font_id;
+    float font_size;
+    float leading;
+    int   pending_half_lines;
+    bool  is_move_pending;
+    };
+
+typedef _GState GState;
+
 struct _PageList
     {
     struct _PageList *next;
@@ -149,8 +305,38 @@ struct _PageList
 
 typedef _PageList PageList;
 
+/**
+ *  Content streams already written, by SHA-256 (for -D); a match is
+ *  printed in place of the page, so the key must not collide
+ */
+
+struct _StreamEntry
+    {
+    unsigned char hash[SHA256_BYTES];
+    int           stream_id;
+    };
+
+typedef _StreamEntry StreamEntry;
+
+StreamEntry *GV_StreamTable = NULL;
+int          GV_StreamTableSize = 0;
+int          GV_StreamTableCount = 0;
+
 PageList *GV_PAGE_LIST = NULL;
 PageList **GV_INSERT_PAGE = &GV_PAGE_LIST;
+PageList *GV_CheckpointPage = NULL;    /* last page in the -K journal */
+
+/**
+ *  print_pdf_string() specialized for this run's options by
+ *  pdf_select_renderers(); [1] is used for '^' (extended ASCII) lines
+ */
+
+typedef void (*StringRenderer)(TCHAR *buffer);
+
+StringRenderer GV_StringRenderer[2] = { NULL, NULL };
+StringRenderer GV_TitleRenderer = NULL; /* titles: never line numbered */
+
+RGB   GV_ControlColor[256];             /* colours of the carriage control table */
 
 /**
  *	Color Definitions used throughout the solution
@@ -163,25 +349,79 @@ RGB   GV_CURRENT_COLOR;
 RGB   GV_LINE_NUMBER_COLOR;
 RGB   GV_TITLE_COLOR;
 
+GState GV_GState;
+
 /**
  *	Function Prototypes
  */
 
 RGB  colorConverter(long hexValue);
 long colorInverter(struct _RGB colorValue);
+bool colorEqual(RGB a, RGB b);
 void adjust_pdf_ypos(float mult);
 void do_process_pages();
-void do_text_translation();
+void pdf_settings_digest(Digest *digest);
+void pdf_auto_fit(int argc, TCHAR **argv);
+void pdf_begin_document();
+void pdf_end_document();
+void pdf_write_xref();
+bool burst_match(const char *text);
+void burst_format_path(char *path, size_t size, const char *name);
+bool burst_is_path_used(const char *path);
+void burst_open_document();
+void burst_close_document();
+bool follow_idle();
+void follow_stop(int signal_number);
+void follow_line_read();
+void follow_report();
+void pdf_page_break(const char *text);
+bool pdf_is_page_break(const char *text);
+int  pdf_page_line();
+bool pdf_open_output();
+void pdf_checkpoint();
+void pdf_page_prefix(unsigned char *prefix, const char *text);
+bool pdf_replay_page(char *text, size_t size);
+void pdf_store_page();
+void do_text_translation(bool is_resumed);
+template <bool IS_ASA> void translate_lines(bool is_resumed);
+char *pdf_read_line(char *buffer, size_t size);
+bool do_plain_line(char *buffer1, size_t size);
+void do_microbench(int repetitions);
 void end_pdf_page();
+void pdf_write_page();
+void pdf_sheet_layout();
+void pdf_place_page(int form_id);
+void pdf_write_sheet();
 void print_margin_label();
 void print_pdf_title_at(float xvalue, float yvalue, TCHAR *string);
 void print_pdf_pagebars();
 void print_pdf_string(TCHAR *buffer);
+template <bool IS_LINE_NUMBERS, bool IS_UTF8, bool IS_EXTENDED> void print_pdf_string_as(TCHAR *buffer);
+void pdf_select_renderers();
+void print_pdf_utf8_string(const unsigned char *text, size_t length);
 void print_pdf_impact_top();
+void pdf_reset_graphics_state();
+void pdf_set_fill_color(RGB color);
+void pdf_flush_fill();
+void pdf_set_font(int id, float size);
+void pdf_set_leading(float leading);
+void pdf_move_lines(float lines);
+void pdf_blank_line();
+void pdf_flush_moves();
+void print_pdf_line(TCHAR *buffer);
+void print_pdf_row(TCHAR *buffer);
+void pdf_layout_line(TCHAR *buffer);
+size_t pdf_expand_tabs(const char *text, size_t length, char *line);
+size_t pdf_column_offset(const char *text, size_t length, int columns);
 void showhelp(int itype);
 void start_pdf_object(int id);
 void start_pdf_page();
 void store_pdf_page(int id);
+int  find_pdf_stream(const unsigned char *hash);
+void remember_pdf_stream(const unsigned char *hash, int id);
+int  pdf_page_printf(const char *format, ...);
+void pdf_page_putc(int c);
+void pdf_page_write(const char *data, long length);
 
 
 /*--------------------------------------------------------------------------
@@ -212,6 +452,7 @@ int main(int argc, TCHAR *argv[])
 
     char *varname;
     char subbuff[16];
+    char spool[1024] = "";
 
     int index;
     int c;
@@ -224,6 +465,16 @@ int main(int argc, TCHAR *argv[])
     */
     GV_IsASA = TRUE;                                    //  ANSI/ASA Processor
     GV_IsExtendedASCII = FALSE;                         //  Mode is Extended ASCII 
+    GV_IsUTF8Input = FALSE;                             //  Input is 8-bit WinAnsi
+    GV_IsEBCDIC = FALSE;                                //  Input is ASCII/WinAnsi
+    GV_RecordFormat = INPUT_LINES;                      //  Newline Delimited Input
+    GV_RecordLength = 0;                                //  (Fixed Records Only)
+    GV_IsOptimizeStream = TRUE;                         //  Elide state changes, merge line moves
+    GV_IsStatistics = FALSE;                            //  Report output statistics
+    GV_IsDedupPages = FALSE;                            //  Share identical page streams
+    GV_WriterBufferSize = 64 * 1024;                    //  Output buffer size
+    GV_WriterQueueDepth = 0;                            //  Synchronous writes (no thread)
+    GV_WriterThreads = 0;                               //  Buffers written in order
     GV_UnitMultiplier = 72.0f;                          //  Standard 72 units per Inch
     GV_IsPrintPageNumbers = FALSE;                      //  Display Page Numbers
     GV_IsPrintLineNumbers = FALSE;                      //  Insert Line Numbers
@@ -257,6 +508,8 @@ int main(int argc, TCHAR *argv[])
             sizeof(GV_BodyFontName));
     strncpy(GV_HeadingFontName, "Courier-Bold",         //  Default is Courier-Bold
             sizeof(GV_HeadingFontName));
+    strncpy(GV_CIDFontName, "ArialUnicodeMS",           //  Fallback for non-WinAnsi UTF-8
+            sizeof(GV_CIDFontName));
 
     GV_TitleFontSize = 12.0;                            //  12 Points (Fixed)
 
@@ -283,10 +536,11 @@ int main(int argc, TCHAR *argv[])
         }
     opterr = 0;
 
-    while ((c = getopt(argc, argv, _T("1:2:A:B:d:g:H:hi:L:l:M:n:N:o:pPR:t:T:u:W:vxX"))) != EOF)
+    while ((c = getopt(argc, argv, _T("1:2:3:aA:B:b:c:Dd:E:eF:g:G:H:hI:i:J:j:k:K:L:l:M:m:n:N:o:O:pPq:Q:r:R:s:S:t:T:u:UVw:W:vxXy:Y:z"))) != EOF)
         switch (c)
             {
                 case _T('A'): GV_IsASA = (bool)((int)strtol(optarg, NULL, 10) == 1);           break; /* Formatted as ANSI/ASA    */
+                case _T('a'): GV_IsAutoFit = TRUE;                                             break; /* layout from the input    */
                 case _T('H'): GV_PageDepth = (float)strtod(optarg, NULL) * GV_UnitMultiplier;  break; /* Height                   */
                 case _T('W'): GV_PageWidth = (float)strtod(optarg, NULL) * GV_UnitMultiplier;  break; /* Width                    */
 
@@ -361,6 +615,7 @@ int main(int argc, TCHAR *argv[])
                 case _T('d'): strncpy(GV_DashCode, optarg, sizeof(GV_DashCode));               break; /* dash code                */
                 case _T('1'): strncpy(GV_BodyFontName, optarg, sizeof(GV_BodyFontName));       break; /* font                     */
                 case _T('2'): strncpy(GV_HeadingFontName, optarg, sizeof(GV_HeadingFontName)); break; /* font                     */
+                case _T('3'): strncpy(GV_CIDFontName, optarg, sizeof(GV_CIDFontName));         break; /* font (UTF-8 fallback)    */
                 case _T('o'): GV_OVERSTRIKE_COLOR = colorConverter(strtol(optarg, NULL, 16));  break; /* color of overprint       */
 
                 case _T('n'):
@@ -374,9 +629,169 @@ int main(int argc, TCHAR *argv[])
                     GV_IsPrintLineNumbers = TRUE;
                     GV_IsPerPageLineNumbers = (bool)((int)strtol(optarg, NULL, 10) == 1);      break; /* Printer Line Numbers     */
 
+                case _T('U'): GV_IsUTF8Input = TRUE;                                          break; /* UTF-8 encoded input      */
+                case _T('Q'):                                                                         /* writer thread buffers   */
+                    GV_WriterBufferSize = strtol(optarg, &varname, 10) * 1024;
+                    GV_WriterQueueDepth = (*varname == ',') ? (int)strtol(varname + 1, &varname, 10) : 2;
+                    if (GV_WriterQueueDepth < 1)
+                        {
+                        GV_WriterQueueDepth = 1;
+                        }
+                    GV_WriterThreads = (*varname == ',') ? (int)strtol(varname + 1, NULL, 10) : 0;
+                    break;
+
+                case _T('r'):                                                                         /* RECFM[,LRECL]           */
+                    GV_RecordFormat = (toupper(optarg[0]) == 'V') ? INPUT_VARIABLE : INPUT_FIXED;
+                    if (toupper(optarg[0]) != 'F' && toupper(optarg[0]) != 'V')
+                        {
+                        fprintf(stderr, "(error) -r %s: record format must be F, FB, FBA, V, VB or VBA.\n", optarg);
+                        exit(1);
+                        }
+                    varname = strchr(optarg, ',');
+                    GV_IsASA = (toupper(optarg[strcspn(optarg, ",") - 1]) == 'A');
+                    GV_RecordLength = (varname != NULL) ? strtol(varname + 1, NULL, 10) : (GV_IsASA ? 133 : 80);
+                    if (GV_RecordFormat == INPUT_FIXED && GV_RecordLength < 1)
+                        {
+                        fprintf(stderr, "(error) -r %s: record length must be positive.\n", optarg);
+                        exit(1);
+                        }
+                    break;
+
+                case _T('m'): GV_CodePageName = optarg;                                       break; /* code page of the input   */
+                case _T('e'): GV_IsEBCDIC = TRUE;                                             break; /* EBCDIC (CP037) input     */
+                case _T('b'): GV_BurstPattern = optarg;                                       break; /* burst on page headers   */
+                case _T('O'): GV_BurstTemplate = optarg;                                      break; /* burst output file names */
+                case _T('E'):                                                                         /* tab stops               */
+                    GV_TabStopCount = 0;
+                    for (varname = optarg; ; varname++)
+                        {
+                        ix = (int)strtol(varname, &varname, 10) - 1;
+                        if (ix >= 0 && GV_TabStopCount < TAB_MAX_STOPS && (GV_TabStopCount == 0 || ix > GV_TabStops[GV_TabStopCount - 1]))
+                            {
+                            GV_TabStops[GV_TabStopCount++] = ix;
+                            }
+                        if (*varname != ',')
+                            {
+                            break;
+                            }
+                        }
+                    if (GV_TabStopCount == 0)
+                        {
+                        fprintf(stderr, "(error) -E takes a tab width or a list of increasing columns.\n");
+                        exit(1);
+                        }
+                    if (GV_TabStopCount == 1)
+                        {
+                        GV_TabInterval = GV_TabStops[0] + 1;    //  -E 8: every 8 columns
+                        GV_TabStopCount = 0;
+                        }
+                    else
+                        {
+                        GV_TabInterval = GV_TabStops[GV_TabStopCount - 1] - GV_TabStops[GV_TabStopCount - 2];
+                        }
+                    break;
+
+                case _T('k'):                                                                         /* lines wider than a page */
+                    if (toupper(optarg[0]) != 'W' && toupper(optarg[0]) != 'T')
+                        {
+                        fprintf(stderr, "(error) -k takes w (wrap) or t (truncate).\n");
+                        exit(1);
+                        }
+                    GV_Overflow = (toupper(optarg[0]) == 'W') ? OVERFLOW_WRAP : OVERFLOW_TRUNCATE;
+                    if (optarg[1] == ',')
+                        {
+                        GV_ContinuationMarker = optarg + 2;
+                        }
+                    break;
+
+                case _T('F'):                                                                         /* follow a growing file   */
+                    GV_IsFollow = TRUE;
+                    GV_FollowPages = (int)strtol(optarg, &varname, 10);
+                    GV_FollowSeconds = (*varname == ',') ? (int)strtol(varname + 1, NULL, 10) : 0;
+                    break;
+                case _T('w'):                                                                         /* watch a spool directory */
+                    strncpy(GV_WatchDirectory, optarg, sizeof(GV_WatchDirectory) - 1);
+                    varname = strrchr(GV_WatchDirectory, ',');
+                    if (varname != NULL && varname[1] != '\0' && strspn(varname + 1, "0123456789") == strlen(varname + 1))
+                        {
+                        GV_WatchWorkers = (int)strtol(varname + 1, NULL, 10);
+                        *varname = '\0';
+                        }
+                    break;
+
+                case _T('K'):                                                                         /* output file, checkpoint */
+                    GV_OutputPath = optarg;
+                    varname = strrchr(optarg, ',');
+                    if (varname != NULL && varname[1] != '\0' && strspn(varname + 1, "0123456789") == strlen(varname + 1))
+                        {
+                        GV_CheckpointInterval = (int)strtol(varname + 1, NULL, 10);
+                        *varname = '\0';
+                        }
+                    if (GV_CheckpointInterval < 1)
+                        {
+                        GV_CheckpointInterval = 1;
+                        }
+                    break;
+
+                case _T('c'):                                                                         /* conversion cache        */
+                    strncpy(GV_CacheDirectory, optarg, sizeof(GV_CacheDirectory) - 1);
+                    varname = strrchr(GV_CacheDirectory, ',');
+                    if (varname != NULL && varname[1] != '\0' && strspn(varname + 1, "0123456789") == strlen(varname + 1))
+                        {
+                        GV_CacheLimit = strtol(varname + 1, NULL, 10);
+                        *varname = '\0';
+                        }
+                    break;
+
+                case _T('G'):                                                                         /* overlay file[,page]     */
+                    GV_OverlayPath = optarg;
+                    varname = strrchr(optarg, ',');
+                    if (varname != NULL && varname[1] != '\0' && strspn(varname + 1, "0123456789") == strlen(varname + 1))
+                        {
+                        GV_OverlayPage = (int)strtol(varname + 1, NULL, 10);
+                        *varname = '\0';
+                        }
+                    if (GV_OverlayPage < 1)
+                        {
+                        GV_OverlayPage = 1;
+                        }
+                    break;
+
+                case _T('J'): GV_ControlPath = optarg;                                        break; /* carriage control table  */
+                case _T('j'): GV_PageCachePath = optarg;                                      break; /* per-page render cache   */
+                case _T('S'): GV_SearchIndexPath = optarg;                                    break; /* search index sidecar    */
+                case _T('s'): GV_SearchTerms = optarg;                                        break; /* query the search index  */
+                case _T('q'): GV_PagesPerSheet = (int)strtol(optarg, NULL, 10);               break; /* n-up: pages per sheet    */
+                case _T('D'): GV_IsDedupPages = TRUE;                                         break; /* share identical pages    */
+                case _T('V'): GV_IsStatistics = TRUE;                                         break; /* statistics to stderr     */
+                case _T('y'): GV_BenchRepetitions = (int)strtol(optarg, NULL, 10);             break; /* kernel microbenchmarks  */
+                case _T('z'): GV_IsOptimizeStream = FALSE;                                    break; /* unoptimized streams      */
+
                 case _T('P'): GV_IsPrintPageNumbers = TRUE; GV_IsPageCountPositionTop = TRUE;  break; /* display page #s - top    */
                 case _T('p'): GV_IsPrintPageNumbers = TRUE; GV_IsPageCountPositionTop = FALSE; break; /* display page #s - bottom */
 
+                case _T('I'):                                                                         /* memory accounting       */
+                    GV_MemorySampleInterval = (int)strtol(optarg, NULL, 10);
+                    if (GV_MemorySampleInterval < 1)
+                        {
+                        GV_MemorySampleInterval = 1;
+                        }
+                    break;
+
+                case _T('Y'):                                                                         /* trace file[,sampling]   */
+                    GV_TracePath = optarg;
+                    varname = strrchr(optarg, ',');
+                    if (varname != NULL && varname[1] != '\0' && strspn(varname + 1, "0123456789") == strlen(varname + 1))
+                        {
+                        GV_TraceSample = (int)strtol(varname + 1, NULL, 10);
+                        *varname = '\0';
+                        }
+                    if (GV_TraceSample < 1)
+                        {
+                        GV_TraceSample = 1;
+                        }
+                    break;
+
                 case _T('h'): showhelp(1); exit(1);                                            break; /* help                     */
                 case _T('x'): case _T('X'): showhelp(2); exit(1);                              break; /* Show parameters          */
                 case _T('v'): fprintf(stderr, "(info) txt2pdf version %f\n", GV_VersionNumber);
@@ -406,141 +821,1469 @@ int main(int argc, TCHAR *argv[])
         GV_ShadeStep = 1;
         }
 
-    for (index = optind; index < argc; index++)
+    if (GV_IsDedupPages && (GV_IsPrintPageNumbers || (GV_IsPrintLineNumbers && !GV_IsPerPageLineNumbers)))
         {
-        fprintf(stderr, "(warning) Non-option Argument %s\n", argv[index]);
+        /*
+        **  Page numbers and running line numbers make every page unique
+        */
+        fprintf(stderr, "(info) -D ignored: page content varies with page/line numbering\n");
+        GV_IsDedupPages = FALSE;
         }
-    do_process_pages();
-    exit(0);
-    }
-
-
-void do_process_pages()
-    {
-
-    int		i;
-    int		catalog_id;
-    int		font_id0;
-    int		font_id1;
-    long	start_xref;
-    
-    /*
-    ** Indicate standard supporting METADATA STREAMS
-    */
-    printf("%%PDF-1.4\n");
 
-    /**
-     *  General PDF Convention:
-     *
-     *  If a PDF file contains binary data, as most do , it is
-     *  recommended that the header line be immediately followed by a
-     *  comment line containing at least four binary characters--that is,
-     *  characters whose codes are 128 or greater. 
-     *
-     *  This will ensure proper behavior of file transfer applications 
-     *  that inspect data near the beginning of a file to determine whether
-     *  to treat the file's contents as text or as binary.
-     *
-     *  The convention is to use the Magic Number of E2E3CFD3.
-     */
+    if (GV_PagesPerSheet < 1 || GV_PagesPerSheet > NUP_MAX)
+        {
+        fprintf(stderr, "(error) -q %d: pages per sheet must be 1 to %d.\n", GV_PagesPerSheet, NUP_MAX);
+        exit(1);
+        }
+    if (GV_PagesPerSheet > 1)
+        {
+        pdf_sheet_layout();
+        }
 
-    fprintf(stdout, "%%%c%c%c%c\n", 0xE2, 0xE3, 0xCF, 0xD3);        //  PDF Magic Number
-    fprintf(stdout, "%% PDF: Adobe Portable Document Format\n");
+    if (GV_IsUTF8Input && !cidfont_load(GV_CIDFontName))
+        {
+        exit(1);
+        }
+    if (GV_OverlayPath != NULL && !overlay_load(GV_OverlayPath, GV_OverlayPage, GV_PageWidth, GV_PageDepth, GV_CacheDirectory))
+        {
+        exit(1);
+        }
 
-    /**
-     *  This is a SquareBox calculation and only works for monospace fonts
-     *  in which all characters fit within the same space.
-     *
-     *  Therefore any fonts which are variable pitch (proportional) cannot be used
-     *  reliably in the rendering of a listing.  For this reason we choose the defaults
-     *  of Courier (monospace) because it is inbuilt (automatically provided) in the
-     *  Adobe provided PDF Engine.
-     */
+    if (GV_MemorySampleInterval > 0)
+        {
+        mem_enable(GV_MemorySampleInterval);
+        }
 
-    GV_StandardLineSize = (GV_PageDepth - GV_PageMarginTop - GV_PageMarginBottom) / GV_LinesPerPage;
-    GV_BodyFontSize = GV_StandardLineSize;
+    if (GV_TracePath != NULL && !trace_open(GV_TracePath, GV_TraceSample))
+        {
+        exit(1);
+        }
 
-    GV_PDFObjectId = 1;
-    GV_PDFPageTreeId = GV_PDFObjectId++;
-    
-    /*
-    **  Process all of the inputs from STDIN
-    */
-    do_text_translation();
+    pdf_select_renderers();
 
-    /*
-    **  Font Object 0 Is used for the general body content
-    */
-    font_id0 = GV_PDFObjectId++;
-    start_pdf_object(font_id0);
-    printf("<</Type/Font/Subtype/Type1/BaseFont/%s/Encoding/WinAnsiEncoding>>\nendobj\n", GV_BodyFontName);
+    cc_defaults();
+    if (GV_ControlPath != NULL && !cc_load(GV_ControlPath, (int)GV_LinesPerPage))
+        {
+        exit(1);
+        }
+    for (ix = 0; ix < 256; ix++)
+        {
+        if (cc_table[ix].color >= 0)
+            {
+            GV_ControlColor[ix] = colorConverter(cc_table[ix].color);
+            }
+        }
 
-    /*
-    **  Font Object 1 Is used for the body text and line numbers
-    */
-    font_id1 = GV_PDFObjectId++;
-    start_pdf_object(font_id1);
-    printf("<</Type/Font/Subtype/Type1/BaseFont/%s/Encoding/WinAnsiEncoding>>\nendobj\n", GV_HeadingFontName);
+    GV_IsBursting = (GV_BurstPattern != NULL || GV_IsFollow);
+    if (GV_IsBursting && GV_WriterQueueDepth == 0)
+        {
+        GV_WriterQueueDepth = 2;                        //  Finish documents on their own threads
+        }
 
-    /*
-    **  Now that the Font Resources are declared, we generate the page tree object
-    */
+    for (index = optind; index < argc; index++)
+        {
+        if (GV_InputPath == NULL)
+            {
+            GV_InputPath = argv[index];                 //  First Non-option is the Input File
+            }
+        else
+            {
+            fprintf(stderr, "(warning) Non-option Argument %s\n", argv[index]);
+            }
+        }
 
-    start_pdf_object(GV_PDFPageTreeId);
-    printf("<</Type /Pages /Count %d\n", GV_PDFNumberOfPages);
+    if (GV_OutputPath != NULL && (GV_BurstPattern != NULL || GV_SearchIndexPath != NULL || GV_WatchDirectory[0] != '\0'))
+        {
+        fprintf(stderr, "(error) -K cannot be combined with -b, -S or -w.\n");
+        exit(1);
+        }
 
-    PageList *ptr = GV_PAGE_LIST;
-    PageList *ptrfree = GV_PAGE_LIST;
+    if (GV_CacheDirectory[0] != '\0' && (GV_OutputPath != NULL || GV_BurstPattern != NULL || GV_SearchIndexPath != NULL))
+        {
+        fprintf(stderr, "(error) -c cannot be combined with -K, -b or -S.\n");
+        exit(1);
+        }
 
-    printf("/Kids[\n");
-    while (ptr != NULL)
+    if (GV_IsFollow && (GV_OutputPath != NULL || GV_CacheDirectory[0] != '\0' || GV_PageCachePath != NULL || GV_SearchIndexPath != NULL || GV_WatchDirectory[0] != '\0'))
         {
-        printf("%d 0 R\n", ptr->page_id);
-        ptrfree = ptr;
-        ptr = ptr->next;
-        free(ptrfree);
+        fprintf(stderr, "(error) -F cannot be combined with -K, -c, -j, -S or -w.\n");
+        exit(1);
+        }
+    if (GV_IsFollow && (GV_InputPath == NULL || strcmp(GV_InputPath, "-") == 0))
+        {
+        fprintf(stderr, "(error) -F needs an input file to follow.\n");
+        exit(1);
         }
-    printf("]\n");
 
+    if (GV_CodePageName != NULL && (GV_IsUTF8Input || GV_IsEBCDIC))
+        {
+        fprintf(stderr, "(error) -m cannot be combined with -U or -e.\n");
+        exit(1);
+        }
+    if (GV_CodePageName != NULL && !codepage_select(GV_CodePageName))
+        {
+        exit(1);
+        }
 
-    /*
-    **  Now create the Subordinate Resources objects
-    */
+    if (GV_PageCachePath != NULL && (GV_OutputPath != NULL || GV_BurstPattern != NULL || GV_SearchIndexPath != NULL || GV_WatchDirectory[0] != '\0'))
+        {
+        fprintf(stderr, "(error) -j cannot be combined with -K, -b, -S or -w.\n");
+        exit(1);
+        }
 
-    printf("/Resources<</ProcSet[/PDF/Text]/Font<<");
-    printf("/F0 %d 0 R\n", font_id0);
-    printf("/F1 %d 0 R\n", font_id1);
-    printf("/F2<</Type /Font /Subtype /Type1 /BaseFont /%s /Encoding /WinAnsiEncoding >> >>\n", GV_HeadingFontName);
-    printf(">>/MediaBox [ 0 0 %g %g ]\n", GV_PageWidth, GV_PageDepth);
-    printf(">>\nendobj\n");
-    
-    /*
-    **  Now create the Catalog and Cross-References object
-    */
+    if (GV_BenchRepetitions > 0)
+        {
+        do_microbench(GV_BenchRepetitions);
+        exit(0);
+        }
 
-    catalog_id = GV_PDFObjectId++;
-    start_pdf_object(catalog_id);
-    printf("<</Type /Catalog /Pages %d 0 R>>\nendobj\n", GV_PDFPageTreeId);
-    start_xref = ftell(stdout);
-    printf("xref\n");
-    printf("0 %d\n", GV_PDFObjectId);
-    printf("0000000000 65535 f \n");
+    if (GV_SearchTerms != NULL)
+        {
+        /*
+        **  Query mode: search an index written by an earlier run
+        */
+        if (GV_SearchIndexPath == NULL)
+            {
+            fprintf(stderr, "(error) -s needs the index named with -S.\n");
+            exit(2);
+            }
+        ix = index_query(GV_SearchIndexPath, GV_SearchTerms);
+        exit((ix > 0) ? 0 : (ix == 0) ? 1 : 2);
+        }
 
-    for (i = 1; i < GV_PDFObjectId; i++)
+    if (GV_WatchDirectory[0] != '\0')
         {
-        printf("%010ld 00000 n \n", GV_XReferences[i]);
+        /*
+        **  Watch mode: workers are run with every option except -w
+        */
+        TCHAR **worker_argv = (TCHAR **)malloc((optind + 1) * sizeof(TCHAR *));
+        ix = 0;
+        for (index = 0; index < optind && worker_argv != NULL; index++)
+            {
+            if (index > 0 && _tcsncmp(argv[index], _T("-w"), 2) == 0)
+                {
+                index += (argv[index][2] == '\0') ? 1 : 0;
+                continue;
+                }
+            worker_argv[ix++] = argv[index];
+            }
+        exit(watch_run(GV_WatchDirectory, GV_WatchWorkers, ix, worker_argv));
         }
 
-    free(GV_XReferences);
+    if (GV_IsAutoFit)
+        {
+        pdf_auto_fit(argc, argv);
+        }
 
-    /*
-    **  Now Complete the file by writing the trailer with the
-    **  appropriate back-references to the Cross-Reference Object
-    **  and the Root object.
-    */
-    printf("trailer\n<<\n/Size %d\n/Root %d 0 R\n>>\n", GV_PDFObjectId, catalog_id);
-    printf("startxref\n%ld\n%%%%EOF\n", start_xref);
-    }
+    if (GV_CacheDirectory[0] != '\0')
+        {
+        /*
+        **  Conversion cache: the key is the SHA-256 of the input bytes
+        **  plus every setting that changes the output
+        */
+        Digest        digest;
+        Sha256        strong;
+        unsigned char key[SHA256_BYTES];
+
+        cache_configure(GV_CacheDirectory, (long long)GV_CacheLimit * 1024 * 1024);
+        digest_init(&digest);
+        sha256_init(&strong);
+        digest_tee(&digest, &strong);
+        pdf_settings_digest(&digest);
+        if (!cache_hash_input(GV_InputPath, &digest, spool, sizeof(spool)))
+            {
+            exit(1);
+            }
+        digest_final(&digest);
+        sha256_final(&strong, key);
+        if (cache_fetch(key, stdout))
+            {
+            if (spool[0] != '\0')
+                {
+                remove(spool);
+                }
+            if (GV_IsStatistics)
+                {
+                fprintf(stderr, "(info) cache hit in %s\n", GV_CacheDirectory);
+                }
+            exit(0);
+            }
+        GV_CacheFile = cache_create(key);
+        if (spool[0] != '\0')
+            {
+            GV_InputPath = spool;
+            }
+        }
+
+    input_set_records(GV_RecordFormat, (size_t)GV_RecordLength, GV_IsEBCDIC);
+    input_set_code_page((GV_CodePageName != NULL) ? codepage_table() : NULL);
+    if (GV_IsFollow)
+        {
+        /*
+        **  Ctrl-C (or a kill) ends the input: the last document is finished
+        */
+        signal(SIGINT, follow_stop);
+        signal(SIGTERM, follow_stop);
+        input_set_follow(follow_idle);
+        }
+    if (!input_open(GV_InputPath) || (GV_SearchIndexPath != NULL && !index_open(GV_SearchIndexPath)))
+        {
+        exit(1);
+        }
+    if (GV_PageCachePath != NULL)
+        {
+        digest_init(&GV_SettingsDigest);
+        pdf_settings_digest(&GV_SettingsDigest);
+        digest_final(&GV_SettingsDigest);
+        if (!page_cache_open(GV_PageCachePath))
+            {
+            exit(1);
+            }
+        }
+    do_process_pages();
+    input_close();
+    if (spool[0] != '\0')
+        {
+        remove(spool);
+        }
+    if (!index_close())
+        {
+        exit(1);
+        }
+    exit(0);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Digest every setting that changes the PDF (the -c
+**                  cache key).  Values are taken after option parsing,
+**                  so $IMPACT_TOP / $IMPACT_GRAYBAR are included and
+**                  equivalent command lines share entries.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_settings_digest(Digest *digest)
+    {
+    RGB colors[5] = { GV_FONT_COLOR, GV_OVERSTRIKE_COLOR, GV_LINE_NUMBER_COLOR, GV_TITLE_COLOR, GV_BAR_COLOR };
+    float sizes[9] = { GV_PageDepth, GV_PageWidth, GV_PageMarginTop, GV_PageMarginBottom,
+                       GV_PageMarginLeft, GV_PageMarginRight, GV_LinesPerPage, GV_TitleFontSize, GV_VersionNumber };
+    int flags[12] = { GV_IsASA, GV_IsUTF8Input, GV_IsEBCDIC, GV_RecordFormat, (int)GV_RecordLength,
+                      GV_IsOptimizeStream, GV_IsDedupPages, GV_IsPrintPageNumbers, GV_IsPrintLineNumbers,
+                      GV_IsPerPageLineNumbers, GV_IsPageCountPositionTop, GV_ShadeStep };
+    const TCHAR *texts[7] = { GV_TitleLeft, GV_TitleRight, GV_ImpactTop, GV_DashCode,
+                              GV_BodyFontName, GV_HeadingFontName, GV_CIDFontName };
+    int i;
+
+    digest_update(digest, "txt2pdf", 8);
+    digest_update(digest, colors, sizeof(colors));
+    digest_update(digest, sizes, sizeof(sizes));
+    digest_update(digest, flags, sizeof(flags));
+    for (i = 0; i < 7; i++)
+        {
+        digest_update(digest, texts[i], strlen(texts[i]) + 1);
+        }
+    cc_digest(digest);
+    if (GV_CodePageName != NULL)
+        {
+        codepage_digest(digest);
+        }
+    if (GV_PagesPerSheet > 1)
+        {
+        digest_update(digest, &GV_PagesPerSheet, sizeof(GV_PagesPerSheet));
+        }
+    if (GV_TabInterval > 0 || GV_Overflow != OVERFLOW_NONE)
+        {
+        digest_update(digest, GV_TabStops, GV_TabStopCount * sizeof(GV_TabStops[0]));
+        digest_update(digest, &GV_TabInterval, sizeof(GV_TabInterval));
+        digest_update(digest, &GV_Overflow, sizeof(GV_Overflow));
+        digest_update(digest, GV_ContinuationMarker, strlen(GV_ContinuationMarker) + 1);
+        }
+    if (GV_OverlayPath != NULL)
+        {
+        overlay_digest(digest);
+        }
+    if (GV_IsUTF8Input)
+        {
+        cidfont_digest(digest);
+        }
+    if (GV_BodyFontScale != 1.0f)
+        {
+        digest_update(digest, &GV_BodyFontScale, sizeof(GV_BodyFontScale));
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Choose the layout from a sample of the input (-a): ASA
+**                  or plain, lines per page, orientation and a body font
+**                  small enough for the widest line.  -A, -l, -W and -H
+**                  given on the command line are kept.
+**
+**  Parameters:     Name        Description.
+**                  argc        Argument count.
+**                  argv        Arguments; those before optind are options.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_auto_fit(int argc, TCHAR **argv)
+    {
+    signed char advance[256];
+    bool   is_given[128];
+    AutoFit fit;
+    float  long_side = MAX(GV_PageWidth, GV_PageDepth);
+    float  short_side = MIN(GV_PageWidth, GV_PageDepth);
+    float  width;
+    float  depth;
+    float  line;
+    float  font;
+    float  best_font = 0.0f;
+    float  best_line = 1.0f;
+    int    columns;
+    int    turns;
+    int    turn;
+    int    ix;
+
+    if (GV_InputPath == NULL || strcmp(GV_InputPath, "-") == 0 || GV_RecordFormat != INPUT_LINES || GV_IsEBCDIC)
+        {
+        fprintf(stderr, "(info) auto: only a text input file can be sampled, layout unchanged\n");
+        return;
+        }
+
+    memset(is_given, 0, sizeof(is_given));
+    for (ix = 1; ix < optind && ix < argc; ix++)
+        {
+        if (argv[ix][0] == '-')
+            {
+            is_given[argv[ix][1] & 0x7F] = TRUE;
+            }
+        }
+
+    /*
+    **  Column 1 is judged by the carriage control table in use (-J)
+    */
+    for (ix = 0; ix < 256; ix++)
+        {
+        switch (cc_table[ix].action)
+            {
+            case CC_SPACE:      advance[ix] = (signed char)MIN(cc_table[ix].count, 100);                   break;
+            case CC_CHANNEL:    advance[ix] = (cc_table[ix].count == 1) ? AUTOFIT_EJECT : 1;               break;
+            case CC_HALF_LINE:  advance[ix] = 1;                                                           break;
+            case CC_FORM_FEED:  advance[ix] = AUTOFIT_EJECT;                                               break;
+            default:            advance[ix] = AUTOFIT_NOT_CONTROL;                                         break;
+            }
+        }
+
+    if (!autofit_sample(GV_InputPath, advance, (GV_TabInterval > 0) ? GV_TabInterval : 8, &fit))
+        {
+        fprintf(stderr, "(info) auto: %s could not be sampled (empty or compressed), layout unchanged\n", GV_InputPath);
+        return;
+        }
+
+    if (!is_given['A'])
+        {
+        GV_IsASA = fit.is_asa;
+        }
+    if (!is_given['l'] && fit.page_lines > 0)
+        {
+        GV_LinesPerPage = (float)fit.page_lines;
+        }
+
+    /*
+    **  Landscape and portrait (unless a size was given): the one with the
+    **  larger font wins, at most the line spacing (Courier is 0.6 em wide)
+    */
+    columns = MIN(MAX(fit.columns, 1), AUTO_MAX_COLUMNS) + (GV_IsPrintLineNumbers ? 9 : 0);
+    turns = (is_given['W'] || is_given['H']) ? 1 : 2;
+    for (turn = 0; turn < turns; turn++)
+        {
+        width = (turns == 1) ? GV_PageWidth : (turn == 0) ? long_side : short_side;
+        depth = (turns == 1) ? GV_PageDepth : (turn == 0) ? short_side : long_side;
+        line = (depth - GV_PageMarginTop - GV_PageMarginBottom) / GV_LinesPerPage;
+        font = MIN(line, (width - GV_PageMarginLeft - GV_PageMarginRight) / (0.6f * columns));
+        if (font > best_font)
+            {
+            best_font = font;
+            best_line = line;
+            GV_PageWidth = width;
+            GV_PageDepth = depth;
+            }
+        }
+    GV_BodyFontScale = (best_font > 0.0f) ? best_font / best_line : 1.0f;
+
+    fprintf(stderr, "(info) auto: %s, %d lines/page, %d columns, %s %gx%g, font %.2f on %.2f"
+                    " (%ld lines, %lld bytes sampled in %.3f ms)\n",
+            GV_IsASA ? "ASA" : "plain", (int)GV_LinesPerPage, fit.columns,
+            (GV_PageWidth > GV_PageDepth) ? "landscape" : "portrait", GV_PageWidth, GV_PageDepth,
+            best_font, best_line, fit.lines, fit.bytes, fit.elapsed_ms);
+    }
+
+
+void do_process_pages()
+    {
+
+    /**
+     *  This is a SquareBox calculation and only works for monospace fonts
+     *  in which all characters fit within the same space.
+     *
+     *  Therefore any fonts which are variable pitch (proportional) cannot be used
+     *  reliably in the rendering of a listing.  For this reason we choose the defaults
+     *  of Courier (monospace) because it is inbuilt (automatically provided) in the
+     *  Adobe provided PDF Engine.
+     */
+
+    GV_StandardLineSize = (GV_PageDepth - GV_PageMarginTop - GV_PageMarginBottom) / GV_LinesPerPage;
+    GV_BodyFontSize = GV_StandardLineSize * GV_BodyFontScale;
+
+    /*
+    **  Columns for -k: Courier advances 0.6 em, a line number takes "nnnnnn | "
+    */
+    GV_LineColumns = (int)((GV_PageWidth - GV_PageMarginLeft - GV_PageMarginRight) / (0.6f * GV_BodyFontSize)) - (GV_IsPrintLineNumbers ? 9 : 0);
+    GV_IsLayoutLines = (GV_TabInterval > 0 || GV_Overflow != OVERFLOW_NONE);
+
+    bool is_resumed = FALSE;
+    long long trace_start;
+
+    if (GV_OutputPath != NULL)
+        {
+        is_resumed = pdf_open_output();
+        }
+    else if (!GV_IsBursting)
+        {
+        writer_open((GV_CacheFile != NULL) ? GV_CacheFile : stdout, GV_WriterBufferSize, GV_WriterQueueDepth, GV_WriterThreads);
+        pdf_begin_document();
+        }
+
+    /*
+    **  Process all of the inputs from STDIN
+    */
+    trace_start = trace_is_enabled ? trace_now() : 0;
+    do_text_translation(is_resumed);
+    if (trace_is_enabled)
+        {
+        trace_span("convert", "document", trace_start, NULL);
+        trace_start = trace_now();
+        }
+
+    if (!GV_IsBursting)
+        {
+        pdf_end_document();
+        if (!writer_close())
+            {
+            cache_discard();
+            if (GV_PageCachePath != NULL)
+                {
+                page_cache_close(FALSE, GV_CurrentPageCount);
+                }
+            fprintf(stderr, "(error) Unable to write the PDF output.\n");
+            exit(1);
+            }
+        if (GV_PageCachePath != NULL && !page_cache_close(TRUE, GV_CurrentPageCount))
+            {
+            fprintf(stderr, "(warning) Unable to update page cache %s.\n", GV_PageCachePath);
+            }
+        if (GV_CacheFile != NULL && !cache_publish(stdout))
+            {
+            fprintf(stderr, "(error) Unable to write the PDF output.\n");
+            exit(1);
+            }
+        if (GV_OutputPath != NULL)
+            {
+            checkpoint_close(TRUE);
+            }
+        }
+    else
+        {
+        burst_close_document();
+        if (!writer_finish())
+            {
+            fprintf(stderr, "(error) Unable to write the burst PDF output.\n");
+            exit(1);
+            }
+        if (GV_IsFollow)
+            {
+            fprintf(stderr, "(info) follow: %d documents, %ld lines, worst latency %lld ms\n",
+                    GV_BurstCount, GV_FollowLinesTotal, GV_FollowLatencyWorst);
+            }
+        }
+    MEM_ACCOUNT(MEM_PAGE_BUFFER, GV_PageBufferSize, 0);
+    free(GV_PageBuffer);
+    GV_PageBuffer = NULL;
+    GV_PageBufferSize = 0;
+
+    if (GV_IsStatistics)
+        {
+        if (GV_IsBursting)
+            {
+            fprintf(stderr, "(info) documents %d, %ld writer stalls\n", GV_BurstCount, writer_stalls());
+            }
+        else
+            {
+            fprintf(stderr, "(info) pages %d, objects %d, %lld bytes, %ld writer stalls\n",
+                    GV_PDFNumberOfPages, GV_PDFObjectId - 1, writer_tell(), writer_stalls());
+            }
+        if (GV_PagesPerSheet > 1)
+            {
+            fprintf(stderr, "(info) %d-up: %d logical pages placed as form XObjects\n",
+                    GV_PagesPerSheet, GV_CurrentPageCount);
+            }
+        fprintf(stderr, "(info) state operators emitted %ld, elided %ld (%ld bytes saved)\n",
+                GV_StatStateEmitted, GV_StatStateElided, GV_StatStateBytesSaved);
+        fprintf(stderr, "(info) line moves %ld operators in, %ld out (%ld bytes saved)\n",
+                GV_StatMoveOpsIn, GV_StatMoveOpsOut, GV_StatMoveBytesIn - GV_StatMoveBytesOut);
+        if (GV_IsDedupPages)
+            {
+            fprintf(stderr, "(info) duplicate pages %ld (%ld bytes saved)\n",
+                    GV_StatPagesDeduplicated, GV_StatDedupBytesSaved);
+            }
+        if (GV_Overflow != OVERFLOW_NONE)
+            {
+            fprintf(stderr, "(info) %d columns per line: %ld rows wrapped, %ld lines truncated\n",
+                    GV_LineColumns, GV_StatRowsWrapped, GV_StatLinesTruncated);
+            }
+        }
+    if (trace_is_enabled)
+        {
+        trace_span("trailer", "document", trace_start, NULL);
+        trace_close();
+        }
+    mem_report();
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the file header and reset the object numbering
+**                  for a new document on the current writer.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_begin_document()
+    {
+    int i;
+
+    /*
+    ** Indicate standard supporting METADATA STREAMS
+    */
+    writer_printf("%%PDF-1.4\n");
+
+    /**
+     *  General PDF Convention:
+     *
+     *  If a PDF file contains binary data, as most do , it is
+     *  recommended that the header line be immediately followed by a
+     *  comment line containing at least four binary characters--that is,
+     *  characters whose codes are 128 or greater. 
+     *
+     *  This will ensure proper behavior of file transfer applications 
+     *  that inspect data near the beginning of a file to determine whether
+     *  to treat the file's contents as text or as binary.
+     *
+     *  The convention is to use the Magic Number of E2E3CFD3.
+     */
+
+    writer_printf("%%%c%c%c%c\n", 0xE2, 0xE3, 0xCF, 0xD3);        //  PDF Magic Number
+    writer_printf("%% PDF: Adobe Portable Document Format\n");
+
+    GV_PDFObjectId = 1;
+    GV_PDFPageTreeId = GV_PDFObjectId++;
+    GV_PDFResourcesId = (GV_PagesPerSheet > 1) ? GV_PDFObjectId++ : 0;
+    GV_SheetStreamId = 0;
+    GV_PDFNumberOfPages = 0;
+    GV_IsDocumentOpen = TRUE;
+
+    /*
+    **  The overlay (-G) is written once per document, ahead of the pages
+    */
+    if (GV_OverlayPath != NULL)
+        {
+        GV_OverlayId = GV_PDFObjectId;
+        for (i = 0; i < overlay_object_count(); i++)
+            {
+            start_pdf_object(GV_PDFObjectId++);
+            overlay_write_object(i, GV_OverlayId);
+            }
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write fonts, page tree, catalog, xref and trailer.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_end_document()
+    {
+
+    int		catalog_id;
+    int		font_id0;
+    int		font_id1;
+    int		font_id3;
+    int		encoding_id;
+    int		code;
+    int		last_code;
+    char	encoding[32];
+    long long	start_xref;
+    long long	trace_start;
+
+    /*
+    **  A part-filled n-up sheet (-q) is the last page
+    */
+    pdf_write_sheet();
+
+    /*
+    **  With a code page (-m) the body fonts show its glyphs for 0x80 - 0xFF
+    */
+    strcpy(encoding, "/WinAnsiEncoding");
+    if (GV_CodePageName != NULL)
+        {
+        encoding_id = GV_PDFObjectId++;
+        start_pdf_object(encoding_id);
+        writer_printf("<</Type/Encoding/BaseEncoding/WinAnsiEncoding/Differences[");
+        last_code = -1;
+        for (code = 0x80; code <= 0xFF; code++)
+            {
+            if (codepage_glyph(code) != NULL)
+                {
+                if (code != last_code + 1)
+                    {
+                    writer_printf(" %d", code);
+                    }
+                writer_printf("/%s", codepage_glyph(code));
+                last_code = code;
+                }
+            }
+        writer_printf("]>>\nendobj\n");
+        snprintf(encoding, sizeof(encoding), " %d 0 R", encoding_id);
+        }
+
+    /*
+    **  Font Object 0 Is used for the general body content
+    */
+    font_id0 = GV_PDFObjectId++;
+    start_pdf_object(font_id0);
+    writer_printf("<</Type/Font/Subtype/Type1/BaseFont/%s/Encoding%s>>\nendobj\n", GV_BodyFontName, encoding);
+
+    /*
+    **  Font Object 1 Is used for the body text and line numbers
+    */
+    font_id1 = GV_PDFObjectId++;
+    start_pdf_object(font_id1);
+    writer_printf("<</Type/Font/Subtype/Type1/BaseFont/%s/Encoding%s>>\nendobj\n", GV_HeadingFontName, encoding);
+
+    /*
+    **  Font Object 3 Carries UTF-8 input which has no WinAnsi glyph.
+    **  Text is shown as 2-byte CIDs equal to the UCS-2 code point; see
+    **  CidFont.cpp for the descriptor, ToUnicode and embedding.
+    */
+    if (GV_IsUTF8Input)
+        {
+        font_id3 = GV_PDFObjectId;
+        for (code = 0; code < cidfont_object_count(); code++)
+            {
+            start_pdf_object(GV_PDFObjectId++);
+            cidfont_write_object(code, font_id3);
+            }
+        }
+
+    /*
+    **  Now that the Font Resources are declared, we generate the page tree object
+    */
+
+    start_pdf_object(GV_PDFPageTreeId);
+    writer_printf("<</Type /Pages /Count %d\n", GV_PDFNumberOfPages);
+
+    PageList *ptr = GV_PAGE_LIST;
+    PageList *ptrfree = GV_PAGE_LIST;
+
+    writer_printf("/Kids[\n");
+    while (ptr != NULL)
+        {
+        writer_printf("%d 0 R\n", ptr->page_id);
+        ptrfree = ptr;
+        ptr = ptr->next;
+        free(ptrfree);
+        MEM_ACCOUNT(MEM_PAGE_LIST, sizeof(*ptrfree), 0);
+        }
+    GV_PAGE_LIST = NULL;
+    GV_INSERT_PAGE = &GV_PAGE_LIST;
+    writer_printf("]\n");
+
+
+    /*
+    **  Now create the Subordinate Resources objects.  With -q they are
+    **  an object of their own, shared by the page forms.
+    */
+
+    if (GV_PDFResourcesId != 0)
+        {
+        writer_printf("/Resources %d 0 R/MediaBox [ 0 0 %g %g ]\n>>\nendobj\n", GV_PDFResourcesId, GV_PageWidth, GV_PageDepth);
+        start_pdf_object(GV_PDFResourcesId);
+        writer_printf("<<");
+        }
+    else
+        {
+        writer_printf("/Resources<<");
+        }
+    writer_printf("/ProcSet[/PDF/Text]/Font<<");
+    writer_printf("/F0 %d 0 R\n", font_id0);
+    writer_printf("/F1 %d 0 R\n", font_id1);
+    if (GV_IsUTF8Input)
+        {
+        writer_printf("/F3 %d 0 R\n", font_id3);
+        }
+    writer_printf("/F2<</Type /Font /Subtype /Type1 /BaseFont /%s /Encoding /WinAnsiEncoding >> >>\n", GV_HeadingFontName);
+    if (GV_OverlayPath != NULL)
+        {
+        writer_printf("/XObject<</OV %d 0 R>>\n", GV_OverlayId);
+        }
+    if (GV_PDFResourcesId != 0)
+        {
+        writer_printf(">>\nendobj\n");
+        }
+    else
+        {
+        writer_printf(">>/MediaBox [ 0 0 %g %g ]\n", GV_PageWidth, GV_PageDepth);
+        writer_printf(">>\nendobj\n");
+        }
+    
+    /*
+    **  Now create the Catalog and Cross-References object
+    */
+
+    catalog_id = GV_PDFObjectId++;
+    start_pdf_object(catalog_id);
+    writer_printf("<</Type /Catalog /Pages %d 0 R>>\nendobj\n", GV_PDFPageTreeId);
+    start_xref = writer_tell();
+    trace_start = trace_is_enabled ? trace_now() : 0;
+    pdf_write_xref();
+    if (trace_is_enabled)
+        {
+        trace_span("xref", "document", trace_start, NULL);
+        }
+
+    MEM_ACCOUNT(MEM_XREF, GV_PDFXRefCount * sizeof(*GV_XReferences), 0);
+    MEM_ACCOUNT(MEM_STREAM_TABLE, GV_StreamTableSize * sizeof(*GV_StreamTable), 0);
+    free(GV_XReferences);
+    free(GV_StreamTable);
+    GV_XReferences = NULL;
+    GV_PDFXRefCount = 0;
+    GV_StreamTable = NULL;
+    GV_StreamTableSize = 0;
+    GV_StreamTableCount = 0;
+
+    /*
+    **  Now Complete the file by writing the trailer with the
+    **  appropriate back-references to the Cross-Reference Object
+    **  and the Root object.
+    */
+    writer_printf("trailer\n<<\n/Size %d\n/Root %d 0 R\n>>\n", GV_PDFObjectId, catalog_id);
+    writer_printf("startxref\n%lld\n%%%%EOF\n", start_xref);
+    GV_IsDocumentOpen = FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the cross-reference table for objects
+**                  1 .. GV_PDFObjectId - 1.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_write_xref()
+    {
+    int i;
+
+    writer_printf("xref\n");
+    writer_printf("0 %d\n", GV_PDFObjectId);
+    writer_printf("0000000000 65535 f \n");
+
+    for (i = 1; i < GV_PDFObjectId; i++)
+        {
+        writer_printf("%010lld 00000 n \n", GV_XReferences[i]);
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Match a page-start line against the -b pattern.
+**
+**  Parameters:     Name        Description.
+**                  text        Line text after the carriage control.
+**
+**  Returns:        TRUE when a new document starts here; GV_BurstName
+**                  holds the word following the match (or a sequence
+**                  name when there is none).
+**
+**------------------------------------------------------------------------*/
+
+bool burst_match(const char *text)
+    {
+    const char *match = strstr(text, GV_BurstPattern);
+    int length = 0;
+
+    if (match == NULL)
+        {
+        return FALSE;
+        }
+
+    match += strlen(GV_BurstPattern);
+    while (*match == ' ')
+        {
+        match++;
+        }
+    while (length < (int)sizeof(GV_BurstName) - 1 && (isalnum((unsigned char)match[length]) || strchr("._-#$@", match[length]) != NULL) && match[length] != '\0')
+        {
+        GV_BurstName[length] = match[length];
+        length++;
+        }
+    GV_BurstName[length] = '\0';
+    if (length == 0)
+        {
+        sprintf_s(GV_BurstName, sizeof(GV_BurstName), "report%04d", GV_BurstCount + 1);
+        }
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Expand the -O template for the current document.
+**
+**  Parameters:     Name        Description.
+**                  path        Receives the file name.
+**                  size        Size of path.
+**                  name        Replaces %s.
+**
+**------------------------------------------------------------------------*/
+
+void burst_format_path(char *path, size_t size, const char *name)
+    {
+    const char *t;
+    size_t      n = 0;
+
+    for (t = GV_BurstTemplate; *t != '\0' && n < size - sizeof(GV_BurstName) - 32; t++)
+        {
+        if (t[0] == '%' && t[1] == 's')
+            {
+            n += snprintf(path + n, size - n, "%s", name);
+            t++;
+            }
+        else if (t[0] == '%' && t[1] == 'd')
+            {
+            n += snprintf(path + n, size - n, "%04d", GV_BurstCount);
+            t++;
+            }
+        else
+            {
+            path[n++] = *t;
+            }
+        }
+    path[n] = '\0';
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Has this run already written a document to path?
+**
+**  Description:    Compared without case, as the names are on Windows.
+**
+**------------------------------------------------------------------------*/
+
+bool burst_is_path_used(const char *path)
+    {
+    int i;
+
+    for (i = 0; i < GV_BurstPathCount; i++)
+        {
+        if (_stricmp(GV_BurstPaths[i], path) == 0)
+            {
+            return TRUE;
+            }
+        }
+    return FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Create the next burst document from the -O template
+**                  (%s is the matched name, %d the document number).
+**
+**  Description:    A report ID can come round again in one stream; the
+**                  later documents are named ID-2, ID-3 and so on rather
+**                  than overwriting the first (which may still be being
+**                  written by its writer thread).
+**
+**------------------------------------------------------------------------*/
+
+void burst_open_document()
+    {
+    char  path[1024];
+    char  name[sizeof(GV_BurstName) + 16];
+    char **paths;
+    int   copy;
+    FILE *file;
+
+    GV_BurstCount++;
+    if (GV_BurstName[0] == '\0')
+        {
+        sprintf_s(GV_BurstName, sizeof(GV_BurstName), "report%04d", GV_BurstCount);
+        }
+
+    burst_format_path(path, sizeof(path), GV_BurstName);
+    for (copy = 2; burst_is_path_used(path); copy++)
+        {
+        if (strstr(GV_BurstTemplate, "%s") == NULL)
+            {
+            fprintf(stderr, "(error) -O %s gives document %d the name of an earlier one (%s).\n",
+                    GV_BurstTemplate, GV_BurstCount, path);
+            writer_finish();
+            exit(1);
+            }
+        snprintf(name, sizeof(name), "%s-%d", GV_BurstName, copy);
+        burst_format_path(path, sizeof(path), name);
+        }
+
+    file = fopen(path, "wb");
+    paths = (char **)realloc(GV_BurstPaths, (GV_BurstPathCount + 1) * sizeof(char *));
+    if (paths != NULL)
+        {
+        GV_BurstPaths = paths;
+        }
+    if (file == NULL || paths == NULL || (GV_BurstPaths[GV_BurstPathCount] = _strdup(path)) == NULL)
+        {
+        fprintf(stderr, "(error) Unable to create burst output %s.\n", path);
+        writer_finish();
+        exit(1);
+        }
+    GV_BurstPathCount++;
+    if (GV_IsStatistics)
+        {
+        fprintf(stderr, "(info) document %d: %s\n", GV_BurstCount, path);
+        }
+
+    writer_open(file, GV_WriterBufferSize, GV_WriterQueueDepth, GV_WriterThreads);
+    pdf_begin_document();
+    GV_BurstName[0] = '\0';
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Finish the current burst document; it is written out
+**                  and closed in the background.
+**
+**------------------------------------------------------------------------*/
+
+void burst_close_document()
+    {
+    if (!GV_IsDocumentOpen)
+        {
+        return;
+        }
+    pdf_end_document();
+    if (!writer_retire())
+        {
+        fprintf(stderr, "(error) Unable to write the burst PDF output.\n");
+        exit(1);
+        }
+    if (GV_IsFollow)
+        {
+        follow_report();
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Milliseconds on a steady clock.
+**
+**------------------------------------------------------------------------*/
+
+static long long follow_now()
+    {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+void follow_stop(int)
+    {
+    GV_FollowStop = 1;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Called between reads of a followed file (-F), and
+**                  while waiting for it to grow.
+**
+**  Description:    Once the oldest line of the document has waited
+**                  GV_FollowSeconds, the page is ended where it is and
+**                  the document finished, so a quiet log is still
+**                  published within the limit.  The next line starts a
+**                  new page (GV_IsFollowPageClosed).  Page and line
+**                  numbers run on across the documents of one log.
+**
+**  Returns:        FALSE once following is to stop (SIGINT, SIGTERM).
+**
+**------------------------------------------------------------------------*/
+
+bool follow_idle()
+    {
+    if (GV_FollowSeconds > 0 && GV_FollowLines > 0 &&
+        follow_now() - GV_FollowOldest >= GV_FollowSeconds * 1000LL)
+        {
+        end_pdf_page();
+        burst_close_document();
+        GV_IsFollowPageClosed = TRUE;
+        }
+    return !GV_FollowStop;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Note the read time of a line of a followed file.
+**
+**------------------------------------------------------------------------*/
+
+void follow_line_read()
+    {
+    long long now = follow_now();
+
+    if (GV_FollowLines == 0)
+        {
+        GV_FollowOldest = now;
+        }
+    GV_FollowLines++;
+    GV_FollowWaitSum += now - GV_FollowOldest;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Report the latency of the document just finished:
+**                  from the read of each line to the document being
+**                  handed to the writer.
+**
+**------------------------------------------------------------------------*/
+
+void follow_report()
+    {
+    long long oldest;
+
+    if (GV_FollowLines == 0)
+        {
+        return;
+        }
+    oldest = follow_now() - GV_FollowOldest;
+    fprintf(stderr, "(info) follow: document %d, %d pages, %ld lines, latency avg %lld ms, max %lld ms\n",
+            GV_BurstCount, GV_PDFNumberOfPages, GV_FollowLines, oldest - GV_FollowWaitSum / GV_FollowLines, oldest);
+
+    GV_FollowLinesTotal += GV_FollowLines;
+    GV_FollowLatencyWorst = MAX(GV_FollowLatencyWorst, oldest);
+    GV_FollowLines = 0;
+    GV_FollowWaitSum = 0;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Page break from carriage control ('1' or form feed).
+**
+**  Parameters:     Name        Description.
+**                  text        Text that starts the new page.
+**
+**  Description:    Nothing happens at the top of a page (breaks at the
+**                  start of a line were already taken by the read loop,
+**                  see pdf_is_page_break()).  In burst mode
+**                  a line matching -b also ends the current document;
+**                  the next one is created when its first page is done.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_page_break(const char *text)
+    {
+    bool is_top = !(GV_PDFPageYPosition < GV_PageDepth - GV_PageMarginTop);
+
+    if (GV_BurstPattern != NULL && burst_match(text))
+        {
+        if (!is_top)
+            {
+            end_pdf_page();
+            }
+        burst_close_document();
+
+        /*
+        **  Restart numbering; the (empty) page begun is started again
+        */
+        GV_CurrentPageCount = 0;
+        if (!GV_IsPerPageLineNumbers)
+            {
+            GV_CurrentLineCount = 1;
+            }
+        start_pdf_page();
+        return;
+        }
+
+    if (!is_top)
+        {
+        GV_IsPageRecorded = FALSE;                      //  -j: not ended at a line start
+        end_pdf_page();
+        start_pdf_page();
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Does this line start a new page?  (Automatic break at
+**                  the bottom margin, an ASA skip to a channel above the
+**                  current line such as '1', or a leading form feed.)
+**
+**  Parameters:     Name        Description.
+**                  text        Line just read.
+**
+**------------------------------------------------------------------------*/
+
+bool pdf_is_page_break(const char *text)
+    {
+    const CarriageControl *cc;
+    bool is_top = !(GV_PDFPageYPosition < GV_PageDepth - GV_PageMarginTop);
+
+    if (!GV_IsASA)
+        {
+        return (text[0] == '\f' && !is_top);
+        }
+
+    /* +1 for roundoff , using floating point point units */
+
+    cc = &cc_table[(unsigned char)text[0]];
+    if (GV_PDFPageYPosition <= (GV_PageMarginBottom + 1) && text[0] != '\0' && !(cc->action == CC_SPACE && cc->count == 0))
+        {
+        return TRUE;
+        }
+
+    /*
+    **  A channel skip with no stop below the current line
+    */
+    return (!is_top && cc->action == CC_CHANNEL && cc_next_stop(cc->count, pdf_page_line()) < 0);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Lines printed on the page so far (0 at the top).
+**
+**------------------------------------------------------------------------*/
+
+int pdf_page_line()
+    {
+    return (int)((GV_PageDepth - GV_PageMarginTop - GV_PDFPageYPosition) / GV_StandardLineSize + 0.5f);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Open the -K output file, resuming from its journal
+**                  when an earlier run with the same settings stopped.
+**
+**  Returns:        TRUE when resumed; the input is positioned at the
+**                  line that starts the next page.
+**
+**------------------------------------------------------------------------*/
+
+bool pdf_open_output()
+    {
+    Checkpoint checkpoint;
+    Digest     options;
+    FILE      *file;
+    long long  identity[2];
+    int        i;
+
+    /*
+    **  The journal is only continued with the same output settings
+    **  (options that do not change the PDF, such as -V, -Y or -Q, may
+    **  differ) and the same input file, unchanged in size and time
+    */
+    digest_init(&options);
+    pdf_settings_digest(&options);
+    if (input_identity(&identity[0], &identity[1]))
+        {
+        digest_update(&options, identity, sizeof(identity));
+        }
+    digest_final(&options);
+
+    snprintf(GV_CheckpointPath, sizeof(GV_CheckpointPath), "%s.ckpt", GV_OutputPath);
+    switch (checkpoint_open(GV_CheckpointPath, &options, &checkpoint))
+        {
+        case CHECKPOINT_MISMATCH:
+            fprintf(stderr, "(error) %s was written with other settings or input; remove it to start over.\n", GV_CheckpointPath);
+            exit(1);
+        case CHECKPOINT_ERROR:
+            fprintf(stderr, "(error) Unable to create checkpoint %s.\n", GV_CheckpointPath);
+            exit(1);
+        case CHECKPOINT_NEW:
+            file = fopen(GV_OutputPath, "wb");
+            if (file == NULL)
+                {
+                fprintf(stderr, "(error) Unable to create %s.\n", GV_OutputPath);
+                exit(1);
+                }
+            writer_open(file, GV_WriterBufferSize, GV_WriterQueueDepth, GV_WriterThreads);
+            pdf_begin_document();
+            return FALSE;
+        }
+
+    /*
+    **  Cut the PDF back to the checkpoint and carry on after it
+    */
+    file = fopen(GV_OutputPath, "r+b");
+    if (file == NULL || _chsize_s(_fileno(file), checkpoint.output_length) != 0 ||
+        _fseeki64(file, 0, SEEK_END) != 0 || _ftelli64(file) != checkpoint.output_length ||
+        !input_skip(checkpoint.input_offset))
+        {
+        fprintf(stderr, "(error) Unable to resume %s from %s.\n", GV_OutputPath, GV_CheckpointPath);
+        exit(1);
+        }
+    writer_open(file, GV_WriterBufferSize, GV_WriterQueueDepth, GV_WriterThreads);
+    writer_resume(checkpoint.output_length);
+
+    GV_XReferences = checkpoint.xrefs;
+    GV_PDFXRefCount = checkpoint.object_id + 1;
+    MEM_ACCOUNT(MEM_XREF, 0, GV_PDFXRefCount * sizeof(*GV_XReferences));
+    GV_PDFObjectId = checkpoint.object_id;
+    GV_PDFPageTreeId = 1;
+    GV_PDFResourcesId = (GV_PagesPerSheet > 1) ? 2 : 0;
+    GV_OverlayId = (GV_PagesPerSheet > 1) ? 3 : 2;
+    GV_PDFNumberOfPages = 0;
+    for (i = 0; i < checkpoint.page_total; i++)
+        {
+        store_pdf_page(checkpoint.page_ids[i]);
+        }
+    for (GV_CheckpointPage = GV_PAGE_LIST; GV_CheckpointPage->next != NULL; GV_CheckpointPage = GV_CheckpointPage->next)
+        {
+        }
+    free(checkpoint.page_ids);
+
+    GV_CurrentLineCount = checkpoint.line_count;
+    GV_CurrentPageCount = checkpoint.page_count;
+    GV_CURRENT_COLOR.r = checkpoint.color[0];
+    GV_CURRENT_COLOR.g = checkpoint.color[1];
+    GV_CURRENT_COLOR.b = checkpoint.color[2];
+    GV_IsDocumentOpen = TRUE;
+
+    if (GV_IsStatistics)
+        {
+        fprintf(stderr, "(info) resuming %s after page %d (input offset %lld)\n",
+                GV_OutputPath, GV_PDFNumberOfPages, checkpoint.input_offset);
+        }
+    return TRUE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Journal a -K checkpoint every N pages.  Called between
+**                  end_pdf_page() and start_pdf_page() while the line
+**                  that opens the next page is the current input line.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_checkpoint()
+    {
+    Checkpoint checkpoint;
+    PageList  *first;
+    PageList  *last = GV_CheckpointPage;
+    PageList  *page;
+    int        count = 0;
+
+    if (GV_OutputPath == NULL || GV_PDFNumberOfPages % GV_CheckpointInterval != 0 || GV_SheetCount != 0)
+        {
+        return;
+        }
+
+    /*
+    **  The PDF must be on disk before the journal says it is
+    */
+    if (!writer_sync())
+        {
+        return;
+        }
+
+    /*
+    **  Only the pages since the previous checkpoint are journaled
+    */
+    first = (GV_CheckpointPage != NULL) ? GV_CheckpointPage->next : GV_PAGE_LIST;
+    for (page = first; page != NULL; page = page->next)
+        {
+        count++;
+        }
+    checkpoint.page_ids = (int *)malloc((count + 1) * sizeof(int));
+    count = 0;
+    for (page = first; page != NULL && checkpoint.page_ids != NULL; page = page->next)
+        {
+        checkpoint.page_ids[count++] = page->page_id;
+        last = page;
+        }
+
+    checkpoint.input_offset = input_line_offset();
+    checkpoint.output_length = writer_tell();
+    checkpoint.object_id = GV_PDFObjectId;
+    checkpoint.line_count = GV_CurrentLineCount - 1;
+    checkpoint.page_count = GV_CurrentPageCount;
+    checkpoint.color[0] = GV_CURRENT_COLOR.r;
+    checkpoint.color[1] = GV_CURRENT_COLOR.g;
+    checkpoint.color[2] = GV_CURRENT_COLOR.b;
+    checkpoint.page_total = count;
+    checkpoint.xrefs = GV_XReferences;
+
+    if (checkpoint.page_ids == NULL || !checkpoint_append(&checkpoint))
+        {
+        fprintf(stderr, "(warning) Unable to write checkpoint %s.\n", GV_CheckpointPath);
+        }
+    else
+        {
+        GV_CheckpointPage = last;
+        }
+    free(checkpoint.page_ids);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        -j key of a page: the settings, the state the page
+**                  starts in and its first line.  Line and page numbers
+**                  only count when they are printed, so pages after an
+**                  insertion can still be reused.
+**
+**  Parameters:     Name        Description.
+**                  prefix      Receives the key.
+**                  text        First line of the page.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_page_prefix(unsigned char *prefix, const char *text)
+    {
+    int    line = (GV_IsPerPageLineNumbers || !GV_IsPrintLineNumbers) ? 0 : GV_CurrentLineCount - 1;
+    int    page = GV_IsPrintPageNumbers ? GV_CurrentPageCount : 0;
+    double color[3] = { GV_CURRENT_COLOR.r, GV_CURRENT_COLOR.g, GV_CURRENT_COLOR.b };
+    Sha256 sha;
+
+    sha256_init(&sha);
+    sha256_update(&sha, &GV_SettingsDigest.h1, sizeof(GV_SettingsDigest.h1));
+    sha256_update(&sha, &GV_SettingsDigest.h2, sizeof(GV_SettingsDigest.h2));
+    sha256_update(&sha, &line, sizeof(line));
+    sha256_update(&sha, &page, sizeof(page));
+    sha256_update(&sha, color, sizeof(color));
+    sha256_update(&sha, text, strlen(text) + 1);
+    sha256_final(&sha, prefix);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Reuse a cached page that starts with this line.
+**
+**  Parameters:     Name        Description.
+**                  text        First line of the page; on success it
+**                              holds the first line of the next page.
+**                  size        Size of text.
+**
+**  Returns:        TRUE if the page was written from the cache.
+**
+**  Description:    The cached page must be followed by the same lines
+**                  as when it was rendered and the line after them must
+**                  break the page at the same place.  The state is then
+**                  left as pdf_is_page_break() would leave it.
+**
+**------------------------------------------------------------------------*/
+
+bool pdf_replay_page(char *text, size_t size)
+    {
+    const PageCacheEntry *entry;
+    const char *line;
+    const char *stream;
+    const int  *totals;
+    unsigned char prefix[SHA256_BYTES];
+    unsigned char check[SHA256_BYTES];
+    Sha256      lines;
+    Sha256      partial;
+    float       y;
+    bool        is_break;
+    int         count;
+    int         i;
+    int         n = 1;
+
+    pdf_page_prefix(prefix, text);
+    count = page_cache_lengths(prefix, &totals);
+
+    /*
+    **  One pass over the lines ahead tries every cached length
+    */
+    sha256_init(&lines);
+    sha256_update(&lines, text, strlen(text) + 1);
+    for (i = 0; i < count; i++)
+        {
+        for (; n < totals[i]; n++)
+            {
+            if ((line = page_cache_peek(n - 1)) == NULL)
+                {
+                return FALSE;
+                }
+            sha256_update(&lines, line, strlen(line) + 1);
+            }
+        partial = lines;
+        sha256_final(&partial, check);
+        if ((entry = page_cache_find(prefix, check)) == NULL ||
+            (line = page_cache_peek(entry->line_total - 1)) == NULL)
+            {
+            continue;
+            }
+
+        y = GV_PDFPageYPosition;
+        GV_PDFPageYPosition = entry->y_end;
+        is_break = pdf_is_page_break(line);
+        GV_PDFPageYPosition = y;
+        if (!is_break || (stream = page_cache_stream(entry)) == NULL)
+            {
+            continue;
+            }
+
+        /*
+        **  Write the page as if it had just been rendered
+        */
+        GV_CurrentPageCount++;
+        GV_PageBufferLength = 0;
+        pdf_page_write(stream, (long)entry->length);
+        pdf_write_page();
+        page_cache_add(entry, stream, TRUE);
+
+        GV_CurrentLineCount = GV_IsPerPageLineNumbers ? entry->line_end : GV_CurrentLineCount - 1 + entry->line_end;
+        GV_PDFPageYPosition = entry->y_end;
+        GV_CURRENT_COLOR.r = entry->color_end[0];
+        GV_CURRENT_COLOR.g = entry->color_end[1];
+        GV_CURRENT_COLOR.b = entry->color_end[2];
+
+        page_cache_drop(entry->line_total - 1);
+        page_cache_gets(text, size);
+        GV_CurrentLineCount++;
+        return TRUE;
+        }
+
+    return FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Keep the page just finished for the next -j run.
+**                  Called where pdf_checkpoint() is, before the next
+**                  page is started.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_store_page()
+    {
+    GV_IsPageRecorded = FALSE;
+    sha256_final(&GV_PageLines, GV_PageRecord.lines);
+    GV_PageRecord.line_end = GV_CurrentLineCount - 1;
+    if (!GV_IsPerPageLineNumbers)
+        {
+        GV_PageRecord.line_end -= GV_PageRecordStart;
+        }
+    GV_PageRecord.y_end = GV_PDFPageYPosition;
+    GV_PageRecord.color_end[0] = GV_CURRENT_COLOR.r;
+    GV_PageRecord.color_end[1] = GV_CURRENT_COLOR.g;
+    GV_PageRecord.color_end[2] = GV_CURRENT_COLOR.b;
+    GV_PageRecord.length = GV_PageBufferLength;
+    GV_PageRecord.offset = 0;
+    page_cache_add(&GV_PageRecord, GV_PageBuffer, FALSE);
+    }
 
 /**
  *  Color Manipulation Routines
@@ -565,6 +2308,410 @@ long colorInverter(struct _RGB colorValue)
     return (colorLong);
     }
 
+bool colorEqual(RGB a, RGB b)
+    {
+    return (a.r == b.r && a.g == b.g && a.b == b.b);
+    }
+
+/**
+ *  Graphics State Tracking
+ *
+ *  Every content stream starts with the PDF defaults (black fill,
+ *  no font, zero leading).  The setters below compare against the
+ *  tracked value and only write the operator when it changes.  The
+ *  fill colour is only recorded when set and written just before the
+ *  next string or rectangle fill (pdf_flush_fill()), so a colour that
+ *  is replaced before anything is painted with it never appears.
+ */
+
+void pdf_reset_graphics_state()
+    {
+    GV_GState.fill = colorConverter(0x000000l);
+    GV_GState.is_fill_pending = FALSE;
+    GV_GState.font_id = -1;
+    GV_GState.font_size = 0.0f;
+    GV_GState.leading = 0.0f;
+    GV_GState.pending_half_lines = 0;
+    GV_GState.is_move_pending = FALSE;
+    }
+
+void pdf_set_fill_color(RGB color)
+    {
+    if (!GV_IsOptimizeStream)
+        {
+        pdf_page_printf("%f %f %f rg\n", color.r, color.g, color.b);
+        GV_GState.fill = color;
+        GV_StatStateEmitted++;
+        return;
+        }
+
+    if (GV_GState.is_fill_pending)
+        {
+        /*
+        **  Replaced before anything was painted with it
+        */
+        GV_StatStateElided++;
+        if (GV_IsStatistics)
+            {
+            GV_StatStateBytesSaved += snprintf(NULL, 0, "%f %f %f rg\n", GV_GState.pending_fill.r,
+                                               GV_GState.pending_fill.g, GV_GState.pending_fill.b);
+            }
+        }
+    GV_GState.pending_fill = color;
+    GV_GState.is_fill_pending = TRUE;
+    }
+
+void pdf_flush_fill()
+    {
+    RGB color = GV_GState.pending_fill;
+
+    if (!GV_GState.is_fill_pending)
+        {
+        return;
+        }
+    GV_GState.is_fill_pending = FALSE;
+
+    if (colorEqual(color, GV_GState.fill))
+        {
+        GV_StatStateElided++;
+        if (GV_IsStatistics)
+            {
+            GV_StatStateBytesSaved += snprintf(NULL, 0, "%f %f %f rg\n", color.r, color.g, color.b);
+            }
+        return;
+        }
+    pdf_page_printf("%f %f %f rg\n", color.r, color.g, color.b);
+    GV_GState.fill = color;
+    GV_StatStateEmitted++;
+    }
+
+void pdf_set_font(int id, float size)
+    {
+    if (GV_IsOptimizeStream && id == GV_GState.font_id && size == GV_GState.font_size)
+        {
+        GV_StatStateElided++;
+        if (GV_IsStatistics)
+            {
+            GV_StatStateBytesSaved += snprintf(NULL, 0, "/F%d %f Tf\n", id, size);
+            }
+        return;
+        }
+    pdf_page_printf("/F%d %f Tf\n", id, size);
+    GV_GState.font_id = id;
+    GV_GState.font_size = size;
+    GV_StatStateEmitted++;
+    }
+
+void pdf_set_leading(float leading)
+    {
+    if (GV_IsOptimizeStream && leading == GV_GState.leading)
+        {
+        GV_StatStateElided++;
+        if (GV_IsStatistics)
+            {
+            GV_StatStateBytesSaved += snprintf(NULL, 0, "%g TL\n", leading);
+            }
+        return;
+        }
+    pdf_page_printf("%g TL\n", leading);
+    GV_GState.leading = leading;
+    GV_StatStateEmitted++;
+    }
+
+/**
+ *  Vertical Move Coalescing
+ *
+ *  Line advances, blank lines and overstrike back-ups are collected
+ *  as a count of half lines and written as one operator just before
+ *  the next string is shown (after any color or font change for it).
+ *  A net move of one line down is T*, any other amount is a Td (0 0 Td
+ *  still restarts the line for an overstrike).  Moves pending at ET
+ *  are dropped since nothing is drawn after them.  A pending fill
+ *  colour is written first, since a string always follows.
+ */
+
+void pdf_move_lines(float lines)
+    {
+
+    /*
+    **  Positive values move up the page (overstrike), negative down
+    */
+
+    if (!GV_IsOptimizeStream)
+        {
+        pdf_page_printf("0 %f Td\n", GV_StandardLineSize * lines);
+        return;
+        }
+
+    GV_GState.pending_half_lines += (int)(lines * 2.0f);
+    GV_GState.is_move_pending = TRUE;
+    GV_StatMoveOpsIn++;
+    if (GV_IsStatistics)
+        {
+        GV_StatMoveBytesIn += snprintf(NULL, 0, "0 %f Td\n", GV_StandardLineSize * lines);
+        }
+    }
+
+void pdf_blank_line()
+    {
+    if (!GV_IsOptimizeStream)
+        {
+        pdf_page_printf("T*()Tj\n");
+        return;
+        }
+
+    GV_GState.pending_half_lines -= 2;
+    GV_GState.is_move_pending = TRUE;
+    GV_StatMoveOpsIn += 2;
+    GV_StatMoveBytesIn += 7;            /* T*()Tj\n */
+    }
+
+void pdf_flush_moves()
+    {
+    int half_lines = GV_GState.pending_half_lines;
+
+    pdf_flush_fill();
+    if (!GV_GState.is_move_pending)
+        {
+        return;
+        }
+
+    if (half_lines == -2)
+        {
+        pdf_page_printf("T*");
+        GV_StatMoveBytesOut += 2;
+        }
+    else
+        {
+        GV_StatMoveBytesOut += pdf_page_printf("0 %g Td", GV_StandardLineSize * half_lines / 2.0f);
+        }
+    GV_StatMoveOpsOut++;
+    GV_GState.pending_half_lines = 0;
+    GV_GState.is_move_pending = FALSE;
+    }
+
+void print_pdf_line(TCHAR *buffer)
+    {
+    if (GV_IsLayoutLines)
+        {
+        pdf_layout_line(buffer);
+        }
+    else
+        {
+        print_pdf_row(buffer);
+        }
+    }
+
+
+void print_pdf_row(TCHAR *buffer)
+    {
+
+    /*
+    **  Advance one line and show the buffer
+    */
+
+    if (GV_IsOptimizeStream)
+        {
+        GV_GState.pending_half_lines -= 2;
+        GV_GState.is_move_pending = TRUE;
+        GV_StatMoveOpsIn++;
+        GV_StatMoveBytesIn += 2;        /* T* */
+
+        if (buffer[0] == '\0' && !GV_IsPrintLineNumbers)
+            {
+            /*
+            **  Nothing to show: the advance stays pending for the next line
+            */
+            GV_StatMoveBytesIn += 5;    /* ()Tj\n */
+            return;
+            }
+        }
+    else
+        {
+        pdf_page_printf("T*\n");
+        }
+
+    print_pdf_string(buffer);
+    pdf_page_printf("Tj\n");
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Print a line with its tabs expanded (-E) and the part
+**                  beyond the right margin wrapped or cut off (-k).
+**
+**  Description:    Each wrapped row starts with the continuation marker
+**                  and takes a line of its own.  In ASA mode a row that
+**                  would fall below the bottom margin starts a new page,
+**                  as a new line would.  The caller still advances past
+**                  the last row.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_layout_line(TCHAR *buffer)
+    {
+    static char line[LAYOUT_MAX + 1];
+    static char row[LAYOUT_MAX + 1];
+    size_t length = strlen(buffer);
+    size_t columns;
+    size_t start;
+    size_t fit;
+    size_t marker = strlen(GV_ContinuationMarker);
+    int    width = MAX(GV_LineColumns, 1);
+    int    row_width = MAX(width - (int)marker, 1);
+
+    /*
+    **  Most lines have no tab and (a byte at most a column) fit as they are
+    */
+    if (codec_column_scan((const unsigned char *)buffer, length, FALSE, &columns) == length &&
+        (GV_Overflow == OVERFLOW_NONE || length <= (size_t)width))
+        {
+        print_pdf_row(buffer);
+        return;
+        }
+
+    length = pdf_expand_tabs(buffer, length, line);
+    fit = pdf_column_offset(line, length, width);
+    if (GV_Overflow == OVERFLOW_NONE || fit == length)
+        {
+        print_pdf_row(line);
+        return;
+        }
+
+    if (GV_Overflow == OVERFLOW_TRUNCATE)
+        {
+        line[fit] = '\0';
+        print_pdf_row(line);
+        GV_StatLinesTruncated++;
+        return;
+        }
+
+    memcpy(row, line, fit);
+    row[fit] = '\0';
+    print_pdf_row(row);
+
+    memcpy(row, GV_ContinuationMarker, marker);
+    GV_IsContinuationRow = TRUE;
+    for (start = fit; start < length; start += fit)
+        {
+        GV_PDFPageYPosition -= GV_StandardLineSize;
+        if (GV_IsASA && GV_PDFPageYPosition <= GV_PageMarginBottom + 1)
+            {
+            pdf_page_break("");
+            }
+
+        fit = pdf_column_offset(line + start, length - start, row_width);
+        memcpy(row + marker, line + start, fit);
+        row[marker + fit] = '\0';
+        print_pdf_row(row);
+        GV_StatRowsWrapped++;
+        }
+    GV_IsContinuationRow = FALSE;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Copy a line replacing each tab by the blanks up to
+**                  the next -E stop (tabs are kept without -E).
+**
+**  Parameters:     Name        Description.
+**                  text        Line to expand.
+**                  length      Its length.
+**                  line        Receives the line, LAYOUT_MAX bytes at
+**                              most, NUL terminated.
+**
+**  Returns:        Length of the expanded line.
+**
+**------------------------------------------------------------------------*/
+
+size_t pdf_expand_tabs(const char *text, size_t length, char *line)
+    {
+    bool   is_utf8 = GV_IsUTF8Input && !GV_IsExtendedASCII;
+    size_t out = 0;
+    size_t run;
+    size_t columns;
+    size_t column = 0;
+    size_t stop;
+    size_t base;
+    size_t i = 0;
+    int    s;
+
+    while (i < length && out < LAYOUT_MAX)
+        {
+        run = codec_column_scan((const unsigned char *)text + i, length - i, is_utf8, &columns);
+        run = MIN(run, LAYOUT_MAX - out);
+        memcpy(line + out, text + i, run);
+        out += run;
+        column += columns;
+        i += run;
+        if (i == length || out == LAYOUT_MAX)
+            {
+            break;
+            }
+
+        i++;
+        if (GV_TabInterval == 0)
+            {
+            line[out++] = '\t';
+            column++;
+            continue;
+            }
+
+        /*
+        **  The listed stops, then the last gap repeated
+        */
+        for (s = 0; s < GV_TabStopCount && (size_t)GV_TabStops[s] <= column; s++)
+            {
+            }
+        if (s < GV_TabStopCount)
+            {
+            stop = GV_TabStops[s];
+            }
+        else
+            {
+            base = (GV_TabStopCount > 0) ? GV_TabStops[GV_TabStopCount - 1] : 0;
+            stop = base + ((column - base) / GV_TabInterval + 1) * GV_TabInterval;
+            }
+        while (column < stop && out < LAYOUT_MAX)
+            {
+            line[out++] = ' ';
+            column++;
+            }
+        }
+
+    line[out] = '\0';
+    return out;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Bytes of text that fill at most `columns` columns.
+**
+**------------------------------------------------------------------------*/
+
+size_t pdf_column_offset(const char *text, size_t length, int columns)
+    {
+    size_t i = 0;
+
+    if (!GV_IsUTF8Input || GV_IsExtendedASCII)
+        {
+        return MIN(length, (size_t)columns);
+        }
+
+    /*
+    **  Stop before the character that would take column `columns`
+    */
+    while (i < length)
+        {
+        if (((unsigned char)text[i] & 0xC0) != 0x80 && columns-- == 0)
+            {
+            break;
+            }
+        i++;
+        }
+    return i;
+    }
+
 /**
  *  PDF Generation routines
  */
@@ -579,6 +2726,7 @@ void store_pdf_page(int id)
         fprintf(stderr, "(error) Unable to allocate array for page %d.", GV_PDFNumberOfPages + 1);
         exit(1);
         }
+    MEM_ACCOUNT(MEM_PAGE_LIST, 0, sizeof(*n));
     n->next = NULL;
     n->page_id = id;
 
@@ -586,6 +2734,144 @@ void store_pdf_page(int id)
     GV_INSERT_PAGE = &n->next;
 
     GV_PDFNumberOfPages++;
+    MEM_SAMPLE(GV_PDFNumberOfPages);
+    }
+
+
+int find_pdf_stream(const unsigned char *hash)
+    {
+    unsigned int slot;
+
+    if (GV_StreamTableSize == 0)
+        {
+        return 0;
+        }
+
+    memcpy(&slot, hash, sizeof(slot));
+    slot &= GV_StreamTableSize - 1;
+    while (GV_StreamTable[slot].stream_id != 0)
+        {
+        if (memcmp(GV_StreamTable[slot].hash, hash, SHA256_BYTES) == 0)
+            {
+            return GV_StreamTable[slot].stream_id;
+            }
+        slot = (slot + 1) & (GV_StreamTableSize - 1);
+        }
+
+    return 0;
+    }
+
+
+void remember_pdf_stream(const unsigned char *hash, int id)
+    {
+    StreamEntry *old_table = GV_StreamTable;
+    int old_size = GV_StreamTableSize;
+    unsigned int slot;
+    int i;
+
+    if ((GV_StreamTableCount + 1) * 2 > GV_StreamTableSize)
+        {
+        /*
+        **  Keep the open-addressed table at most half full
+        */
+        GV_StreamTableSize = (old_size == 0) ? 256 : old_size * 2;
+        GV_StreamTable = (StreamEntry *)calloc(GV_StreamTableSize, sizeof(*GV_StreamTable));
+        if (GV_StreamTable == NULL)
+            {
+            fprintf(stderr, "(error) Unable to allocate stream table for page %d.", GV_PDFNumberOfPages + 1);
+            exit(1);
+            }
+        MEM_ACCOUNT(MEM_STREAM_TABLE, old_size * sizeof(*GV_StreamTable), GV_StreamTableSize * sizeof(*GV_StreamTable));
+        GV_StreamTableCount = 0;
+        for (i = 0; i < old_size; i++)
+            {
+            if (old_table[i].stream_id != 0)
+                {
+                remember_pdf_stream(old_table[i].hash, old_table[i].stream_id);
+                }
+            }
+        free(old_table);
+        }
+
+    memcpy(&slot, hash, sizeof(slot));
+    slot &= GV_StreamTableSize - 1;
+    while (GV_StreamTable[slot].stream_id != 0)
+        {
+        slot = (slot + 1) & (GV_StreamTableSize - 1);
+        }
+    memcpy(GV_StreamTable[slot].hash, hash, SHA256_BYTES);
+    GV_StreamTable[slot].stream_id = id;
+    GV_StreamTableCount++;
+    }
+
+
+/**
+ *  Page content is assembled in memory and written by end_pdf_page()
+ *  once complete, so its length is known and identical pages can be
+ *  detected before anything reaches the output.
+ */
+
+static void pdf_page_reserve(long needed)
+    {
+    char *new_buffer;
+    long  new_size;
+
+    if (GV_PageBufferLength + needed <= GV_PageBufferSize)
+        {
+        return;
+        }
+
+    new_size = MAX(GV_PageBufferSize * 2, GV_PageBufferLength + needed + 4096);
+    new_buffer = (char *)realloc(GV_PageBuffer, new_size);
+    if (new_buffer == NULL)
+        {
+        fprintf(stderr, "(error) Unable to allocate buffer for page %d.", GV_CurrentPageCount);
+        exit(1);
+        }
+    MEM_ACCOUNT(MEM_PAGE_BUFFER, GV_PageBufferSize, new_size);
+    GV_PageBuffer = new_buffer;
+    GV_PageBufferSize = new_size;
+    }
+
+
+int pdf_page_printf(const char *format, ...)
+    {
+    va_list args;
+    int     length;
+
+    pdf_page_reserve(256);
+    va_start(args, format);
+    length = vsnprintf(GV_PageBuffer + GV_PageBufferLength, GV_PageBufferSize - GV_PageBufferLength, format, args);
+    va_end(args);
+
+    if (length >= GV_PageBufferSize - GV_PageBufferLength)
+        {
+        pdf_page_reserve(length + 1);
+        va_start(args, format);
+        vsnprintf(GV_PageBuffer + GV_PageBufferLength, GV_PageBufferSize - GV_PageBufferLength, format, args);
+        va_end(args);
+        }
+
+    GV_PageBufferLength += length;
+    return length;
+    }
+
+
+void pdf_page_putc(int c)
+    {
+    if (GV_PageBufferLength >= GV_PageBufferSize)
+        {
+        pdf_page_reserve(1);
+        }
+    GV_PageBuffer[GV_PageBufferLength++] = (char)c;
+    }
+
+
+void pdf_page_write(const char *data, long length)
+    {
+    pdf_page_reserve(length);
+    memcpy(GV_PageBuffer + GV_PageBufferLength, data, length);
+    GV_PageBufferLength += length;
     }
 
 
@@ -594,8 +2880,8 @@ void start_pdf_object(int id)
     if (id >= GV_PDFXRefCount)
         {
 
-        long *new_xrefs;
-        int  delta, new_num_xrefs;
+        long long *new_xrefs;
+        int        delta, new_num_xrefs;
         delta = GV_PDFXRefCount / 5;
 
         if (delta < 1000)
@@ -604,7 +2890,7 @@ void start_pdf_object(int id)
             }
 
         new_num_xrefs = GV_PDFXRefCount + delta;
-        new_xrefs = (long *)malloc(new_num_xrefs * sizeof(*new_xrefs));
+        new_xrefs = (long long *)malloc(new_num_xrefs * sizeof(*new_xrefs));
 
         if (new_xrefs == NULL)
             {
@@ -612,6 +2898,7 @@ void start_pdf_object(int id)
             exit(1);
             }
 
+        MEM_ACCOUNT(MEM_XREF, GV_PDFXRefCount * sizeof(*GV_XReferences), new_num_xrefs * sizeof(*new_xrefs));
         memcpy(new_xrefs, GV_XReferences, GV_PDFXRefCount * sizeof(*GV_XReferences));
         free(GV_XReferences);
         GV_XReferences = new_xrefs;
@@ -619,8 +2906,8 @@ void start_pdf_object(int id)
 
         }
 
-    GV_XReferences[id] = ftell(stdout);
-    printf("%d 0 obj", id);
+    GV_XReferences[id] = writer_tell();
+    writer_printf("%d 0 obj", id);
 
     }
 
@@ -643,8 +2930,8 @@ void print_pdf_pagebars()
     **  fprintf(stdout, "%f g\n", 0.800781f); if you want to use gray scale value
     */
     
-    fprintf(stdout, "%f %f %f rg\n", GV_BAR_COLOR.r, GV_BAR_COLOR.g, GV_BAR_COLOR.b);
-    fprintf(stdout, "%d i\n", 1);
+    pdf_set_fill_color(GV_BAR_COLOR);
+    pdf_page_printf("%d i\n", 1);
 
     x1 = GV_PageMarginLeft - (float) 0.1 * GV_BodyFontSize;
     height = GV_ShadeStep * GV_StandardLineSize;
@@ -653,7 +2940,7 @@ void print_pdf_pagebars()
     step = (float) 1.0;
     if (GV_DashCode[0] != '\0')
         {
-        fprintf(stdout, "0 w [%s] 0 d\n", GV_DashCode); /* dash code array plus offset */
+        pdf_page_printf("0 w [%s] 0 d\n", GV_DashCode); /* dash code array plus offset */
         }
 
     /**
@@ -665,7 +2952,8 @@ void print_pdf_pagebars()
         if (GV_DashCode[0] == '\0')
             {
             /* a shaded bar */
-            fprintf(stdout, "%f %f %f %f re f\n", x1, y1, width, height);
+            pdf_flush_fill();
+            pdf_page_printf("%f %f %f %f re f\n", x1, y1, width, height);
             step = 2.0;
             /*
              * x1 y1 m x2 y2 l S
@@ -675,34 +2963,50 @@ void print_pdf_pagebars()
             }
         else
             {
-            fprintf(stdout, "%f %f m ", x1, y1);
-            fprintf(stdout, "%f %f l s\n", x1 + width, y1);
+            pdf_page_printf("%f %f m ", x1, y1);
+            pdf_page_printf("%f %f l s\n", x1 + width, y1);
             }
         y1 = y1 - step*height;
         }
     if (GV_DashCode[0] != '\0')
         {
-        fprintf(stdout, "[] 0 d\n");	/* set dash pattern to solid line */
+        pdf_page_printf("[] 0 d\n");	/* set dash pattern to solid line */
         }
 
-    fprintf(stdout, "%d G\n", 0);			/* */
-    fprintf(stdout, "%d g\n", 0);			/* gray-scale value */
+    pdf_page_printf("%d G\n", 0);			/* */
+    pdf_set_fill_color(colorConverter(0x000000l));
 
     }
 
 void print_pdf_string(TCHAR *buffer)
     {
+    GV_StringRenderer[GV_IsExtendedASCII](buffer);
+    }
 
-    /*
-    **  Print string as (escaped_string) 
-    **  where ()\ have a preceding \ character 
-    **  added 
-    */
 
-    char c;
+/*--------------------------------------------------------------------------
+**  Purpose:        Print string as (escaped_string) where ()\ have a
+**                  preceding \ character added, or shifted up by 127
+**                  for '^' lines.
+**
+**  Description:    One instance per combination of the run's options,
+**                  so the per-character loop carries no mode tests;
+**                  the page buffer is reserved once for the worst case
+**                  (every character escaped).
+**
+**------------------------------------------------------------------------*/
 
+template <bool IS_LINE_NUMBERS, bool IS_UTF8, bool IS_EXTENDED>
+void print_pdf_string_as(TCHAR *buffer)
+    {
 
-    if (GV_IsPrintLineNumbers)
+    char  *out;
+    char   c;
+    size_t length = strlen(buffer);
+    size_t i;
+
+
+    if (IS_LINE_NUMBERS)
         {
         /*
         **  If we are printing Line Numbers
@@ -711,60 +3015,192 @@ void print_pdf_string(TCHAR *buffer)
         **      print the line count, 
         **          reset the color to current.
         */
-        fprintf(stdout, 
-                "/F1 %f Tf\n %f %f %f rg\n (%6d | )Tj\n /F0 %f Tf\n %f %f %f rg ", 
-                GV_BodyFontSize,
-                GV_LINE_NUMBER_COLOR.r, GV_LINE_NUMBER_COLOR.g, GV_LINE_NUMBER_COLOR.b,
-                GV_CurrentLineCount,
-                GV_BodyFontSize,
-                GV_CURRENT_COLOR.r, GV_CURRENT_COLOR.g, GV_CURRENT_COLOR.b);
-        }
-    else if (GV_CURRENT_COLOR.r != GV_FONT_COLOR.r || 
-             GV_CURRENT_COLOR.g != GV_FONT_COLOR.g ||
-             GV_CURRENT_COLOR.b != GV_FONT_COLOR.b )
+        pdf_set_font(1, GV_BodyFontSize);
+        pdf_set_fill_color(GV_LINE_NUMBER_COLOR);
+        pdf_flush_moves();
+        if (GV_IsContinuationRow)
+            {
+            pdf_page_printf("(       | )Tj\n");
+            }
+        else
+            {
+            pdf_page_printf("(%6d | )Tj\n", GV_CurrentLineCount);
+            }
+        pdf_set_font(0, GV_BodyFontSize);
+        pdf_set_fill_color(GV_CURRENT_COLOR);
+        }
+    else if (!colorEqual(GV_CURRENT_COLOR, GV_FONT_COLOR))
         {
         /**
          *  If we are not printing line numbers
          *      we need to check to see if we need to emit
          *      a color change where different from the default.
          */
-        fprintf(stdout,
-                " %f %f %f rg\n",
-                GV_CURRENT_COLOR.r, GV_CURRENT_COLOR.g, GV_CURRENT_COLOR.b);
+        pdf_set_fill_color(GV_CURRENT_COLOR);
+        }
+
+    if (IS_UTF8 && !IS_EXTENDED)
+        {
+        /*
+        **  Pure ASCII lines take the byte loop below unchanged
+        */
+        if (codec_ascii_prefix((const unsigned char *)buffer, length) < length)
+            {
+            print_pdf_utf8_string((const unsigned char *)buffer, length);
+            return;
+            }
         }
 
-    putchar('(');
+    pdf_flush_moves();
+    pdf_page_reserve((long)(2 * length + 2));
+    out = GV_PageBuffer + GV_PageBufferLength;
+    *out++ = '(';
 
-    while ((c = *buffer++) != '\0')
+    for (i = 0; i < length; i++)
         {
-        if (GV_IsExtendedASCII)
+        c = buffer[i];
+        if (IS_EXTENDED)
             {
-            putchar(c + 127);
+            *out++ = (char)(c + 127);
             }
         else
             {
-            switch (c)      //  Escape the lower reserved characters
+            if (c == '(' || c == ')' || c == '\\')   //  Escape the lower reserved characters
+                {
+                *out++ = '\\';
+                }
+            *out++ = c;
+            }
+        }
+
+    *out++ = ')';
+    GV_PageBufferLength = (long)(out - GV_PageBuffer);
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Pick the print_pdf_string() instances for the run's
+**                  options; called once after option parsing (and by
+**                  the -y benchmark when it changes them).
+**
+**------------------------------------------------------------------------*/
+
+void pdf_select_renderers()
+    {
+    if (GV_IsPrintLineNumbers)
+        {
+        GV_StringRenderer[0] = GV_IsUTF8Input ? print_pdf_string_as<true, true, false> : print_pdf_string_as<true, false, false>;
+        GV_StringRenderer[1] = print_pdf_string_as<true, false, true>;
+        }
+    else
+        {
+        GV_StringRenderer[0] = GV_IsUTF8Input ? print_pdf_string_as<false, true, false> : print_pdf_string_as<false, false, false>;
+        GV_StringRenderer[1] = print_pdf_string_as<false, false, true>;
+        }
+    GV_TitleRenderer = GV_IsUTF8Input ? print_pdf_string_as<false, true, false> : print_pdf_string_as<false, false, false>;
+    }
+
+
+void print_pdf_utf8_string(const unsigned char *text, size_t length)
+    {
+
+    /*
+    **  Print UTF-8 text as a sequence of shown strings.  Characters
+    **  with a WinAnsi code stay in the active font, anything else is
+    **  shown as <hex> CIDs in /F3 and the active font is restored.
+    **  The caller supplies the final Tj as for print_pdf_string().
+    */
+
+    const unsigned char *end = text + length;
+    int    font_id = GV_GState.font_id;
+    float  font_size = GV_GState.font_size;
+    size_t run;
+    long   codepoint;
+    int    winansi;
+    bool   isCID = FALSE;
+
+    pdf_flush_moves();
+    pdf_page_putc('(');
+
+    while (text < end)
+        {
+        run = codec_ascii_prefix(text, end - text);
+        if (run > 0 && isCID)
+            {
+            pdf_page_printf(">Tj ");
+            pdf_set_font(font_id, font_size);
+            pdf_page_putc('(');
+            isCID = FALSE;
+            }
+
+        while (run-- > 0)
+            {
+            switch (*text)
                 {
                     case '(':
                     case ')':
                     case '\\':
-                        putchar('\\');
+                        pdf_page_putc('\\');
+                }
+            pdf_page_putc(*text++);
+            }
+
+        if (text >= end)
+            {
+            break;
+            }
+
+        codepoint = codec_utf8_decode(&text, end);
+        winansi = codec_unicode_to_winansi(codepoint);
+
+        if (winansi >= 0)
+            {
+            if (isCID)
+                {
+                pdf_page_printf(">Tj ");
+                pdf_set_font(font_id, font_size);
+                pdf_page_putc('(');
+                isCID = FALSE;
+                }
+            pdf_page_putc(winansi);
+            }
+        else
+            {
+            if (!isCID)
+                {
+                pdf_page_printf(")Tj ");
+                pdf_set_font(3, font_size);
+                pdf_page_putc('<');
+                isCID = TRUE;
                 }
-            putchar(c);
+            codepoint = (codepoint > 0xFFFF) ? 0xFFFDl : codepoint;
+            pdf_page_putc("0123456789ABCDEF"[(codepoint >> 12) & 0xF]);
+            pdf_page_putc("0123456789ABCDEF"[(codepoint >> 8) & 0xF]);
+            pdf_page_putc("0123456789ABCDEF"[(codepoint >> 4) & 0xF]);
+            pdf_page_putc("0123456789ABCDEF"[codepoint & 0xF]);
             }
         }
 
+    if (isCID)
+        {
+        pdf_page_printf(">Tj ");
+        pdf_set_font(font_id, font_size);
+        pdf_page_putc('(');
+        }
 
-    putchar(')');
+    pdf_page_putc(')');
     }
 
 
 void print_pdf_title_at(float xvalue, float yvalue, TCHAR *string)
     {
 
-    fprintf(stdout, "BT /F2 %f Tf %f %f Td", GV_TitleFontSize, xvalue, yvalue);
-    print_pdf_string(string);
-    fprintf(stdout, " Tj ET\n");
+    pdf_flush_fill();
+    pdf_page_printf("BT ");
+    pdf_set_font(2, GV_TitleFontSize);
+    pdf_page_printf("%f %f Td", xvalue, yvalue);
+    GV_TitleRenderer(string);
+    pdf_page_printf(" Tj ET\n");
 
     }
 
@@ -776,20 +3212,24 @@ void print_pdf_impact_top()
     float xvalue;
     float yvalue;
     float text_size = GV_TitleFontSize + 2.0f;
+    RGB   bright_red = { 0.9, 0.0, 0.0 };
     
     if (GV_ImpactTop[0] != '\0') 
         {
             charwidth = text_size * (float) 0.60;	    /* assuming fixed-space font Courier-Bold */
-            fprintf(stdout, "0.9 0.0 0.0 rg\n");		/* Bright Red */
+            pdf_set_fill_color(bright_red);		/* Bright Red */
 
             yvalue = GV_PageDepth - text_size;
             xvalue = GV_PageMarginLeft
                 + ((GV_PageWidth - GV_PageMarginLeft - GV_PageMarginRight) / (float) 2.0)
                 - (strlen(GV_ImpactTop) * charwidth / (float) 2.0);
 
-            fprintf(stdout, "BT /F2 %f Tf %f %f Td", text_size, xvalue, yvalue);
-            print_pdf_string(GV_ImpactTop);
-            fprintf(stdout, " Tj ET\n");
+            pdf_flush_fill();
+            pdf_page_printf("BT ");
+            pdf_set_font(2, text_size);
+            pdf_page_printf("%f %f Td", xvalue, yvalue);
+            GV_TitleRenderer(GV_ImpactTop);
+            pdf_page_printf(" Tj ET\n");
 
          }
 
@@ -805,17 +3245,13 @@ void print_margin_label()
     float position_left;
     float position_center;
     float position_right;
-    bool  save_linenumber_state;
-
-    save_linenumber_state = GV_IsPrintLineNumbers;
-    GV_IsPrintLineNumbers = FALSE;
 
     print_pdf_impact_top();
 
     /* assuming fixed-space font Courier-Bold */
     charwidth = GV_TitleFontSize * 0.60f;
 
-    fprintf(stdout, "%f %f %f rg\n", GV_TITLE_COLOR.r, GV_TITLE_COLOR.g, GV_TITLE_COLOR.b);
+    pdf_set_fill_color(GV_TITLE_COLOR);
 
     if (GV_IsPrintPageNumbers)
         {
@@ -852,55 +3288,306 @@ void print_margin_label()
 
         }
 
-    GV_IsPrintLineNumbers = save_linenumber_state;
-
-    fprintf(stdout, "%f %f %f rg\n",
-            GV_FONT_COLOR.r, GV_FONT_COLOR.g, GV_FONT_COLOR.b);
+    pdf_set_fill_color(GV_FONT_COLOR);
 
     }
 
 
 void start_pdf_page()
     {
-    GV_PDFStreamId = GV_PDFObjectId++;
-    GV_PDFStreamLengthId = GV_PDFObjectId++;
     GV_CurrentPageCount++;
     if (GV_IsPerPageLineNumbers)
         {
         GV_CurrentLineCount = 0;
         }
-    start_pdf_object(GV_PDFStreamId);
-    printf("<< /Length %d 0 R >>", GV_PDFStreamLengthId);
-    printf("stream\n");
-    GV_PDFStreamStart = ftell(stdout);
+    GV_PageBufferLength = 0;
+    pdf_reset_graphics_state();
+
+    /*
+    **  -Y traces one page in GV_TraceSample
+    */
+    GV_IsPageTraced = trace_is_sampled(GV_CurrentPageCount);
+    GV_PageOverstrikes = 0;
+    if (GV_IsPageTraced)
+        {
+        GV_TracePageStart = trace_now();
+        GV_TraceReadTime = 0;
+        }
 
     print_pdf_pagebars();
 
+    /*
+    **  The overlay (-G) goes over the bars, like the lines of a
+    **  pre-printed form, and under the text
+    */
+    if (GV_OverlayPath != NULL)
+        {
+        pdf_flush_fill();               //  the form paints in the current fill unless it sets its own
+        pdf_page_printf("q /OV Do Q\n");
+        }
+
     print_margin_label();
 
-    printf("BT\n/F0 %g Tf\n", GV_BodyFontSize);
+    if (GV_IsPageTraced)
+        {
+        trace_span("furniture", "page", GV_TracePageStart, NULL);
+        }
+
+    pdf_page_printf("BT\n");
+    pdf_set_font(0, GV_BodyFontSize);
     GV_PDFPageYPosition = GV_PageDepth - GV_PageMarginTop;
-    printf("%g %g Td\n", GV_PageMarginLeft, GV_PDFPageYPosition);
-    printf("%g TL\n", GV_StandardLineSize);
+    pdf_page_printf("%g %g Td\n", GV_PageMarginLeft, GV_PDFPageYPosition);
+    pdf_set_leading(GV_StandardLineSize);
 
     }
 
 
 void end_pdf_page()
     {
+    char args[128];
+
+    pdf_page_printf("ET\n");
+    pdf_write_page();
+
+    if (GV_IsFollow && GV_FollowPages > 0 && GV_PDFNumberOfPages >= GV_FollowPages)
+        {
+        burst_close_document();                         //  -F: the next page starts a new document
+        }
+
+    if (GV_IsPageTraced)
+        {
+        snprintf(args, sizeof(args), "\"page\":%d,\"bytes\":%ld,\"overstrikes\":%d,\"read_us\":%lld",
+                 GV_CurrentPageCount, GV_PageBufferLength, GV_PageOverstrikes, GV_TraceReadTime);
+        trace_span("page", "page", GV_TracePageStart, args);
+        GV_IsPageTraced = FALSE;
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the finished content stream in GV_PageBuffer
+**                  (or share an identical one) and its page object.
+**                  With -q the stream is a form XObject placed on the
+**                  current sheet instead.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_write_page()
+    {
+
+    unsigned char hash[SHA256_BYTES];
+    Sha256 sha;
+    int stream_id = 0;
+    int page_id;
+
+    if (!GV_IsDocumentOpen)
+        {
+        burst_open_document();
+        }
+
+    if (GV_IsDedupPages)
+        {
+        sha256_init(&sha);
+        sha256_update(&sha, GV_PageBuffer, GV_PageBufferLength);
+        sha256_final(&sha, hash);
+        stream_id = find_pdf_stream(hash);
+        }
+
+    if (stream_id != 0)
+        {
+        GV_StatPagesDeduplicated++;
+        GV_StatDedupBytesSaved += GV_PageBufferLength;
+        }
+    else
+        {
+        stream_id = GV_PDFObjectId++;
+        start_pdf_object(stream_id);
+        if (GV_PagesPerSheet > 1)
+            {
+            writer_printf("<</Type/XObject/Subtype/Form/BBox[0 0 %g %g]/Resources %d 0 R/Length %ld>>stream\n",
+                          GV_PageWidth, GV_PageDepth, GV_PDFResourcesId, GV_PageBufferLength);
+            }
+        else
+            {
+            writer_printf("<< /Length %ld >>stream\n", GV_PageBufferLength);
+            }
+        writer_write(GV_PageBuffer, GV_PageBufferLength);
+        writer_printf("endstream\nendobj\n");
+        if (GV_IsDedupPages)
+            {
+            remember_pdf_stream(hash, stream_id);
+            }
+        }
 
-    long stream_len;
-    int page_id = GV_PDFObjectId++;
+    if (GV_PagesPerSheet > 1)
+        {
+        pdf_place_page(stream_id);
+        return;
+        }
 
+    page_id = GV_PDFObjectId++;
     store_pdf_page(page_id);
-    printf("ET\n");
-    stream_len = ftell(stdout) - GV_PDFStreamStart;
-    printf("endstream\nendobj\n");
-    start_pdf_object(GV_PDFStreamLengthId);
-    printf("\n%ld\nendobj\n", stream_len);
     start_pdf_object(page_id);
-    printf("<</Type/Page/Parent %d 0 R/Contents %d 0 R>>\nendobj\n", GV_PDFPageTreeId, GV_PDFStreamId);
+    writer_printf("<</Type/Page/Parent %d 0 R/Contents %d 0 R>>\nendobj\n", GV_PDFPageTreeId, stream_id);
+
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Choose the n-up (-q) grid and the placement of each
+**                  logical page on the sheet.
+**
+**  Description:    The sheet is the page size itself.  Every grid of
+**                  GV_PagesPerSheet cells is tried with the pages upright
+**                  and turned a quarter left, and the one that shows them
+**                  largest wins (upright on a tie): 2-up landscape
+**                  listings come out side by side and turned, 4-up in an
+**                  upright 2 x 2.  Pages are placed in reading order, of
+**                  the sheet as it is held to read them.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_sheet_layout()
+    {
+    float scale;
+    float best = 0.0f;
+    float cell_width;
+    float cell_depth;
+    float x;
+    float y;
+    int   columns;
+    int   rows = 1;
+    int   best_columns = 1;
+    bool  is_best_turned = FALSE;
+    int   turn;
+    int   i;
+
+    for (columns = 1; columns <= GV_PagesPerSheet; columns++)
+        {
+        if (GV_PagesPerSheet % columns != 0)
+            {
+            continue;
+            }
+        rows = GV_PagesPerSheet / columns;
+        cell_width = GV_PageWidth / columns;
+        cell_depth = GV_PageDepth / rows;
+        for (turn = 0; turn < 2; turn++)
+            {
+            scale = (turn == 1) ? MIN(cell_width / GV_PageDepth, cell_depth / GV_PageWidth)
+                                : MIN(cell_width / GV_PageWidth, cell_depth / GV_PageDepth);
+            if (scale > best * 1.0001f)
+                {
+                best = scale;
+                best_columns = columns;
+                is_best_turned = (turn == 1);
+                }
+            }
+        }
+
+    columns = best_columns;
+    rows = GV_PagesPerSheet / columns;
+    cell_width = GV_PageWidth / columns;
+    cell_depth = GV_PageDepth / rows;
+    for (i = 0; i < GV_PagesPerSheet; i++)
+        {
+        float *m = GV_SheetMatrix[i];
+
+        if (is_best_turned)
+            {
+            /*
+            **  Page tops face the left edge: the sheet is read turned
+            **  clockwise, so columns run left to right, cells bottom up
+            */
+            x = (i / rows) * cell_width;
+            y = (i % rows) * cell_depth;
+            m[0] = 0.0f;    m[1] = best;
+            m[2] = -best;   m[3] = 0.0f;
+            m[4] = x + (cell_width + best * GV_PageDepth) / 2;
+            m[5] = y + (cell_depth - best * GV_PageWidth) / 2;
+            }
+        else
+            {
+            x = (i % columns) * cell_width;
+            y = GV_PageDepth - (i / columns + 1) * cell_depth;
+            m[0] = best;    m[1] = 0.0f;
+            m[2] = 0.0f;    m[3] = best;
+            m[4] = x + (cell_width - best * GV_PageWidth) / 2;
+            m[5] = y + (cell_depth - best * GV_PageDepth) / 2;
+            }
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Put a logical page (form XObject) in the next cell of
+**                  the current sheet; a full sheet is written out.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_place_page(int form_id)
+    {
+    GV_SheetForms[GV_SheetCount++] = form_id;
+    if (GV_SheetCount == GV_PagesPerSheet)
+        {
+        pdf_write_sheet();
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Write the page object of the current sheet.
+**
+**  Description:    Cells are named rather than forms (a form shared by
+**                  -D may be placed more than once), so every full sheet
+**                  of a document shows the same content stream; only a
+**                  part-filled last sheet needs one of its own.
+**
+**------------------------------------------------------------------------*/
+
+void pdf_write_sheet()
+    {
+    char  content[NUP_MAX * 96];
+    int   length = 0;
+    int   stream_id;
+    int   page_id;
+    int   i;
+
+    if (GV_SheetCount == 0)
+        {
+        return;
+        }
+
+    stream_id = (GV_SheetCount == GV_PagesPerSheet) ? GV_SheetStreamId : 0;
+    if (stream_id == 0)
+        {
+        for (i = 0; i < GV_SheetCount; i++)
+            {
+            float *m = GV_SheetMatrix[i];
+
+            length += snprintf(content + length, sizeof(content) - length, "q %g %g %g %g %g %g cm /P%d Do Q\n",
+                               m[0], m[1], m[2], m[3], m[4], m[5], i);
+            }
+        stream_id = GV_PDFObjectId++;
+        start_pdf_object(stream_id);
+        writer_printf("<< /Length %d >>stream\n", length);
+        writer_write(content, length);
+        writer_printf("endstream\nendobj\n");
+        if (GV_SheetCount == GV_PagesPerSheet)
+            {
+            GV_SheetStreamId = stream_id;
+            }
+        }
 
+    page_id = GV_PDFObjectId++;
+    store_pdf_page(page_id);
+    start_pdf_object(page_id);
+    writer_printf("<</Type/Page/Parent %d 0 R/Resources<</XObject<<", GV_PDFPageTreeId);
+    for (i = 0; i < GV_SheetCount; i++)
+        {
+        writer_printf("/P%d %d 0 R", i, GV_SheetForms[i]);
+        }
+    writer_printf(">> >>/Contents %d 0 R>>\nendobj\n", stream_id);
+    GV_SheetCount = 0;
     }
 
 
@@ -915,247 +3602,602 @@ void adjust_pdf_ypos(float mult)
     }
 
 
-void do_text_translation()
+/*--------------------------------------------------------------------------
+**  Purpose:        Convert the input, with the ASA and plain text line
+**                  processors compiled as separate instances.
+**
+**------------------------------------------------------------------------*/
+
+void do_text_translation(bool is_resumed)
+    {
+    if (GV_IsASA)
+        {
+        translate_lines<true>(is_resumed);
+        }
+    else
+        {
+        translate_lines<false>(is_resumed);
+        }
+    }
+
+
+template <bool IS_ASA>
+void translate_lines(bool is_resumed)
     {
 
     char buffer1[4096];
-    char buffer2[4096];
-    char ASA;
     bool bResetColor;
+    const CarriageControl *cc;
+    int  line;
+    int  stop;
+    int  skip;
 
-    int i1;
-    int i2;
+    /*
+    **  A resumed (-K) conversion starts where a page ended
+    */
+    bool is_page_open = !is_resumed;
 
-    start_pdf_page();
+    if (is_page_open)
+        {
+        start_pdf_page();
+        }
 
-    while (gets_s(&buffer1[0], sizeof(buffer1)) != NULL)
+    while (pdf_read_line(&buffer1[0], sizeof(buffer1)) != NULL)
         {
         GV_CurrentLineCount++;
 
+        if (GV_IsFollowPageClosed)
+            {
+            /*
+            **  -F finished the document while this line was awaited
+            */
+            GV_IsFollowPageClosed = FALSE;
+            is_page_open = FALSE;
+            }
+
         bResetColor = FALSE;
         GV_IsExtendedASCII = FALSE;
 
-        /* +1 for roundoff , using floating point point units */
-
-        if (GV_PDFPageYPosition <= (GV_PageMarginBottom + 1) && strlen(buffer1) != 0 && (GV_IsASA && buffer1[0] != '+') )
+        if (is_page_open && pdf_is_page_break(buffer1))
             {
+            /*
+            **  The page ends before this line: the place to checkpoint
+            **  (-K) and to keep the page for the next run (-j)
+            */
             end_pdf_page();
+            pdf_checkpoint();
+            if (GV_IsPageRecorded)
+                {
+                pdf_store_page();
+                }
+            is_page_open = FALSE;
+            }
+
+        if (!is_page_open)
+            {
+            if (GV_PageCachePath != NULL)
+                {
+                while (pdf_replay_page(buffer1, sizeof(buffer1)))
+                    {
+                    }
+                pdf_page_prefix(GV_PageRecord.prefix, buffer1);
+                sha256_init(&GV_PageLines);
+                GV_PageRecord.line_total = 0;
+                GV_PageRecordStart = GV_CurrentLineCount - 1;
+                GV_IsPageRecorded = TRUE;
+                }
             start_pdf_page();
+            is_page_open = TRUE;
+            }
+
+        if (GV_IsPageRecorded)
+            {
+            sha256_update(&GV_PageLines, buffer1, strlen(buffer1) + 1);
+            GV_PageRecord.line_total++;
             }
 
         if (strlen(buffer1) == 0)
             { /* blank line */
 
-            printf("T*()Tj\n");
+            pdf_blank_line();
 
             }
-        else if (!GV_IsASA)
-
-            /** This is the NON-ASA Format Processor
-             **     We construct a parallel buffer (buffer2) which
-             **     will be a substitute for the regular ASA buffer
-             **/
-
+        else if (!IS_ASA)
             {
-
-            i2 = 0;
-            buffer2[i2] = '\0';      // NULL at the end of buffer2
-            /**
-             ** Scan the buffer starting from the offset through the end of the buffer
-             **/
-            for (i1 = 0; i1 < sizeof(buffer1); i1++)
-                {
-                switch (buffer1[i1])
-                    {
-                        case '\f':  //  formfeed character invokes new page
-                            if (GV_PDFPageYPosition < GV_PageDepth - GV_PageMarginTop)
-                                {
-                                end_pdf_page();
-                                start_pdf_page();
-                                }
-                            break;
-                        case '\r':
-                            GV_PDFPageYPosition -= GV_StandardLineSize;
-                            /**
-                             *  Don't process the final CR
-                             */
-                            if (buffer1[i1 + 1] != '\0')
-                                {
-                                /**
-                                 *  just treat it as an overstrike
-                                 */
-                                GV_CURRENT_COLOR = GV_OVERSTRIKE_COLOR;
-                                fprintf(stdout, "0 %f Td\n", GV_StandardLineSize);
-                                adjust_pdf_ypos(1.0);
-                                bResetColor = TRUE;
-                                GV_CurrentLineCount--;
-                                /**
-                                 *  Fall through to print
-                                 */
-                                } 
-
-                        case '\0':
-                            if (buffer2[0] != '\0')
-                                {
-                                    printf("T*");
-                                    print_pdf_string(&buffer2[0]);
-                                    printf("Tj\n");
-                                }
-                            else
-                                {
-                                    adjust_pdf_ypos(1.0);
-                                    GV_CurrentLineCount--;
-                                }
-                            /**
-                             *  Move the pointer for buffer2 back
-                             */
-                            i2 = 0;
-                            buffer2[i2] = '\0';
-
-                            break;
-
-                        default:
-                            buffer2[i2] = buffer1[i1];
-                            i2++;
-                            buffer2[i2] = '\0';
-                            break;
-                    }
-                }
-            }   //  End of NON-ASA Processing
+            bResetColor = do_plain_line(buffer1, sizeof(buffer1));
+            }
         else
             /*  This is the ASA Format Processor */
             {
 
-            ASA = buffer1[0];
+            cc = &cc_table[(unsigned char)buffer1[0]];
 
-            switch (ASA)
+            switch (cc->action)
                 {
 
-                    case '1':     /* start a new page before processing data on line */
+                    case CC_SPACE:
+
+                        if (cc->count == 0)
+                            {   /* print at same y-position as previous line */
+                            pdf_move_lines(1.0f);
+                            adjust_pdf_ypos(1.0);
+                            GV_CurrentLineCount--;
+                            GV_PageOverstrikes++;
+                            }
+                        for (skip = 1; skip < cc->count; skip++)
+                            {   /* put out blank lines before processing data on line */
+                            pdf_blank_line();
+                            GV_PDFPageYPosition -= GV_StandardLineSize;
+                            GV_CurrentLineCount++;
+                            }
+                        break;
+
+                    case CC_CHANNEL:  /* skip to the next FCB stop of the channel */
 
-                        if (GV_PDFPageYPosition < GV_PageDepth - GV_PageMarginTop)
+                        line = pdf_page_line();
+                        stop = cc_next_stop(cc->count, line);
+                        if (stop == 0)
+                            {
+                            fprintf(stderr, "(warning) No FCB stop for channel %d (control %c); spacing one line\n", cc->count, buffer1[0]);
+                            break;
+                            }
+                        if (stop < 0 || line == 0)
+                            {
+                            pdf_page_break(&buffer1[1]);
+                            line = pdf_page_line();
+                            stop = (stop < 0) ? -stop : stop;
+                            }
+                        for (skip = line + 1; skip < stop; skip++)
                             {
-                            end_pdf_page();
-                            start_pdf_page();
+                            pdf_blank_line();
+                            GV_PDFPageYPosition -= GV_StandardLineSize;
+                            GV_CurrentLineCount++;
                             }
                         break;
 
-                    case '0':        /* put out a blank line before processing data on line */
+                    case CC_HALF_LINE:
 
-                        printf("T*()Tj\n");
-                        GV_PDFPageYPosition -= GV_StandardLineSize;
-                        GV_CurrentLineCount++;
+                        pdf_move_lines(0.5f);
+                        adjust_pdf_ypos(0.5);
+                        break;
+
+                    case CC_FORM_FEED:  /* ctrl-L is a common form-feed character on Unix, but NOT ASA */
+
+                        end_pdf_page();
+                        start_pdf_page();
                         break;
 
-                    case '-':        /* put out two blank lines before processing data on line */
+                    default:
 
-                        printf("T*()Tj\n");
-                        GV_PDFPageYPosition -= GV_StandardLineSize;
-                        GV_PDFPageYPosition -= GV_StandardLineSize;
-                        GV_CurrentLineCount++;
-                        GV_CurrentLineCount++;
+                        fprintf(stderr, "(warning) Unknown ASA Carriage Control Character %c\n", buffer1[0]);
                         break;
 
-                    case '+':        /* print at same y-position as previous line */
+                }
+
+            if (cc->color != CC_COLOR_NONE)
+                {
+                GV_CURRENT_COLOR = (cc->color == CC_COLOR_OVERSTRIKE) ? GV_OVERSTRIKE_COLOR : GV_ControlColor[(unsigned char)buffer1[0]];
+                bResetColor = TRUE;
+                }
+            GV_IsExtendedASCII = cc->is_extended;
+
+            print_pdf_line(&buffer1[1]);
+
+            }   //  End of ASA Processing
+
+            GV_PDFPageYPosition -= GV_StandardLineSize;
+
+        if (GV_SearchIndexPath != NULL && buffer1[0] != '\0')
+            {
+            index_add_line(IS_ASA ? &buffer1[1] : buffer1, GV_CurrentPageCount, GV_CurrentLineCount);
+            }
+
+        if (bResetColor)
+            {
+            GV_CURRENT_COLOR = GV_FONT_COLOR;
+            pdf_set_fill_color(GV_FONT_COLOR);
+            }
+
+        }
+    if (!GV_IsFollowPageClosed)
+        {
+        end_pdf_page();
+        }
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        Read the next input line (through the page cache
+**                  with -j), timing the read when tracing (-Y).
+**
+**  Returns:        buffer, NULL at the end of the input.
+**
+**------------------------------------------------------------------------*/
+
+char *pdf_read_line(char *buffer, size_t size)
+    {
+    long long start = 0;
+    long long elapsed;
+    char     *line;
+
+    if (GV_IsFollow)
+        {
+        follow_idle();                                  //  a log that never pauses is published on time too
+        }
+
+    if (trace_is_enabled)
+        {
+        start = trace_now();
+        }
+    line = (GV_PageCachePath != NULL) ? page_cache_gets(buffer, size) : input_gets(buffer, size);
+    if (trace_is_enabled)
+        {
+        elapsed = trace_now() - start;
+        GV_TraceReadTime += elapsed;
+
+        /*
+        **  Reads that wait (pipes, inflating the next block) are always shown
+        */
+        if (elapsed >= 1000)
+            {
+            trace_span("input", "input", start, NULL);
+            }
+        }
+
+    if (GV_IsFollow && line != NULL)
+        {
+        follow_line_read();
+        }
+    return line;
+    }
+
+
+/*--------------------------------------------------------------------------
+**  Purpose:        NON-ASA format processor for one input line.
+**
+**  Parameters:     Name        Description.
+**                  buffer1     Line as read.
+**                  size        Size of buffer1.
+**
+**  Returns:        TRUE if an overstrike changed the colour (the caller
+**                  resets it after the line).
+**
+**  Description:    We construct a parallel buffer (buffer2) which will
+**                  be a substitute for the regular ASA buffer: form
+**                  feeds break the page, a carriage return inside the
+**                  line starts an overstrike.
+**
+**------------------------------------------------------------------------*/
+
+bool do_plain_line(char *buffer1, size_t size)
+    {
+
+    char   buffer2[4096];
+    bool   bResetColor = FALSE;
+    size_t i1;
+    int    i2;
 
+    i2 = 0;
+    buffer2[i2] = '\0';      // NULL at the end of buffer2
+    /**
+     ** Scan the buffer starting from the offset through the end of the buffer
+     **/
+    for (i1 = 0; i1 < size && (i1 == 0 || buffer1[i1 - 1] != '\0'); i1++)
+        {
+        /*
+        **  Stop after the terminating NUL, the rest of buffer1
+        **  still holds bytes from earlier (longer) lines.
+        */
+        switch (buffer1[i1])
+            {
+                case '\f':  //  formfeed character invokes new page
+                    pdf_page_break(&buffer1[i1 + 1]);
+                    break;
+                case '\r':
+                    GV_PDFPageYPosition -= GV_StandardLineSize;
+                    /**
+                     *  Don't process the final CR
+                     */
+                    if (buffer1[i1 + 1] != '\0')
+                        {
+                        /**
+                         *  just treat it as an overstrike
+                         */
                         GV_CURRENT_COLOR = GV_OVERSTRIKE_COLOR;
-                        fprintf(stdout, "0 %f Td\n", GV_StandardLineSize);
+                        pdf_move_lines(1.0f);
                         adjust_pdf_ypos(1.0);
                         bResetColor = TRUE;
                         GV_CurrentLineCount--;
-                        break;
+                        GV_PageOverstrikes++;
+                        /**
+                         *  Fall through to print
+                         */
+                        } 
+
+                case '\0':
+                    if (buffer2[0] != '\0')
+                        {
+                            print_pdf_line(&buffer2[0]);
+                        }
+                    else
+                        {
+                            adjust_pdf_ypos(1.0);
+                            GV_CurrentLineCount--;
+                        }
+                    /**
+                     *  Move the pointer for buffer2 back
+                     */
+                    i2 = 0;
+                    buffer2[i2] = '\0';
 
-                    case 'R':        /* RED print at same y-position as previous line */
-                    case 'G':        /* GREEN print at same y-position as previous line */
-                    case 'B':        /* BLUE print at same y-position as previous line */
+                    break;
 
-                        switch (ASA)
-                            {
-                            case 'R':
-                                GV_CURRENT_COLOR = colorConverter(0xFF0000l);
-                            case 'G':
-                                GV_CURRENT_COLOR = colorConverter(0x00FF00l);
-                            case 'B':
-                                GV_CURRENT_COLOR = colorConverter(0x0000FFl);
-                            }
+                default:
+                    buffer2[i2] = buffer1[i1];
+                    i2++;
+                    buffer2[i2] = '\0';
+                    break;
+            }
+        }
 
-                        bResetColor = TRUE;
-                        fprintf(stdout, "0 %f Td\n", GV_StandardLineSize);
-                        adjust_pdf_ypos(1.0);
-                        GV_CurrentLineCount--;
-                        break;
+    return bResetColor;
+    }
 
-                    case 'H':        /* 1/2 line advance */
 
-                        fprintf(stdout, "0 %f Td\n", GV_StandardLineSize / 2.0);
-                        adjust_pdf_ypos(0.5);
-                        break;
 
-                    case 'r':        /* RED print */
-                    case 'g':        /* GREEN print */
-                    case 'b':        /* BLUE print */
+/**
+ *  Microbenchmark kernels (-y)
+ *
+ *  Each wrapper resets the page buffer (or position) it appends to, so
+ *  a call costs the same however often it is repeated.
+ */
 
-                        switch (ASA)
-                            {
-                                case 'R':
-                                    GV_CURRENT_COLOR = colorConverter(0xFF0000l);
-                                case 'g':
-                                    GV_CURRENT_COLOR = colorConverter(0x00FF00l);
-                                case 'b':
-                                    GV_CURRENT_COLOR = colorConverter(0x0000FFl);
-                            }
+struct _BenchInput
+    {
+    char  text[4096];
+    long  value;
+    };
 
-                        bResetColor = TRUE;
-                        break;
+typedef _BenchInput BenchInput;
 
-                    case '^':        /* print at same y-position as previous line like + but add 127 to character */
+static void bench_pdf_string(void *context)
+    {
+    GV_PageBufferLength = 0;
+    print_pdf_string(((BenchInput *)context)->text);
+    }
 
-                        printf("0 %f Td\n", GV_StandardLineSize);
-                        adjust_pdf_ypos(1.0);
-                        GV_IsExtendedASCII = TRUE;
-                        GV_CurrentLineCount--;
-                        break;
+static void bench_plain_line(void *context)
+    {
+    GV_PageBufferLength = 0;
+    GV_PDFPageYPosition = GV_PageDepth - GV_PageMarginTop;
+    do_plain_line(((BenchInput *)context)->text, sizeof(((BenchInput *)context)->text));
+    }
 
-                    case '>':        /* Unknown */
+static void bench_column_scan(void *context)
+    {
+    BenchInput *input = (BenchInput *)context;
+    size_t      columns;
 
-                        break;
+    input->value += (long)codec_column_scan((const unsigned char *)input->text, strlen(input->text), TRUE, &columns) + (long)columns;
+    }
 
-                    case '\f':       /* ctrl-L is a common form-feed character on Unix, but NOT ASA */
+static void bench_utf8_decode(void *context)
+    {
+    BenchInput          *input = (BenchInput *)context;
+    const unsigned char *text = (const unsigned char *)input->text;
+    const unsigned char *end = text + strlen(input->text);
 
-                        end_pdf_page();
-                        start_pdf_page();
-                        break;
+    while (text < end)
+        {
+        input->value += codec_utf8_decode(&text, end);
+        }
+    }
 
-                    case ' ':
+static void bench_pagebars(void *)
+    {
+    GV_PageBufferLength = 0;
+    print_pdf_pagebars();
+    }
 
-                        break;
+static void bench_color(void *context)
+    {
+    BenchInput *input = (BenchInput *)context;
 
-                    default:
+    input->value += (long)(colorConverter(input->value & 0xFFFFFF).g * 255.0);
+    }
 
-                        fprintf(stderr, "(warning) Unknown ASA Carriage Control Character %c\n", ASA);
-                        break;
+static void bench_move_format(void *)
+    {
+    GV_PageBufferLength = 0;
+    pdf_page_printf("%g %g Td\n", GV_PageMarginLeft, GV_PDFPageYPosition);
+    }
 
-                }
+static void bench_xref(void *)
+    {
+    pdf_write_xref();
+    }
 
-            printf("T*");
-            print_pdf_string(&buffer1[1]);
-            printf("Tj\n");
+static void bench_page_write(void *context)
+    {
+    int line;
 
-            }   //  End of ASA Processing
+    GV_PageBufferLength = 0;
+    for (line = 0; line < 60; line++)
+        {
+        print_pdf_string(((BenchInput *)context)->text);
+        }
+    writer_write(GV_PageBuffer, GV_PageBufferLength);
+    }
 
-            GV_PDFPageYPosition -= GV_StandardLineSize;
 
-        if (bResetColor)
+/*--------------------------------------------------------------------------
+**  Purpose:        Time the inner kernels in isolation (-y reps) and
+**                  print ns per byte or per call to stdout.
+**
+**  Parameters:     Name        Description.
+**                  repetitions Timed batches per kernel.
+**
+**------------------------------------------------------------------------*/
+
+void do_microbench(int repetitions)
+    {
+    static const int sizes[] = { 32, 132, 1024 };
+    BenchInput input;
+    FILE      *sink;
+    char       name[64];
+    int        s;
+    int        i;
+    int        length;
+
+    GV_StandardLineSize = (GV_PageDepth - GV_PageMarginTop - GV_PageMarginBottom) / GV_LinesPerPage;
+    GV_BodyFontSize = GV_StandardLineSize;
+    GV_IsPrintLineNumbers = FALSE;
+    pdf_select_renderers();
+    pdf_reset_graphics_state();
+    bench_header(repetitions);
+
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+        {
+        length = sizes[s];
+
+        /*
+        **  print_pdf_string(): plain, line numbered, UTF-8 (-U) over
+        **  ASCII, escaped, extended ASCII
+        */
+        for (i = 0; i < length; i++)
             {
-            GV_CURRENT_COLOR = GV_FONT_COLOR;
-            fprintf(stdout, "%f %f %f rg\n",
-                    GV_FONT_COLOR.r, GV_FONT_COLOR.g, GV_FONT_COLOR.b);
+            input.text[i] = (char)('A' + i % 26);
+            }
+        input.text[length] = '\0';
+        snprintf(name, sizeof(name), "print_pdf_string plain %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+
+        GV_IsPrintLineNumbers = TRUE;
+        pdf_select_renderers();
+        snprintf(name, sizeof(name), "print_pdf_string numbered %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+        GV_IsPrintLineNumbers = FALSE;
+        pdf_select_renderers();
+
+        GV_IsUTF8Input = TRUE;
+        pdf_select_renderers();
+        snprintf(name, sizeof(name), "print_pdf_string UTF-8 ascii %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+        GV_IsUTF8Input = FALSE;
+        pdf_select_renderers();
+
+        snprintf(name, sizeof(name), "do_plain_line (non-ASA scan) %d", length);
+        bench_run(name, "B", length, bench_plain_line, &input);
+
+        snprintf(name, sizeof(name), "codec_column_scan (no tab) %d", length);
+        bench_run(name, "B", length, bench_column_scan, &input);
+
+        for (i = 0; i < length; i++)
+            {
+            input.text[i] = "(x)\\"[i % 4];
+            }
+        snprintf(name, sizeof(name), "print_pdf_string escaped %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+
+        for (i = 0; i < length; i++)
+            {
+            input.text[i] = (char)(0x41 + i % 64);
             }
+        GV_IsExtendedASCII = TRUE;
+        snprintf(name, sizeof(name), "print_pdf_string extended %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+        GV_IsExtendedASCII = FALSE;
 
+        /*
+        **  UTF-8 (-U): ASCII with 2-byte WinAnsi and 3-byte CID characters
+        */
+        for (i = 0; i + 6 <= length; )
+            {
+            memcpy(input.text + i, (i % 12 == 0) ? "a\xC3\xA9\xE4\xB8\xAD" : "bc\xE2\x82\xAC" "d", 6);
+            i += 6;
+            }
+        while (i < length)
+            {
+            input.text[i++] = 'z';
+            }
+        input.text[length] = '\0';
+        snprintf(name, sizeof(name), "codec_utf8_decode mixed %d", length);
+        bench_run(name, "B", length, bench_utf8_decode, &input);
+
+        GV_IsUTF8Input = TRUE;
+        pdf_select_renderers();
+        snprintf(name, sizeof(name), "print_pdf_string UTF-8 mixed %d", length);
+        bench_run(name, "B", length, bench_pdf_string, &input);
+        GV_IsUTF8Input = FALSE;
+        pdf_select_renderers();
+        }
+
+    bench_run("print_pdf_pagebars", "call", 1, bench_pagebars, &input);
+    input.value = 0x123456;
+    bench_run("colorConverter", "call", 1, bench_color, &input);
+    GV_PDFPageYPosition = GV_PageDepth / 3.0f;
+    bench_run("pdf_page_printf %g %g Td", "call", 1, bench_move_format, &input);
+
+    /*
+    **  Cross-reference table of 10000 objects, to the null device
+    */
+#ifdef _WIN32
+    sink = fopen("NUL", "wb");
+#else
+    sink = fopen("/dev/null", "wb");
+#endif
+    if (sink != NULL)
+        {
+        GV_PDFObjectId = 10001;
+        GV_XReferences = (long long *)malloc(GV_PDFObjectId * sizeof(long long));
+        for (i = 0; i < GV_PDFObjectId && GV_XReferences != NULL; i++)
+            {
+            GV_XReferences[i] = 1000LL + 2113LL * i;
+            }
+        if (GV_XReferences != NULL)
+            {
+            writer_open(sink, GV_WriterBufferSize, 0, 0);
+            bench_run("pdf_write_xref 10000 objects", "entry", GV_PDFObjectId - 1, bench_xref, &input);
+            writer_close();
+            }
+        fclose(sink);
+        free(GV_XReferences);
+        GV_XReferences = NULL;
         }
-    end_pdf_page();
-    }
 
+    /*
+    **  Pages of 60 lines formatted and written to a consumer that takes
+    **  512 MB/s, without and with the writer thread (-Q): with the
+    **  thread the time per byte should approach the slower of the two
+    **  rather than their sum
+    */
+    for (i = 0; i < 132; i++)
+        {
+        input.text[i] = (char)('A' + i % 26);
+        }
+    input.text[132] = '\0';
+    GV_PageBufferLength = 0;
+    for (i = 0; i < 60; i++)
+        {
+        print_pdf_string(input.text);
+        }
+    length = (int)GV_PageBufferLength;
+    for (i = 0; i < 2; i++)
+        {
+        sink = bench_slow_sink_open(512.0 * 1024 * 1024);
+        if (sink == NULL)
+            {
+            break;
+            }
+        writer_open(sink, GV_WriterBufferSize, (i == 0) ? 0 : 2, 0);
+        bench_run((i == 0) ? "page to slow consumer" : "page to slow consumer, -Q thread", "B", length,
+                  bench_page_write, &input);
+        writer_close();
+        bench_slow_sink_close(sink);
+        }
+    free(GV_PageBuffer);
+    GV_PageBuffer = NULL;
+    }
 
 
 void showhelp(int itype)
@@ -1171,7 +4213,8 @@ void showhelp(int itype)
                 fprintf(stderr, " |                                                                              |\n");
                 fprintf(stderr, " | SYNOPSIS:                                                                    |\n");
                 fprintf(stderr, " |                                                                              |\n");
-                fprintf(stderr, " |   txt2pdf(1) reads input from standard input. The first character            |\n");
+                fprintf(stderr, " |   txt2pdf(1) reads input from standard input (or the file named after the    |\n");
+                fprintf(stderr, " |   options; gzip or zstd input is recognised). The first character            |\n");
                 fprintf(stderr, " |   of each line is interpreted as a control character. Lines beginning with   |\n");
                 fprintf(stderr, " |   any character other than those listed in the ASA carriage-control          |\n");
                 fprintf(stderr, " |   characters table are interpreted as if they began with a blank,            |\n");
@@ -1279,13 +4322,51 @@ void showhelp(int itype)
                 fprintf(stderr, " |INTERPRETER OPTIONS                                                           |\n");
                 fprintf(stderr, " |                                                                              |\n");
                 fprintf(stderr, " |   -A (0|1)         # Non-ANSI/ANSI Formatted Inputs (Default ASA)            |\n");
+                fprintf(stderr, " |   -U               # Input is UTF-8 (mapped to WinAnsi where possible)       |\n");
+                fprintf(stderr, " |   -3 ArialUnicodeMS # CID font for UTF-8 text outside WinAnsi (a .ttf file   |\n");
+                fprintf(stderr, " |                      is embedded with its cmap)                              |\n");
+                fprintf(stderr, " |   -r FBA,133       # records: F/FB/FBA,lrecl or V/VB/VBA (RDW); A sets -A 1  |\n");
+                fprintf(stderr, " |                      (blocked V input keeping its BDWs is recognised)        |\n");
+                fprintf(stderr, " |   -m cp437         # input code page: cp437, cp850, latin1 or a table file   |\n");
+                fprintf(stderr, " |   -e               # Input is EBCDIC (code page 037)                         |\n");
                 fprintf(stderr, " |   -N (0|1)         # add line numbers   0=Running or 1=Per-Page              |\n");
+                fprintf(stderr, " |   -E 8             # expand tabs every 8 columns, or at listed columns       |\n");
+                fprintf(stderr, " |                      (-E 10,16,35,72 then every 37)                          |\n");
+                fprintf(stderr, " |   -k w,+           # lines wider than the page: w wrap (rows start with +)   |\n");
+                fprintf(stderr, " |                      or t truncate                                           |\n");
+                fprintf(stderr, " |   -a               # sample the input: pick ASA/plain, lines per page,       |\n");
+                fprintf(stderr, " |                      orientation and font (-A, -l, -W, -H given are kept)    |\n");
                 fprintf(stderr, " |                                                                              |\n");
                 fprintf(stderr, " +------------------------------------------------------------------------------+\n");
                 fprintf(stderr, " |                                                                              |\n");
                 fprintf(stderr, " |   -v 3             # version number                                          |\n");
+                fprintf(stderr, " |   -I 1000          # memory use by subsystem, RSS every 1000 pages, at exit  |\n");
+                fprintf(stderr, " |   -Y run.json,100  # Chrome/Perfetto trace, every 100th page in detail       |\n");
                 fprintf(stderr, " |   -h               # display this help                                       |\n");
                 fprintf(stderr, " |   -X               # display the parsed values and exit                      |\n");
+                fprintf(stderr, " |   -V               # report output statistics on stderr                      |\n");
+                fprintf(stderr, " |   -q 2             # n-up: 2 (or 4, ...) pages per sheet, turned to fit      |\n");
+                fprintf(stderr, " |   -D               # share one content stream between identical pages        |\n");
+                fprintf(stderr, " |   -S listing.idx   # also write a word index: term -> page and line          |\n");
+                fprintf(stderr, " |   -w spool,4       # watch spool dir: convert new files with 4 workers into  |\n");
+                fprintf(stderr, " |                      spool/done (input + PDF) or spool/failed                |\n");
+                fprintf(stderr, " |   -b \"REPORT ID:\" # burst: new PDF at each '1'/FF line with this text        |\n");
+                fprintf(stderr, " |   -O out/%%s.pdf    # burst file names: %%s word after the match, %%d number    |\n");
+                fprintf(stderr, " |                      (a name used before in the run gets -2, -3, ...)        |\n");
+                fprintf(stderr, " |   -F 50,60         # follow a growing log (to Ctrl-C): next PDF (-O names)   |\n");
+                fprintf(stderr, " |                      after 50 pages or when a line has waited 60 seconds     |\n");
+                fprintf(stderr, " |   -S listing.idx -s \"WORD ...\"  # list page/line of lines with every word    |\n");
+                fprintf(stderr, " |   -K out.pdf,100   # write out.pdf, checkpoint every 100 pages; rerun the    |\n");
+                fprintf(stderr, " |                      same command to resume after an interruption            |\n");
+                fprintf(stderr, " |   -c cache,1024    # reuse PDFs of identical input + options from cache dir, |\n");
+                fprintf(stderr, " |                      keeping the most recently used 1024 MB                  |\n");
+                fprintf(stderr, " |   -G form.pdf,1    # form overlay: page 1 of a PDF, a JPEG or PDF operators  |\n");
+                fprintf(stderr, " |   -J ctl.txt       # carriage control table and FCB channel stops (ASA)      |\n");
+                fprintf(stderr, " |   -j daily.pgc     # page cache: copy pages unchanged since the last run     |\n");
+                fprintf(stderr, " |   -Q 256,4         # write on a thread: KB per buffer, buffers queued        |\n");
+                fprintf(stderr, " |   -Q 1024,16,4     # to a regular file: 4 threads write buffers at offsets   |\n");
+                fprintf(stderr, " |   -y 15            # time the inner kernels (15 batches each) and exit       |\n");
+                fprintf(stderr, " |   -z               # unoptimized content streams (every state op and move)   |\n");
                 fprintf(stderr, " |                                                                              |\n");
                 fprintf(stderr, " +------------------------------------------------------------------------------+\n");
                 fprintf(stderr, " |ENVIRONMENT VARIABLES:                                                        |\n");
@@ -1327,9 +4408,17 @@ void showhelp(int itype)
                 fprintf(stderr, " +----------------------   Current Settings Requested (below)   ----------------+\n");
                 fprintf(stderr, " +------------------------------------------------------------------------------+\n");
                 fprintf(stderr, "\t\t--== Operating Mode ==--\n");
-                fprintf(stderr, "\t-A  [flag=%d]\t: Interpreter Mode (ASA/ANSI!=0)\n\n", GV_IsASA);
+                fprintf(stderr, "\t-A  [flag=%d]\t: Interpreter Mode (ASA/ANSI!=0)\n", GV_IsASA);
+                fprintf(stderr, "\t-U  [flag=%d]\t: UTF-8 Input\n", GV_IsUTF8Input);
+                fprintf(stderr, "\t-r  %d,%ld\t: Record Format (0=Lines 1=Fixed 2=Variable), Length\n", GV_RecordFormat, GV_RecordLength);
+                fprintf(stderr, "\t-m  %s\t: Input Code Page\n", (GV_CodePageName != NULL) ? GV_CodePageName : "(WinAnsi)");
+                fprintf(stderr, "\t-e  [flag=%d]\t: EBCDIC Input\n\n", GV_IsEBCDIC);
 
                 fprintf(stderr, "\t-l  %f\t: Lines Per Page\n\n", GV_LinesPerPage);
+                fprintf(stderr, "\t-E  %d,%d\t: Tab Stops Listed, Then Every n Columns (0 = tabs kept)\n", GV_TabStopCount, GV_TabInterval);
+                fprintf(stderr, "\t-k  %s,%s\t: Lines Wider Than the Page, Continuation Marker\n",
+                        (GV_Overflow == OVERFLOW_WRAP) ? "wrap" : (GV_Overflow == OVERFLOW_TRUNCATE) ? "truncate" : "none", GV_ContinuationMarker);
+                fprintf(stderr, "\t-a  [flag=%d]\t: Layout From a Sample of the Input (font scale %.3f)\n", GV_IsAutoFit, GV_BodyFontScale);
 
                 fprintf(stderr, "\t\t--== Page Dimensions ==--\n");
                 fprintf(stderr, "\t-u  %f\t: Unit of Measure Multiplier (72.0 = 1 Inch)\n", GV_UnitMultiplier);
@@ -1349,11 +4438,13 @@ void showhelp(int itype)
                 fprintf(stderr, "\t-n  R:%f\t: RGB of Line Numbers (0x%06X)\n\t    G:%f\n\t    B:%f\n\n", GV_LINE_NUMBER_COLOR.r, colorInverter(GV_LINE_NUMBER_COLOR), GV_LINE_NUMBER_COLOR.g, GV_LINE_NUMBER_COLOR.b);
 
                 fprintf(stderr, "\t-i  %d\t\t: Shading Line Increment\n", GV_ShadeStep);
+                fprintf(stderr, "\t-I  %d\t\t: Memory Sample Interval in Pages (0 = off)\n", GV_MemorySampleInterval);
                 fprintf(stderr, "\t-d  [%s]\t: Shading Line Dash Code\n\n", GV_DashCode);
 
                 fprintf(stderr, "\t\t--== Fonts and Labeling ==--\n");
                 fprintf(stderr, "\t-1  [%s]\t: Body Font Name\n", GV_BodyFontName);
-                fprintf(stderr, "\t-2  [%s]\t: Heading Font Name\n\n", GV_HeadingFontName);
+                fprintf(stderr, "\t-2  [%s]\t: Heading Font Name\n", GV_HeadingFontName);
+                fprintf(stderr, "\t-3  [%s]\t: UTF-8 Fallback CID Font Name\n\n", GV_CIDFontName);
 
                 fprintf(stderr, "\t-R  [%s]\t: Right Header Margin Label\n", GV_TitleRight);
                 fprintf(stderr, "\t-L  [%s]\t: Left Header Margin Label\n\n", GV_TitleLeft);
@@ -1364,6 +4455,23 @@ void showhelp(int itype)
 
                 fprintf(stderr, "\t\t--== Miscellaneous ==--\n");
                 fprintf(stderr, "\t-v  %f\t: Version Number\n", GV_VersionNumber);
+                fprintf(stderr, "\t-V  [flag=%d]\t: Report Statistics\n", GV_IsStatistics);
+                fprintf(stderr, "\t-q  %d\t\t: Pages Per Sheet (n-up)\n", GV_PagesPerSheet);
+                fprintf(stderr, "\t-D  [flag=%d]\t: Deduplicate Page Streams\n", GV_IsDedupPages);
+                fprintf(stderr, "\t-S  %s\t: Search Index File\n", (GV_SearchIndexPath != NULL) ? GV_SearchIndexPath : "(none)");
+                fprintf(stderr, "\t-w  %s,%d\t: Watch Directory, Workers\n", (GV_WatchDirectory[0] != '\0') ? GV_WatchDirectory : "(none)", GV_WatchWorkers);
+                fprintf(stderr, "\t-b  %s\t: Burst Pattern\n", (GV_BurstPattern != NULL) ? GV_BurstPattern : "(none)");
+                fprintf(stderr, "\t-O  %s\t: Burst File Names\n", GV_BurstTemplate);
+                fprintf(stderr, "\t-F  %d,%d\t: Follow Input, New Document Every Pages,Seconds%s\n", GV_FollowPages, GV_FollowSeconds, GV_IsFollow ? "" : " (off)");
+                fprintf(stderr, "\t-K  %s,%d\t: Output File, Checkpoint Pages\n", (GV_OutputPath != NULL) ? GV_OutputPath : "(stdout)", GV_CheckpointInterval);
+                fprintf(stderr, "\t-c  %s,%ld\t: Cache Directory, MB\n", (GV_CacheDirectory[0] != '\0') ? GV_CacheDirectory : "(none)", GV_CacheLimit);
+                fprintf(stderr, "\t-G  %s,%d\t: Overlay Form, Page\n", (GV_OverlayPath != NULL) ? GV_OverlayPath : "(none)", GV_OverlayPage);
+                fprintf(stderr, "\t-J  %s\t: Carriage Control File\n", (GV_ControlPath != NULL) ? GV_ControlPath : "(built-in)");
+                fprintf(stderr, "\t-j  %s\t: Page Cache File\n", (GV_PageCachePath != NULL) ? GV_PageCachePath : "(none)");
+                fprintf(stderr, "\t-Q  %ld,%d,%d\t: Output Buffer KB, Writer Queue Depth (0 = no thread), Positioned Writer Threads\n", GV_WriterBufferSize / 1024, GV_WriterQueueDepth, GV_WriterThreads);
+                fprintf(stderr, "\t-Y  %s,%d\t: Trace File, Page Sampling\n", (GV_TracePath != NULL) ? GV_TracePath : "(none)", GV_TraceSample);
+                fprintf(stderr, "\t-y  %d\t\t: Microbenchmark Repetitions (0 = convert)\n", GV_BenchRepetitions);
+                fprintf(stderr, "\t-z  [flag=%d]\t: Optimize Content Streams\n", GV_IsOptimizeStream);
                 fprintf(stderr, "\t-X  \t\t: Display Settings\n");
                 fprintf(stderr, "\t-h  \t\t: Display Help and Settings\n");
                 break;
@@ -1394,7 +4502,7 @@ void showhelp(int itype)
  dash patterns. As can be seen from the table, an empty dash array and zero phase can be used to restore the
  dash pattern to a solid line.
 
- Table 56  Examples of Line Dash Patterns
+ Table 56 � Examples of Line Dash Patterns
 
  Dash Array       Appearance                   Description
  and Phase